@@ -932,48 +932,7 @@ void MeshValmetControls::Compute()
     MeshSetup(&pargs);
     mesh_run(&pargs, &model1, &model2, log, &pr, &stats, &stats_rev, &abs_sampling_step, &abs_sampling_dens);
 
-    int num_vert1 = model1.mesh->num_vert;
-    int num_vert2 = model2.mesh->num_vert;
-    int num_faces1 = model1.mesh->num_faces;
-    int num_faces2 = model2.mesh->num_faces;
-
-    double * L1 = new double[3*num_vert1];
-    double * L2 = new double[3*num_vert2];
-    int * T1 = new int[3*num_faces1];
-    int * T2 = new int[3*num_faces2];
-
-    vertex_t * vert_list = model1.mesh->vertices;
-    for(int i=0; i<num_vert1; i++) {
-      L1[3*i+0] = vert_list[i].x;
-      L1[3*i+1] = vert_list[i].y;
-      L1[3*i+2] = vert_list[i].z;
-    }
-    vert_list = model2.mesh->vertices;
-    for(int i=0; i<num_vert2; i++) {
-      L2[3*i+0] = vert_list[i].x;
-      L2[3*i+1] = vert_list[i].y;
-      L2[3*i+2] = vert_list[i].z;
-    }
-
-    face_t * face_list = model1.mesh->faces;
-    for(int i=0; i<num_faces1; i++) {
-      T1[3*i+0] = face_list[i].f0+1;
-      T1[3*i+1] = face_list[i].f1+1;
-      T1[3*i+2] = face_list[i].f2+1;
-    }
-    face_list = model2.mesh->faces;
-    for(int i=0; i<num_faces2; i++) {
-      T2[3*i+0] = face_list[i].f0+1;
-      T2[3*i+1] = face_list[i].f1+1;
-      T2[3*i+2] = face_list[i].f2+1;
-    } 
-
-    ComputeRobustVolumeOverlap(L1,L2,num_vert1,num_vert2,T1,T2,num_faces1,num_faces2,dice_coefficient,int_union_ratio);
-
-    delete [] L1;
-    delete [] L2;
-    delete [] T1;
-    delete [] T2;
+    ComputeRobustVolumeOverlapModels(model1.mesh,model2.mesh,NULL,dice_coefficient,int_union_ratio,NULL);
 
     int t = pargs.do_symmetric;
     bool signedd = pargs.signeddist;
@@ -154,18 +154,34 @@ struct model {
   float total_area; /* area of the whole model */
   vertex_t bBox[2]; /* bBox[0] is the min  bBox[1] is the max */
   struct face_tree **tree; /* spanning tree of the dual graph */
+  int borrowed; /* MODEL_BORROWS_* flags of the arrays not owned by the
+                 * model, which __free_raw_model does not free */
 };
 
+/* Flags for model.borrowed */
+#define MODEL_BORROWS_VERTICES     0x1
+#define MODEL_BORROWS_FACES        0x2
+#define MODEL_BORROWS_NORMALS      0x4
+#define MODEL_BORROWS_FACE_NORMALS 0x8
+#define MODEL_BORROWS_AREA         0x10
+
 #ifndef __free_raw_model
 #define __free_raw_model(raw_model)                             \
 do {                                                            \
-    free(((struct model*)raw_model)->vertices);                 \
-    free(((struct model*)raw_model)->faces);                    \
-    if (((struct model*)raw_model)->normals != NULL)            \
+    if (!(((struct model*)raw_model)->borrowed &                \
+          MODEL_BORROWS_VERTICES))                              \
+      free(((struct model*)raw_model)->vertices);               \
+    if (!(((struct model*)raw_model)->borrowed &                \
+          MODEL_BORROWS_FACES))                                 \
+      free(((struct model*)raw_model)->faces);                  \
+    if (!(((struct model*)raw_model)->borrowed &                \
+          MODEL_BORROWS_NORMALS))                               \
       free(((struct model*)raw_model)->normals);                \
-    if (((struct model*)raw_model)->face_normals != NULL)       \
+    if (!(((struct model*)raw_model)->borrowed &                \
+          MODEL_BORROWS_FACE_NORMALS))                          \
       free(((struct model*)raw_model)->face_normals);           \
-    if (((struct model*)raw_model)->area != NULL)               \
+    if (!(((struct model*)raw_model)->borrowed &                \
+          MODEL_BORROWS_AREA))                                  \
       free(((struct model*)raw_model)->area);                   \
     free(((struct model*)raw_model));                           \
 } while (0)
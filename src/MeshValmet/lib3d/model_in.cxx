@@ -59,6 +59,8 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
 #ifdef READ_TIME
 # include <time.h>
 #endif
@@ -69,6 +71,26 @@
 # include <debug_print.h>
 #endif
 
+/* Files are memory mapped on POSIX systems, unless MESH_NO_MMAP is defined */
+#if !defined(_WIN32) && !defined(MESH_NO_MMAP)
+# define MESH_USE_MMAP
+#endif
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+#ifdef MESH_USE_MMAP
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+#endif
+/* Compressed files are decompressed by a producer thread on POSIX systems,
+ * unless MESH_NO_GZ_THREAD is defined */
+#if !defined(DONT_USE_ZLIB) && !defined(_WIN32) && !defined(MESH_NO_GZ_THREAD)
+# define MESH_GZ_THREAD
+# include <pthread.h>
+#endif
+
 /* --------------------------------------------------------------------------
    LOCAL PARAMETERS
    -------------------------------------------------------------------------- */
@@ -81,6 +103,11 @@
 #define GZ_RBYTES   16000
 /* Increment for the size of the buffer, just in case ... */
 #define GZ_BUF_INCR 512
+#ifdef MESH_GZ_THREAD
+/* Number and size (in bytes) of the blocks in the decompression ring */
+#define GZ_RING_SLOTS 4
+#define GZ_SLOT_SZ 65536
+#endif
 
 /* Converts argument into string, without replacing defines in argument */
 #define STRING_Q(N) #N
@@ -93,6 +120,194 @@
    LOCAL FUNCTIONS
    -------------------------------------------------------------------------- */
 static int refill_buffer(struct file_data*);
+
+#ifdef MESH_GZ_THREAD
+/* A ring of blocks filled with decompressed data by a producer thread and
+ * emptied by refill_buffer(), so that decompression overlaps with parsing.
+ * The producer fills the slots in order from the tail, the consumer reads
+ * them in order from 'head'; a filled slot belongs to the consumer until it
+ * is released. */
+struct gz_ring {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;        /* signaled when a slot is filled or released,
+                               * or the producer is asked to stop */
+  gzFile f;                   /* the compressed file */
+  unsigned char *slot[GZ_RING_SLOTS];
+  int len[GZ_RING_SLOTS];     /* the number of bytes in each filled slot */
+  int n_filled;               /* the number of filled slots */
+  int head;                   /* the slot being read by the consumer */
+  int pos;                    /* the read position in the head slot */
+  int done;                   /* the producer reached the end of the file */
+  int error;                  /* the producer got a read error */
+  int stop;                   /* the consumer asks the producer to stop */
+};
+
+/* The producer thread: decompresses the file into the free slots */
+static void* gz_ring_producer(void *arg)
+{
+  struct gz_ring *r;
+  int tail, n;
+
+  r = (struct gz_ring*)arg;
+  tail = 0;
+  for (;;) {
+    pthread_mutex_lock(&(r->lock));
+    while (r->n_filled == GZ_RING_SLOTS && !r->stop) {
+      pthread_cond_wait(&(r->cond), &(r->lock));
+    }
+    if (r->stop) {
+      pthread_mutex_unlock(&(r->lock));
+      break;
+    }
+    pthread_mutex_unlock(&(r->lock));
+
+    /* the tail slot is free, fill it without holding the lock */
+    n = gzread(r->f, r->slot[tail], GZ_SLOT_SZ);
+
+    pthread_mutex_lock(&(r->lock));
+    if (n > 0) {
+      r->len[tail] = n;
+      r->n_filled++;
+      tail = (tail+1)%GZ_RING_SLOTS;
+    }
+    if (n < GZ_SLOT_SZ) { /* end of file or error */
+      r->done = 1;
+      r->error = (n < 0);
+    }
+    pthread_cond_broadcast(&(r->cond));
+    pthread_mutex_unlock(&(r->lock));
+    if (n < GZ_SLOT_SZ) break;
+  }
+  return NULL;
+}
+
+/* Starts decompressing 'f' on a producer thread. Returns NULL if the ring
+ * can not be set up, in which case 'f' is to be read directly. */
+static struct gz_ring* gz_ring_open(gzFile f)
+{
+  struct gz_ring *r;
+  int k;
+
+  r = (struct gz_ring*)calloc(1, sizeof(*r));
+  if (r == NULL) return NULL;
+  r->f = f;
+  r->slot[0] = (unsigned char*)malloc(GZ_RING_SLOTS*GZ_SLOT_SZ);
+  if (r->slot[0] == NULL) {
+    free(r);
+    return NULL;
+  }
+  for (k=1; k<GZ_RING_SLOTS; k++) r->slot[k] = r->slot[k-1]+GZ_SLOT_SZ;
+  pthread_mutex_init(&(r->lock), NULL);
+  pthread_cond_init(&(r->cond), NULL);
+  if (pthread_create(&(r->thread), NULL, gz_ring_producer, r) != 0) {
+    pthread_cond_destroy(&(r->cond));
+    pthread_mutex_destroy(&(r->lock));
+    free(r->slot[0]);
+    free(r);
+    return NULL;
+  }
+  return r;
+}
+
+/* Stops the producer thread, if still running, and frees the ring. The file
+ * is not closed. */
+static void gz_ring_close(struct gz_ring *r)
+{
+  pthread_mutex_lock(&(r->lock));
+  r->stop = 1;
+  pthread_cond_broadcast(&(r->cond));
+  pthread_mutex_unlock(&(r->lock));
+  pthread_join(r->thread, NULL);
+  pthread_cond_destroy(&(r->cond));
+  pthread_mutex_destroy(&(r->lock));
+  free(r->slot[0]);
+  free(r);
+}
+
+/* Copies up to 'len' decompressed bytes into 'buf', waiting for the
+ * producer as needed. Returns the number of bytes copied, which is less
+ * than 'len' only at the end of the file (or on error). */
+static int gz_ring_read(struct gz_ring *r, unsigned char *buf, int len)
+{
+  int got, n;
+
+  got = 0;
+  while (got < len) {
+    if (r->pos == 0) { /* wait for the head slot to be filled */
+      pthread_mutex_lock(&(r->lock));
+      while (r->n_filled == 0 && !r->done) {
+        pthread_cond_wait(&(r->cond), &(r->lock));
+      }
+      n = r->n_filled;
+      pthread_mutex_unlock(&(r->lock));
+      if (n == 0) break; /* end of file */
+    }
+    n = r->len[r->head]-r->pos;
+    if (n > len-got) n = len-got;
+    memcpy(buf+got, r->slot[r->head]+r->pos, n);
+    got += n;
+    r->pos += n;
+    if (r->pos == r->len[r->head]) { /* release the head slot */
+      pthread_mutex_lock(&(r->lock));
+      r->n_filled--;
+      pthread_cond_broadcast(&(r->cond));
+      pthread_mutex_unlock(&(r->lock));
+      r->head = (r->head+1)%GZ_RING_SLOTS;
+      r->pos = 0;
+    }
+  }
+  return got;
+}
+#endif
+
+/* Reads up to 'len' bytes of the file into 'buf', from the decompression
+ * ring if there is one. Returns the number of bytes read, less than 'len'
+ * at the end of the file or on error. */
+static int stream_read(struct file_data *data, unsigned char *buf, int len)
+{
+  int n;
+
+#ifdef MESH_GZ_THREAD
+  if (data->ring != NULL) return gz_ring_read(data->ring, buf, len);
+#endif
+  n = (int)loc_fread(buf, sizeof(unsigned char), len, data->f);
+  return (n < 0) ? 0 : n;
+}
+
+/* Returns the next byte of the file, or EOF */
+static int stream_getc(struct file_data *data)
+{
+#ifdef MESH_GZ_THREAD
+  unsigned char c;
+
+  if (data->ring != NULL) return (gz_ring_read(data->ring, &c, 1) == 1) ? c : EOF;
+#endif
+  return loc_getc(data->f);
+}
+
+/* Returns non-zero if an I/O (or decompression) error occurred reading the
+ * file */
+static int stream_error(struct file_data *data)
+{
+#ifdef DONT_USE_ZLIB
+  return data->f != NULL && ferror(data->f);
+#else
+  int errnum;
+
+# ifdef MESH_GZ_THREAD
+  if (data->ring != NULL) {
+    pthread_mutex_lock(&(data->ring->lock));
+    errnum = data->ring->error;
+    pthread_mutex_unlock(&(data->ring->lock));
+    return errnum;
+  }
+# endif
+  if (data->f == NULL) return 0;
+  gzerror(data->f, &errnum);
+  return errnum < 0;
+#endif
+}
 /* 
    In order to be able to use zlib to read gzipped files directly, we
    have to use our own versions of most of the IO functions. The data
@@ -148,7 +363,7 @@ static int refill_buffer(struct file_data* data)
   /* now fill da buffer w. at most GZ_RBYTES of data */
   rsz = (GZ_RBYTES < data->size-1) ? GZ_RBYTES : data->size-1;
   assert(rsz > 255);
-  rbytes = loc_fread(&(data->block[1]), sizeof(unsigned char), rsz, data->f);
+  rbytes = stream_read(data, &(data->block[1]), rsz);
   data->nbytes = rbytes+1;
 
 
@@ -168,7 +383,7 @@ static int refill_buffer(struct file_data* data)
   
   /* now let's fill the buffer s.t. a valid separator ends it */
   while (strchr(VRML_WS_CHARS, data->block[data->nbytes-1]) == NULL) {
-    tmp = loc_getc(data->f);
+    tmp = stream_getc(data);
     if (tmp == EOF) {
       data->eof_reached = 1;
       memset(&(data->block[data->nbytes]), 0, 
@@ -200,131 +415,446 @@ static int refill_buffer(struct file_data* data)
   return 1;
 }
 
-/* equivalent of fread() */
+/* equivalent of fread(). What is left in the block is copied at once, and
+ * getc refills it when empty. */
 size_t bin_read(void *ptr, size_t size, size_t nmemb, struct file_data *data) 
 {
-  size_t len,i;
+  size_t len,i,n;
   char *cptr;
   int c;
 
   len = size*nmemb;
   i = 0;
   cptr = (char*)ptr;
-  do {
-    c = getc(data);
-    if (c != EOF) *(cptr++) = c;
-  } while (c != EOF && (++i) < len);
+  while (i < len) {
+    if (data->nbytes > 0 && data->pos < data->nbytes) {
+      n = (size_t)(data->nbytes-data->pos);
+      if (n > len-i) n = len-i;
+      memcpy(cptr+i, &(data->block[data->pos]), n);
+      data->pos += (int)n;
+      i += n;
+    } else {
+      c = getc(data);
+      if (c == EOF) break;
+      cptr[i++] = (char)c;
+    }
+  }
   return i/size;
 }
 
-/* This function is an equivalent for 'sscanf(data->block, "%d", out)'
- * except that it uses 'strtod' that is faster... */
-int int_scanf(struct file_data *data, int *out) 
-{
-  char *endptr=NULL;
-  int tmp, c;
+/* --------------------------------------------------------------------------
+   NUMBER PARSING
+   -------------------------------------------------------------------------- */
 
-  do {
-    c = getc(data);
-  } while ((c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '#' ||
-           c == '\"' || c ==',') && c != EOF);
-  if (c != EOF)
-    ungetc(c, data);
-  
-  tmp = (int)strtol((char*)&(data->block[data->pos]), &endptr, 10);
-  if (endptr == (char*)&(data->block[data->pos]) || endptr == NULL) {
-#ifdef DEBUG
-    DEBUG_PRINT("pos=%d block= %s\n", data->pos, &(data->block[data->pos]));
+/* The number parsers below work directly on the data block. They accept
+ * exactly what strtol(...,10) and strtod() accept for plain decimal numbers
+ * in the "C" locale, independently of the current locale, and produce the
+ * same values. Anything they can not convert exactly (more than 19
+ * significant digits, large exponents, hexadecimal, inf/nan, ...) is handed
+ * over to strtol()/strtod(). Runs of 8 digits are converted at once (SWAR)
+ * on little endian machines. */
+
+/* Decimal powers that are exactly representable as doubles */
+static const double exact_pow10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+  1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* Maximum number of significant digits that fit in a uint64_t */
+#define MAX_SIG_DIGITS 19
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ || \
+    defined(_M_IX86) || defined(_M_X64)
+# define SWAR_DIGITS
 #endif
+
+#ifdef SWAR_DIGITS
+/* If the 8 bytes at 'p' are all decimal digits, stores their value in
+ * '*val' and returns 1. Returns 0 otherwise. */
+static int eight_digits(const unsigned char *p, uint64_t *val)
+{
+  uint64_t v;
+
+  memcpy(&v, p, sizeof(v));
+  if (((v & 0xF0F0F0F0F0F0F0F0ULL) |
+       (((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) !=
+      0x3333333333333333ULL)
     return 0;
-  }  
-#ifdef DEBUG
-  DEBUG_PRINT("tmp = %d\n", tmp);
+  v -= 0x3030303030303030ULL;
+  v = (v * 10) + (v >> 8); /* pairs of digits */
+  v = (((v & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+       (((v >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+  *val = v;
+  return 1;
+}
 #endif
-  data->pos += (endptr - (char*)&(data->block[data->pos]))*sizeof(char);
 
-  if (data->pos == data->nbytes-1) {
-#ifdef DEBUG
-    DEBUG_PRINT("calling refill_buffer\n");
+/* Accumulates the digits starting at 'p' into '*mant', adding the number of
+ * digits read to '*ndig' and the number of significant digits to '*nsig'
+ * (leading zeros of a zero '*mant' are not significant). If '*nsig' would
+ * exceed MAX_SIG_DIGITS, the remaining digits are consumed but not
+ * accumulated, and '*nsig' is set to MAX_SIG_DIGITS+1. Bytes up to 'lim'
+ * (excluded) can be read. Returns the first non-digit position. */
+static const unsigned char* scan_digits(const unsigned char *p,
+                                        const unsigned char *lim,
+                                        uint64_t *mant, int *nsig, int *ndig)
+{
+  const unsigned char *s = p;
+#ifdef SWAR_DIGITS
+  uint64_t v;
 #endif
-    refill_buffer(data);
+
+  if (*mant == 0) {
+    while (*p == '0') p++;
+  }
+#ifdef SWAR_DIGITS
+  while (lim-p >= 8 && *nsig+8 <= MAX_SIG_DIGITS && eight_digits(p, &v)) {
+    *mant = *mant*100000000 + v;
+    *nsig += 8;
+    p += 8;
+  }
+#else
+  (void)lim;
+#endif
+  while (*p >= '0' && *p <= '9') {
+    if (*nsig < MAX_SIG_DIGITS) {
+      *mant = *mant*10 + (*p-'0');
+      (*nsig)++;
+    } else {
+      *nsig = MAX_SIG_DIGITS+1;
+    }
+    p++;
   }
+  *ndig += (int)(p-s);
+  return p;
+}
 
-  *out = tmp;
-  return 1;
+/* Parses the decimal number at 's' into '*out', as strtod() would. Returns
+ * the end of the number, 's' if there is no number, or NULL if the number
+ * can not be converted exactly here (strtod() should be used then). Bytes
+ * up to 'lim' (excluded) can be read, and the data must be terminated by a
+ * non-number character before 'lim'. */
+static const unsigned char* parse_double(const unsigned char *s,
+                                         const unsigned char *lim,
+                                         double *out)
+{
+  const unsigned char *p = s, *q;
+  uint64_t mant = 0;
+  int neg = 0, nsig = 0, nint = 0, nfrac = 0, nexp = 0;
+  int exp10, e = 0, eneg = 0;
+  double d;
+
+  if (*p == '+' || *p == '-') {
+    neg = (*p == '-');
+    p++;
+  }
+  if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) return NULL; /* hex */
+  p = scan_digits(p, lim, &mant, &nsig, &nint);
+  if (*p == '.') {
+    p = scan_digits(p+1, lim, &mant, &nsig, &nfrac);
+  }
+  if (nint+nfrac == 0) { /* no digits: not a number, or inf/nan */
+    return (*p == 'i' || *p == 'I' || *p == 'n' || *p == 'N') ? NULL : s;
+  }
+  if (nsig > MAX_SIG_DIGITS) return NULL;
+  if (*p == 'e' || *p == 'E') {
+    q = p+1;
+    if (*q == '+' || *q == '-') {
+      eneg = (*q == '-');
+      q++;
+    }
+    while (*q >= '0' && *q <= '9') {
+      if (e < 10000) e = e*10 + (*q-'0');
+      q++;
+      nexp++;
+    }
+    if (nexp > 0) p = q; /* otherwise the 'e' is not part of the number */
+  }
+
+  /* The value is mant*10^exp10. With at most 53 bits of mantissa and an
+   * exactly representable power of ten, a single IEEE multiplication or
+   * division gives the correctly rounded result (Clinger's fast path). */
+  if (mant == 0) {
+    *out = neg ? -0.0 : 0.0;
+    return p;
+  }
+  exp10 = (eneg ? -e : e) - nfrac;
+  if (exp10 < -22 || exp10 > 22 || mant > ((uint64_t)1 << 53)) return NULL;
+  d = (double)mant;
+  d = (exp10 < 0) ? d/exact_pow10[-exp10] : d*exact_pow10[exp10];
+  *out = neg ? -d : d;
+  return p;
 }
 
-/* This function is an equivalent for 'sscanf(data->block, "%f", out)'
- * except that it uses 'strtol' that is faster... 
- * Two versions: the one for Window$ makes a copy of the number into a
- * buffer, s.t. strtol does not waste more time in strlen calls. 
- * It is still _much_ slower than the glibc implementation, but it 
- * improves things.
- */
-#ifdef _WIN32
-int float_scanf(struct file_data *data, float *out) 
+/* Parses the decimal integer at 's' into '*out', as strtol(...,10) would.
+ * Returns the end of the number, 's' if there is no number, or NULL if the
+ * number does not fit in a long (strtol() should be used then, for its
+ * clamping). Same buffer requirements as parse_double(). */
+static const unsigned char* parse_long(const unsigned char *s,
+                                       const unsigned char *lim, long *out)
 {
-  char buf[512];
-  float tmp;
-  int c, i=-1;
+  const unsigned char *p = s;
+  uint64_t mant = 0;
+  int neg = 0, nsig = 0, ndig = 0;
 
+  if (*p == '+' || *p == '-') {
+    neg = (*p == '-');
+    p++;
+  }
+  p = scan_digits(p, lim, &mant, &nsig, &ndig);
+  if (ndig == 0) return s;
+  if (nsig > MAX_SIG_DIGITS || mant > (uint64_t)LONG_MAX) return NULL;
+  *out = neg ? -(long)mant : (long)mant;
+  return p;
+}
+
+/* Returns non-zero if 'c' may precede a number read by int_scanf() or
+ * float_scanf() */
+#define IS_NUM_SEP(c) ((c) == ' ' || (c) == '\t' || (c) == '\n' || \
+                       (c) == '\r' || (c) == '#' || (c) == '\"' || (c) == ',')
+
+/* Skips the separators before a number, directly in the block as long as
+ * possible, and through getc (which refills the block) otherwise */
+static void skip_num_sep(struct file_data *data)
+{
+  const unsigned char *p, *end;
+  int c;
+
+  if (data->nbytes > 0) {
+    p = &(data->block[data->pos]);
+    end = &(data->block[data->nbytes]);
+    while (p < end && IS_NUM_SEP(*p)) p++;
+    data->pos = (int)(p-data->block);
+    if (p < end) return;
+  }
   do {
     c = getc(data);
-  } while ((c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '#' ||
-            c == '\"' || c ==',') && c != EOF);
+  } while (IS_NUM_SEP(c) && c != EOF);
   if (c != EOF)
     ungetc(c, data);
+}
 
-  do {
-    buf[++i] = getc(data);
-  } while ((buf[i] >= '0' && buf[i] <= '9') || buf[i] == 'e' || 
-           buf[i] == 'E' || buf[i] == '+' || buf[i] == '-' || 
-           buf[i] == '.');
-  buf[++i] = '\0';
-
-  if (i == 1) /* screwed up ! */
+/* This function is an equivalent for 'sscanf(data->block, "%d", out)',
+ * without the overhead of sscanf (see parse_long()) */
+int int_scanf(struct file_data *data, int *out) 
+{
+  const unsigned char *start, *end;
+  char *endptr=NULL;
+  long tmp = 0;
+
+  skip_num_sep(data);
+  start = &(data->block[data->pos]);
+  end = parse_long(start, &(data->block[data->size]), &tmp);
+  if (end == NULL) {
+    tmp = strtol((char*)start, &endptr, 10);
+    end = (const unsigned char*)endptr;
+  }
+  if (end == start || end == NULL) {
+#ifdef DEBUG
+    DEBUG_PRINT("pos=%d block= %s\n", data->pos, &(data->block[data->pos]));
+#endif
     return 0;
+  }
+#ifdef DEBUG
+  DEBUG_PRINT("tmp = %ld\n", tmp);
+#endif
+  data->pos += (int)(end-start);
+  /* the separator after the number is left in the block, since refilling
+   * it here would drop it (getc refills the block once it is read) */
 
-  tmp = (float)atof(buf);
+  *out = (int)tmp;
+  return 1;
+}
 
+/* This function is an equivalent for 'sscanf(data->block, "%f", out)',
+ * without the overhead of sscanf and, most of the time, of strtod (see
+ * parse_double()). As with strtod the value is rounded to double first. */
+int float_scanf(struct file_data *data, float *out) 
+{
+  const unsigned char *start, *end;
+  char *endptr = NULL;
+  double tmp = 0;
+
+  skip_num_sep(data);
+  start = &(data->block[data->pos]);
+  end = parse_double(start, &(data->block[data->size]), &tmp);
+  if (end == NULL) {
+    tmp = strtod((char*)start, &endptr);
+    end = (const unsigned char*)endptr;
+  }
+  if (end == start || end == NULL) 
+    return 0;
 #ifdef DEBUG
   DEBUG_PRINT("tmp = %f\n", tmp);
 #endif
-  if (data->pos == data->nbytes-1) {
-    refill_buffer(data);
+  data->pos += (int)(end-start);
+  /* the separator is left in the block, as in int_scanf() */
+  *out = (float)tmp;
+  return 1;
+}
+
+/* --------------------------------------------------------------------------
+   PARALLEL RECORD PARSING
+   -------------------------------------------------------------------------- */
+
+/* Minimum number of records for parse_records() to split the work */
+#define PAR_MIN_RECORDS 65536
+/* Number of chunks per thread, for load balancing */
+#define PAR_CHUNKS_PER_THREAD 4
+
+/* Skips the number separators in [*p,end). Returns 1 if there is something
+ * else left before 'end', 0 otherwise. */
+static int span_skip_sep(const unsigned char **p, const unsigned char *end)
+{
+  const unsigned char *q = *p;
+
+  while (q < end && IS_NUM_SEP(*q)) q++;
+  *p = q;
+  return q < end;
+}
+
+/* see model_in.h */
+int span_int_scanf(const unsigned char **p, const unsigned char *end,
+                   const unsigned char *lim, int *out)
+{
+  const unsigned char *e;
+  char *endptr = NULL;
+  long tmp = 0;
+
+  if (!span_skip_sep(p, end)) return 0;
+  e = parse_long(*p, lim, &tmp);
+  if (e == NULL) {
+    tmp = strtol((char*)*p, &endptr, 10);
+    e = (const unsigned char*)endptr;
   }
-  *out = tmp;
+  if (e == *p || e == NULL || e > end) return 0;
+  *p = e;
+  *out = (int)tmp;
   return 1;
 }
-#else
-int float_scanf(struct file_data *data, float *out) 
+
+/* see model_in.h */
+int span_float_scanf(const unsigned char **p, const unsigned char *end,
+                     const unsigned char *lim, float *out)
 {
-  float tmp;
+  const unsigned char *e;
   char *endptr = NULL;
-  int c;
+  double tmp = 0;
 
-  do {
-    c = getc(data);
-  } while ((c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '#' ||
-            c == '\"' || c ==',') && c != EOF);
-  if (c != EOF)
-    ungetc(c, data);
+  if (!span_skip_sep(p, end)) return 0;
+  e = parse_double(*p, lim, &tmp);
+  if (e == NULL) {
+    tmp = strtod((char*)*p, &endptr);
+    e = (const unsigned char*)endptr;
+  }
+  if (e == *p || e == NULL || e > end) return 0;
+  *p = e;
+  *out = (float)tmp;
+  return 1;
+}
 
-  tmp = strtod((char*)&(data->block[data->pos]), &endptr);
-  if (endptr == (char*)&(data->block[data->pos]) || endptr==NULL) 
+/* Returns the start of the line following the one containing 'p', or 'end'
+ * if there is none */
+static const unsigned char* next_line(const unsigned char *p,
+                                      const unsigned char *end)
+{
+  const unsigned char *nl;
+
+  nl = (const unsigned char*)memchr(p, '\n', end-p);
+  return (nl == NULL) ? end : nl+1;
+}
+
+/* see model_in.h */
+int parse_records(struct file_data *data, int n_records,
+                  record_parser parse, void *ctx)
+{
+  const unsigned char *body, *body_end, *lim, *last_end;
+  const unsigned char **starts;
+  int *first;
+  int n_chunks, k, total, n_failed;
+
+  if (n_records < PAR_MIN_RECORDS || !data->eof_reached || data->is_binary ||
+      data->pos >= data->nbytes)
     return 0;
-#ifdef DEBUG
-  DEBUG_PRINT("tmp = %f\n", tmp);
+#ifdef _OPENMP
+  if (omp_get_max_threads() <= 1) return 0;
+  n_chunks = omp_get_max_threads()*PAR_CHUNKS_PER_THREAD;
+#else
+  return 0; /* the sequential reader is as fast */
 #endif
-  data->pos += (endptr - (char*)&(data->block[data->pos]))*sizeof(char);
 
-  if (data->pos == data->nbytes-1) {
-    refill_buffer(data);
+  /* The rest of the file is in the block: split it at line starts */
+  body = &(data->block[data->pos]);
+  body_end = &(data->block[data->nbytes]);
+  lim = &(data->block[data->size]);
+  starts = (const unsigned char**)malloc((n_chunks+1)*sizeof(*starts));
+  first = (int*)malloc((n_chunks+1)*sizeof(*first));
+  if (starts == NULL || first == NULL) {
+    free(starts);
+    free(first);
+    return 0;
   }
-  *out = tmp;
+  starts[0] = body;
+  for (k=1; k<n_chunks; k++) {
+    starts[k] = body + (size_t)(body_end-body)*k/n_chunks;
+    if (starts[k] <= starts[k-1]) starts[k] = starts[k-1];
+    else starts[k] = next_line(starts[k]-1, body_end);
+  }
+  starts[n_chunks] = body_end;
+
+  /* Count the non-blank lines of each chunk, to number the records */
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (k=0; k<n_chunks; k++) {
+    const unsigned char *s, *e;
+    int n = 0;
+    for (s=starts[k]; s<starts[k+1]; s=e) {
+      e = next_line(s, starts[k+1]);
+      if (span_skip_sep(&s, e) && *s != '\n') n++;
+    }
+    first[k+1] = n;
+  }
+  first[0] = 0;
+  for (k=0; k<n_chunks; k++) first[k+1] += first[k];
+  total = first[n_chunks];
+  if (total < n_records) {
+    free(starts);
+    free(first);
+    return 0;
+  }
+
+  /* Parse each record in its own line; anything unexpected (a record that
+   * does not fit on one line, extra fields, a parse error) makes us give up
+   * and leave the section to the sequential reader, which reports errors */
+  n_failed = 0;
+  last_end = NULL;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) reduction(+:n_failed)
+#endif
+  for (k=0; k<n_chunks; k++) {
+    const unsigned char *s, *e, *q;
+    int idx = first[k];
+    for (s=starts[k]; s<starts[k+1] && idx<n_records && n_failed==0; s=e) {
+      e = next_line(s, starts[k+1]);
+      q = s;
+      if (!span_skip_sep(&q, e) || *q == '\n') continue; /* blank line */
+      if (parse(&q, e, lim, idx, ctx) < 0 ||
+          (span_skip_sep(&q, e) && *q != '\n')) {
+        n_failed++;
+        break;
+      }
+      if (idx == n_records-1) last_end = e;
+      idx++;
+    }
+  }
+  free(starts);
+  free(first);
+  if (n_failed > 0) return 0;
+
+  data->pos = (int)(last_end-data->block);
   return 1;
 }
-#endif
 
 /* Reads a word until a separator is encountered. This is the
  * equivalent of doing a [sf]canf(data, "%60[^ \t,\n\r#\"]", out)
@@ -584,12 +1114,62 @@ int find_string2(struct file_data *data, const char *string)
 
 
 
+/* Returns 1 if the SMF-like file in the '*data' block is more likely a
+ * Wavefront OBJ one. The lines are scanned up to the first face or OBJ
+ * statement unknown to SMF (normals, texture coordinates, groups,
+ * materials...), which decides: OBJ for such statements and for faces with
+ * more than three corners or with "/" separated texture and normal indices,
+ * SMF for other faces. If the block ends before that, without holding the
+ * whole file, OBJ is assumed for files starting with vertices: the OBJ
+ * reader reads the vertices and triangles of SMF files as the SMF reader
+ * does, the converse is not true. */
+static int looks_like_obj(const struct file_data *data)
+{
+  static const char *obj_kw[] = {"vn", "vt", "vp", "o", "g", "s", "usemtl",
+                                 "mtllib", NULL};
+  const unsigned char *p, *end, *eol, *w;
+  int k, n, n_vtcs;
+
+  p = &(data->block[1]);
+  end = &(data->block[data->nbytes]);
+  n_vtcs = 0;
+  while (p < end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+      p++;
+    eol = p;
+    while (eol < end && *eol != '\n' && *eol != '\r') eol++;
+    if (eol == end && !data->eof_reached) break; /* line may go on */
+    for (w = p; w < eol && *w != ' ' && *w != '\t'; w++);
+    for (k=0; obj_kw[k] != NULL; k++) {
+      if ((size_t)(w-p) == strlen(obj_kw[k]) &&
+          memcmp(p, obj_kw[k], w-p) == 0)
+        return 1;
+    }
+    if (w-p == 1 && *p == 'f') {
+      for (n=0; w < eol && *w != '#'; n++) {
+        while (w < eol && (*w == ' ' || *w == '\t')) w++;
+        if (w == eol || *w == '#') break;
+        while (w < eol && *w != ' ' && *w != '\t') {
+          if (*w == '/') return 1;
+          w++;
+        }
+      }
+      return n > 3;
+    }
+    if (w-p == 1 && *p == 'v') n_vtcs++;
+    p = eol;
+  }
+  return !data->eof_reached && n_vtcs > 0;
+}
+
 /* Detect the file format of the '*data' stream, returning the detected
  * type. The header identifying the file format, if any, is stripped out and
  * the '*data' stream is positioned just after it. If an I/O error occurs
  * MESH_CORRUPTED is returned. If the file format can not be detected
  * MESH_BAD_FF is returned. The detected file formats are: MESH_FF_RAW,
- * MESH_FF_VRML, MESH_FF_IV, MESH_FF_PLY and MESH_FF_SMF. */
+ * MESH_FF_VRML, MESH_FF_IV, MESH_FF_PLY, MESH_FF_SMF, MESH_FF_VTK,
+ * MESH_FF_VTP, MESH_FF_STL and MESH_FF_OBJ (for the VTK, STL and OBJ formats
+ * the stream is rewound to the start of the file). */
 static int detect_file_format(struct file_data *data)
 {
   char stmp[MAX_WORD_LEN+1];
@@ -599,8 +1179,17 @@ static int detect_file_format(struct file_data *data)
   int rcode;
   char *eptr;
   double ver;
+  int stl_guess;
 
   c = getc(data);
+  if (c != EOF && is_binary_stl(data)) { /* size matches a binary STL */
+    data->pos = 1; /* rewind file */
+    return MESH_FF_STL;
+  }
+  /* if the size is not known, binary STL is only a guess for files that
+   * match none of the signatures below (binary PLY and VTK files have
+   * control bytes after their text header too) */
+  stl_guess = (c != EOF && looks_like_binary_stl(data));
   if (c == '1'){ /* probably byu*/
     c = getc(data);
     if(c == ' ')
@@ -611,7 +1200,8 @@ static int detect_file_format(struct file_data *data)
     }
     else
     {
-      c = ungetc(c,data);
+      data->pos = 1; /* rewind file */
+      c = getc(data);
     }
   }
   if (c == '#') { /* Probably VRML or Inventor but can also be a SMF comment */
@@ -627,7 +1217,7 @@ static int detect_file_format(struct file_data *data)
           }
           rcode = (c != EOF) ? MESH_FF_VRML : MESH_CORRUPTED;
         } else {
-          rcode = ferror((FILE*)data->f) ? MESH_CORRUPTED : MESH_BAD_FF;
+          rcode = stream_error(data) ? MESH_CORRUPTED : MESH_BAD_FF;
         }
       } else if (strcmp(stmp,"Inventor") == 0) {        
         if (getc(data) == ' ' && buf_fscanf_1arg(data,svfmt,stmp) == 1 &&
@@ -640,54 +1230,76 @@ static int detect_file_format(struct file_data *data)
           }
           rcode = (c != EOF) ? MESH_FF_IV : MESH_CORRUPTED;
         } else {
-          rcode = ferror((FILE*)data->f) ? MESH_CORRUPTED : MESH_BAD_FF;
+          rcode = stream_error(data) ? MESH_CORRUPTED : MESH_BAD_FF;
         }
+      } else if (strcmp(stmp,"vtk") == 0) {
+        data->pos = 1; /* rewind file */
+        rcode = MESH_FF_VTK;
       } else {
         /* Is is a comment line of a SMF file ? */
         data->pos = 1; /* rewind file */
         if ((c = skip_ws_comm(data)) == EOF) rcode = MESH_BAD_FF;
-        if (c == 'v' || c == 'b' || c == 'f' || c == 'c')
+        if (looks_like_obj(data))
+          rcode = MESH_FF_OBJ;
+        else if (c == 'v' || c == 'b' || c == 'f' || c == 'c')
           rcode = MESH_FF_SMF;
         else 
-          rcode = ferror((FILE*)data->f) ? MESH_CORRUPTED : MESH_BAD_FF;
+          rcode = stream_error(data) ? MESH_CORRUPTED : MESH_BAD_FF;
       }
     } else {
       /* We need to test for SMF files here also, maybe a comment line
        * */
       data->pos = 1; /* rewind file */
       if((c = skip_ws_comm(data)) == EOF) rcode = MESH_BAD_FF;
-      if (c == 'v' || c == 'b' || c == 'f' || c == 'c')
+      if (looks_like_obj(data))
+        rcode = MESH_FF_OBJ;
+      else if (c == 'v' || c == 'b' || c == 'f' || c == 'c')
         rcode = MESH_FF_SMF;
       else 
-        rcode = ferror((FILE*)data->f) ? MESH_CORRUPTED : MESH_BAD_FF;
+        rcode = stream_error(data) ? MESH_CORRUPTED : MESH_BAD_FF;
     }
   } else {
-   c = skip_ws_comm(data); /* In case the header does not start at 1st column */
+   c = ungetc(c,data);
+   if (c != EOF) /* In case the header does not start at 1st column */
+     c = skip_ws_comm(data);
    if (c == EOF) rcode = MESH_BAD_FF;
-   if (c == 'p') { /* Probably ply */
-     c = ungetc(c,data);
-     if (c != EOF) {
-      if (string_scanf(data, stmp) == 1 && strcmp(stmp, "ply") == 0) {
-        rcode = MESH_FF_PLY;
-      } else {
-        rcode = ferror((FILE*)data->f) ? MESH_CORRUPTED : MESH_BAD_FF;
-      }
+   if (c == '<') { /* Probably XML, i.e. VTK PolyData */
+     data->pos = 1; /* rewind file */
+     rcode = MESH_FF_VTP;
+   } else if (c == 's') { /* Probably ASCII STL */
+    if (string_scanf(data, stmp) == 1 && strcmp(stmp, "solid") == 0) {
+      data->pos = 1; /* rewind file */
+      rcode = MESH_FF_STL;
+    } else { /* or an OBJ smoothing group */
+      data->pos = 1; /* rewind file */
+      rcode = looks_like_obj(data) ? MESH_FF_OBJ :
+        (stream_error(data) ? MESH_CORRUPTED : MESH_BAD_FF);
+    }
+   } else if (c == 'p') { /* Probably ply */
+    if (string_scanf(data, stmp) == 1 && strcmp(stmp, "ply") == 0) {
+      rcode = MESH_FF_PLY;
     } else {
-      rcode = MESH_CORRUPTED;
+      rcode = stream_error(data) ? MESH_CORRUPTED : MESH_BAD_FF;
     }
     } else if (c >= '0' && c <= '9') { /* probably raw */
-    c = ungetc(c,data);
-    rcode = (c != EOF) ? MESH_FF_RAW : MESH_CORRUPTED;
+    rcode = MESH_FF_RAW;
     } else { 
     /* test for SMF also here before returning */
     data->pos=1; /* rewind file */
     if ((c = skip_ws_comm(data)) == EOF) rcode = MESH_BAD_FF;
-    if (c == 'v' || c == 'b' || c == 'f' || c == 'c')
+    if (looks_like_obj(data))
+      rcode = MESH_FF_OBJ;
+    else if (c == 'v' || c == 'b' || c == 'f' || c == 'c')
       rcode = MESH_FF_SMF;
     else 
-      rcode = ferror((FILE*)data->f) ? MESH_CORRUPTED : MESH_BAD_FF;
+      rcode = stream_error(data) ? MESH_CORRUPTED : MESH_BAD_FF;
   }
   }
+  if (stl_guess && (rcode == MESH_BAD_FF || rcode == MESH_FF_RAW ||
+                    rcode == MESH_FF_SMF || rcode == MESH_FF_OBJ)) {
+    data->pos = 1; /* rewind file */
+    rcode = MESH_FF_STL;
+  }
   return rcode;
 }
 
@@ -728,6 +1340,18 @@ int read_model(struct model **models_ref, struct file_data *data,
     //rcode = read_byu_tmesh(&models, data);
     rcode = read_byu_tmesh2(&models, data, fname);
     break;
+  case MESH_FF_VTK:
+    rcode = read_vtk_tmesh(&models, data);
+    break;
+  case MESH_FF_VTP:
+    rcode = read_vtp_tmesh(&models, data);
+    break;
+  case MESH_FF_STL:
+    rcode = read_stl_tmesh(&models, data);
+    break;
+  case MESH_FF_OBJ:
+    rcode = read_obj_tmesh(&models, data);
+    break;
   case MESH_FF_M3D:
   //rcode = read_m3d_tmesh(&models, data);
     break;
@@ -742,12 +1366,74 @@ int read_model(struct model **models_ref, struct file_data *data,
   return rcode;
 }
 
+#ifdef MESH_USE_MMAP
+/* Maps the whole file 'fname' in memory and sets up the '*data' block to be
+ * the mapped file, so that it never needs to be refilled. As with
+ * refill_buffer() the file data starts at data->block[1], and the block is
+ * followed by zeros (the mapping is read-only, which is fine since the
+ * readers never write to the block once it is filled). The mapping starts at
+ * the returned address and spans '*map_len' bytes. If the file can not be
+ * mapped (e.g. it is not a regular file, it is empty, too large for the 'int'
+ * positions of 'struct file_data', or gzipped) NULL is returned and '*data'
+ * is left unchanged. */
+static unsigned char* map_file_data(struct file_data *data, const char *fname,
+                                    size_t *map_len)
+{
+  int fd;
+  struct stat st;
+  size_t page, fsize, len;
+  unsigned char *base;
+
+  fd = open(fname, O_RDONLY);
+  if (fd < 0) return NULL;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size < 2 ||
+      st.st_size > INT_MAX-2) {
+    close(fd);
+    return NULL;
+  }
+  fsize = (size_t)st.st_size;
+  page = (size_t)sysconf(_SC_PAGESIZE);
+
+  /* Reserve a zero page for data->block[0], the file pages, and at least one
+   * more zero page, then map the file in place */
+  len = page + (fsize/page+1)*page;
+  base = (unsigned char*)mmap(NULL, len, PROT_READ, MAP_PRIVATE|MAP_ANONYMOUS,
+                              -1, 0);
+  if (base == (unsigned char*)MAP_FAILED) {
+    close(fd);
+    return NULL;
+  }
+  if (mmap(base+page, fsize, PROT_READ, MAP_PRIVATE|MAP_FIXED, fd, 0) ==
+      MAP_FAILED) {
+    munmap(base, len);
+    close(fd);
+    return NULL;
+  }
+  close(fd);
+  if (base[page] == 0x1f && base[page+1] == 0x8b) { /* gzip magic */
+    munmap(base, len);
+    return NULL;
+  }
+  madvise(base+page, fsize, MADV_SEQUENTIAL);
+
+  data->block = base+page-1;
+  data->size = (int)fsize+1;
+  data->nbytes = (int)fsize+1;
+  data->pos = 1;
+  data->eof_reached = 1; /* nothing left to refill */
+  *map_len = len;
+  return base;
+}
+#endif
+
 /* see model_in.h */
 int read_fmodel(struct model **models_ref, const char *fname,
                 int fformat, int concat)
 {
   int rcode;
   struct file_data *data;
+  unsigned char *map;
+  size_t map_len;
 #ifdef READ_TIME
   clock_t stime;
 #endif
@@ -755,15 +1441,29 @@ int read_fmodel(struct model **models_ref, const char *fname,
   data = (struct file_data*)malloc(sizeof(struct file_data));
 
   data->f = loc_fopen(fname, "rb");
-  data->block = (unsigned char*)malloc(GZ_BUF_SZ*sizeof(unsigned char));
-
-  if (data->f == NULL) return MESH_BAD_FNAME;
+  if (data->f == NULL) {
+    free(data);
+    return MESH_BAD_FNAME;
+  }
   /* initialize file_data structure */
-  data->size = GZ_BUF_SZ;
-  data->eof_reached = 0;
-  data->nbytes = 0;
-  data->pos = 1;
   data->is_binary = 0;
+  data->ring = NULL;
+  map = NULL;
+  map_len = 0;
+#ifdef MESH_USE_MMAP
+  map = map_file_data(data, fname, &map_len);
+#endif
+  if (map == NULL) {
+    data->block = (unsigned char*)malloc(GZ_BUF_SZ*sizeof(unsigned char));
+    data->size = GZ_BUF_SZ;
+    data->eof_reached = 0;
+    data->nbytes = 0;
+    data->pos = 1;
+#ifdef MESH_GZ_THREAD
+    /* decompress ahead on another thread, while the block is parsed */
+    if (!gzdirect(data->f)) data->ring = gz_ring_open(data->f);
+#endif
+  }
 
 #ifdef READ_TIME
   stime = clock();
@@ -775,7 +1475,16 @@ int read_fmodel(struct model **models_ref, const char *fname,
   printf("Model read in %f sec.\n", (double)(clock()-stime)/CLOCKS_PER_SEC);
 #endif
 
+#ifdef MESH_GZ_THREAD
+  if (data->ring != NULL) gz_ring_close(data->ring);
+#endif
   loc_fclose(data->f);
+#ifdef MESH_USE_MMAP
+  if (map != NULL) {
+    munmap(map, map_len);
+    data->block = NULL;
+  }
+#endif
   free(data->block);
   free(data);
   return rcode;
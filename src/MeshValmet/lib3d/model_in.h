@@ -89,6 +89,19 @@
  *     improve things sometimes, especially if you converted your
  *     ASCII file into a binary one using 'ply2binary'...
  *
+ * - VTK legacy POLYDATA and XML PolyData :
+ *     Only the points, polygons and triangle strips are read, the
+ *     polygons and strips being split into triangles. See
+ *     'model_in_vtk.cxx'.
+ *
+ * - STL, binary or ASCII :
+ *     The triangles are read and their vertices welded (copies with
+ *     the same coordinates merged), the facet normals are ignored.
+ *
+ * - Wavefront OBJ :
+ *     Only the vertices and the faces are read, polygons being split
+ *     into triangles. Texture and normal indices are ignored.
+ *
  */
 
 #ifndef _MODEL_IN_PROTO
@@ -102,10 +115,9 @@
 
 /* 
  * 'zlib' is not part of the Window$ platforms. Comment out this to use zlib
- * under Windows (It *does* work ! I saw it on my PC !).
+ * under Windows (It *does* work ! I saw it on my PC !). Elsewhere the build
+ * defines DONT_USE_ZLIB when zlib is not found.
  */
-#define DONT_USE_ZLIB
-
 #ifdef WIN32
 # define DONT_USE_ZLIB
 #endif
@@ -129,6 +141,8 @@ BEGIN_DECL
 /* --------------------------------------------------------------------------
    BUFFERED FILE DATA STRUCTURE
    -------------------------------------------------------------------------- */
+struct gz_ring; /* private to model_in.cxx */
+
 struct file_data {
 #ifdef DONT_USE_ZLIB
   FILE *f;
@@ -141,6 +155,9 @@ struct file_data {
   int pos; /* current position in block */
   int is_binary; /* flag for binary data */
   int eof_reached;
+  struct gz_ring *ring; /* blocks decompressed by a producer thread, which
+                         * refill_buffer() reads instead of 'f' (NULL if
+                         * not used) */
 };
 
 /* --------------------------------------------------------------------------
@@ -156,6 +173,10 @@ struct file_data {
 #define MESH_FF_SMF       6 /* SMF format (from QSlim) */
 #define MESH_FF_BYU      7 /* BYU format */
 #define MESH_FF_M3D      8 /* M3D format, M-rep model file from Pablo */
+#define MESH_FF_VTK       9 /* VTK legacy POLYDATA, ascii or binary */
+#define MESH_FF_VTP      10 /* VTK XML PolyData */
+#define MESH_FF_STL      11 /* STL, binary or ascii */
+#define MESH_FF_OBJ      12 /* Wavefront OBJ */
 
 /* --------------------------------------------------------------------------
    ERROR CODES (always negative)
@@ -267,6 +288,34 @@ int find_string(struct file_data*, const char*);
 int find_string2(struct file_data*, const char*);
 size_t bin_read(void *, size_t, size_t, struct file_data*);
 
+/* Versions of int_scanf() and float_scanf() that read from memory: the
+ * number is read at '*p', after skipping separators, and must end before
+ * 'end'. The bytes up to 'lim' (excluded) can be read, and the data must be
+ * terminated before 'lim' by a non-number character. On success '*p' is
+ * moved past the number and 1 is returned, otherwise 0 is returned. */
+int span_int_scanf(const unsigned char **p, const unsigned char *end,
+                   const unsigned char *lim, int *out);
+int span_float_scanf(const unsigned char **p, const unsigned char *end,
+                     const unsigned char *lim, float *out);
+
+/* Parses the record with index 'idx' found in the line starting at '*p' and
+ * ending at 'end' (see span_int_scanf() for 'lim'), moving '*p' past what
+ * was read. Returns 0 on success or a negative value otherwise. */
+typedef int (*record_parser)(const unsigned char **p, const unsigned char *end,
+                             const unsigned char *lim, int idx, void *ctx);
+
+/* Reads the next 'n_records' records from the '*data' stream concurrently,
+ * if the rest of the stream is in memory (e.g. a memory mapped file) and
+ * there are enough of them. Each record must be on its own line, blank
+ * lines are ignored. The lines are split in chunks, parsed concurrently by
+ * 'parse' (with 'ctx'), and the stream is positioned at the end of the last
+ * record. If that succeeds 1 is returned. Otherwise (including on parse
+ * errors) 0 is returned and the stream is left unchanged, so that the
+ * caller can read the records sequentially. Records beyond 'n_records' are
+ * not read. */
+int parse_records(struct file_data *data, int n_records,
+                  record_parser parse, void *ctx);
+
 /* File format reader functions - should be accessed only through
  * read_[f]model. See the model_in*.c files for more details about
  * their behaviour (esp. wrt. error handling and/or [un]implemented
@@ -278,6 +327,23 @@ int read_vrml_tmesh(struct model**, struct file_data*, int);
 int read_iv_tmesh(struct model**, struct file_data*);
 int read_byu_tmesh(struct model**, struct file_data*);
 int read_byu_tmesh2(struct model**, struct file_data*, const char* fname);
+int read_vtk_tmesh(struct model**, struct file_data*);
+int read_vtp_tmesh(struct model**, struct file_data*);
+int read_stl_tmesh(struct model**, struct file_data*);
+int read_obj_tmesh(struct model**, struct file_data*);
+
+/* Returns non-zero if the size of the '*data' file matches the triangle
+ * count of a binary STL header, which is how binary STL files are told
+ * apart (their header may start with "solid" too). The size is known when
+ * the whole file is in the block or, if zlib is not used, from the file
+ * itself; otherwise zero is returned. */
+int is_binary_stl(const struct file_data *data);
+
+/* Same as is_binary_stl(), but when the size of the file is not known
+ * (gzipped or non-regular files) returns non-zero if the first binary
+ * records hold control bytes, which text files do not. This is only a
+ * guess, for files that match no other format. */
+int looks_like_binary_stl(const struct file_data *data);
 
 /* Reads the 3D triangular mesh models from the input '*data' stream, in the
  * file format specified by 'fformat'. The model meshes are returned in the
@@ -298,7 +364,12 @@ int read_model(struct model **models_ref, struct file_data *data,
  * MESH_BAD_FNAME is returned (the detailed error is given in errno). If an
  * error occurs '*models_ref' is not modified. If 'fformat' is MESH_FF_AUTO
  * the file format is autodetected. If 'concat' is non-zero only one mesh is
- * returned, which is the concatenation of the the ones read. */
+ * returned, which is the concatenation of the the ones read. On POSIX
+ * systems (unless MESH_NO_MMAP is defined) regular files are memory mapped
+ * and read in place, instead of through the refilled 'struct file_data'
+ * block. Gzipped files are read when zlib is used; they are then
+ * decompressed by a producer thread (unless MESH_NO_GZ_THREAD is defined)
+ * that feeds the block as it gets parsed. */
 int read_fmodel(struct model **models_ref, const char *fname,
                 int fformat, int concat);
 
@@ -0,0 +1,170 @@
+/*
+ * Reader for Wavefront OBJ files.
+ *
+ * Only the vertex positions ("v") and the faces ("f") are read; texture
+ * coordinates, normals, groups, materials and the other statements are
+ * skipped. Face corners may be given as "v", "v/vt", "v//vn" or "v/vt/vn",
+ * with 1-based or negative (relative to the last vertex) indices. Polygons
+ * are triangulated as fans around their first corner.
+ */
+
+#include <model_in.h>
+#ifdef DEBUG
+# include <debug_print.h>
+#endif
+
+/* Skips the rest of the current line */
+static void skip_obj_line(struct file_data *data)
+{
+  int c;
+
+  do {
+    c = getc(data);
+  } while (c != EOF && c != '\n' && c != '\r');
+}
+
+/* Reads the corners of the face on the current line of '*data' and appends
+ * its fan triangles to '*faces', growing it as needed. 'n_vtcs' is the
+ * number of vertices read so far, used to resolve the negative indices.
+ * The largest vertex index used is kept in '*max_vidx'. Returns 0 on success
+ * or a negative error code. */
+static int read_obj_face(struct file_data *data, face_t **faces, int *n_faces,
+                         int *len, int n_vtcs, int *max_vidx)
+{
+  int c, n, idx, first, prev;
+
+  n = 0;
+  first = prev = -1;
+  for (;;) {
+    do {
+      c = getc(data);
+    } while (c == ' ' || c == '\t');
+    if (c == EOF || c == '\n' || c == '\r') break;
+    if (c == '#') { /* trailing comment */
+      skip_obj_line(data);
+      break;
+    }
+    if (c == '\\') { /* line continuation */
+      skip_obj_line(data);
+      continue;
+    }
+    if (!((c >= '0' && c <= '9') || c == '-' || c == '+'))
+      return MESH_CORRUPTED;
+    ungetc(c, data);
+    if (int_scanf(data, &idx) != 1) return MESH_CORRUPTED;
+    do { /* skip the texture and normal indices */
+      c = getc(data);
+    } while (c != EOF && c != ' ' && c != '\t' && c != '\n' && c != '\r' &&
+             c != '#');
+    if (c != EOF) ungetc(c, data);
+
+    if (idx > 0) {
+      idx--;
+    } else if (idx < 0) {
+      idx += n_vtcs;
+      if (idx < 0) return MESH_CORRUPTED;
+    } else {
+      return MESH_CORRUPTED;
+    }
+    if (idx > *max_vidx) *max_vidx = idx;
+
+    if (n == 0) {
+      first = idx;
+    } else if (n >= 2) {
+      if (*n_faces == *len) {
+        *faces = (face_t*)grow_array(*faces, sizeof(face_t), len, 0);
+        if (*faces == NULL) return MESH_NO_MEM;
+      }
+      (*faces)[*n_faces].f0 = first;
+      (*faces)[*n_faces].f1 = prev;
+      (*faces)[*n_faces].f2 = idx;
+      (*n_faces)++;
+    }
+    prev = idx;
+    n++;
+  }
+  return 0;
+}
+
+/* Reads a mesh from a Wavefront OBJ file, triangulating its polygons (see
+ * above). All the objects and groups of the file are read into a single
+ * model. It returns the number of meshes read (i.e. 1) if successful, and a
+ * negative code if it failed. */
+int read_obj_tmesh(struct model **tmesh_ref, struct file_data *data)
+{
+  char stmp[MAX_WORD_LEN+1];
+  struct model *tmesh;
+  vertex_t *vtcs;
+  face_t *faces;
+  int n_vtcs, n_faces, v_len, f_len, max_vidx;
+  int k, rcode;
+
+  n_vtcs = n_faces = 0;
+  v_len = f_len = 0;
+  max_vidx = -1;
+  vtcs = (vertex_t*)grow_array(NULL, sizeof(vertex_t), &v_len, 0);
+  faces = (face_t*)grow_array(NULL, sizeof(face_t), &f_len, 0);
+  tmesh = (struct model*)calloc(1, sizeof(struct model));
+  if (vtcs == NULL || faces == NULL || tmesh == NULL) {
+    free(vtcs);
+    free(faces);
+    free(tmesh);
+    return MESH_NO_MEM;
+  }
+
+  rcode = 0;
+  while (rcode >= 0 && skip_ws_comm(data) != EOF) {
+    if (string_scanf(data, stmp) != 1) {
+      rcode = MESH_CORRUPTED;
+    } else if (strcmp(stmp, "v") == 0) {
+      if (n_vtcs == v_len) {
+        vtcs = (vertex_t*)grow_array(vtcs, sizeof(vertex_t), &v_len, 0);
+        if (vtcs == NULL) {
+          rcode = MESH_NO_MEM;
+          break;
+        }
+      }
+      if (float_scanf(data, &(vtcs[n_vtcs].x)) != 1 ||
+          float_scanf(data, &(vtcs[n_vtcs].y)) != 1 ||
+          float_scanf(data, &(vtcs[n_vtcs].z)) != 1) {
+        rcode = MESH_CORRUPTED;
+      } else {
+        n_vtcs++;
+        skip_obj_line(data); /* optional weight or color */
+      }
+    } else if (strcmp(stmp, "f") == 0) {
+      rcode = read_obj_face(data, &faces, &n_faces, &f_len, n_vtcs,
+                            &max_vidx);
+    } else { /* not a vertex nor a face => skip the whole line */
+      skip_obj_line(data);
+    }
+  }
+  if (rcode >= 0 && max_vidx >= n_vtcs) rcode = MESH_CORRUPTED;
+
+  if (rcode < 0) {
+    free(vtcs);
+    free(faces);
+    free(tmesh);
+    return rcode;
+  }
+
+  tmesh->vertices = vtcs;
+  tmesh->faces = faces;
+  tmesh->num_vert = n_vtcs;
+  tmesh->num_faces = n_faces;
+  if (n_vtcs == 0) {
+    memset(tmesh->bBox, 0, sizeof(tmesh->bBox));
+  } else {
+    tmesh->bBox[0] = tmesh->bBox[1] = vtcs[0];
+    for (k=1; k<n_vtcs; k++) {
+      if (vtcs[k].x < tmesh->bBox[0].x) tmesh->bBox[0].x = vtcs[k].x;
+      if (vtcs[k].x > tmesh->bBox[1].x) tmesh->bBox[1].x = vtcs[k].x;
+      if (vtcs[k].y < tmesh->bBox[0].y) tmesh->bBox[0].y = vtcs[k].y;
+      if (vtcs[k].y > tmesh->bBox[1].y) tmesh->bBox[1].y = vtcs[k].y;
+      if (vtcs[k].z < tmesh->bBox[0].z) tmesh->bBox[0].z = vtcs[k].z;
+      if (vtcs[k].z > tmesh->bBox[1].z) tmesh->bBox[1].z = vtcs[k].z;
+    }
+  }
+  *tmesh_ref = tmesh;
+  return 1;
+}
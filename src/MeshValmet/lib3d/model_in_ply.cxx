@@ -520,6 +520,291 @@ static int read_properties(struct file_data *data, struct ply_prop **prop)
   return (rcode < 0) ? rcode : n_prop;
 }
 
+/* Context of the ASCII record parsers used with parse_records() */
+struct ply_records {
+  vertex_t *vtcs;
+  face_t *faces;
+  int n_vtcs;
+  const struct ply_prop *prop;
+  int n_prop;
+};
+
+/* Skips an ASCII field of type 'type' in memory, as skip_field() does */
+static int span_skip_field(const unsigned char **p, const unsigned char *end,
+                           const unsigned char *lim, const int type)
+{
+  int tmp_int;
+  float tmp_float;
+
+  switch (type) {
+  case uint8:
+  case int8:
+  case uint16:
+  case int16:
+  case uint32:
+  case int32:
+    return (span_int_scanf(p, end, lim, &tmp_int) == 1) ? 0 : MESH_CORRUPTED;
+  case float32:
+  case float64:
+    return (span_float_scanf(p, end, lim, &tmp_float) == 1) ? 0 : 
+      MESH_CORRUPTED;
+  default:
+    return MESH_CORRUPTED;
+  }
+}
+
+/* Reads the ASCII vertex record 'idx' in memory, as read_ply_vertices()
+ * does (see record_parser in model_in.h) */
+static int parse_ply_vertex_record(const unsigned char **p, 
+                                   const unsigned char *end,
+                                   const unsigned char *lim, int idx, 
+                                   void *ctx)
+{
+  const struct ply_records *r = (const struct ply_records*)ctx;
+  vertex_t *v = &(r->vtcs[idx]);
+  int j, rcode = 0;
+
+  for (j=0; j<r->n_prop && rcode>=0; j++) {
+    switch (r->prop[j].prop) {
+    case v_x:
+      if (span_float_scanf(p, end, lim, &(v->x)) != 1) rcode = MESH_CORRUPTED;
+      break;
+    case v_y:
+      if (span_float_scanf(p, end, lim, &(v->y)) != 1) rcode = MESH_CORRUPTED;
+      break;
+    case v_z:
+      if (span_float_scanf(p, end, lim, &(v->z)) != 1) rcode = MESH_CORRUPTED;
+      break;
+    default:
+      rcode = span_skip_field(p, end, lim, r->prop[j].type_prop);
+      break;
+    }
+  }
+  return rcode;
+}
+
+/* Reads the ASCII face record 'idx' in memory, as read_ply_faces() does
+ * (see record_parser in model_in.h) */
+static int parse_ply_face_record(const unsigned char **p, 
+                                 const unsigned char *end,
+                                 const unsigned char *lim, int idx, void *ctx)
+{
+  const struct ply_records *r = (const struct ply_records*)ctx;
+  int j, nvert, f0, f1, f2;
+
+  for (j=0; j<r->n_prop; j++) {
+    if (r->prop[j].prop != v_idx) {
+      if (span_skip_field(p, end, lim, r->prop[j].type_prop) < 0)
+        return MESH_CORRUPTED;
+      continue;
+    }
+    if (!r->prop[j].is_list || span_int_scanf(p, end, lim, &nvert) != 1)
+      return MESH_CORRUPTED;
+    if ((t_uint8)nvert != 3) 
+      return MESH_NOT_TRIAG;
+    if (span_int_scanf(p, end, lim, &f0) != 1 ||
+        span_int_scanf(p, end, lim, &f1) != 1 ||
+        span_int_scanf(p, end, lim, &f2) != 1)
+      return MESH_CORRUPTED;
+    if (f0 < 0 || f1 < 0 || f2 < 0 || 
+        f0 >= r->n_vtcs || f1 >= r->n_vtcs || f2 >= r->n_vtcs)
+      return MESH_MODEL_ERR;
+    r->faces[idx].f0 = f0;
+    r->faces[idx].f1 = f1;
+    r->faces[idx].f2 = f2;
+  }
+  return 0;
+}
+
+/* Number of records converted at a time by the binary bulk readers */
+#define BIN_BATCH 4096
+
+/* Byte swaps the 32 bit word 'w' */
+#define SWAP32(w) ((((w) & 0xFFU) << 24) | (((w) & 0xFF00U) << 8) | \
+                   (((w) >> 8) & 0xFF00U) | (((w) >> 24) & 0xFFU))
+
+/* Returns a pointer to the next 'len' bytes of the 'data' stream and skips
+ * them. The bytes are returned in place if they are all in the current
+ * block (e.g. for memory mapped files), or copied to 'buf' (of at least
+ * 'len' bytes) otherwise. NULL is returned if the stream is too short. */
+static const unsigned char* bin_span(struct file_data *data, const int len,
+                                     unsigned char *buf)
+{
+  const unsigned char *p;
+
+  if (data->nbytes > 0 && data->nbytes-data->pos >= len) {
+    p = &(data->block[data->pos]);
+    data->pos += len;
+    return p;
+  }
+  return ((int)bin_read(buf, 1, len, data) == len) ? buf : NULL;
+}
+
+/* Computes the layout of a binary record made of the 'n_prop' properties
+ * 'prop', storing the byte offset of each property in 'offsets'. The
+ * property at index 'list_idx' (if any) is taken as a list of 3 elements,
+ * the others must not be lists. Returns the record size, or -1 if the record
+ * does not have a fixed size. */
+static int bin_record_layout(const struct ply_prop *prop, const int n_prop,
+                             const int list_idx, int *offsets)
+{
+  int j, size;
+
+  for (j=0, size=0; j<n_prop; j++) {
+    if (prop[j].type_prop < int8 || prop[j].type_prop > float64)
+      return -1;
+    offsets[j] = size;
+    if (j == list_idx) {
+      if (prop[j].type_list < int8 || prop[j].type_list > float64)
+        return -1;
+      size += ply_sizes[prop[j].type_list] + 3*ply_sizes[prop[j].type_prop];
+    } else if (prop[j].is_list) {
+      return -1;
+    } else {
+      size += ply_sizes[prop[j].type_prop];
+    }
+  }
+  return size;
+}
+
+/* Reads the binary vertices in bulk, when x, y and z are float32 and all
+ * properties have a fixed size: whole batches of records are taken from the
+ * stream at once, and copied (with byte swapping if needed) to 'vtcs'. If
+ * the layout is supported 1 is returned, with the result of the reading in
+ * '*rcode' (as for read_ply_vertices()), otherwise 0 is returned and nothing
+ * is read. */
+static int read_ply_vertices_bulk(vertex_t *vtcs, struct file_data *data,
+                                  const int n_vtcs, const int swap_bytes,
+                                  const struct ply_prop *v_prop, 
+                                  const int n_v_prop, int *rcode)
+{
+  int *offsets;
+  int off[3] = {-1, -1, -1};
+  int j, k, i, nb, size;
+  const unsigned char *src, *rec;
+  unsigned char *buf;
+  t_uint32 w[3];
+
+  offsets = (int*)malloc(n_v_prop*sizeof(*offsets));
+  if (offsets == NULL) return 0;
+  size = bin_record_layout(v_prop, n_v_prop, -1, offsets);
+  for (j=0; j<n_v_prop && size>0; j++) {
+    k = v_prop[j].prop - v_x;
+    if (k < 0 || k > 2) continue;
+    if (v_prop[j].type_prop != float32 || off[k] >= 0) size = -1;
+    else off[k] = offsets[j];
+  }
+  free(offsets);
+  if (size <= 0 || off[0] < 0 || off[1] < 0 || off[2] < 0) return 0;
+
+  buf = (unsigned char*)malloc(BIN_BATCH*size);
+  if (buf == NULL) {
+    *rcode = MESH_NO_MEM;
+    return 1;
+  }
+  *rcode = 0;
+  for (i=0; i<n_vtcs; i+=nb) {
+    nb = (n_vtcs-i < BIN_BATCH) ? n_vtcs-i : BIN_BATCH;
+    src = bin_span(data, nb*size, buf);
+    if (src == NULL) {
+      *rcode = MESH_CORRUPTED;
+      break;
+    }
+    if (!swap_bytes && size == 3*4 && off[0] == 0 && off[1] == 4 &&
+        off[2] == 8 && sizeof(vertex_t) == 3*4) {
+      memcpy(&(vtcs[i]), src, nb*size);
+      continue;
+    }
+    for (k=0, rec=src; k<nb; k++, rec+=size) {
+      memcpy(&(w[0]), rec+off[0], 4);
+      memcpy(&(w[1]), rec+off[1], 4);
+      memcpy(&(w[2]), rec+off[2], 4);
+      if (swap_bytes) {
+        w[0] = SWAP32(w[0]);
+        w[1] = SWAP32(w[1]);
+        w[2] = SWAP32(w[2]);
+      }
+      memcpy(&(vtcs[i+k].x), &(w[0]), 4);
+      memcpy(&(vtcs[i+k].y), &(w[1]), 4);
+      memcpy(&(vtcs[i+k].z), &(w[2]), 4);
+    }
+  }
+  free(buf);
+  return 1;
+}
+
+/* Reads the binary faces in bulk, when the vertex indices are a list of
+ * int32 or uint32 with an 8 bit count, and the other properties have a fixed
+ * size (see read_ply_vertices_bulk()). The count must be 3, as in
+ * read_ply_faces(). */
+static int read_ply_faces_bulk(face_t *faces, struct file_data *data,
+                               const int n_faces, const int n_vtcs,
+                               const int swap_bytes,
+                               const struct ply_prop *face_prop, 
+                               const int n_f_prop, int *rcode)
+{
+  int *offsets;
+  int j, i, k, nb, size, idx_prop, off;
+  const unsigned char *src, *rec;
+  unsigned char *buf;
+  t_uint32 w[3];
+  int f[3];
+
+  for (j=0, idx_prop=-1; j<n_f_prop; j++) {
+    if (face_prop[j].prop != v_idx) continue;
+    if (idx_prop >= 0 || !face_prop[j].is_list ||
+        (face_prop[j].type_list != uint8 && face_prop[j].type_list != int8) ||
+        (face_prop[j].type_prop != int32 && face_prop[j].type_prop != uint32))
+      return 0;
+    idx_prop = j;
+  }
+  if (idx_prop < 0) return 0;
+  offsets = (int*)malloc(n_f_prop*sizeof(*offsets));
+  if (offsets == NULL) return 0;
+  size = bin_record_layout(face_prop, n_f_prop, idx_prop, offsets);
+  off = offsets[idx_prop];
+  free(offsets);
+  if (size <= 0) return 0;
+
+  buf = (unsigned char*)malloc(BIN_BATCH*size);
+  if (buf == NULL) {
+    *rcode = MESH_NO_MEM;
+    return 1;
+  }
+  *rcode = 0;
+  for (i=0; i<n_faces && *rcode==0; i+=nb) {
+    nb = (n_faces-i < BIN_BATCH) ? n_faces-i : BIN_BATCH;
+    src = bin_span(data, nb*size, buf);
+    if (src == NULL) {
+      *rcode = MESH_CORRUPTED;
+      break;
+    }
+    for (k=0, rec=src+off; k<nb; k++, rec+=size) {
+      if (rec[0] != 3) { /* Non triangular mesh -> bail out */
+        *rcode = MESH_NOT_TRIAG;
+        break;
+      }
+      memcpy(w, rec+1, sizeof(w));
+      if (swap_bytes) {
+        w[0] = SWAP32(w[0]);
+        w[1] = SWAP32(w[1]);
+        w[2] = SWAP32(w[2]);
+      }
+      memcpy(f, w, sizeof(f));
+      if (f[0] < 0 || f[1] < 0 || f[2] < 0 || 
+          f[0] >= n_vtcs || f[1] >= n_vtcs || f[2] >= n_vtcs) {
+        *rcode = MESH_MODEL_ERR;
+        break;
+      }
+      faces[i+k].f0 = f[0];
+      faces[i+k].f1 = f[1];
+      faces[i+k].f2 = f[2];
+    }
+  }
+  free(buf);
+  return 1;
+}
+
 /* Read 'n_faces' faces of the model from a binary/ascii 'data' stream. 
  * Returns 0 if successful and a negative value in case of trouble. 
  * Non-triangular faces are NOT supported. Moreover, the face's vertex
@@ -537,6 +822,20 @@ static int read_ply_faces(face_t *faces, struct file_data *data,
   int rcode=0;
   t_uint8 nvert=0;
   int tmp_int=0;
+  struct ply_records rec;
+
+  if (is_bin && read_ply_faces_bulk(faces, data, n_faces, n_vtcs, swap_bytes,
+                                    face_prop, n_f_prop, &rcode))
+    return rcode;
+  if (!is_bin) { /* try to read concurrently first */
+    rec.vtcs = NULL;
+    rec.faces = faces;
+    rec.n_vtcs = n_vtcs;
+    rec.prop = face_prop;
+    rec.n_prop = n_f_prop;
+    if (parse_records(data, n_faces, parse_ply_face_record, &rec))
+      return 0;
+  }
 
   for (i=0; i<n_faces && rcode >=0; i++) {
     for (j=0; j<n_f_prop && rcode >=0; j++) {
@@ -625,10 +924,34 @@ static int read_ply_vertices(vertex_t *vtcs, struct file_data *data,
   int rcode = 0;
   int i, j;
   vertex_t bbmin,bbmax;
+  struct ply_records rec;
 
   bbmin.x = bbmin.y = bbmin.z = FLT_MAX;
   bbmax.x = bbmax.y = bbmax.z = -FLT_MAX;
 
+  rec.vtcs = vtcs;
+  rec.faces = NULL;
+  rec.n_vtcs = n_vtcs;
+  rec.prop = v_prop;
+  rec.n_prop = n_v_prop;
+  if ((!is_bin && parse_records(data, n_vtcs, parse_ply_vertex_record, &rec))
+      || (is_bin && n_vtcs > 0 &&
+          read_ply_vertices_bulk(vtcs, data, n_vtcs, swap_bytes, v_prop, 
+                                 n_v_prop, &rcode))) {
+    /* read in bulk, only the bounding box is left */
+    for (i=0; i<n_vtcs; i++) {
+      if (vtcs[i].x < bbmin.x) bbmin.x = vtcs[i].x;
+      if (vtcs[i].x > bbmax.x) bbmax.x = vtcs[i].x;
+      if (vtcs[i].y < bbmin.y) bbmin.y = vtcs[i].y;
+      if (vtcs[i].y > bbmax.y) bbmax.y = vtcs[i].y;
+      if (vtcs[i].z < bbmin.z) bbmin.z = vtcs[i].z;
+      if (vtcs[i].z > bbmax.z) bbmax.z = vtcs[i].z;
+    }
+    *bbox_min = bbmin;
+    *bbox_max = bbmax;
+    return rcode;
+  }
+
   for (i=0; i<n_vtcs && rcode>=0; i++) {
     for (j=0; j<n_v_prop && rcode>=0; j++) {
       switch (v_prop[j].prop) {
@@ -809,7 +1132,9 @@ int read_ply_tmesh(struct model **tmesh_ref, struct file_data *data)
             platform_endianness = -1;
           }
           swap_bytes = (file_endianness == platform_endianness)?0:1;
-          skip_ws_comm(data); /* find the first relevant byte */
+          /* the binary data starts right after the end of line */
+          while ((c = getc(data)) != EOF && c != '\n');
+          data->is_binary = 1;
         }
         
         /* read the vertices */
@@ -820,7 +1145,8 @@ int read_ply_tmesh(struct model **tmesh_ref, struct file_data *data)
                                       vertex_prop, n_vert_prop);
         
         /* read the faces */
-        rcode = read_ply_faces(tmesh->faces, data, is_bin,
+        if (rcode >= 0)
+          rcode = read_ply_faces(tmesh->faces, data, is_bin,
                                    tmesh->num_faces,
                                    tmesh->num_vert,
                                    swap_bytes,
@@ -53,6 +53,50 @@
 
 
 
+/* Context of the ASCII record parsers used with parse_records() */
+struct raw_records {
+  vertex_t *vtcs;
+  face_t *faces;
+  int n_vtcs;
+};
+
+/* Reads the ASCII face record 'idx' in memory, as read_raw_faces() does (see
+ * record_parser in model_in.h) */
+static int parse_raw_face_record(const unsigned char **p, 
+                                 const unsigned char *end,
+                                 const unsigned char *lim, int idx, void *ctx)
+{
+  const struct raw_records *r = (const struct raw_records*)ctx;
+  face_t *f = &(r->faces[idx]);
+
+  if (span_int_scanf(p, end, lim, &(f->f0)) != 1 ||
+      span_int_scanf(p, end, lim, &(f->f1)) != 1 ||
+      span_int_scanf(p, end, lim, &(f->f2)) != 1)
+    return MESH_CORRUPTED;
+  if (f->f0 < 0 || f->f0 >= r->n_vtcs ||
+      f->f1 < 0 || f->f1 >= r->n_vtcs ||
+      f->f2 < 0 || f->f2 >= r->n_vtcs)
+    return MESH_MODEL_ERR;
+  return 0;
+}
+
+/* Reads the ASCII vertex record 'idx' in memory, as read_raw_vertices() does
+ * (see record_parser in model_in.h) */
+static int parse_raw_vertex_record(const unsigned char **p, 
+                                   const unsigned char *end,
+                                   const unsigned char *lim, int idx, 
+                                   void *ctx)
+{
+  const struct raw_records *r = (const struct raw_records*)ctx;
+  vertex_t *v = &(r->vtcs[idx]);
+
+  if (span_float_scanf(p, end, lim, &(v->x)) != 1 ||
+      span_float_scanf(p, end, lim, &(v->y)) != 1 ||
+      span_float_scanf(p, end, lim, &(v->z)) != 1)
+    return MESH_CORRUPTED;
+  return 0;
+}
+
 /* Reads 'n_faces' triangular faces from the '*data' stream in raw ascii
  * format and stores them in the 'faces' array. The face's vertex indices are
  * checked for consistency with the number of vertices 'n_vtcs'. If 'use_bin'
@@ -63,7 +107,14 @@ static int read_raw_faces(face_t *faces, struct file_data *data, int use_bin,
 {
   int i;
   int vidx[3];
+  struct raw_records rec;
   
+  if (!use_bin) { /* try to read concurrently first */
+    rec.vtcs = NULL;
+    rec.faces = faces;
+    rec.n_vtcs = n_vtcs;
+    if (parse_records(data, n_faces, parse_raw_face_record, &rec)) return 0;
+  }
   for (i=0; i<n_faces; i++) {
     if (use_bin) {
       if (bin_read(vidx,sizeof(*vidx),3,data) != 3) return MESH_CORRUPTED;
@@ -139,14 +190,24 @@ static int read_raw_vertices(vertex_t *vtcs, struct file_data *data,
                              int use_bin, int n_vtcs,
                              vertex_t *bbox_min, vertex_t *bbox_max)
 {
-  int i;
+  int i, parsed;
   vertex_t bbmin,bbmax;
   float v[3];
+  struct raw_records rec;
 
   bbmin.x = bbmin.y = bbmin.z = FLT_MAX;
   bbmax.x = bbmax.y = bbmax.z = -FLT_MAX;
+  parsed = 0;
+  if (!use_bin) { /* try to read concurrently first */
+    rec.vtcs = vtcs;
+    rec.faces = NULL;
+    rec.n_vtcs = n_vtcs;
+    parsed = parse_records(data, n_vtcs, parse_raw_vertex_record, &rec);
+  }
   for (i=0; i<n_vtcs; i++) {
-    if (use_bin) {
+    if (parsed) {
+      /* already read, only the bounding box is left */
+    } else if (use_bin) {
       if (bin_read(v,sizeof(*v),3,data) != 3) return MESH_CORRUPTED;
       vtcs[i].x = v[0];
       vtcs[i].y = v[1];
@@ -0,0 +1,341 @@
+/*
+ * Reader for STL files, binary or ASCII.
+ *
+ * STL files store each triangle with its own copy of its three vertices.
+ * The copies are welded back into shared vertices (vertices with exactly
+ * the same coordinates are merged), so that the model is connected and the
+ * topology analysis sees the mesh the file describes. The facet normals are
+ * not read.
+ */
+
+#include <model_in.h>
+#include <stdint.h>
+#if defined(DONT_USE_ZLIB) && !defined(_WIN32)
+# include <sys/stat.h>
+#endif
+#ifdef DEBUG
+# include <debug_print.h>
+#endif
+
+/* Size of the binary header, and of each binary triangle record */
+#define STL_HEADER_SZ 80
+#define STL_RECORD_SZ 50
+/* Number of binary records checked for control bytes, see
+ * looks_like_binary_stl() */
+#define STL_SNIFF_RECORDS 8
+
+/* Returns 1 if the size of the '*data' file is known, and sets '*fsize' to
+ * it, or 0 if it is not (see is_binary_stl()). */
+static int stl_file_size(const struct file_data *data, size_t *fsize)
+{
+#if defined(DONT_USE_ZLIB) && !defined(_WIN32)
+  struct stat st;
+#endif
+
+  if (data->eof_reached) {
+    *fsize = (size_t)(data->nbytes-1);
+    return 1;
+  }
+#if defined(DONT_USE_ZLIB) && !defined(_WIN32)
+  /* only part of the file is in the block, ask for its size */
+  if (fstat(fileno((FILE*)data->f), &st) != 0 || !S_ISREG(st.st_mode))
+    return 0;
+  *fsize = (size_t)st.st_size;
+  return 1;
+#else
+  /* the size of a (possibly compressed) stream is not known */
+  return 0;
+#endif
+}
+
+/* see model_in.h */
+int is_binary_stl(const struct file_data *data)
+{
+  const unsigned char *p;
+  size_t n_tri, fsize;
+
+  if (data->nbytes < 1+STL_HEADER_SZ+4) return 0;
+  if (!stl_file_size(data, &fsize)) return 0;
+  p = &(data->block[1+STL_HEADER_SZ]);
+  n_tri = (size_t)p[0] | ((size_t)p[1]<<8) | ((size_t)p[2]<<16) |
+    ((size_t)p[3]<<24);
+  return fsize-STL_HEADER_SZ-4 == n_tri*STL_RECORD_SZ;
+}
+
+/* see model_in.h */
+int looks_like_binary_stl(const struct file_data *data)
+{
+  const unsigned char *p, *end;
+  size_t fsize;
+
+  if (data->nbytes < 1+STL_HEADER_SZ+4) return 0;
+  if (stl_file_size(data, &fsize)) return is_binary_stl(data);
+  /* look for the control bytes, which do not appear in text files (UTF-8
+   * or not), in the first records */
+  p = &(data->block[1+STL_HEADER_SZ+4]);
+  end = p+STL_SNIFF_RECORDS*STL_RECORD_SZ;
+  if (end > &(data->block[data->nbytes])) end = &(data->block[data->nbytes]);
+  for (; p < end; p++) {
+    if (*p < '\t' || (*p > '\r' && *p < ' ')) return 1;
+  }
+  return 0;
+}
+
+/* Returns 1 if the STL file whose start is in the block is an ASCII one:
+ * it starts with "solid" and its second line with "facet" or "endsolid"
+ * (binary files may also start with "solid"). */
+static int is_ascii_stl(const struct file_data *data)
+{
+  const unsigned char *p, *end;
+
+  p = &(data->block[data->pos]);
+  end = &(data->block[data->nbytes]);
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+  if (end-p < 5 || memcmp(p, "solid", 5) != 0) return 0;
+  p = (const unsigned char*)memchr(p, '\n', end-p);
+  if (p == NULL) return 0;
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+  return (end-p >= 5 && memcmp(p, "facet", 5) == 0) ||
+    (end-p >= 8 && memcmp(p, "endsolid", 8) == 0);
+}
+
+/* Returns 1 on big endian platforms and 0 on little endian ones */
+static int host_is_big_endian(void)
+{
+  uint32_t one = 1;
+  return *(uint8_t*)&one == 0;
+}
+
+/* Hash of the coordinates of a vertex, given as bit patterns */
+static uint32_t vertex_hash(const uint32_t *k)
+{
+  uint32_t h;
+
+  h = k[0]*0x9E3779B1u;
+  h = (h ^ (h>>15) ^ k[1])*0x85EBCA77u;
+  h = (h ^ (h>>13) ^ k[2])*0xC2B2AE3Du;
+  return h ^ (h>>16);
+}
+
+/* Welds the vertices of the 'n_faces' triangles whose nine coordinates
+ * (three vertices of x, y and z floats) start every 'stride' bytes from
+ * 'rec', with their bytes reversed if 'swap' is non-zero. The unique
+ * vertices (in order of first appearance) and the faces are stored in
+ * '*tmesh', along with the bounding box. Returns 0 on success or a negative
+ * error code. */
+static int weld_stl_vertices(struct model *tmesh, const unsigned char *rec,
+                             size_t stride, int n_faces, int swap)
+{
+  int *table, *fidx;
+  size_t cap, mask, slot, i;
+  int n_vtcs, k, j, v;
+  uint32_t key[3];
+  unsigned char b[12];
+  float xyz[3];
+  vertex_t *vtcs;
+  int vcap;
+
+  tmesh->faces = (face_t*)malloc(((size_t)n_faces+1)*sizeof(face_t));
+  vcap = (n_faces < SZ_INIT_DEF) ? SZ_INIT_DEF : n_faces;
+  tmesh->vertices = (vertex_t*)malloc((size_t)vcap*sizeof(vertex_t));
+  for (cap=1024; cap < 2*(size_t)vcap; cap*=2);
+  table = (int*)malloc(cap*sizeof(int));
+  if (tmesh->faces == NULL || tmesh->vertices == NULL || table == NULL) {
+    free(table);
+    return MESH_NO_MEM;
+  }
+  memset(table, 0xff, cap*sizeof(int)); /* all slots at -1 */
+  mask = cap-1;
+  n_vtcs = 0;
+
+  for (k=0; k<n_faces; k++, rec+=stride) {
+    fidx = (int*)&(tmesh->faces[k]);
+    for (j=0; j<3; j++) {
+      if (swap) {
+        for (v=0; v<12; v++) b[v] = rec[12*j+(v&~3)+3-(v&3)];
+        memcpy(xyz, b, sizeof(xyz));
+      } else {
+        memcpy(xyz, rec+12*j, sizeof(xyz));
+      }
+      for (v=0; v<3; v++) {
+        if (xyz[v] == 0) xyz[v] = 0; /* -0 and +0 are the same vertex */
+      }
+      memcpy(key, xyz, sizeof(key));
+      for (slot = vertex_hash(key)&mask; table[slot] >= 0; slot = (slot+1)&mask) {
+        if (memcmp(&(tmesh->vertices[table[slot]]), xyz, sizeof(xyz)) == 0)
+          break;
+      }
+      if (table[slot] < 0) { /* new vertex */
+        if (n_vtcs == vcap) {
+          tmesh->vertices = (vertex_t*)grow_array(tmesh->vertices,
+                                                  sizeof(vertex_t), &vcap, 0);
+          if (tmesh->vertices == NULL) {
+            free(table);
+            return MESH_NO_MEM;
+          }
+        }
+        memcpy(&(tmesh->vertices[n_vtcs]), xyz, sizeof(xyz));
+        table[slot] = n_vtcs++;
+        if (2*(size_t)n_vtcs > cap) { /* keep the table half empty */
+          free(table);
+          cap *= 2;
+          mask = cap-1;
+          table = (int*)malloc(cap*sizeof(int));
+          if (table == NULL) return MESH_NO_MEM;
+          memset(table, 0xff, cap*sizeof(int));
+          for (i=0; i<(size_t)n_vtcs; i++) {
+            memcpy(key, &(tmesh->vertices[i]), sizeof(key));
+            for (slot = vertex_hash(key)&mask; table[slot] >= 0;
+                 slot = (slot+1)&mask);
+            table[slot] = (int)i;
+          }
+        }
+      }
+      fidx[j] = table[slot];
+    }
+  }
+  free(table);
+  tmesh->num_faces = n_faces;
+  tmesh->num_vert = n_vtcs;
+
+  if (n_vtcs == 0) {
+    memset(tmesh->bBox, 0, sizeof(tmesh->bBox));
+  } else {
+    tmesh->bBox[0] = tmesh->bBox[1] = tmesh->vertices[0];
+    for (k=1; k<n_vtcs; k++) {
+      vtcs = &(tmesh->vertices[k]);
+      if (vtcs->x < tmesh->bBox[0].x) tmesh->bBox[0].x = vtcs->x;
+      if (vtcs->x > tmesh->bBox[1].x) tmesh->bBox[1].x = vtcs->x;
+      if (vtcs->y < tmesh->bBox[0].y) tmesh->bBox[0].y = vtcs->y;
+      if (vtcs->y > tmesh->bBox[1].y) tmesh->bBox[1].y = vtcs->y;
+      if (vtcs->z < tmesh->bBox[0].z) tmesh->bBox[0].z = vtcs->z;
+      if (vtcs->z > tmesh->bBox[1].z) tmesh->bBox[1].z = vtcs->z;
+    }
+  }
+  return 0;
+}
+
+/* Reads the triangles of a binary STL file. The records are welded where
+ * they are when the whole file is in memory, and are otherwise read in a
+ * single block first. */
+static int read_stl_binary(struct model *tmesh, struct file_data *data)
+{
+  unsigned char hdr[STL_HEADER_SZ+4];
+  unsigned char *buf;
+  const unsigned char *rec;
+  uint32_t n_tri;
+  size_t len;
+  int rcode;
+
+  if (bin_read(hdr, 1, sizeof(hdr), data) != sizeof(hdr))
+    return MESH_CORRUPTED;
+  n_tri = (uint32_t)hdr[STL_HEADER_SZ] |
+    ((uint32_t)hdr[STL_HEADER_SZ+1]<<8) |
+    ((uint32_t)hdr[STL_HEADER_SZ+2]<<16) |
+    ((uint32_t)hdr[STL_HEADER_SZ+3]<<24);
+  if (n_tri > (uint32_t)(INT_MAX/STL_RECORD_SZ)) return MESH_CORRUPTED;
+  len = (size_t)n_tri*STL_RECORD_SZ;
+
+  buf = NULL;
+  if (data->nbytes > data->pos && (size_t)(data->nbytes-data->pos) >= len) {
+    rec = &(data->block[data->pos]);
+    data->pos += (int)len;
+  } else {
+    if (data->eof_reached) return MESH_CORRUPTED;
+    buf = (unsigned char*)malloc(len+1);
+    if (buf == NULL) return MESH_NO_MEM;
+    if (bin_read(buf, 1, len, data) != len) {
+      free(buf);
+      return MESH_CORRUPTED;
+    }
+    rec = buf;
+  }
+  /* skip the facet normal; the records are little endian */
+  rcode = weld_stl_vertices(tmesh, rec+12, STL_RECORD_SZ, (int)n_tri,
+                            host_is_big_endian());
+  free(buf);
+  return rcode;
+}
+
+/* Reads the triangles of an ASCII STL file. All the solids in the file are
+ * read. */
+static int read_stl_ascii(struct model *tmesh, struct file_data *data)
+{
+  char stmp[MAX_WORD_LEN+1];
+  float *coords;
+  int len, n_coords, n_in_facet, c, rcode;
+
+  len = 0;
+  coords = (float*)grow_array(NULL, sizeof(float), &len, 0);
+  if (coords == NULL) return MESH_NO_MEM;
+  n_coords = 0;
+  n_in_facet = 0;
+  rcode = 0;
+  while (rcode >= 0 && skip_ws_comm(data) != EOF) {
+    if (string_scanf(data, stmp) != 1) {
+      rcode = MESH_CORRUPTED;
+    } else if (strcmp(stmp, "vertex") == 0) {
+      if (n_coords+3 > len) {
+        coords = (float*)grow_array(coords, sizeof(float), &len, 0);
+        if (coords == NULL) return MESH_NO_MEM;
+      }
+      if (float_scanf(data, &(coords[n_coords])) != 1 ||
+          float_scanf(data, &(coords[n_coords+1])) != 1 ||
+          float_scanf(data, &(coords[n_coords+2])) != 1) {
+        rcode = MESH_CORRUPTED;
+      }
+      n_coords += 3;
+      n_in_facet++;
+    } else if (strcmp(stmp, "endfacet") == 0) {
+      if (n_in_facet != 3) rcode = MESH_NOT_TRIAG;
+      n_in_facet = 0;
+    } else if (strcmp(stmp, "solid") == 0 || strcmp(stmp, "endsolid") == 0 ||
+               strcmp(stmp, "facet") == 0) { /* name or normal */
+      do {
+        c = getc(data);
+      } while (c != EOF && c != '\n' && c != '\r');
+    } else if (strcmp(stmp, "outer") != 0 && strcmp(stmp, "loop") != 0 &&
+               strcmp(stmp, "endloop") != 0) {
+      rcode = MESH_CORRUPTED;
+    }
+  }
+  if (rcode >= 0 && n_in_facet != 0) rcode = MESH_CORRUPTED;
+  if (rcode >= 0) {
+    rcode = weld_stl_vertices(tmesh, (const unsigned char*)coords,
+                              9*sizeof(float), n_coords/9, 0);
+  }
+  free(coords);
+  return rcode;
+}
+
+/* Reads a _triangular_ mesh from a STL file, binary or ASCII. The stream
+ * must be at the start of the file. The vertices shared by several
+ * triangles are welded (see weld_stl_vertices()). It returns the number of
+ * meshes read (i.e. 1) if successful, and a negative code if it failed. */
+int read_stl_tmesh(struct model **tmesh_ref, struct file_data *data)
+{
+  struct model *tmesh;
+  int c, rcode;
+
+  /* make sure the start of the file is in the block */
+  c = getc(data);
+  if (c == EOF) return MESH_CORRUPTED;
+  ungetc(c, data);
+
+  tmesh = (struct model*)calloc(1, sizeof(struct model));
+  if (tmesh == NULL) return MESH_NO_MEM;
+  if (!is_binary_stl(data) && is_ascii_stl(data)) {
+    rcode = read_stl_ascii(tmesh, data);
+  } else {
+    data->is_binary = 1;
+    rcode = read_stl_binary(tmesh, data);
+  }
+
+  if (rcode >= 0) {
+    *tmesh_ref = tmesh;
+    rcode = 1;
+  } else {
+    __free_raw_model(tmesh);
+  }
+  return rcode;
+}
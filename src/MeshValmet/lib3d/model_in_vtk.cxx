@@ -0,0 +1,1129 @@
+/*
+ * Readers for the VTK mesh file formats: legacy POLYDATA files (".vtk",
+ * ASCII or binary, with the 4.x cell lists or the 5.x offsets and
+ * connectivity arrays) and XML PolyData files (".vtp", with ascii, base64
+ * or appended raw/base64 arrays, zlib compressed if zlib is used).
+ *
+ * Only the points and the polygons and triangle strips are read. Polygons
+ * are triangulated as fans around their first point and strips are split
+ * in triangles, as VTK_to_MeshValmet() does; vertex and line cells, point
+ * and cell data are skipped. Variants that can not be read (e.g. string
+ * field data or unsupported compressors) give MESH_BAD_FF, so that the
+ * caller can fall back to the VTK readers.
+ */
+
+#include <model_in.h>
+#include <stdint.h>
+#include <ctype.h>
+#ifdef DEBUG
+# include <debug_print.h>
+#endif
+
+/* --------------------------------------------------------------------------
+   DATA TYPES
+   -------------------------------------------------------------------------- */
+
+/* Data types of the VTK arrays that are supported */
+enum vtk_types { vtk_not_valid=-1,
+                 vtk_int8, vtk_uint8,
+                 vtk_int16, vtk_uint16,
+                 vtk_int32, vtk_uint32,
+                 vtk_int64, vtk_uint64,
+                 vtk_float32, vtk_float64 };
+
+/* Sizes of each type (in bytes) */
+static const int vtk_sizes[] = { 1, 1, 2, 2, 4, 4, 8, 8, 4, 8 };
+
+/* Returns the type named 's', either in a legacy file (e.g. "float",
+ * "vtktypeint64") or in a XML file (e.g. "Float32"), or vtk_not_valid. */
+static int vtk_type(const char *s)
+{
+  static const char *legacy_names[] = {
+    "char", "unsigned_char", "short", "unsigned_short", "int", "unsigned_int",
+    "vtktypeint64", "vtktypeuint64", "float", "double"
+  };
+  static const char *xml_names[] = {
+    "Int8", "UInt8", "Int16", "UInt16", "Int32", "UInt32", "Int64", "UInt64",
+    "Float32", "Float64"
+  };
+  int i;
+
+  for (i=0; i<(int)(sizeof(xml_names)/sizeof(xml_names[0])); i++) {
+    if (strcmp(s, legacy_names[i]) == 0 || strcmp(s, xml_names[i]) == 0)
+      return i;
+  }
+  if (strcmp(s, "vtktypeint32") == 0) return vtk_int32;
+  if (strcmp(s, "vtktypeuint32") == 0) return vtk_uint32;
+  return vtk_not_valid;
+}
+
+/* Returns 1 on big endian platforms and 0 on little endian ones */
+static int host_is_big_endian(void)
+{
+  uint32_t one = 1;
+  return *(uint8_t*)&one == 0;
+}
+
+/* Returns the value of type 'type' stored at 'p' (with its bytes reversed
+ * if 'swap' is non-zero) */
+static double vtk_value(const unsigned char *p, int type, int swap)
+{
+  unsigned char b[8];
+  int i, sz;
+  int8_t i8; uint8_t u8; int16_t i16; uint16_t u16; int32_t i32;
+  uint32_t u32; int64_t i64; uint64_t u64; float f; double d;
+
+  sz = vtk_sizes[type];
+  for (i=0; i<sz; i++) b[i] = swap ? p[sz-1-i] : p[i];
+  switch (type) {
+  case vtk_int8: memcpy(&i8, b, 1); return i8;
+  case vtk_uint8: memcpy(&u8, b, 1); return u8;
+  case vtk_int16: memcpy(&i16, b, 2); return i16;
+  case vtk_uint16: memcpy(&u16, b, 2); return u16;
+  case vtk_int32: memcpy(&i32, b, 4); return i32;
+  case vtk_uint32: memcpy(&u32, b, 4); return u32;
+  case vtk_int64: memcpy(&i64, b, 8); return (double)i64;
+  case vtk_uint64: memcpy(&u64, b, 8); return (double)u64;
+  case vtk_float32: memcpy(&f, b, 4); return f;
+  default: memcpy(&d, b, 8); return d;
+  }
+}
+
+/* Converts the 'n' values of type 'type' at 'src' to floats in 'dst' */
+static void vtk_to_floats(const unsigned char *src, int type, int swap,
+                          size_t n, float *dst)
+{
+  size_t i;
+  unsigned char *b;
+  unsigned char tmp;
+
+  if (type == vtk_float32) {
+    memcpy(dst, src, n*sizeof(float));
+    if (swap) {
+      for (i=0, b=(unsigned char*)dst; i<n; i++, b+=4) {
+        tmp = b[0]; b[0] = b[3]; b[3] = tmp;
+        tmp = b[1]; b[1] = b[2]; b[2] = tmp;
+      }
+    }
+  } else {
+    for (i=0; i<n; i++, src+=vtk_sizes[type])
+      dst[i] = (float)vtk_value(src, type, swap);
+  }
+}
+
+/* Converts the 'n' values of integer type 'type' at 'src' to ints in
+ * 'dst'. Returns 0 on success, or MESH_MODEL_ERR if a value is negative or
+ * does not fit in an int. */
+static int vtk_to_ints(const unsigned char *src, int type, int swap,
+                       size_t n, int *dst)
+{
+  size_t i;
+  double v;
+
+  for (i=0; i<n; i++, src+=vtk_sizes[type]) {
+    v = vtk_value(src, type, swap);
+    if (v < 0 || v > INT_MAX) return MESH_MODEL_ERR;
+    dst[i] = (int)v;
+  }
+  return 0;
+}
+
+/* --------------------------------------------------------------------------
+   TRIANGULATION
+   -------------------------------------------------------------------------- */
+
+/* Appends to '*tmesh' the triangles of the 'n_cells' cells whose point ids
+ * are conn[offs[i]] to conn[offs[i+1]-1]. The ids refer to the 'n_pts'
+ * points starting at vertex 'base' of '*tmesh'. Polygons are split in fans
+ * around their first point, and if 'strips' is non-zero the cells are
+ * triangle strips: every other triangle is flipped to keep the
+ * orientation, and the degenerate triangles joining strips are
+ * skipped. Cells with less than 3 points are ignored. Returns 0 on success
+ * or a negative error code. */
+static int add_vtk_cells(struct model *tmesh, int base, int n_pts,
+                         const int *conn, int conn_len, const int *offs,
+                         int n_cells, int strips)
+{
+  int i, j, n_tri, a, b, c;
+  face_t *faces;
+
+  n_tri = 0;
+  for (i=0; i<n_cells; i++) {
+    if (offs[i] < 0 || offs[i] > offs[i+1] || offs[i+1] > conn_len)
+      return MESH_MODEL_ERR;
+    if (offs[i+1]-offs[i] > 2) {
+      if (n_tri > INT_MAX-(offs[i+1]-offs[i])) return MESH_NO_MEM;
+      n_tri += offs[i+1]-offs[i]-2;
+    }
+  }
+  for (i=0; i<conn_len; i++) {
+    if (conn[i] < 0 || conn[i] >= n_pts) return MESH_MODEL_ERR;
+  }
+  if (n_tri == 0) return 0;
+
+  faces = (face_t*)realloc(tmesh->faces,
+                           ((size_t)tmesh->num_faces+n_tri)*sizeof(face_t));
+  if (faces == NULL) return MESH_NO_MEM;
+  tmesh->faces = faces;
+  faces += tmesh->num_faces;
+
+  for (i=0; i<n_cells; i++) {
+    for (j=offs[i]+2; j<offs[i+1]; j++) {
+      if (!strips) {
+        a = conn[offs[i]];
+        b = conn[j-1];
+        c = conn[j];
+      } else {
+        a = conn[j-2];
+        b = conn[j-1];
+        c = conn[j];
+        if (a == b || b == c || a == c) continue;
+        if ((j-offs[i])%2 == 1) { /* odd triangle of the strip */
+          a = conn[j-1];
+          b = conn[j-2];
+        }
+      }
+      faces->f0 = base+a;
+      faces->f1 = base+b;
+      faces->f2 = base+c;
+      faces++;
+      tmesh->num_faces++;
+    }
+  }
+  return 0;
+}
+
+/* Sets the bounding box of '*tmesh' from its vertices */
+static void set_vtk_bbox(struct model *tmesh)
+{
+  int i;
+  vertex_t *v;
+
+  if (tmesh->num_vert == 0) {
+    memset(tmesh->bBox, 0, sizeof(tmesh->bBox));
+    return;
+  }
+  tmesh->bBox[0] = tmesh->vertices[0];
+  tmesh->bBox[1] = tmesh->vertices[0];
+  for (i=1; i<tmesh->num_vert; i++) {
+    v = &(tmesh->vertices[i]);
+    if (v->x < tmesh->bBox[0].x) tmesh->bBox[0].x = v->x;
+    if (v->x > tmesh->bBox[1].x) tmesh->bBox[1].x = v->x;
+    if (v->y < tmesh->bBox[0].y) tmesh->bBox[0].y = v->y;
+    if (v->y > tmesh->bBox[1].y) tmesh->bBox[1].y = v->y;
+    if (v->z < tmesh->bBox[0].z) tmesh->bBox[0].z = v->z;
+    if (v->z > tmesh->bBox[1].z) tmesh->bBox[1].z = v->z;
+  }
+}
+
+/* --------------------------------------------------------------------------
+   LEGACY VTK FILES
+   -------------------------------------------------------------------------- */
+
+/* Reads a word as string_scanf() does, after skipping whitespace, and
+ * converts it to lower case (legacy keywords are case insensitive) */
+static int vtk_keyword(struct file_data *data, char *out)
+{
+  char *s;
+
+  if (skip_ws_comm(data) == EOF || string_scanf(data, out) != 1)
+    return 0;
+  for (s=out; *s != '\0'; s++) *s = (char)tolower((unsigned char)*s);
+  return 1;
+}
+
+/* Skips the rest of the current line, including the end of line. Returns
+ * the last character read. */
+static int vtk_skip_line(struct file_data *data)
+{
+  int c;
+
+  do {
+    c = getc(data);
+  } while (c != '\n' && c != EOF);
+  return c;
+}
+
+/* Reads the 'n' values of type 'type' that follow in the '*data' stream, as
+ * text if 'is_bin' is zero or as big endian binary data otherwise. If
+ * 'fout' is not NULL they are stored as floats in 'fout', else if 'iout' is
+ * not NULL they are stored as ints in 'iout' (see vtk_to_ints()), and
+ * otherwise they are skipped. Returns 0 on success or a negative error
+ * code. */
+static int read_vtk_values(struct file_data *data, int is_bin, int type,
+                           size_t n, float *fout, int *iout)
+{
+  unsigned char *buf;
+  size_t i, k, sz;
+  float f;
+  int rcode;
+
+  if (!is_bin) {
+    for (i=0; i<n; i++) {
+      if (iout != NULL) {
+        if (int_scanf(data, &(iout[i])) != 1) return MESH_CORRUPTED;
+        if (iout[i] < 0) return MESH_MODEL_ERR;
+      } else {
+        if (float_scanf(data, &f) != 1) return MESH_CORRUPTED;
+        if (fout != NULL) fout[i] = f;
+      }
+    }
+    return 0;
+  }
+
+  /* Binary data starts after the end of the keyword line */
+  if (vtk_skip_line(data) == EOF) return MESH_CORRUPTED;
+  sz = (size_t)vtk_sizes[type];
+  if (fout != NULL && type == vtk_float32) { /* read in place */
+    if (bin_read(fout, sz, n, data) != n) return MESH_CORRUPTED;
+    if (!host_is_big_endian())
+      vtk_to_floats((unsigned char*)fout, type, 1, n, fout);
+    return 0;
+  }
+  buf = (unsigned char*)malloc(SZ_INIT_DEF*sz);
+  if (buf == NULL) return MESH_NO_MEM;
+  rcode = 0;
+  for (i=0; i<n && rcode == 0; i+=k) {
+    k = (n-i < SZ_INIT_DEF) ? n-i : SZ_INIT_DEF;
+    if (bin_read(buf, sz, k, data) != k) {
+      rcode = MESH_CORRUPTED;
+    } else if (fout != NULL) {
+      vtk_to_floats(buf, type, !host_is_big_endian(), k, fout+i);
+    } else if (iout != NULL) {
+      rcode = vtk_to_ints(buf, type, !host_is_big_endian(), k, iout+i);
+    }
+  }
+  free(buf);
+  return rcode;
+}
+
+/* Reads the type name ending the current keyword line, and checks that it
+ * is a supported type (an integer one if 'want_int' is non-zero). Returns
+ * the type or a negative error code. */
+static int read_vtk_type(struct file_data *data, int want_int)
+{
+  char stmp[MAX_WORD_LEN+1];
+  int type;
+
+  if (skip_ws_comm(data) == EOF || string_scanf(data, stmp) != 1)
+    return MESH_CORRUPTED;
+  type = vtk_type(stmp);
+  if (type == vtk_not_valid || (want_int && type >= vtk_float32))
+    return MESH_BAD_FF;
+  return type;
+}
+
+/* Reads the cells of a VERTICES, LINES, POLYGONS or TRIANGLE_STRIPS
+ * section, whose keyword has been read. Both the 4.x layout (a list with
+ * the number of points of each cell followed by its point ids) and the 5.x
+ * layout (OFFSETS and CONNECTIVITY arrays) are read. The point ids are
+ * returned in the new '*conn' array ('*conn_len' ids) and the offsets of
+ * the '*n_cells' cells in the new '*offs' array ('*n_cells'+1
+ * values). Returns 0 on success or a negative error code. */
+static int read_vtk_cells(struct file_data *data, int is_bin, int **conn,
+                          int *conn_len, int **offs, int *n_cells)
+{
+  char stmp[MAX_WORD_LEN+1];
+  int n, size, i, j, k, c, type, rcode;
+  int *list, *o;
+
+  *conn = NULL;
+  *offs = NULL;
+  if (int_scanf(data, &n) != 1 || int_scanf(data, &size) != 1)
+    return MESH_CORRUPTED;
+  if (n < 0 || size < 0) return MESH_MODEL_ERR;
+
+  /* Peek at the next line to find the layout */
+  if (is_bin) {
+    if (vtk_skip_line(data) == EOF) return MESH_CORRUPTED;
+    c = getc(data);
+  } else {
+    c = skip_ws_comm(data);
+    if (c != EOF) c = getc(data);
+  }
+  if (c == EOF) return (n == 0 && size == 0) ? 0 : MESH_CORRUPTED;
+  ungetc(c, data);
+
+  if (c == 'O' || c == 'o') { /* 5.x: "OFFSETS type" and "CONNECTIVITY type" */
+    o = (int*)malloc(((size_t)n+1)*sizeof(int));
+    list = (int*)malloc(((size_t)size+1)*sizeof(int));
+    *offs = o;
+    *conn = list;
+    if (o == NULL || list == NULL) return MESH_NO_MEM;
+    if (!vtk_keyword(data, stmp) || strcmp(stmp, "offsets") != 0)
+      return MESH_CORRUPTED;
+    if ((type = read_vtk_type(data, 1)) < 0) return type;
+    if ((rcode = read_vtk_values(data, is_bin, type, n, NULL, o)) < 0)
+      return rcode;
+    if (!vtk_keyword(data, stmp) || strcmp(stmp, "connectivity") != 0)
+      return MESH_CORRUPTED;
+    if ((type = read_vtk_type(data, 1)) < 0) return type;
+    if ((rcode = read_vtk_values(data, is_bin, type, size, NULL, list)) < 0)
+      return rcode;
+    *n_cells = (n > 0) ? n-1 : 0;
+    if (n == 0) o[0] = 0;
+    *conn_len = size;
+    return 0;
+  }
+
+  /* 4.x: the list is compacted in place into the point ids */
+  list = (int*)malloc(((size_t)size+1)*sizeof(int));
+  o = (int*)malloc(((size_t)n+1)*sizeof(int));
+  *conn = list;
+  *offs = o;
+  if (o == NULL || list == NULL) return MESH_NO_MEM;
+  if (is_bin) {
+    if (bin_read(list, sizeof(int), size, data) != (size_t)size)
+      return MESH_CORRUPTED;
+    if (!host_is_big_endian() &&
+        vtk_to_ints((unsigned char*)list, vtk_int32, 1, size, list) < 0)
+      return MESH_MODEL_ERR;
+  } else if ((rcode = read_vtk_values(data, 0, vtk_int32, size, NULL,
+                                      list)) < 0) {
+    return rcode;
+  }
+  for (i=0, j=0, k=0; i<n; i++) {
+    if (j >= size || list[j] < 0 || list[j] > size-j-1) return MESH_MODEL_ERR;
+    c = list[j];
+    o[i] = k;
+    memmove(&(list[k]), &(list[j+1]), c*sizeof(int));
+    k += c;
+    j += c+1;
+  }
+  o[n] = k;
+  *n_cells = n;
+  *conn_len = k;
+  return 0;
+}
+
+/* Skips a METADATA section (up to the next empty line) */
+static int skip_vtk_metadata(struct file_data *data)
+{
+  int c, len;
+
+  if (vtk_skip_line(data) == EOF) return 0;
+  do {
+    len = 0;
+    while ((c = getc(data)) != EOF && c != '\n') {
+      if (c != '\r' && c != ' ' && c != '\t') len++;
+    }
+  } while (c != EOF && len > 0);
+  return 0;
+}
+
+/* Skips a FIELD section, whose keyword has been read */
+static int skip_vtk_field(struct file_data *data, int is_bin)
+{
+  char stmp[MAX_WORD_LEN+1];
+  int n_arrays, n_comp, n_tuples, type, i, rcode;
+
+  if (!vtk_keyword(data, stmp) || int_scanf(data, &n_arrays) != 1)
+    return MESH_CORRUPTED;
+  for (i=0; i<n_arrays; i++) {
+    if (!vtk_keyword(data, stmp)) return MESH_CORRUPTED;
+    if (strcmp(stmp, "metadata") == 0) { /* belongs to the previous array */
+      skip_vtk_metadata(data);
+      i--;
+      continue;
+    }
+    if (strcmp(stmp, "null_array") == 0) continue;
+    if (int_scanf(data, &n_comp) != 1 || int_scanf(data, &n_tuples) != 1)
+      return MESH_CORRUPTED;
+    if ((type = read_vtk_type(data, 0)) < 0) return type;
+    rcode = read_vtk_values(data, is_bin, type, (size_t)n_comp*n_tuples,
+                            NULL, NULL);
+    if (rcode < 0) return rcode;
+  }
+  return 0;
+}
+
+/* Reads a _triangular_ mesh from a legacy VTK POLYDATA file. The stream
+ * must be at the start of the file. Returns the number of meshes read
+ * (i.e. 1) if successful, and a negative code if it failed. */
+int read_vtk_tmesh(struct model **tmesh_ref, struct file_data *data)
+{
+  char stmp[MAX_WORD_LEN+1];
+  struct model *tmesh;
+  int is_bin, n, type, rcode, done, c, i;
+  int *conn, *offs, conn_len, n_cells;
+
+  /* Header: version line, title line, file type and dataset type */
+  i = 0;
+  while ((c = getc(data)) != EOF && c != '\n') {
+    if (i < MAX_WORD_LEN) stmp[i++] = (char)c;
+  }
+  stmp[i] = '\0';
+  if (c == EOF || strncmp(stmp, "# vtk DataFile", 14) != 0)
+    return MESH_CORRUPTED;
+  if (vtk_skip_line(data) == EOF || !vtk_keyword(data, stmp))
+    return MESH_CORRUPTED;
+  if (strcmp(stmp, "ascii") == 0)
+    is_bin = 0;
+  else if (strcmp(stmp, "binary") == 0)
+    is_bin = 1;
+  else
+    return MESH_CORRUPTED;
+  if (!vtk_keyword(data, stmp) || strcmp(stmp, "dataset") != 0 ||
+      !vtk_keyword(data, stmp))
+    return MESH_CORRUPTED;
+  if (strcmp(stmp, "polydata") != 0)
+    return MESH_BAD_FF;
+
+  tmesh = (struct model*)calloc(1, sizeof(struct model));
+  if (tmesh == NULL) return MESH_NO_MEM;
+  rcode = 0;
+  done = 0;
+  while (rcode >= 0 && !done && vtk_keyword(data, stmp)) {
+    conn = offs = NULL;
+    if (strcmp(stmp, "points") == 0) {
+      if (tmesh->vertices != NULL || int_scanf(data, &n) != 1 || n < 0) {
+        rcode = MESH_CORRUPTED;
+      } else if ((type = read_vtk_type(data, 0)) < 0) {
+        rcode = type;
+      } else {
+        tmesh->vertices = (vertex_t*)malloc(((size_t)n+1)*sizeof(vertex_t));
+        if (tmesh->vertices == NULL) {
+          rcode = MESH_NO_MEM;
+        } else {
+          tmesh->num_vert = n;
+          rcode = read_vtk_values(data, is_bin, type, 3*(size_t)n,
+                                  (float*)tmesh->vertices, NULL);
+        }
+      }
+    } else if (strcmp(stmp, "vertices") == 0 || strcmp(stmp, "lines") == 0) {
+      rcode = read_vtk_cells(data, is_bin, &conn, &conn_len, &offs, &n_cells);
+    } else if (strcmp(stmp, "polygons") == 0 ||
+               strcmp(stmp, "triangle_strips") == 0) {
+      rcode = read_vtk_cells(data, is_bin, &conn, &conn_len, &offs, &n_cells);
+      if (rcode >= 0) {
+        rcode = add_vtk_cells(tmesh, 0, tmesh->num_vert, conn, conn_len, offs,
+                              n_cells, stmp[0] == 't');
+      }
+    } else if (strcmp(stmp, "metadata") == 0) {
+      rcode = skip_vtk_metadata(data);
+    } else if (strcmp(stmp, "field") == 0) {
+      rcode = skip_vtk_field(data, is_bin);
+    } else if (strcmp(stmp, "point_data") == 0 ||
+               strcmp(stmp, "cell_data") == 0) {
+      done = 1; /* the attributes are not read */
+    } else {
+      rcode = MESH_BAD_FF;
+    }
+    free(conn);
+    free(offs);
+  }
+
+  if (rcode >= 0) {
+    set_vtk_bbox(tmesh);
+    *tmesh_ref = tmesh;
+    rcode = 1;
+  } else {
+    __free_raw_model(tmesh);
+  }
+  return rcode;
+}
+
+/* --------------------------------------------------------------------------
+   XML VTK FILES
+   -------------------------------------------------------------------------- */
+
+/* A XML PolyData file held in memory */
+struct vtp_file {
+  const unsigned char *end;     /* end of the XML elements */
+  const unsigned char *lim;     /* see span_int_scanf() */
+  const unsigned char *app;     /* start of the appended data, or NULL */
+  const unsigned char *app_end; /* end of the appended data */
+  int app_base64;               /* non-zero if the appended data is base64 */
+  int swap;                     /* non-zero if the byte order is not the
+                                 * one of the platform */
+  int header_type;              /* type of the binary array headers */
+  int compressed;               /* non-zero if the binary arrays are zlib
+                                 * compressed */
+};
+
+/* Returns the first occurrence of 's' in [p,end), or NULL */
+static const unsigned char *find_str(const unsigned char *p,
+                                     const unsigned char *end, const char *s)
+{
+  size_t n;
+
+  n = strlen(s);
+  while (p < end && (size_t)(end-p) >= n) {
+    p = (const unsigned char*)memchr(p, s[0], (end-p)-n+1);
+    if (p == NULL) return NULL;
+    if (memcmp(p, s, n) == 0) return p;
+    p++;
+  }
+  return NULL;
+}
+
+/* Returns the start of the next tag of element 'name' in [p,end), setting
+ * '*tag_end' to its closing '>', or NULL if there is none */
+static const unsigned char *find_tag(const unsigned char *p,
+                                     const unsigned char *end,
+                                     const char *name,
+                                     const unsigned char **tag_end)
+{
+  size_t n;
+  const unsigned char *t;
+
+  n = strlen(name);
+  while (p < end &&
+         (p = (const unsigned char*)memchr(p, '<', end-p)) != NULL) {
+    p++;
+    if ((size_t)(end-p) > n && memcmp(p, name, n) == 0 &&
+        (isspace(p[n]) || p[n] == '>' || p[n] == '/')) {
+      t = (const unsigned char*)memchr(p, '>', end-p);
+      if (t == NULL) return NULL;
+      *tag_end = t;
+      return p-1;
+    }
+  }
+  return NULL;
+}
+
+/* Copies the value of attribute 'name' of the tag [tag,tag_end) into 'val'
+ * (of 'len' bytes, truncating it if needed). Returns 1 if the attribute is
+ * found and 0 otherwise. */
+static int xml_attr(const unsigned char *tag, const unsigned char *tag_end,
+                    const char *name, char *val, size_t len)
+{
+  const unsigned char *p, *q;
+  unsigned char quote;
+  size_t n, i;
+
+  n = strlen(name);
+  for (p=tag+1; (p = find_str(p, tag_end, name)) != NULL; p+=n) {
+    if (!isspace(p[-1])) continue;
+    for (q=p+n; q<tag_end && isspace(*q); q++);
+    if (q == tag_end || *q != '=') continue;
+    for (q++; q<tag_end && isspace(*q); q++);
+    if (q == tag_end || (*q != '"' && *q != '\'')) continue;
+    quote = *q++;
+    for (i=0; q<tag_end && *q != quote && i+1<len; i++) val[i] = (char)*q++;
+    val[i] = '\0';
+    return 1;
+  }
+  return 0;
+}
+
+/* Reads the non-negative int attribute 'name' of the tag [tag,tag_end) in
+ * '*out' (0 if the attribute is absent). Returns 0 on success or
+ * MESH_CORRUPTED. */
+static int xml_int_attr(const unsigned char *tag, const unsigned char *tag_end,
+                        const char *name, int *out)
+{
+  char stmp[MAX_WORD_LEN+1];
+  char *eptr;
+  long v;
+
+  *out = 0;
+  if (!xml_attr(tag, tag_end, name, stmp, sizeof(stmp))) return 0;
+  v = strtol(stmp, &eptr, 10);
+  if (eptr == stmp || v < 0 || v > INT_MAX) return MESH_CORRUPTED;
+  *out = (int)v;
+  return 0;
+}
+
+/* Returns the value of base64 digit 'c', or -1 */
+static int b64_digit(int c)
+{
+  if (c >= 'A' && c <= 'Z') return c-'A';
+  if (c >= 'a' && c <= 'z') return c-'a'+26;
+  if (c >= '0' && c <= '9') return c-'0'+52;
+  if (c == '+') return 62;
+  if (c == '/') return 63;
+  return -1;
+}
+
+/* Decodes at most 'n_groups' groups of 4 base64 digits from '*p' (up to
+ * 'end', whitespace is skipped) into 'out', and moves '*p' past them. A
+ * padded group ends the decoding. Returns the number of bytes decoded. */
+static size_t b64_decode(const unsigned char **p, const unsigned char *end,
+                         unsigned char *out, size_t n_groups)
+{
+  const unsigned char *s;
+  size_t n, g;
+  int d[4], k;
+
+  s = *p;
+  n = 0;
+  for (g=0; g<n_groups; g++) {
+    for (k=0; k<4; k++) {
+      while (s < end && isspace(*s)) s++;
+      if (s == end) break;
+      if (*s == '=' && k >= 2) {
+        d[k] = -2;
+      } else if ((d[k] = b64_digit(*s)) < 0) {
+        break;
+      }
+      s++;
+    }
+    if (k < 4 || d[1] < 0) break;
+    out[n++] = (unsigned char)((d[0]<<2)|(d[1]>>4));
+    if (d[2] == -2) break;
+    out[n++] = (unsigned char)(((d[1]&0xf)<<4)|(d[2]>>2));
+    if (d[3] == -2) break;
+    out[n++] = (unsigned char)(((d[2]&0x3)<<6)|d[3]);
+  }
+  *p = s;
+  return n;
+}
+
+/* Returns the bytes of the binary array whose data (including its header)
+ * starts at 'p' and ends before 'end', base64 encoded if 'b64' is non-zero,
+ * and sets '*len' to their number. Data that had to be decoded or
+ * uncompressed is returned in the new '*buf' array, which must be freed,
+ * while raw data is returned in place ('*buf' is NULL). On error NULL is
+ * returned and '*rcode' is set. */
+static const unsigned char *vtp_payload(const struct vtp_file *vf,
+                                        const unsigned char *p,
+                                        const unsigned char *end, int b64,
+                                        size_t *len, unsigned char **buf,
+                                        int *rcode)
+{
+  unsigned char hdr[24];
+  const unsigned char *q;
+  size_t hs, n;
+#ifndef DONT_USE_ZLIB
+  unsigned char *sizes, *cbuf;
+  const unsigned char *src;
+  size_t nb, bs, last, i, c_total, c_off, u_len;
+  uLongf dlen;
+#endif
+
+  *buf = NULL;
+  *rcode = MESH_CORRUPTED;
+  hs = (size_t)vtk_sizes[vf->header_type];
+  q = p;
+  if (!vf->compressed) { /* header: number of bytes */
+    if (b64) {
+      if (b64_decode(&q, end, hdr, (hs+2)/3) < hs) return NULL;
+    } else {
+      if ((size_t)(end-p) < hs) return NULL;
+      memcpy(hdr, p, hs);
+    }
+    n = (size_t)vtk_value(hdr, vf->header_type, vf->swap);
+    if (n > (size_t)(end-p)) return NULL;
+    if (!b64) {
+      if (n > (size_t)(end-p)-hs) return NULL;
+      *len = n;
+      return p+hs;
+    }
+    *buf = (unsigned char*)malloc(hs+n+3);
+    if (*buf == NULL) {
+      *rcode = MESH_NO_MEM;
+      return NULL;
+    }
+    q = p;
+    if (b64_decode(&q, end, *buf, (hs+n+2)/3) < hs+n) {
+      free(*buf);
+      *buf = NULL;
+      return NULL;
+    }
+    *len = n;
+    return *buf+hs;
+  }
+
+#ifndef DONT_USE_ZLIB
+  /* header: number of blocks, block size, last block size and compressed
+   * size of each block. In base64 the header and the blocks are encoded
+   * separately. */
+  if (b64) {
+    if (b64_decode(&q, end, hdr, hs) < 3*hs) return NULL;
+  } else {
+    if ((size_t)(end-q) < 3*hs) return NULL;
+    memcpy(hdr, q, 3*hs);
+    q += 3*hs;
+  }
+  nb = (size_t)vtk_value(hdr, vf->header_type, vf->swap);
+  bs = (size_t)vtk_value(hdr+hs, vf->header_type, vf->swap);
+  last = (size_t)vtk_value(hdr+2*hs, vf->header_type, vf->swap);
+  if (nb > (size_t)(end-q)/hs || (nb > 0 && bs == 0) || last > bs)
+    return NULL;
+  sizes = (unsigned char*)malloc(nb*hs+3);
+  if (sizes == NULL) {
+    *rcode = MESH_NO_MEM;
+    return NULL;
+  }
+  if (b64) {
+    if (b64_decode(&q, end, sizes, (nb*hs+2)/3) < nb*hs) {
+      free(sizes);
+      return NULL;
+    }
+  } else {
+    memcpy(sizes, q, nb*hs);
+    q += nb*hs;
+  }
+  c_total = 0;
+  for (i=0; i<nb; i++) {
+    c_total += (size_t)vtk_value(sizes+i*hs, vf->header_type, vf->swap);
+    if (c_total > (size_t)(end-q)) {
+      free(sizes);
+      return NULL;
+    }
+  }
+  u_len = (nb == 0) ? 0 : (nb-1)*bs + (last > 0 ? last : bs);
+
+  cbuf = NULL;
+  src = q;
+  if (b64) {
+    cbuf = (unsigned char*)malloc(c_total+3);
+    if (cbuf == NULL) {
+      free(sizes);
+      *rcode = MESH_NO_MEM;
+      return NULL;
+    }
+    if (b64_decode(&q, end, cbuf, (c_total+2)/3) < c_total) {
+      free(cbuf);
+      free(sizes);
+      return NULL;
+    }
+    src = cbuf;
+  }
+  *buf = (unsigned char*)malloc(u_len+1);
+  if (*buf == NULL) {
+    free(cbuf);
+    free(sizes);
+    *rcode = MESH_NO_MEM;
+    return NULL;
+  }
+  c_off = 0;
+  for (i=0; i<nb; i++) {
+    n = (size_t)vtk_value(sizes+i*hs, vf->header_type, vf->swap);
+    dlen = (uLongf)((i == nb-1 && last > 0) ? last : bs);
+    if (uncompress(*buf+i*bs, &dlen, src+c_off, (uLong)n) != Z_OK ||
+        dlen != (uLongf)((i == nb-1 && last > 0) ? last : bs)) {
+      free(*buf);
+      *buf = NULL;
+      break;
+    }
+    c_off += n;
+  }
+  free(cbuf);
+  free(sizes);
+  if (*buf == NULL) return NULL;
+  *len = u_len;
+  return *buf;
+#else
+  *rcode = MESH_BAD_FF; /* compressed data needs zlib */
+  return NULL;
+#endif
+}
+
+/* Reads the DataArray element whose tag is [tag,tag_end] as floats (if
+ * 'as_float' is non-zero) or as non-negative ints, in the new '*out' array
+ * of '*n' values. Returns 0 on success or a negative error code. */
+static int vtp_read_array(const struct vtp_file *vf, const unsigned char *tag,
+                          const unsigned char *tag_end, int as_float,
+                          void **out, size_t *n)
+{
+  char stmp[MAX_WORD_LEN+1];
+  const unsigned char *p, *end, *bytes;
+  unsigned char *buf;
+  size_t cap, len, i;
+  int type, rcode, b64;
+  float f;
+  int v;
+  char *eptr;
+  unsigned long offset;
+  void *tmp;
+
+  *out = NULL;
+  *n = 0;
+  if (!xml_attr(tag, tag_end, "type", stmp, sizeof(stmp)) ||
+      (type = vtk_type(stmp)) == vtk_not_valid ||
+      (!as_float && type >= vtk_float32))
+    return MESH_BAD_FF;
+  if (!xml_attr(tag, tag_end, "format", stmp, sizeof(stmp)))
+    strcpy(stmp, "ascii");
+
+  if (strcmp(stmp, "appended") == 0) {
+    if (vf->app == NULL ||
+        !xml_attr(tag, tag_end, "offset", stmp, sizeof(stmp)))
+      return MESH_CORRUPTED;
+    offset = strtoul(stmp, &eptr, 10);
+    if (eptr == stmp || offset >= (unsigned long)(vf->app_end-vf->app))
+      return MESH_CORRUPTED;
+    p = vf->app+offset;
+    end = vf->app_end;
+    b64 = vf->app_base64;
+  } else {
+    p = tag_end+1;
+    if (tag_end[-1] == '/') { /* empty element */
+      end = p;
+    } else if ((end = find_str(p, vf->end, "</DataArray")) == NULL) {
+      return MESH_CORRUPTED;
+    }
+    if (strcmp(stmp, "ascii") == 0) {
+      cap = SZ_INIT_DEF;
+      *out = malloc(cap*sizeof(float));
+      if (*out == NULL) return MESH_NO_MEM;
+      for (i=0; ; i++) {
+        if (as_float ? !span_float_scanf(&p, end, vf->lim, &f) :
+            !span_int_scanf(&p, end, vf->lim, &v))
+          break;
+        if (i == cap) {
+          cap *= 2;
+          if ((tmp = realloc(*out, cap*sizeof(float))) == NULL)
+            return MESH_NO_MEM;
+          *out = tmp;
+        }
+        if (as_float) {
+          ((float*)*out)[i] = f;
+        } else {
+          if (v < 0) return MESH_MODEL_ERR;
+          ((int*)*out)[i] = v;
+        }
+      }
+      *n = i;
+      /* only whitespace can be left */
+      while (p < end && isspace(*p)) p++;
+      return (p == end) ? 0 : MESH_CORRUPTED;
+    } else if (strcmp(stmp, "binary") == 0) {
+      while (p < end && isspace(*p)) p++;
+      b64 = 1;
+    } else {
+      return MESH_BAD_FF;
+    }
+  }
+
+  bytes = vtp_payload(vf, p, end, b64, &len, &buf, &rcode);
+  if (bytes == NULL) return rcode;
+  *n = len/vtk_sizes[type];
+  *out = malloc((*n+1)*sizeof(float));
+  if (*out == NULL) {
+    rcode = MESH_NO_MEM;
+  } else if (as_float) {
+    vtk_to_floats(bytes, type, vf->swap, *n, (float*)*out);
+    rcode = 0;
+  } else {
+    rcode = vtk_to_ints(bytes, type, vf->swap, *n, (int*)*out);
+  }
+  free(buf);
+  return rcode;
+}
+
+/* Reads the "Polys" or "Strips" element 'name' of the piece [p,end), which
+ * has 'n_cells' cells on the 'n_pts' points starting at vertex 'base', and
+ * adds its triangles to '*tmesh'. Returns 0 on success or a negative error
+ * code. */
+static int vtp_read_cells(const struct vtp_file *vf, const unsigned char *p,
+                          const unsigned char *end, const char *name,
+                          int n_cells, int base, int n_pts,
+                          struct model *tmesh)
+{
+  char stmp[MAX_WORD_LEN+1];
+  const unsigned char *t, *te;
+  void *arr;
+  int *conn, *offs, *o;
+  size_t n_conn, n_offs, n;
+  int rcode;
+
+  if (n_cells == 0) return 0;
+  if (find_tag(p, end, name, &te) == NULL) return MESH_CORRUPTED;
+  sprintf(stmp, "</%s", name);
+  if ((end = find_str(te, end, stmp)) == NULL) return MESH_CORRUPTED;
+
+  conn = offs = NULL;
+  n_conn = n_offs = 0;
+  rcode = 0;
+  for (p=te; rcode >= 0 && (t = find_tag(p, end, "DataArray", &te)) != NULL;
+       p=te) {
+    if (!xml_attr(t, te, "Name", stmp, sizeof(stmp))) continue;
+    if (strcmp(stmp, "connectivity") == 0 && conn == NULL) {
+      rcode = vtp_read_array(vf, t, te, 0, &arr, &n_conn);
+      conn = (int*)arr;
+    } else if (strcmp(stmp, "offsets") == 0 && offs == NULL) {
+      rcode = vtp_read_array(vf, t, te, 0, &arr, &n);
+      offs = (int*)arr;
+      n_offs = n;
+    }
+  }
+  if (rcode >= 0 && (conn == NULL || offs == NULL || n_conn > INT_MAX))
+    rcode = MESH_CORRUPTED;
+
+  /* The offsets are either the end of each cell or (newer files) the start
+   * of each cell followed by the end of the last one */
+  if (rcode >= 0) {
+    if (n_offs == (size_t)n_cells) {
+      o = (int*)realloc(offs, ((size_t)n_cells+1)*sizeof(int));
+      if (o == NULL) {
+        rcode = MESH_NO_MEM;
+      } else {
+        offs = o;
+        memmove(offs+1, offs, n_cells*sizeof(int));
+        offs[0] = 0;
+      }
+    } else if (n_offs != (size_t)n_cells+1) {
+      rcode = MESH_CORRUPTED;
+    }
+  }
+  if (rcode >= 0) {
+    rcode = add_vtk_cells(tmesh, base, n_pts, conn, (int)n_conn, offs,
+                          n_cells, name[0] == 'S');
+  }
+  free(conn);
+  free(offs);
+  return rcode;
+}
+
+/* Makes the rest of the '*data' stream available in memory, from '*begin'
+ * to '*end' (see span_int_scanf() for '*lim'). If it is not already in the
+ * block (e.g. a memory mapped file) it is read into a new array, which is
+ * returned and must be freed; otherwise NULL is returned. On error
+ * '*rcode' is set to a negative value. */
+static unsigned char *vtp_stream_in_memory(struct file_data *data,
+                                           const unsigned char **begin,
+                                           const unsigned char **end,
+                                           const unsigned char **lim,
+                                           int *rcode)
+{
+  unsigned char *buf, *tmp;
+  size_t cap, len, k;
+
+  *rcode = 0;
+  if (data->eof_reached) {
+    *begin = &(data->block[data->pos]);
+    *end = &(data->block[data->nbytes]);
+    *lim = &(data->block[data->size]);
+    return NULL;
+  }
+  cap = 1<<20;
+  len = 0;
+  buf = (unsigned char*)malloc(cap);
+  while (buf != NULL && (k = bin_read(buf+len, 1, cap-len-1, data)) > 0) {
+    len += k;
+    if (len == cap-1) {
+      cap *= 2;
+      tmp = (unsigned char*)realloc(buf, cap);
+      if (tmp == NULL) free(buf);
+      buf = tmp;
+    }
+  }
+  if (buf == NULL) {
+    *rcode = MESH_NO_MEM;
+    return NULL;
+  }
+  buf[len] = '\0';
+  *begin = buf;
+  *end = buf+len;
+  *lim = buf+len+1;
+  return buf;
+}
+
+/* Reads a _triangular_ mesh from a XML PolyData file. All the pieces are
+ * read in a single mesh. The stream must be at the start of the
+ * file. Returns the number of meshes read (i.e. 1) if successful, and a
+ * negative code if it failed. */
+int read_vtp_tmesh(struct model **tmesh_ref, struct file_data *data)
+{
+  char stmp[MAX_WORD_LEN+1];
+  struct vtp_file vf;
+  struct model *tmesh;
+  const unsigned char *begin, *p, *t, *te, *pe, *ate;
+  unsigned char *copy;
+  void *arr;
+  vertex_t *vtcs;
+  size_t n;
+  int rcode, n_pts, n_polys, n_strips, base;
+
+  memset(&vf, 0, sizeof(vf));
+  vf.header_type = vtk_uint32;
+  copy = vtp_stream_in_memory(data, &begin, &vf.end, &vf.lim, &rcode);
+  if (rcode < 0) return rcode;
+
+  /* File attributes */
+  if ((t = find_tag(begin, vf.end, "VTKFile", &te)) == NULL) {
+    rcode = MESH_CORRUPTED;
+  } else if (!xml_attr(t, te, "type", stmp, sizeof(stmp)) ||
+             strcmp(stmp, "PolyData") != 0) {
+    rcode = MESH_BAD_FF;
+  } else {
+    vf.swap = (xml_attr(t, te, "byte_order", stmp, sizeof(stmp)) &&
+               strcmp(stmp, "BigEndian") == 0) != host_is_big_endian();
+    if (xml_attr(t, te, "header_type", stmp, sizeof(stmp)) &&
+        strcmp(stmp, "UInt64") == 0)
+      vf.header_type = vtk_uint64;
+    if (xml_attr(t, te, "compressor", stmp, sizeof(stmp)) &&
+        stmp[0] != '\0') {
+      if (strcmp(stmp, "vtkZLibDataCompressor") == 0)
+        vf.compressed = 1;
+      else
+        rcode = MESH_BAD_FF;
+    }
+  }
+  /* The appended data follows the last XML element and starts after '_' */
+  if (rcode >= 0 &&
+      (t = find_tag(begin, vf.end, "AppendedData", &te)) != NULL) {
+    vf.app_base64 = !xml_attr(t, te, "encoding", stmp, sizeof(stmp)) ||
+      strcmp(stmp, "raw") != 0;
+    p = (const unsigned char*)memchr(te, '_', vf.end-te);
+    if (p == NULL) {
+      rcode = MESH_CORRUPTED;
+    } else {
+      vf.app = p+1;
+      vf.app_end = vf.end;
+      if (vf.app_base64 &&
+          (pe = find_str(vf.app, vf.end, "</AppendedData")) != NULL)
+        vf.app_end = pe;
+      vf.end = t;
+    }
+  }
+
+  tmesh = (struct model*)calloc(1, sizeof(struct model));
+  if (tmesh == NULL) rcode = MESH_NO_MEM;
+
+  /* Pieces */
+  for (p=begin; rcode >= 0 && (t = find_tag(p, vf.end, "Piece", &te)) != NULL;
+       p=pe) {
+    if (te[-1] == '/') { /* empty piece */
+      pe = te;
+      continue;
+    }
+    if ((pe = find_str(te, vf.end, "</Piece")) == NULL ||
+        xml_int_attr(t, te, "NumberOfPoints", &n_pts) < 0 ||
+        xml_int_attr(t, te, "NumberOfPolys", &n_polys) < 0 ||
+        xml_int_attr(t, te, "NumberOfStrips", &n_strips) < 0 ||
+        n_pts > INT_MAX-tmesh->num_vert) {
+      rcode = MESH_CORRUPTED;
+      break;
+    }
+    base = tmesh->num_vert;
+    if (n_pts > 0) {
+      if (find_tag(te, pe, "Points", &ate) == NULL ||
+          (t = find_tag(ate, pe, "DataArray", &ate)) == NULL) {
+        rcode = MESH_CORRUPTED;
+        break;
+      }
+      rcode = vtp_read_array(&vf, t, ate, 1, &arr, &n);
+      if (rcode >= 0 && n != 3*(size_t)n_pts) rcode = MESH_CORRUPTED;
+      vtcs = (rcode < 0) ? NULL :
+        (vertex_t*)realloc(tmesh->vertices,
+                           ((size_t)base+n_pts)*sizeof(vertex_t));
+      if (rcode >= 0 && vtcs == NULL) rcode = MESH_NO_MEM;
+      if (rcode >= 0) {
+        tmesh->vertices = vtcs;
+        memcpy(&(vtcs[base]), arr, n*sizeof(float));
+        tmesh->num_vert += n_pts;
+      }
+      free(arr);
+      if (rcode < 0) break;
+    }
+    rcode = vtp_read_cells(&vf, te, pe, "Polys", n_polys, base, n_pts, tmesh);
+    if (rcode >= 0) {
+      rcode = vtp_read_cells(&vf, te, pe, "Strips", n_strips, base, n_pts,
+                             tmesh);
+    }
+  }
+  free(copy);
+
+  if (rcode >= 0) {
+    set_vtk_bbox(tmesh);
+    *tmesh_ref = tmesh;
+    rcode = 1;
+  } else if (tmesh != NULL) {
+    __free_raw_model(tmesh);
+  }
+  return rcode;
+}
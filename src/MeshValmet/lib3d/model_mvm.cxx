@@ -0,0 +1,334 @@
+/*
+ * Writer and loader of the MVM binary model cache (see model_mvm.h).
+ */
+
+#include <model_in.h>
+#include <model_mvm.h>
+#include <stdint.h>
+#include <errno.h>
+
+/* Files are memory mapped on POSIX systems, unless MESH_NO_MMAP is defined */
+#if !defined(_WIN32) && !defined(MESH_NO_MMAP)
+# define MESH_USE_MMAP
+#endif
+#ifdef MESH_USE_MMAP
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+#endif
+
+/* The first bytes of every MVM file. The "\r\n\032" catches files mangled
+ * by text mode transfers, as in the PNG signature. */
+#define MVM_MAGIC "MVM\r\n\032\n"
+/* Written in the host byte order, to detect files from other hosts */
+#define MVM_BYTE_ORDER 0x01020304u
+/* Alignment of the sections in the file, which keeps them aligned in the
+ * (page aligned) mapping */
+#define MVM_ALIGN 64
+
+/* The sections of an MVM file, in the order in which they are written */
+enum mvm_section {
+  MVM_VERTICES = 0,
+  MVM_FACES,
+  MVM_NORMALS,
+  MVM_FACE_NORMALS,
+  MVM_AREA,
+  MVM_INFO,
+  MVM_N_SECTIONS
+};
+
+/* The header, at the start of the file. A section that is not present has
+ * a zero offset and size. */
+struct mvm_header {
+  char magic[8];            /* MVM_MAGIC, with its terminating null */
+  uint32_t version;         /* MVM_VERSION */
+  uint32_t byte_order;      /* MVM_BYTE_ORDER */
+  uint64_t file_size;       /* The size of the whole file, in bytes */
+  int32_t num_vert;         /* model.num_vert */
+  int32_t num_faces;        /* model.num_faces */
+  int32_t builtin_normals;  /* model.builtin_normals */
+  float total_area;         /* model.total_area */
+  float bbox[6];            /* model.bBox, min then max */
+  uint64_t offset[MVM_N_SECTIONS]; /* The offset of each section */
+  uint64_t size[MVM_N_SECTIONS];   /* The size of each section, in bytes */
+};
+
+/* The sections hold the arrays as they are in memory */
+typedef char mvm_vertex_check[sizeof(vertex_t) == 3*sizeof(float) ? 1 : -1];
+typedef char mvm_face_check[sizeof(face_t) == 3*sizeof(int) ? 1 : -1];
+
+/* A loaded model and the file data its arrays point into. The model is the
+ * first member, so that a 'struct model*' returned by read_mvm_model() can be
+ * converted back. */
+struct mvm_model {
+  struct model model;
+  unsigned char *base; /* The file data */
+  size_t len;          /* The size of the file data, in bytes */
+  int mapped;          /* Non-zero if the data is mapped, zero if allocated */
+};
+
+/* Writes 'len' bytes from 'p' to 'f', followed by the zeros that align the
+ * next section. Returns 0 on success and -1 on error. */
+static int write_mvm_section(FILE *f, const void *p, size_t len)
+{
+  static const char zeros[MVM_ALIGN] = {0};
+  size_t pad;
+
+  if (len > 0 && fwrite(p, 1, len, f) != len) return -1;
+  pad = (MVM_ALIGN - len%MVM_ALIGN) % MVM_ALIGN;
+  if (pad > 0 && fwrite(zeros, 1, pad, f) != pad) return -1;
+  return 0;
+}
+
+/* see model_mvm.h */
+int write_mvm_model(const char *fname, const struct model *m,
+                    const void *info, int info_sz)
+{
+  struct mvm_header h;
+  const void *sect[MVM_N_SECTIONS];
+  uint64_t pos;
+  FILE *f;
+  int k, rcode;
+
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, MVM_MAGIC, sizeof(h.magic));
+  h.version = MVM_VERSION;
+  h.byte_order = MVM_BYTE_ORDER;
+  h.num_vert = m->num_vert;
+  h.num_faces = m->num_faces;
+  h.builtin_normals = m->builtin_normals;
+  h.total_area = m->total_area;
+  h.bbox[0] = m->bBox[0].x;
+  h.bbox[1] = m->bBox[0].y;
+  h.bbox[2] = m->bBox[0].z;
+  h.bbox[3] = m->bBox[1].x;
+  h.bbox[4] = m->bBox[1].y;
+  h.bbox[5] = m->bBox[1].z;
+
+  sect[MVM_VERTICES] = m->vertices;
+  h.size[MVM_VERTICES] = (uint64_t)m->num_vert*sizeof(vertex_t);
+  sect[MVM_FACES] = m->faces;
+  h.size[MVM_FACES] = (uint64_t)m->num_faces*sizeof(face_t);
+  sect[MVM_NORMALS] = m->normals;
+  h.size[MVM_NORMALS] = (m->normals != NULL) ?
+    (uint64_t)m->num_vert*sizeof(vertex_t) : 0;
+  sect[MVM_FACE_NORMALS] = m->face_normals;
+  h.size[MVM_FACE_NORMALS] = (m->face_normals != NULL) ?
+    (uint64_t)m->num_faces*sizeof(vertex_t) : 0;
+  sect[MVM_AREA] = m->area;
+  h.size[MVM_AREA] = (m->area != NULL) ?
+    (uint64_t)m->num_faces*sizeof(float) : 0;
+  sect[MVM_INFO] = info;
+  h.size[MVM_INFO] = (info != NULL && info_sz > 0) ? (uint64_t)info_sz : 0;
+
+  /* The vertices and faces always get an offset, even when empty */
+  pos = (sizeof(h)+MVM_ALIGN-1)/MVM_ALIGN*MVM_ALIGN;
+  for (k=0; k<MVM_N_SECTIONS; k++) {
+    if (k <= MVM_FACES || h.size[k] > 0) {
+      h.offset[k] = pos;
+      pos += (h.size[k]+MVM_ALIGN-1)/MVM_ALIGN*MVM_ALIGN;
+    }
+  }
+  h.file_size = pos;
+
+  f = fopen(fname, "wb");
+  if (f == NULL) return MESH_BAD_FNAME;
+  rcode = write_mvm_section(f, &h, sizeof(h));
+  for (k=0; k<MVM_N_SECTIONS && rcode == 0; k++) {
+    if (h.offset[k] != 0) rcode = write_mvm_section(f, sect[k], h.size[k]);
+  }
+  if (fclose(f) != 0) rcode = -1;
+  if (rcode != 0) {
+    remove(fname);
+    return MESH_CORRUPTED;
+  }
+  return 0;
+}
+
+/* Loads the whole file 'fname' into memory, mapped if possible. The data is
+ * returned in '*base' and its size in '*len'. Returns 1 if the data is
+ * mapped, 0 if it is allocated, or a negative error code. */
+static int load_mvm_file(const char *fname, unsigned char **base, size_t *len)
+{
+#ifdef MESH_USE_MMAP
+  struct stat st;
+  void *p;
+  int fd;
+
+  fd = open(fname, O_RDONLY);
+  if (fd < 0) return MESH_BAD_FNAME;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return MESH_CORRUPTED;
+  }
+  if (st.st_size < (off_t)sizeof(struct mvm_header)) {
+    close(fd);
+    return MESH_BAD_FF;
+  }
+  /* copy-on-write, so that the model can be modified (e.g. oriented) */
+  p = mmap(NULL, (size_t)st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) return MESH_CORRUPTED;
+  *base = (unsigned char*)p;
+  *len = (size_t)st.st_size;
+  return 1;
+#else
+  FILE *f;
+  long fsize;
+
+  f = fopen(fname, "rb");
+  if (f == NULL) return MESH_BAD_FNAME;
+  if (fseek(f, 0, SEEK_END) != 0 || (fsize = ftell(f)) < 0 ||
+      fseek(f, 0, SEEK_SET) != 0) {
+    fclose(f);
+    return MESH_CORRUPTED;
+  }
+  if ((size_t)fsize < sizeof(struct mvm_header)) {
+    fclose(f);
+    return MESH_BAD_FF;
+  }
+  /* malloc() alignment is enough for the float and int arrays */
+  *base = (unsigned char*)malloc((size_t)fsize);
+  if (*base == NULL) {
+    fclose(f);
+    return MESH_NO_MEM;
+  }
+  if (fread(*base, 1, (size_t)fsize, f) != (size_t)fsize) {
+    free(*base);
+    fclose(f);
+    return MESH_CORRUPTED;
+  }
+  fclose(f);
+  *len = (size_t)fsize;
+  return 0;
+#endif
+}
+
+/* Releases the file data loaded by load_mvm_file() */
+static void unload_mvm_file(unsigned char *base, size_t len, int mapped)
+{
+#ifdef MESH_USE_MMAP
+  if (mapped) {
+    munmap(base, len);
+    return;
+  }
+#endif
+  (void)len;
+  (void)mapped;
+  free(base);
+}
+
+/* Checks the header of the 'len' bytes of file data at 'h'. Returns 0 if
+ * the layout is valid or a negative error code. */
+static int check_mvm_header(const struct mvm_header *h, size_t len)
+{
+  uint64_t expect[MVM_N_SECTIONS];
+  int k;
+
+  if (memcmp(h->magic, MVM_MAGIC, sizeof(h->magic)) != 0 ||
+      h->version != MVM_VERSION || h->byte_order != MVM_BYTE_ORDER)
+    return MESH_BAD_FF;
+  if (h->file_size != (uint64_t)len || h->num_vert < 0 || h->num_faces < 0)
+    return MESH_CORRUPTED;
+
+  expect[MVM_VERTICES] = (uint64_t)h->num_vert*sizeof(vertex_t);
+  expect[MVM_FACES] = (uint64_t)h->num_faces*sizeof(face_t);
+  expect[MVM_NORMALS] = expect[MVM_VERTICES];
+  expect[MVM_FACE_NORMALS] = (uint64_t)h->num_faces*sizeof(vertex_t);
+  expect[MVM_AREA] = (uint64_t)h->num_faces*sizeof(float);
+  expect[MVM_INFO] = h->size[MVM_INFO];
+  for (k=0; k<MVM_N_SECTIONS; k++) {
+    if (h->offset[k] == 0) { /* absent */
+      if (k <= MVM_FACES || h->size[k] != 0) return MESH_CORRUPTED;
+      continue;
+    }
+    if (h->size[k] != expect[k] || h->offset[k]%MVM_ALIGN != 0 ||
+        h->offset[k] < sizeof(*h) || h->offset[k] > h->file_size ||
+        h->size[k] > h->file_size-h->offset[k])
+      return MESH_CORRUPTED;
+  }
+  if (h->size[MVM_INFO] > INT_MAX) return MESH_CORRUPTED;
+  return 0;
+}
+
+/* see model_mvm.h */
+int read_mvm_model(struct model **m_ref, const char *fname,
+                   const void **info, int *info_sz)
+{
+  const struct mvm_header *h;
+  struct mvm_model *mm;
+  struct model *m;
+  unsigned char *base;
+  size_t len;
+  int mapped, rcode;
+
+  base = NULL;
+  len = 0;
+  mapped = load_mvm_file(fname, &base, &len);
+  if (mapped < 0) return mapped;
+  h = (const struct mvm_header*)base;
+  rcode = check_mvm_header(h, len);
+  if (rcode < 0) {
+    unload_mvm_file(base, len, mapped);
+    return rcode;
+  }
+  mm = (struct mvm_model*)calloc(1, sizeof(*mm));
+  if (mm == NULL) {
+    unload_mvm_file(base, len, mapped);
+    return MESH_NO_MEM;
+  }
+  mm->base = base;
+  mm->len = len;
+  mm->mapped = mapped;
+
+  m = &(mm->model);
+  m->num_vert = h->num_vert;
+  m->num_faces = h->num_faces;
+  m->builtin_normals = h->builtin_normals;
+  m->total_area = h->total_area;
+  m->bBox[0].x = h->bbox[0];
+  m->bBox[0].y = h->bbox[1];
+  m->bBox[0].z = h->bbox[2];
+  m->bBox[1].x = h->bbox[3];
+  m->bBox[1].y = h->bbox[4];
+  m->bBox[1].z = h->bbox[5];
+  m->vertices = (vertex_t*)(base+h->offset[MVM_VERTICES]);
+  m->faces = (face_t*)(base+h->offset[MVM_FACES]);
+  m->borrowed = MODEL_BORROWS_VERTICES|MODEL_BORROWS_FACES;
+  if (h->offset[MVM_NORMALS] != 0) {
+    m->normals = (vertex_t*)(base+h->offset[MVM_NORMALS]);
+    m->borrowed |= MODEL_BORROWS_NORMALS;
+  }
+  if (h->offset[MVM_FACE_NORMALS] != 0) {
+    m->face_normals = (vertex_t*)(base+h->offset[MVM_FACE_NORMALS]);
+    m->borrowed |= MODEL_BORROWS_FACE_NORMALS;
+  }
+  if (h->offset[MVM_AREA] != 0) {
+    m->area = (float*)(base+h->offset[MVM_AREA]);
+    m->borrowed |= MODEL_BORROWS_AREA;
+  }
+  if (info != NULL) {
+    *info = (h->offset[MVM_INFO] != 0) ? base+h->offset[MVM_INFO] : NULL;
+    *info_sz = (int)h->size[MVM_INFO];
+  }
+  *m_ref = m;
+  return 1;
+}
+
+/* see model_mvm.h */
+void free_mvm_model(struct model *m)
+{
+  struct mvm_model *mm;
+  unsigned char *base;
+  size_t len;
+  int mapped;
+
+  if (m == NULL) return;
+  mm = (struct mvm_model*)m;
+  base = mm->base;
+  len = mm->len;
+  mapped = mm->mapped;
+  __free_raw_model(m); /* the arrays allocated later, and mm */
+  unload_mvm_file(base, len, mapped);
+}
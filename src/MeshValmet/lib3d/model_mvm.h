@@ -0,0 +1,61 @@
+/*
+ * MVM files: a binary cache of a 'struct model', laid out so that it can be
+ * memory mapped and used in place, without any parsing.
+ *
+ * The file starts with a fixed size header (see model_mvm.cxx) followed by
+ * the sections holding the model arrays, as they are in memory: vertices,
+ * faces and, if present, vertex normals, face normals and face areas. An
+ * optional opaque section holds the analysis of the model (e.g. a 'struct
+ * model_info', see model_analysis.h) so that it does not need to be
+ * recomputed. The data is in the byte order of the host that wrote the file;
+ * files of another byte order or version are rejected with MESH_BAD_FF, and
+ * should be converted again.
+ */
+
+#ifndef _MODEL_MVM_PROTO
+#define _MODEL_MVM_PROTO
+
+#include <3dmodel.h>
+
+#ifdef __cplusplus
+# define BEGIN_DECL extern "C" {
+# define END_DECL }
+#else
+# define BEGIN_DECL
+# define END_DECL
+#endif
+
+BEGIN_DECL
+#undef BEGIN_DECL
+
+/* Version of the MVM layout, stored in and checked against each file */
+#define MVM_VERSION 1
+
+/* Writes model 'm' to the new MVM file 'fname'. If 'info' is not NULL its
+ * 'info_sz' bytes are stored along. Returns 0 on success, MESH_BAD_FNAME if
+ * the file can not be created (the detailed error is given in errno) or
+ * MESH_CORRUPTED if writing it fails. */
+int write_mvm_model(const char *fname, const struct model *m,
+                    const void *info, int info_sz);
+
+/* Loads the model of the MVM file 'fname' into '*m_ref'. On POSIX systems
+ * (unless MESH_NO_MMAP is defined) the file is mapped copy-on-write and the
+ * arrays of the model point into the mapping, so loading costs only the page
+ * faults on the data actually used; elsewhere the file is read in one
+ * block. The arrays are flagged as borrowed (see 'struct model'), and the
+ * model must be freed with free_mvm_model(). If 'info' is not NULL it is set
+ * to the stored analysis, or NULL if there is none, and its size is returned
+ * in '*info_sz'. The file is trusted: only its layout is checked, not the
+ * face indices. Returns 1 on success or a negative error code (MESH_BAD_FF
+ * for a file that is not an MVM file of this version and byte order). */
+int read_mvm_model(struct model **m_ref, const char *fname,
+                   const void **info, int *info_sz);
+
+/* Frees a model returned by read_mvm_model(), along with the arrays that
+ * were allocated after loading (e.g. normals computed later). */
+void free_mvm_model(struct model *m);
+
+END_DECL
+#undef END_DECL
+
+#endif /* _MODEL_MVM_PROTO */
@@ -0,0 +1,329 @@
+/*
+ * Test of the file format detection of read_fmodel(): each file written
+ * here is read with MESH_FF_AUTO and with its actual format, which must
+ * give the same model. When zlib is used a gzipped copy is read too, so that
+ * the detection also runs on the refilled block instead of the memory
+ * mapped file.
+ *
+ * Returns 0 if all the checks pass, 1 otherwise.
+ */
+
+#include <model_in.h>
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Number of vertices of the large files, whose vertices alone take more
+ * than 64 KB, and than a refilled block */
+#define N_LARGE_VTCS 8000
+
+/* Number of vertices along X of the grids of grid_vertices() */
+#define GRID_W 50
+
+/* Number of checks that failed */
+static int n_failed = 0;
+
+/* A growing text or binary buffer holding the file to write */
+struct text {
+  char *buf;
+  size_t len, size;
+};
+
+/* Appends 'len' bytes at 'data' to '*t' */
+static void append(struct text *t, const void *data, size_t len)
+{
+  if (t->len+len+1 > t->size) {
+    t->size = 2*(t->len+len+1);
+    t->buf = (char*)realloc(t->buf, t->size);
+  }
+  memcpy(t->buf+t->len, data, len);
+  t->len += len;
+  t->buf[t->len] = '\0';
+}
+
+/* Appends the string 'str' to '*t' */
+static void append_str(struct text *t, const char *str)
+{
+  append(t, str, strlen(str));
+}
+
+/* Appends the text formatted as by printf() to '*t' */
+static void appendf(struct text *t, const char *fmt, ...)
+{
+  char line[256];
+  va_list ap;
+
+  va_start(ap, fmt);
+  vsnprintf(line, sizeof(line), fmt, ap);
+  va_end(ap);
+  append_str(t, line);
+}
+
+/* Writes the 'len' bytes at 'data' to file 'fname', gzipped if 'gz' is
+ * non-zero. Returns 0 on success. */
+static int write_file(const char *fname, const char *data, size_t len, int gz)
+{
+  FILE *f;
+
+#ifndef DONT_USE_ZLIB
+  if (gz) {
+    gzFile g;
+    g = gzopen(fname, "wb");
+    if (g == NULL) return -1;
+    if (gzwrite(g, data, (unsigned)len) != (int)len) {
+      gzclose(g);
+      return -1;
+    }
+    return gzclose(g) == Z_OK ? 0 : -1;
+  }
+#endif
+  f = fopen(fname, "wb");
+  if (f == NULL) return -1;
+  if (fwrite(data, 1, len, f) != len) {
+    fclose(f);
+    return -1;
+  }
+  return fclose(f) == 0 ? 0 : -1;
+}
+
+/* Reads 'fname' autodetected and as 'fformat', and checks that both give
+ * the same model, with 'n_vtcs' vertices and 'n_faces' faces */
+static void check_file(const char *name, const char *fname, int fformat,
+                       int n_vtcs, int n_faces)
+{
+  struct model *m_auto, *m_ff;
+  int rc_auto, rc_ff;
+
+  m_auto = m_ff = NULL;
+  rc_auto = read_fmodel(&m_auto, fname, MESH_FF_AUTO, 1);
+  rc_ff = read_fmodel(&m_ff, fname, fformat, 1);
+  if (rc_ff != 1) {
+    printf("%s: reading as its format gives %d\n", name, rc_ff);
+    n_failed++;
+  } else if (rc_auto != 1) {
+    printf("%s: reading autodetected gives %d\n", name, rc_auto);
+    n_failed++;
+  } else if (m_ff->num_vert != n_vtcs || m_ff->num_faces != n_faces) {
+    printf("%s: %d vertices and %d faces read, instead of %d and %d\n", name,
+           m_ff->num_vert, m_ff->num_faces, n_vtcs, n_faces);
+    n_failed++;
+  } else if (m_auto->num_vert != n_vtcs || m_auto->num_faces != n_faces ||
+             memcmp(m_auto->vertices, m_ff->vertices,
+                    n_vtcs*sizeof(vertex_t)) != 0 ||
+             memcmp(m_auto->faces, m_ff->faces,
+                    n_faces*sizeof(face_t)) != 0) {
+    printf("%s: the autodetected format gives another model\n", name);
+    n_failed++;
+  }
+  if (rc_auto > 0) __free_raw_model(m_auto);
+  if (rc_ff > 0) __free_raw_model(m_ff);
+}
+
+/* Writes '*t' to a file, plain and gzipped, and checks it (see
+ * check_file()) */
+static void check_text(const char *name, const struct text *t, int fformat,
+                       int n_vtcs, int n_faces)
+{
+  static const char fname[] = "test_file_format.tmp";
+  char gz_name[64];
+
+  if (write_file(fname, t->buf, t->len, 0) != 0) {
+    printf("%s: cannot write %s\n", name, fname);
+    n_failed++;
+    return;
+  }
+  check_file(name, fname, fformat, n_vtcs, n_faces);
+  remove(fname);
+#ifndef DONT_USE_ZLIB
+  snprintf(gz_name, sizeof(gz_name), "%s (gzipped)", name);
+  if (write_file(fname, t->buf, t->len, 1) != 0) {
+    printf("%s: cannot write %s\n", gz_name, fname);
+    n_failed++;
+    return;
+  }
+  check_file(gz_name, fname, fformat, n_vtcs, n_faces);
+  remove(fname);
+#else
+  (void)gz_name;
+#endif
+}
+
+/* Appends the vertices of a grid of 'n' vertices to '*t', as "v x y z"
+ * lines */
+static void grid_vertices(struct text *t, int n)
+{
+  int i;
+
+  for (i=0; i<n; i++) {
+    appendf(t, "v %g %g %g\n", (double)(i%GRID_W), (double)(i/GRID_W),
+            0.25*(i%7));
+  }
+}
+
+/* OBJ and SMF files, which only differ by their statements */
+static void check_obj_smf(void)
+{
+  struct text t;
+  int i;
+
+  memset(&t, 0, sizeof(t));
+
+  /* SMF triangles */
+  append_str(&t, "# SMF\n");
+  grid_vertices(&t, 4);
+  append_str(&t, "f 1 2 3\nf 1 3 4\n");
+  check_text("small SMF", &t, MESH_FF_SMF, 4, 2);
+
+  /* OBJ quad */
+  t.len = 0;
+  grid_vertices(&t, 4);
+  append_str(&t, "f 1 2 3 4\n");
+  check_text("OBJ quad", &t, MESH_FF_OBJ, 4, 2);
+
+  /* SMF whose vertices do not fit in a refilled block */
+  t.len = 0;
+  grid_vertices(&t, N_LARGE_VTCS);
+  for (i=1; i+2<=N_LARGE_VTCS; i+=3) {
+    appendf(&t, "f %d %d %d\n", i, i+1, i+2);
+  }
+  check_text("large SMF", &t, MESH_FF_SMF, N_LARGE_VTCS, N_LARGE_VTCS/3);
+
+  /* OBJ with texture indices after as many vertices */
+  t.len = 0;
+  grid_vertices(&t, N_LARGE_VTCS);
+  for (i=1; i+2<=N_LARGE_VTCS; i+=3) {
+    appendf(&t, "f %d/1 %d/1 %d/1\n", i, i+1, i+2);
+  }
+  check_text("large OBJ", &t, MESH_FF_OBJ, N_LARGE_VTCS, N_LARGE_VTCS/3);
+
+  free(t.buf);
+}
+
+/* Appends the 32 bit word 'w' to '*t', in little endian order if 'little'
+ * is non-zero and big endian order otherwise */
+static void append_word(struct text *t, uint32_t w, int little)
+{
+  unsigned char b[4];
+  int i;
+
+  for (i=0; i<4; i++) {
+    b[little ? i : 3-i] = (unsigned char)(w >> (8*i));
+  }
+  append(t, b, 4);
+}
+
+/* Appends the float 'f' to '*t', as append_word() */
+static void append_float(struct text *t, float f, int little)
+{
+  uint32_t w;
+
+  memcpy(&w, &f, 4);
+  append_word(t, w, little);
+}
+
+/* Sets the vertices of the grid of grid_vertices() with 'n' vertices in
+ * 'vtcs', and the two triangles of each of its cells in 'faces'. Returns the
+ * number of triangles. */
+static int grid_mesh(int n, float (*vtcs)[3], int (*faces)[3])
+{
+  int i, x, y, n_faces;
+
+  for (i=0; i<n; i++) {
+    vtcs[i][0] = (float)(i%GRID_W);
+    vtcs[i][1] = (float)(i/GRID_W);
+    vtcs[i][2] = (float)(0.25*(i%7));
+  }
+  n_faces = 0;
+  for (y=0; y+1<n/GRID_W; y++) {
+    for (x=0; x+1<GRID_W; x++) {
+      i = y*GRID_W+x;
+      faces[n_faces][0] = i;
+      faces[n_faces][1] = i+1;
+      faces[n_faces][2] = i+GRID_W+1;
+      n_faces++;
+      faces[n_faces][0] = i;
+      faces[n_faces][1] = i+GRID_W+1;
+      faces[n_faces][2] = i+GRID_W;
+      n_faces++;
+    }
+  }
+  return n_faces;
+}
+
+/* Binary files, whose data follows a short text header (PLY, VTK) or is
+ * all binary (STL), large enough not to fit in a refilled block. When their
+ * size is not known, as for gzipped files, a binary STL is told by the
+ * control bytes of its records, which the binary data of the PLY and VTK
+ * files has too. */
+static void check_binary(void)
+{
+  struct text t;
+  float (*vtcs)[3];
+  int (*faces)[3];
+  unsigned char count;
+  char header[80];
+  int i, k, n_faces;
+
+  memset(&t, 0, sizeof(t));
+  vtcs = (float(*)[3])malloc(N_LARGE_VTCS*sizeof(*vtcs));
+  faces = (int(*)[3])malloc(2*N_LARGE_VTCS*sizeof(*faces));
+  n_faces = grid_mesh(N_LARGE_VTCS, vtcs, faces);
+
+  /* binary PLY */
+  appendf(&t, "ply\nformat binary_little_endian 1.0\nelement vertex %d\n"
+          "property float x\nproperty float y\nproperty float z\n"
+          "element face %d\nproperty list uchar int vertex_indices\n"
+          "end_header\n", N_LARGE_VTCS, n_faces);
+  for (i=0; i<N_LARGE_VTCS; i++) {
+    for (k=0; k<3; k++) append_float(&t, vtcs[i][k], 1);
+  }
+  for (i=0; i<n_faces; i++) {
+    count = 3;
+    append(&t, &count, 1);
+    for (k=0; k<3; k++) append_word(&t, (uint32_t)faces[i][k], 1);
+  }
+  check_text("binary PLY", &t, MESH_FF_PLY, N_LARGE_VTCS, n_faces);
+
+  /* binary legacy VTK */
+  t.len = 0;
+  appendf(&t, "# vtk DataFile Version 4.2\ngrid\nBINARY\n"
+          "DATASET POLYDATA\nPOINTS %d float\n", N_LARGE_VTCS);
+  for (i=0; i<N_LARGE_VTCS; i++) {
+    for (k=0; k<3; k++) append_float(&t, vtcs[i][k], 0);
+  }
+  appendf(&t, "\nPOLYGONS %d %d\n", n_faces, 4*n_faces);
+  for (i=0; i<n_faces; i++) {
+    append_word(&t, 3, 0);
+    for (k=0; k<3; k++) append_word(&t, (uint32_t)faces[i][k], 0);
+  }
+  append_str(&t, "\n");
+  check_text("binary VTK", &t, MESH_FF_VTK, N_LARGE_VTCS, n_faces);
+
+  /* binary STL, with a header that does not start with "solid" */
+  t.len = 0;
+  memset(header, ' ', sizeof(header));
+  memcpy(header, "binary STL", 10);
+  append(&t, header, sizeof(header));
+  append_word(&t, (uint32_t)n_faces, 1);
+  for (i=0; i<n_faces; i++) {
+    for (k=0; k<3; k++) append_float(&t, 0, 1); /* normal */
+    for (k=0; k<9; k++) append_float(&t, vtcs[faces[i][k/3]][k%3], 1);
+    append(&t, "\0\0", 2); /* attribute byte count */
+  }
+  check_text("binary STL", &t, MESH_FF_STL, N_LARGE_VTCS, n_faces);
+
+  free(vtcs);
+  free(faces);
+  free(t.buf);
+}
+
+int main(void)
+{
+  check_obj_smf();
+  check_binary();
+  printf("%d failures\n", n_failed);
+  return n_failed == 0 ? 0 : 1;
+}
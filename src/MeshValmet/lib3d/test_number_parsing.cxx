@@ -0,0 +1,324 @@
+/*
+ * Correctness test of the number parsers of model_in.cxx: parse_double() and
+ * parse_long() must give the same values (bit for bit) and stop at the same
+ * place as strtod() and strtol(...,10), or hand the number over to them.
+ * The parsers are static, so model_in.cxx is included here.
+ *
+ * Returns 0 if all the checks pass, 1 otherwise.
+ */
+
+#include "model_in.cxx"
+
+#include <stdio.h>
+#include <errno.h>
+
+/* Number of random inputs */
+#define N_RANDOM 500000
+
+/* Number of checks that failed, and of numbers converted by the parsers
+ * themselves (not handed over to strtod/strtol) */
+static int n_failed = 0;
+static int n_fast = 0;
+
+/* A small deterministic generator, so that failures can be reproduced */
+static uint64_t rng_state = 88172645463325252ULL;
+
+static uint64_t rng(void)
+{
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+/* Returns a copy of 'str' in a buffer of exactly its size, so that reads
+ * past the terminating zero (the 'lim' of the parsers) are caught by memory
+ * checkers. */
+static unsigned char* exact_copy(const char *str)
+{
+  size_t len;
+  unsigned char *buf;
+
+  len = strlen(str);
+  buf = (unsigned char*)malloc(len+1);
+  memcpy(buf, str, len+1);
+  return buf;
+}
+
+/* Checks parse_double() on the string 'str' */
+static void check_double(const char *str)
+{
+  unsigned char *buf;
+  const unsigned char *end;
+  char *ref_end;
+  double d, ref;
+
+  buf = exact_copy(str);
+  d = 0;
+  end = parse_double(buf, buf+strlen(str)+1, &d);
+  if (end == NULL) { /* handed over to strtod() */
+    free(buf);
+    return;
+  }
+  ref = strtod((const char*)buf, &ref_end);
+  if (end != (const unsigned char*)ref_end) {
+    printf("parse_double(\"%s\") stops at %d, strtod() at %d\n", str,
+           (int)(end-buf), (int)(ref_end-(char*)buf));
+    n_failed++;
+  } else if (end != buf && memcmp(&d, &ref, sizeof(d)) != 0) {
+    printf("parse_double(\"%s\") = %.17g, strtod() = %.17g\n", str, d, ref);
+    n_failed++;
+  } else if (end != buf) {
+    n_fast++;
+  }
+  free(buf);
+}
+
+/* Checks parse_long() on the string 'str', as check_double() does */
+static void check_long(const char *str)
+{
+  unsigned char *buf;
+  const unsigned char *end;
+  char *ref_end;
+  long l, ref;
+
+  buf = exact_copy(str);
+  l = 0;
+  end = parse_long(buf, buf+strlen(str)+1, &l);
+  if (end == NULL) { /* handed over to strtol() */
+    free(buf);
+    return;
+  }
+  errno = 0;
+  ref = strtol((const char*)buf, &ref_end, 10);
+  if (end != (const unsigned char*)ref_end) {
+    printf("parse_long(\"%s\") stops at %d, strtol() at %d\n", str,
+           (int)(end-buf), (int)(ref_end-(char*)buf));
+    n_failed++;
+  } else if (end != buf && (l != ref || errno != 0)) {
+    printf("parse_long(\"%s\") = %ld, strtol() = %ld\n", str, l, ref);
+    n_failed++;
+  } else if (end != buf) {
+    n_fast++;
+  }
+  free(buf);
+}
+
+/* Appends 'n' random digits to 's' */
+static char* random_digits(char *s, int n)
+{
+  int i;
+
+  for (i=0; i<n; i++) *s++ = (char)('0'+rng()%10);
+  return s;
+}
+
+/* Writes a random decimal number, or something close to one, into 's' */
+static void random_number(char *s)
+{
+  uint64_t r;
+
+  r = rng();
+  if (r%4 == 0) *s++ = (r%8 == 0) ? '-' : '+';
+  r >>= 3;
+  if (r%8 == 0) { /* leading zeros */
+    *s++ = '0';
+    *s++ = '0';
+  }
+  r >>= 3;
+  s = random_digits(s, (int)(r%24));
+  r >>= 5;
+  if (r%2 == 0) {
+    *s++ = '.';
+    r >>= 1;
+    if (r%4 == 0) { /* leading zeros after the point */
+      memset(s, '0', 1+r%12);
+      s += 1+r%12;
+    }
+    r >>= 4;
+    s = random_digits(s, (int)(r%24));
+  }
+  r = rng();
+  if (r%3 == 0) {
+    *s++ = (r%6 == 0) ? 'e' : 'E';
+    r >>= 3;
+    if (r%3 == 0) *s++ = (r%6 == 0) ? '-' : '+';
+    r >>= 3;
+    if (r%16 != 0) /* "1e" with no exponent digits, once in a while */
+      s += sprintf(s, "%d", (int)(r%70)-35);
+  }
+  *s++ = (rng()%2 == 0) ? ' ' : '\n';
+  *s = '\0';
+}
+
+/* Checks the parsers on edge cases: digit counts around MAX_SIG_DIGITS,
+ * mantissas around 2^53, exponents around the exact powers of ten, leading
+ * zeros, and incomplete numbers. */
+static void check_edge_cases(void)
+{
+  static const char *cases[] = {
+    "0", "-0", "+0", "0.0", "-0.0e5", "00000000000000000000001",
+    "1234567890123456789", "12345678901234567890", "-1234567890123456789",
+    "9999999999999999999", "99999999999999999999",
+    "1.234567890123456789", "1.2345678901234567890", "0.1234567890123456789",
+    "123456789012345678.9", "12345678.12345678", "87654321",
+    "9007199254740992", "9007199254740993", "9007199254740991",
+    "9007199254740992e22", "9007199254740993e-22", "-9007199254740992e-22",
+    "9007199254.740992", "900719925474099.2e-5",
+    "1e22", "1e23", "1e-22", "1e-23", "9e22", "9e-22", "123e21", "123e-25",
+    "0.0000000000000000000000123", "0.00000000000000000000001",
+    "0.000000001234567890123456789", "1.00000000000000000000",
+    "1e", "1e+", "1E-", "-1e", "1.5e", "1ex", "1e5x", "1.e3",
+    ".5", "5.", ".", "-", "+", "+.e1", "-.5e-3", "e5",
+    "0x10", "0X1p3", "inf", "-inf", "nan", "NaN", "Infinity",
+    "1,5", "2\t3", "3#4", "1e0000000000000000000000005",
+    "9223372036854775807", "9223372036854775808", "-9223372036854775808",
+    "-9223372036854775809", "000000000000000000000000009223372036854775807",
+    NULL
+  };
+  char buf[64];
+  int i;
+
+  for (i=0; cases[i] != NULL; i++) {
+    check_double(cases[i]);
+    check_long(cases[i]);
+    /* the same, followed by another number */
+    snprintf(buf, sizeof(buf), "%s 7", cases[i]);
+    check_double(buf);
+    check_long(buf);
+  }
+}
+
+/* Checks the parsers on random numbers, and on doubles printed exactly and
+ * rounded */
+static void check_random(void)
+{
+  char buf[128];
+  uint64_t bits;
+  double d;
+  int i;
+
+  for (i=0; i<N_RANDOM; i++) {
+    random_number(buf);
+    check_double(buf);
+    check_long(buf);
+    do {
+      bits = rng();
+      memcpy(&d, &bits, sizeof(d));
+    } while (d != d || d-d != 0); /* no nan or inf */
+    snprintf(buf, sizeof(buf), "%.*g", (int)(1+rng()%17), d);
+    check_double(buf);
+    snprintf(buf, sizeof(buf), "%.6f", (double)(int64_t)rng()/(1ULL<<(rng()%40)));
+    check_double(buf);
+    snprintf(buf, sizeof(buf), "%ld", (long)(int64_t)rng() >> (rng()%64));
+    check_long(buf);
+  }
+}
+
+#ifdef MESH_USE_MMAP
+/* Reads the numbers of a file ending exactly at a page boundary with the
+ * last digit of a number, through the mapped block (read_fmodel()'s path),
+ * and checks them against strtod()/strtol(). The last number has 16 digits,
+ * so that the 8 digit (SWAR) reads go right up to the boundary, and the
+ * parsers then look at the byte after the file, in the zero page of the
+ * mapping. */
+static void check_mapped_page_end(void)
+{
+  static const char fname[] = "test_number_parsing.tmp";
+  struct file_data data;
+  size_t page, map_len, n, fsize;
+  unsigned char *map;
+  char *text, *p, *ref_end;
+  FILE *f;
+  float v;
+  int i, k, count;
+
+  page = (size_t)sysconf(_SC_PAGESIZE);
+  fsize = 2*page;
+  text = (char*)malloc(fsize+1);
+  n = 0;
+  count = 0;
+  /* Alternate integers and reals, then spaces and a last real that ends on
+   * the last byte */
+  while (n < fsize-40) {
+    if (count%2 == 0)
+      n += sprintf(text+n, "%d ", (int)(rng()%2000000)-1000000);
+    else
+      n += sprintf(text+n, "%.9g\n", (double)(int64_t)rng()/(1ULL<<(rng()%62)));
+    count++;
+  }
+  memset(text+n, ' ', fsize-n);
+  memcpy(text+fsize-17, "12345678.87654321", 17);
+  text[fsize] = '\0';
+  count++;
+
+  f = fopen(fname, "wb");
+  if (f == NULL || fwrite(text, 1, fsize, f) != fsize) {
+    printf("cannot write %s\n", fname);
+    n_failed++;
+    if (f != NULL) fclose(f);
+    free(text);
+    return;
+  }
+  fclose(f);
+
+  map = map_file_data(&data, fname, &map_len);
+  remove(fname);
+  if (map == NULL) {
+    printf("cannot map %s\n", fname);
+    n_failed++;
+    free(text);
+    return;
+  }
+  if (data.block+data.size != map+page+fsize || (map_len-fsize)%page != 0) {
+    printf("the mapped block does not end at a page boundary\n");
+    n_failed++;
+  }
+
+  /* float_scanf() and int_scanf() in turn, against strtod()/strtol() */
+  p = text;
+  for (i=0; i<count; i++) {
+    if (i%2 == 0 && i != count-1) {
+      if (!int_scanf(&data, &k) || k != (int)strtol(p, &ref_end, 10)) {
+        printf("int_scanf() differs from strtol() at number %d\n", i);
+        n_failed++;
+        break;
+      }
+    } else {
+      if (!float_scanf(&data, &v) || v != (float)strtod(p, &ref_end)) {
+        printf("float_scanf() differs from strtod() at number %d\n", i);
+        n_failed++;
+        break;
+      }
+    }
+    p = ref_end;
+    if (data.block+data.pos != (unsigned char*)map+page+(p-text)) {
+      printf("the block position differs from strtod() at number %d\n", i);
+      n_failed++;
+      break;
+    }
+  }
+  if (i == count && data.pos != data.nbytes) {
+    printf("the last number does not end the block\n");
+    n_failed++;
+  }
+  munmap(map, map_len);
+  free(text);
+}
+#endif
+
+int main(void)
+{
+  check_edge_cases();
+  check_random();
+#ifdef MESH_USE_MMAP
+  check_mapped_page_end();
+#endif
+  if (n_fast == 0) {
+    printf("no number was converted by the parsers themselves\n");
+    n_failed++;
+  }
+  printf("%d numbers converted by the parsers, %d failures\n", n_fast,
+         n_failed);
+  return n_failed == 0 ? 0 : 1;
+}
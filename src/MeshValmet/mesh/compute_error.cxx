@@ -153,6 +153,16 @@ struct t_in_cell_list {
   double n_t_per_ne_cell;   /* Average number of triangles per non-empty cell */
 };
 
+/* A cell grid over a bounding box, with the list of triangles intersecting
+ * each cell (the spatial index of a surface for dist_pt_surf()) */
+struct dist_grid {
+  dvertex_t bbox_min;         /* The origin (minimum corner) of the grid */
+  double cell_sz;             /* The side length of the cubic cells */
+  struct size3d grid_sz;      /* The number of cells in the X, Y and Z
+                               * directions */
+  struct t_in_cell_list *fic; /* The triangles intersecting each cell */
+};
+
 /* A list of samples of a surface in 3D space. */
 struct sample_list {
   dvertex_t* sample; /* Array of sample 3D coordinates */
@@ -311,7 +321,12 @@ static void calc_normals_as_oriented_model(struct model *m,
   int k,kmax;
   vertex_t n;
 
-  /* initialize all normals to zero */
+  /* initialize all normals to zero (a borrowed array is replaced, not
+   * reallocated) */
+  if (m->borrowed & MODEL_BORROWS_NORMALS) {
+    m->normals = NULL;
+    m->borrowed &= ~MODEL_BORROWS_NORMALS;
+  }
   m->normals = (vertex_t *)xa_realloc(m->normals,m->num_vert*sizeof(*(m->normals)));
   memset(m->normals,0,m->num_vert*sizeof(*(m->normals)));
   /* add face normals to vertices, weighted by face area */
@@ -347,7 +362,14 @@ static void calc_normals_as_oriented_model(struct model *m,
  * and the user-determined min sampling freq., whichever is smaller.
  */
 
-static int get_sampling_freq(double t_area, double s_density)
+/* The random variable is drawn from a linear congruential generator whose
+ * state is local to each call of the distance functions, rather than from
+ * rand(), so that several comparisons can run concurrently and each gives
+ * the same result from one run to the next. */
+#define SAMPLING_SEED 1u
+
+static int get_sampling_freq(double t_area, double s_density,
+                             unsigned int *seed)
 {
   double rv,p,n_samples;
   int n;
@@ -359,7 +381,8 @@ static int get_sampling_freq(double t_area, double s_density)
    * gives no more than n_samples. The we choose n with probability p, or n+1
    * with probability 1-p, so that p*n*(n+1)/2+(1-p)*(n+1)*(n+2)/2=n_samples,
    * that is the expected value is n_samples. */
-  rv = rand()/(RAND_MAX+1.0); /* rand var. in [0,1) interval */
+  *seed = *seed*1103515245u+12345u;
+  rv = (*seed>>8)/16777216.0; /* rand var. in [0,1) interval */
   n_samples = t_area*s_density;
   n = (int)floor(sqrt(0.25+2*n_samples)-0.5);
   p = (n+2)*0.5-n_samples/(n+1);
@@ -625,18 +648,17 @@ static void get_cells_at_distance(struct dist_cell_lists *dlists,
 
 /* Initializes the triangle '*t' using the '*a' '*b' and '*c' vertices and
  * calculates all the relative fields of the struct. */
-static void init_triangle(const vertex_t *a, const vertex_t *b, 
-                          const vertex_t *c, struct triangle_info *t)
+static void init_triangle(const dvertex_t *a, const dvertex_t *b, 
+                          const dvertex_t *c, struct triangle_info *t)
 {
   dvertex_t dv_a,dv_b,dv_c;
   dvertex_t ab,ac,bc;
   double ab_len_sqr,ac_len_sqr,bc_len_sqr;
   double n_len;
 
-  /* Convert float vertices to double */
-  vertex_f2d_dv(a,&dv_a);
-  vertex_f2d_dv(b,&dv_b);
-  vertex_f2d_dv(c,&dv_c);
+  dv_a = *a;
+  dv_b = *b;
+  dv_c = *c;
   /* Get the vertices in the proper ordering (the orientation is not
    * changed). AB should be the longest side. */
   __substract_v(dv_b,dv_a,ab);
@@ -864,13 +886,17 @@ static INLINE double dist_sqr_pt_cell(const dvertex_t *p, int gr_x, int gr_y,
 
 /* Convert the triangular model m to a triangle list (without connectivity
  * information) with the associated information. All the information about the
- * triangles (i.e. fields of struct triangle_info) is computed. */
-static struct triangle_list* model_to_triangle_list(const struct model *m)
+ * triangles (i.e. fields of struct triangle_info) is computed. If dv is not
+ * NULL it holds the vertices of m in double precision, otherwise they are
+ * converted on the fly. */
+static struct triangle_list* model_to_triangle_list(const struct model *m,
+                                                    const dvertex_t *dv)
 {
   int i,n;
   struct triangle_list *tl;
   struct triangle_info *triags;
   face_t *face_i;
+  dvertex_t v0,v1,v2;
 
   /* Initialize and allocate storage */
   n = m->num_faces;
@@ -883,8 +909,15 @@ static struct triangle_list* model_to_triangle_list(const struct model *m)
   /* Convert triangles and update global data */
   for (i=0; i<n; i++) {
     face_i = &(m->faces[i]);
-    init_triangle(&(m->vertices[face_i->f0]),&(m->vertices[face_i->f1]),
-                  &(m->vertices[face_i->f2]),&(triags[i]));
+    if (dv != NULL) {
+      init_triangle(&(dv[face_i->f0]),&(dv[face_i->f1]),&(dv[face_i->f2]),
+                    &(triags[i]));
+    } else {
+      vertex_f2d_dv(&(m->vertices[face_i->f0]),&v0);
+      vertex_f2d_dv(&(m->vertices[face_i->f1]),&v1);
+      vertex_f2d_dv(&(m->vertices[face_i->f2]),&v2);
+      init_triangle(&v0,&v1,&v2,&(triags[i]));
+    }
     tl->area += triags[i].s_area;
   }
 
@@ -1099,64 +1132,129 @@ static void sample_triangle(const dvertex_t *a, const dvertex_t *b,
   }
 }
 
-/* Given a triangle list tl, returns the list of triangle indices that
- * intersect a cell, for each cell in the grid. The size of the grid is given
- * by grid_sz, the side length of the cubic cells by cell_sz and the minimum
- * coordinates of the bounding box (i.e. origin) of the grid by bbox_min. The
- * returned struct, its arrays and subarrays are malloc'ed independently. */
-static struct t_in_cell_list* 
-triangles_in_cells(const struct triangle_list *tl,
-                   struct size3d grid_sz,
-                   double cell_sz,
-                   dvertex_t bbox_min)
+/* Returns non-zero if the triangle (a,b,c) intersects the axis aligned box
+ * of center ctr and half side length h, zero otherwise. It is the separating
+ * axis test of T. Akenine-Moller ("Fast 3D triangle-box overlap testing",
+ * Journal of Graphics Tools, 6(1), 2001): the triangle and the box do not
+ * intersect if and only if their projections on one of the 3 box face
+ * normals, the triangle normal or the 9 cross products of edge directions
+ * are disjoint. */
+static int triangle_box_overlap(const dvertex_t *a, const dvertex_t *b,
+                                const dvertex_t *c, const dvertex_t *ctr,
+                                double h)
 {
-  struct t_in_cell_list *lst; /* The list to return */
-  struct sample_list sl;      /* samples from a triangle */
-  int **tab;                  /* Table containing the indices of intersecting
-                               * triangles for each cell. */
-  int *nt;                    /* Array with the number of intersecting
-                               * triangles found so far for each cell */
-  ec_bitmap_t *ecb;           /* The empty cell bitmap */
-  int cell_idx,cell_idx_prev; /* linear (1D) cell indices */
+  dvertex_t v0,v1,v2;         /* triangle vertices relative to the center */
+  dvertex_t e0,e1,e2;         /* triangle edges */
+  dvertex_t n;                /* triangle normal */
+  double p0,p1,p2,r,pmin,pmax;
+  double fex,fey,fez;
+
+  __substract_v(*a,*ctr,v0);
+  __substract_v(*b,*ctr,v1);
+  __substract_v(*c,*ctr,v2);
+  __substract_v(v1,v0,e0);
+  __substract_v(v2,v1,e1);
+  __substract_v(v0,v2,e2);
+
+  /* The 9 edge cross product axes. For each, two of the three projections
+   * are equal, so only two are computed. */
+#define AXIS_TEST(pa,pb,ra)                                     \
+  do {                                                          \
+    if ((pa) < (pb)) { pmin = (pa); pmax = (pb); }              \
+    else { pmin = (pb); pmax = (pa); }                          \
+    r = (ra);                                                   \
+    if (pmin > r || pmax < -r) return 0;                        \
+  } while (0)
+
+  fex = fabs(e0.x); fey = fabs(e0.y); fez = fabs(e0.z);
+  p0 = e0.z*v0.y-e0.y*v0.z; p2 = e0.z*v2.y-e0.y*v2.z;
+  AXIS_TEST(p0,p2,(fez+fey)*h);             /* X x e0 */
+  p0 = -e0.z*v0.x+e0.x*v0.z; p2 = -e0.z*v2.x+e0.x*v2.z;
+  AXIS_TEST(p0,p2,(fez+fex)*h);             /* Y x e0 */
+  p1 = e0.y*v1.x-e0.x*v1.y; p2 = e0.y*v2.x-e0.x*v2.y;
+  AXIS_TEST(p1,p2,(fey+fex)*h);             /* Z x e0 */
+
+  fex = fabs(e1.x); fey = fabs(e1.y); fez = fabs(e1.z);
+  p0 = e1.z*v0.y-e1.y*v0.z; p2 = e1.z*v2.y-e1.y*v2.z;
+  AXIS_TEST(p0,p2,(fez+fey)*h);             /* X x e1 */
+  p0 = -e1.z*v0.x+e1.x*v0.z; p2 = -e1.z*v2.x+e1.x*v2.z;
+  AXIS_TEST(p0,p2,(fez+fex)*h);             /* Y x e1 */
+  p0 = e1.y*v0.x-e1.x*v0.y; p1 = e1.y*v1.x-e1.x*v1.y;
+  AXIS_TEST(p0,p1,(fey+fex)*h);             /* Z x e1 */
+
+  fex = fabs(e2.x); fey = fabs(e2.y); fez = fabs(e2.z);
+  p0 = e2.z*v0.y-e2.y*v0.z; p1 = e2.z*v1.y-e2.y*v1.z;
+  AXIS_TEST(p0,p1,(fez+fey)*h);             /* X x e2 */
+  p0 = -e2.z*v0.x+e2.x*v0.z; p1 = -e2.z*v1.x+e2.x*v1.z;
+  AXIS_TEST(p0,p1,(fez+fex)*h);             /* Y x e2 */
+  p1 = e2.y*v1.x-e2.x*v1.y; p2 = e2.y*v2.x-e2.x*v2.y;
+  AXIS_TEST(p1,p2,(fey+fex)*h);             /* Z x e2 */
+
+#undef AXIS_TEST
+
+  /* The box face normals: the triangle bounding box against the box. The
+   * caller only tests cells that intersect the triangle bounding box, but
+   * the box may be larger than the cell (see add_triangles_to_cells()). */
+  if (min3(v0.x,v1.x,v2.x) > h || max3(v0.x,v1.x,v2.x) < -h) return 0;
+  if (min3(v0.y,v1.y,v2.y) > h || max3(v0.y,v1.y,v2.y) < -h) return 0;
+  if (min3(v0.z,v1.z,v2.z) > h || max3(v0.z,v1.z,v2.z) < -h) return 0;
+
+  /* The triangle normal: the plane of the triangle against the box */
+  __crossprod_dv(e0,e1,n);
+  r = h*(fabs(n.x)+fabs(n.y)+fabs(n.z));
+  p0 = __scalprod_v(n,v0);
+  if (p0 > r || p0 < -r) return 0;
+
+  return 1;
+}
+
+/* Adds the triangles of the list tl to the lists of the cells they
+ * intersect. The size of the grid is given by grid_sz, the side length of the
+ * cubic cells by cell_sz and the minimum coordinates of the bounding box
+ * (i.e. origin) of the grid by bbox_min. The index of triangle i of tl is
+ * stored as i+idx_offset. tab[k] is the list of the nt[k] triangles
+ * intersecting cell k so far, it is realloc'ed as needed and is always large
+ * enough to hold two more elements. The triangles are added in index order,
+ * without duplicates. */
+static void add_triangles_to_cells(const struct triangle_list *tl,
+                                   int idx_offset, struct size3d grid_sz,
+                                   double cell_sz, dvertex_t bbox_min,
+                                   int **tab, int *nt)
+{
+  const struct triangle_info *t; /* current triangle */
+  int cell_idx;               /* linear (1D) cell index */
   int cell_stride_z;          /* spacement for Z index in 3D addressing of
                                * cell list */
-  int i,j,h,imax;             /* counters and loop limits */
+  int i,imax;                 /* counters and loop limits */
   int m_a,n_a,o_a,m_b,n_b,o_b,m_c,n_c,o_c; /* 3D cell indices for vertices */
-  int tmpi,max_cell_dist;     /* maximum cell distance along any axis */
-  int n_samples;              /* number of samples to use for triangles */
-  int m,n,o;                  /* 3D cell indices for samples */
-  int *c_buf;                 /* temp storage for cell list */
-  int c_buf_sz;               /* the size of c_buf */
-
-  /* Initialize */
+  int m0,m1,n0,n1,o0,o1;      /* range of 3D cell indices of the triangle's
+                               * bounding box */
+  int m,n,o;                  /* 3D cell indices */
+  dvertex_t ctr;              /* center of current cell */
+  double h;                   /* half side length of the tested boxes */
+
+  /* Initialize. The boxes are slightly enlarged so that rounding can not
+   * make a triangle that touches a cell miss it. */
   cell_stride_z = grid_sz.x*grid_sz.y;
-  c_buf = NULL;
-  c_buf_sz = 0;
-  memset(&(sl.sample),0,sizeof(sl));
-  lst = (struct t_in_cell_list *)xa_malloc(sizeof(*lst));
-  nt = (int *)xa_calloc(grid_sz.x*grid_sz.y*grid_sz.z,sizeof(*nt));
-  tab = (int **)xa_calloc(grid_sz.x*grid_sz.y*grid_sz.z,sizeof(*tab));
-  ecb = (int *)xa_calloc((grid_sz.x*grid_sz.y*grid_sz.z+EC_BITMAP_T_BITS-1)/
-                  EC_BITMAP_T_BITS,EC_BITMAP_T_SZ);
-  lst->triag_idx = tab;
-  lst->n_cells = grid_sz.x*grid_sz.y*grid_sz.z;
-  lst->empty_cell = ecb;
+  h = 0.5*cell_sz*(1+1e-6);
 
   /* Get intersecting cells for each triangle */
   for (i=0, imax=tl->n_triangles; i<imax;i++) {
+    t = &(tl->triangles[i]);
     /* Get the cells in which the triangle vertices are. For non-negative
      * values, cast to int is equivalent to floor and probably faster (here
      * negative values can not happen since bounding box is obtained from the
-     * vertices in tl). */
-    m_a = (int)((tl->triangles[i].a.x-bbox_min.x)/cell_sz);
-    n_a = (int)((tl->triangles[i].a.y-bbox_min.y)/cell_sz);
-    o_a = (int)((tl->triangles[i].a.z-bbox_min.z)/cell_sz);
-    m_b = (int)((tl->triangles[i].b.x-bbox_min.x)/cell_sz);
-    n_b = (int)((tl->triangles[i].b.y-bbox_min.y)/cell_sz);
-    o_b = (int)((tl->triangles[i].b.z-bbox_min.z)/cell_sz);
-    m_c = (int)((tl->triangles[i].c.x-bbox_min.x)/cell_sz);
-    n_c = (int)((tl->triangles[i].c.y-bbox_min.y)/cell_sz);
-    o_c = (int)((tl->triangles[i].c.z-bbox_min.z)/cell_sz);
+     * vertices in tl). Vertices on the maximum faces of the bounding box can
+     * be one past the last cell, so indices are limited to the grid. */
+    m_a = min((int)((t->a.x-bbox_min.x)/cell_sz),grid_sz.x-1);
+    n_a = min((int)((t->a.y-bbox_min.y)/cell_sz),grid_sz.y-1);
+    o_a = min((int)((t->a.z-bbox_min.z)/cell_sz),grid_sz.z-1);
+    m_b = min((int)((t->b.x-bbox_min.x)/cell_sz),grid_sz.x-1);
+    n_b = min((int)((t->b.y-bbox_min.y)/cell_sz),grid_sz.y-1);
+    o_b = min((int)((t->b.z-bbox_min.z)/cell_sz),grid_sz.z-1);
+    m_c = min((int)((t->c.x-bbox_min.x)/cell_sz),grid_sz.x-1);
+    n_c = min((int)((t->c.y-bbox_min.y)/cell_sz),grid_sz.y-1);
+    o_c = min((int)((t->c.z-bbox_min.z)/cell_sz),grid_sz.z-1);
 
     if (m_a == m_b && m_a == m_c && n_a == n_b && n_a == n_c &&
         o_a == o_b && o_a == o_c) {
@@ -1164,80 +1262,52 @@ triangles_in_cells(const struct triangle_list *tl,
       cell_idx = m_a+n_a*grid_sz.x+o_a*cell_stride_z;
       assert(cell_idx >= 0 && cell_idx < grid_sz.x*grid_sz.y*grid_sz.z);
       tab[cell_idx] = (int *)xa_realloc(tab[cell_idx],(nt[cell_idx]+2)*sizeof(**tab));
-      tab[cell_idx][nt[cell_idx]++] = i;
+      tab[cell_idx][nt[cell_idx]++] = i+idx_offset;
       continue;
     }
 
-    /* Triangle does not fit in one cell, how many cells does the triangle
-     * span ? */
-    max_cell_dist = abs(m_a-m_b);
-    if ((tmpi = abs(m_a-m_c)) > max_cell_dist) max_cell_dist = tmpi;
-    if ((tmpi = abs(m_b-m_c)) > max_cell_dist) max_cell_dist = tmpi;
-    if ((tmpi = abs(n_a-n_b)) > max_cell_dist) max_cell_dist = tmpi;
-    if ((tmpi = abs(n_a-n_c)) > max_cell_dist) max_cell_dist = tmpi;
-    if ((tmpi = abs(n_b-n_c)) > max_cell_dist) max_cell_dist = tmpi;
-    if ((tmpi = abs(o_a-o_b)) > max_cell_dist) max_cell_dist = tmpi;
-    if ((tmpi = abs(o_a-o_c)) > max_cell_dist) max_cell_dist = tmpi;
-    if ((tmpi = abs(o_b-o_c)) > max_cell_dist) max_cell_dist = tmpi;
-    /* Sample the triangle so as to have twice the samples in any direction
-     * than the number of cells spanned in that direction. */
-    n_samples = 2*(max_cell_dist+1);
-    sample_triangle(&(tl->triangles[i].a),&(tl->triangles[i].b),
-                    &(tl->triangles[i].c),n_samples,&sl);
-    /* Get the intersecting cells from the samples */
-    cell_idx_prev = -1;
-    h = 0;
-    for(j=0;j<sl.n_samples;j++){
-      /* Get cell in which the sample is. Due to rounding in the triangle
-       * sampling process we check the indices to be within bounds. As above,
-       * we can use cast to int instead of floor (probably faster) */
-      m=(int)((sl.sample[j].x-bbox_min.x)/cell_sz);
-      if(m >= grid_sz.x) {
-        m = grid_sz.x - 1;
-      } else if (m < 0) {
-        m = 0;
-      }
-      n=(int)((sl.sample[j].y-bbox_min.y)/cell_sz);
-      if (n >= grid_sz.y) {
-        n = grid_sz.y - 1;
-      } else if (n < 0) {
-        n = 0;
-      }
-      o=(int)((sl.sample[j].z-bbox_min.z)/cell_sz);
-      if (o >= grid_sz.z) {
-        o = grid_sz.z - 1;
-      } else if (o < 0) {
-        o = 0;
-      }
-
-      /* Include cell index in list only if not the same as previous one
-       * (avoid too many duplicates). */
-      cell_idx = m + n*grid_sz.x + o*cell_stride_z;
-      assert(cell_idx >= 0 && cell_idx < grid_sz.x*grid_sz.y*grid_sz.z);
-      if (cell_idx != cell_idx_prev) {
-        if (c_buf_sz <= h) {
-          c_buf = (int *)xa_realloc(c_buf, (h+1)*sizeof(*c_buf));
-          c_buf_sz++;
+    /* Triangle does not fit in one cell: test each cell of its bounding box
+     * (in linear index order, so that no duplicates can occur) */
+    m0 = min3(m_a,m_b,m_c); m1 = max3(m_a,m_b,m_c);
+    n0 = min3(n_a,n_b,n_c); n1 = max3(n_a,n_b,n_c);
+    o0 = min3(o_a,o_b,o_c); o1 = max3(o_a,o_b,o_c);
+    for (o=o0; o<=o1; o++) {
+      ctr.z = bbox_min.z+(o+0.5)*cell_sz;
+      for (n=n0; n<=n1; n++) {
+        ctr.y = bbox_min.y+(n+0.5)*cell_sz;
+        for (m=m0; m<=m1; m++) {
+          ctr.x = bbox_min.x+(m+0.5)*cell_sz;
+          if (!triangle_box_overlap(&(t->a),&(t->b),&(t->c),&ctr,h)) continue;
+          cell_idx = m + n*grid_sz.x + o*cell_stride_z;
+          assert(cell_idx >= 0 && cell_idx < grid_sz.x*grid_sz.y*grid_sz.z);
+          tab[cell_idx] = (int *)xa_realloc(tab[cell_idx],
+                                     (nt[cell_idx]+2)*sizeof(**tab));
+          tab[cell_idx][nt[cell_idx]++] = i+idx_offset;
         }
-        c_buf[h++] = cell_idx;
-        cell_idx_prev = cell_idx;
-      }
-    }
-
-    /* Include triangle in intersecting cell lists, without duplicate. */
-    for (j=0; j<h; j++) {
-      cell_idx = c_buf[j];
-      assert(cell_idx >= 0 && cell_idx < grid_sz.x*grid_sz.y*grid_sz.z);
-      if (nt[cell_idx] == 0 || tab[cell_idx][nt[cell_idx]-1] != i) {
-        tab[cell_idx] = (int *)xa_realloc(tab[cell_idx],
-                                   (nt[cell_idx]+2)*sizeof(**tab));
-        tab[cell_idx][nt[cell_idx]++] = i;
       }
     }
   }
+}
+
+/* Terminates the n_cells cell lists in tab, of nt[k] triangles each (as
+ * filled by add_triangles_to_cells()), and returns them as a struct
+ * t_in_cell_list, which takes ownership of tab. */
+static struct t_in_cell_list* make_t_in_cell_list(int **tab, const int *nt,
+                                                  int n_cells)
+{
+  struct t_in_cell_list *lst; /* The list to return */
+  ec_bitmap_t *ecb;           /* The empty cell bitmap */
+  int i,j,h;                  /* counters */
+
+  lst = (struct t_in_cell_list *)xa_malloc(sizeof(*lst));
+  ecb = (ec_bitmap_t *)xa_calloc((n_cells+EC_BITMAP_T_BITS-1)/
+                                 EC_BITMAP_T_BITS,EC_BITMAP_T_SZ);
+  lst->triag_idx = tab;
+  lst->n_cells = n_cells;
+  lst->empty_cell = ecb;
 
   /* Terminate lists with -1 and set empty cell bitmap */
-  for(i=0, j=0, h=0, imax=grid_sz.x*grid_sz.y*grid_sz.z; i<imax; i++){
+  for(i=0, j=0, h=0; i<n_cells; i++){
     if (nt[i] == 0) { /* mark empty cell in bitmap */
       EC_BITMAP_SET_BIT(ecb,i);
     } else {
@@ -1249,12 +1319,112 @@ triangles_in_cells(const struct triangle_list *tl,
 
   lst->n_ne_cells = j;
   lst->n_t_per_ne_cell = (double)h/j;
+  return lst;
+}
+
+/* Given a triangle list tl, returns the list of triangle indices that
+ * intersect a cell, for each cell in the grid. The size of the grid is given
+ * by grid_sz, the side length of the cubic cells by cell_sz and the minimum
+ * coordinates of the bounding box (i.e. origin) of the grid by bbox_min. The
+ * returned struct, its arrays and subarrays are malloc'ed independently. */
+static struct t_in_cell_list* 
+triangles_in_cells(const struct triangle_list *tl,
+                   struct size3d grid_sz,
+                   double cell_sz,
+                   dvertex_t bbox_min)
+{
+  struct t_in_cell_list *lst; /* The list to return */
+  int **tab;                  /* Table containing the indices of intersecting
+                               * triangles for each cell. */
+  int *nt;                    /* Array with the number of intersecting
+                               * triangles found so far for each cell */
+  int n_cells;                /* The number of cells */
+
+  n_cells = grid_sz.x*grid_sz.y*grid_sz.z;
+  nt = (int *)xa_calloc(n_cells,sizeof(*nt));
+  tab = (int **)xa_calloc(n_cells,sizeof(*tab));
+  add_triangles_to_cells(tl,0,grid_sz,cell_sz,bbox_min,tab,nt);
+  lst = make_t_in_cell_list(tab,nt,n_cells);
   free(nt);
-  free(sl.sample);
-  free(c_buf);
   return lst;
 }
 
+/* Given the triangle lists tl1 and tl2 of two models, builds a single grid of
+ * cell lists holding the triangles of both, and returns in *fic1 and *fic2
+ * the lists of triangle indices (relative to tl1 and tl2, respectively) that
+ * intersect each cell. The grid is given by grid_sz, cell_sz and bbox_min as
+ * in triangles_in_cells(). Both lists share the per cell storage, which is
+ * returned in *storage (an array of grid_sz.x*grid_sz.y*grid_sz.z lists) and
+ * must be freed with free_split_cell_lists(), along with *fic1 and *fic2. */
+static void triangles_in_cells_split(const struct triangle_list *tl1,
+                                     const struct triangle_list *tl2,
+                                     struct size3d grid_sz, double cell_sz,
+                                     dvertex_t bbox_min,
+                                     struct t_in_cell_list **fic1,
+                                     struct t_in_cell_list **fic2,
+                                     int ***storage)
+{
+  int **tab;                  /* cell lists of both models, tagged by index
+                               * (model 2 indices offset by n1) */
+  int *nt;                    /* number of triangles in each list of tab */
+  int **tab1,**tab2;          /* per model views of the cell lists */
+  int *nt1,*nt2;              /* number of triangles in tab1 and tab2 */
+  int n_cells,n1,i,j,k1;
+
+  n_cells = grid_sz.x*grid_sz.y*grid_sz.z;
+  n1 = tl1->n_triangles;
+  nt = (int *)xa_calloc(n_cells,sizeof(*nt));
+  tab = (int **)xa_calloc(n_cells,sizeof(*tab));
+  add_triangles_to_cells(tl1,0,grid_sz,cell_sz,bbox_min,tab,nt);
+  add_triangles_to_cells(tl2,n1,grid_sz,cell_sz,bbox_min,tab,nt);
+
+  /* Each list has the triangles of model 1 first (they are added first and
+   * in index order). Split it in place into a -1 terminated list for each
+   * model: [model 1 indices, -1, model 2 indices, -1] */
+  nt1 = (int *)xa_calloc(n_cells,sizeof(*nt1));
+  nt2 = (int *)xa_calloc(n_cells,sizeof(*nt2));
+  tab1 = (int **)xa_calloc(n_cells,sizeof(*tab1));
+  tab2 = (int **)xa_calloc(n_cells,sizeof(*tab2));
+  for (i=0; i<n_cells; i++) {
+    if (nt[i] == 0) continue;
+    for (k1=0; k1<nt[i] && tab[i][k1]<n1; k1++);
+    tab[i] = (int *)xa_realloc(tab[i],(nt[i]+2)*sizeof(**tab));
+    for (j=nt[i]; j>k1; j--) {
+      tab[i][j] = tab[i][j-1]-n1;
+    }
+    tab[i][k1] = -1;
+    nt1[i] = k1;
+    nt2[i] = nt[i]-k1;
+    if (nt1[i] > 0) tab1[i] = tab[i];
+    if (nt2[i] > 0) tab2[i] = tab[i]+k1+1;
+  }
+  *fic1 = make_t_in_cell_list(tab1,nt1,n_cells);
+  *fic2 = make_t_in_cell_list(tab2,nt2,n_cells);
+  *storage = tab;
+  free(nt);
+  free(nt1);
+  free(nt2);
+}
+
+/* Frees the cell lists returned by triangles_in_cells_split() */
+static void free_split_cell_lists(struct t_in_cell_list *fic1,
+                                  struct t_in_cell_list *fic2,
+                                  int **storage)
+{
+  int k;
+
+  for (k=0; k<fic1->n_cells; k++) {
+    free(storage[k]);
+  }
+  free(storage);
+  free(fic1->triag_idx);
+  free(fic1->empty_cell);
+  free(fic1);
+  free(fic2->triag_idx);
+  free(fic2->empty_cell);
+  free(fic2);
+}
+
 /* Returns the distance from point p to the surface defined by the triangle
  * list tl. The distance from a point to a surface is defined as the distance
  * from a point to the closest point on the surface. To speed up the search
@@ -1347,10 +1517,14 @@ static double dist_pt_surf(dvertex_t p, const struct triangle_list *tl,
   }
 
   /* Determine starting k, based on previous point (which is typically close
-   * to current point) and its distance to closest triangle */
+   * to current point) and its distance to closest triangle. The bound does
+   * not hold for the cell a point out of the grid is clamped to, so such
+   * points start at k equal 0. */
   dmin = prev_d-dist_dv(&p,prev_p);
   k = (int) floor(dmin*SQRT_1_3/cell_sz)-2;
-  if (k <0) k = 0;
+  if (k <0 || p_rel.x < 0 || p_rel.y < 0 || p_rel.z < 0 ||
+      p_rel.x >= grid_sz.x*cell_sz || p_rel.y >= grid_sz.y*cell_sz ||
+      p_rel.z >= grid_sz.z*cell_sz) k = 0;
 
   /* Scan cells, at sequentially increasing index distance k */
   kmax = max3(grid_sz.x,grid_sz.y,grid_sz.z);
@@ -1428,20 +1602,78 @@ static double dist_pt_surf(dvertex_t p, const struct triangle_list *tl,
     return -sqrt(dmin_sqr);
 }
 
-/* --------------------------------------------------------------------------*
- *                          External functions                               *
- * --------------------------------------------------------------------------*/
+/* Builds the cell grid, on the bounding box given by bbox_min and bbox_max,
+ * for the surface tl. The returned struct and its arrays are malloc'ed and
+ * must be freed with free_dist_grid(). */
+static struct dist_grid* make_dist_grid(const struct triangle_list *tl,
+                                        const dvertex_t *bbox_min,
+                                        const dvertex_t *bbox_max)
+{
+  struct dist_grid *grid;
+
+  grid = (struct dist_grid *)xa_malloc(sizeof(*grid));
+  grid->bbox_min = *bbox_min;
+  grid->cell_sz = get_cell_size(tl,bbox_min,bbox_max,&(grid->grid_sz));
+  grid->fic = triangles_in_cells(tl,grid->grid_sz,grid->cell_sz,
+                                 grid->bbox_min);
+  return grid;
+}
 
-/* See compute_error.h */
-void dist_surf_surf(struct model_error *me1, struct model *m2, 
-        double sampling_density, int min_sample_freq,
-                    struct dist_surf_surf_stats *stats, int calc_normals,
-                    struct prog_reporter *prog)
+/* Frees the grid returned by make_dist_grid() */
+static void free_dist_grid(struct dist_grid *grid)
+{
+  int k,kmax;
+
+  if (grid == NULL) return;
+  for (k=0, kmax=grid->fic->n_cells; k<kmax; k++) {
+    free(grid->fic->triag_idx[k]);
+  }
+  free(grid->fic->triag_idx);
+  free(grid->fic->empty_cell);
+  free(grid->fic);
+  free(grid);
+}
+
+/* Frees the list returned by model_to_triangle_list() */
+static void free_triangle_list(struct triangle_list *tl)
+{
+  if (tl == NULL) return;
+  free(tl->triangles);
+  free(tl);
+}
+
+/* Frees the cache of cells at each distance used by dist_pt_surf(), for a
+ * grid of grid_sz cells. */
+static void free_dist_cell_lists(struct dist_cell_lists *dcl,
+                                 struct size3d grid_sz)
+{
+  int i,k,kmax;
+
+  for (k=0, kmax=grid_sz.x*grid_sz.y*grid_sz.z; k<kmax; k++) {
+    if (dcl[k].list != NULL) {
+      for (i=0; i<dcl[k].n_dists; i++) {
+        free(dcl[k].list[i].cell);
+      }
+      free(dcl[k].list);
+    }
+  }
+  free(dcl);
+}
+
+/* Does the work of dist_surf_surf(), given the triangle list tl2 of m2 and
+ * its cell grid. If not NULL, dv1 and farea1 hold the vertices of me1->mesh
+ * in double precision and its face areas, which are otherwise computed on
+ * the fly. */
+static void dist_surf_surf_grid(struct model_error *me1, const dvertex_t *dv1,
+                                const double *farea1, struct model *m2,
+                                const struct triangle_list *tl2,
+                                const struct dist_grid *grid,
+                                double sampling_density, int min_sample_freq,
+                                struct dist_surf_surf_stats *stats,
+                                int calc_normals, struct prog_reporter *prog)
 {
   struct model *m1;           /* The m1 model mesh */
-  dvertex_t bbox_min,bbox_max;/* min and max of bounding box of m1 and m2 */
-  struct triangle_list *tl2;  /* triangle list for m2 */
-  struct t_in_cell_list *fic; /* list of faces intersecting each cell */
+  const struct t_in_cell_list *fic; /* list of faces intersecting each cell */
   struct sample_list ts;      /* list of sample from a triangle */
   struct triag_sample_error tse; /* the errors at the triangle samples */
   int n;                      /* sampling frequency for current triangle */
@@ -1456,7 +1688,9 @@ void dist_surf_surf(struct model_error *me1, struct model *m2,
   dvertex_t prev_p;           /* previous point */
   double prev_d;              /* distance for previous point */
   dvertex_t v1,v2,v3;         /* double version of triangle vertices */
+  dvertex_t bbox_min;         /* origin of the grid */
   struct misc_stats m_stats;  /* temporary structure for temp stats */
+  unsigned int seed;          /* state of the sampling random variable */
 #ifdef DO_DIST_PT_SURF_STATS
   struct dist_pt_surf_stats dps_stats; /* Statistics */
 #endif
@@ -1467,28 +1701,22 @@ void dist_surf_surf(struct model_error *me1, struct model *m2,
   memset(&tse,0,sizeof(tse));
   report_step = (int) (m1->num_faces/(100.0/2)); /* report every 2 % */
   if (report_step <= 0) report_step = 1;
-  bbox_min.x = min(m1->bBox[0].x,m2->bBox[0].x);
-  bbox_min.y = min(m1->bBox[0].y,m2->bBox[0].y);
-  bbox_min.z = min(m1->bBox[0].z,m2->bBox[0].z);
-  bbox_max.x = max(m1->bBox[1].x,m2->bBox[1].x);
-  bbox_max.y = max(m1->bBox[1].y,m2->bBox[1].y);
-  bbox_max.z = max(m1->bBox[1].z,m2->bBox[1].z);
+  bbox_min = grid->bbox_min;
+  cell_sz = grid->cell_sz;
+  grid_sz = grid->grid_sz;
+  fic = grid->fic;
   prev_p.x = 0;
   prev_p.y = 0;
   prev_p.z = 0;
   prev_d = 0;
+  seed = SAMPLING_SEED;
 
-  /* Get the triangle list from model 2 and determine the grid and cell size */
-  tl2 = model_to_triangle_list(m2);
-  //cell_sz: side length of the cubic cell
-  cell_sz = get_cell_size(tl2,&bbox_min,&bbox_max,&grid_sz);
+  /* The cache of cells at each distance is filled as we go, so it is per
+   * call (the grid itself is only read) */
   dcl = (struct dist_cell_lists *)xa_calloc(grid_sz.x*grid_sz.y*grid_sz.z,sizeof(*dcl));
   dcl_buf = NULL;
   dcl_buf_sz = 0;
 
-  /* Get the list of triangles in each cell */
-  fic = triangles_in_cells(tl2,grid_sz,cell_sz,bbox_min);
-
   /* Allocate storage for errors */
   me1->fe = (struct face_error *)xa_realloc(me1->fe,m1->num_faces*sizeof(*(me1->fe)));
 
@@ -1515,12 +1743,19 @@ void dist_surf_surf(struct model_error *me1, struct model *m2,
     if (prog != NULL && k!=0 && k%report_step==0) {
       prog_report(prog,(100*k/(kmax-1)));
     }
-    vertex_f2d_dv(&(m1->vertices[m1->faces[k].f0]),&v1);
-    vertex_f2d_dv(&(m1->vertices[m1->faces[k].f1]),&v2);
-    vertex_f2d_dv(&(m1->vertices[m1->faces[k].f2]),&v3);
-    me1->fe[k].face_area = tri_area_dv(&v1,&v2,&v3);
+    if (dv1 != NULL) {
+      v1 = dv1[m1->faces[k].f0];
+      v2 = dv1[m1->faces[k].f1];
+      v3 = dv1[m1->faces[k].f2];
+    } else {
+      vertex_f2d_dv(&(m1->vertices[m1->faces[k].f0]),&v1);
+      vertex_f2d_dv(&(m1->vertices[m1->faces[k].f1]),&v2);
+      vertex_f2d_dv(&(m1->vertices[m1->faces[k].f2]),&v3);
+    }
+    me1->fe[k].face_area = (farea1 != NULL) ? farea1[k] :
+      tri_area_dv(&v1,&v2,&v3);
     if (me1->fe[k].face_area < DMARGIN*DBL_MIN) continue; /* degenerate */
-    n = get_sampling_freq(me1->fe[k].face_area,sampling_density);
+    n = get_sampling_freq(me1->fe[k].face_area,sampling_density,&seed);
     if (n < min_sample_freq) n = min_sample_freq;
     realloc_triag_sample_error(&tse,n);
     sample_triangle(&v1,&v2,&v3,n,&ts);
@@ -1569,28 +1804,291 @@ void dist_surf_surf(struct model_error *me1, struct model *m2,
   }
 
   /* free temporary storage */
-  free(tl2->triangles);
-  free(tl2);
-  for (k=0, kmax=fic->n_cells; k<kmax; k++) {
-    free(fic->triag_idx[k]);
+  free_dist_cell_lists(dcl,grid_sz);
+  free(dcl_buf);
+  free_triag_sample_error(&tse);
+  free(ts.sample);
+}
+
+/* Does the work of dist_surf_surf_symmetric(), given the triangle lists tl1
+ * and tl2 of the two models. The optional dv1, farea1, dv2 and farea2 are as
+ * in dist_surf_surf_grid(). */
+static void dist_surf_surf_sym_lists(struct model_error *me1,
+                                     const dvertex_t *dv1,
+                                     const double *farea1,
+                                     const struct triangle_list *tl1,
+                                     struct model_error *me2,
+                                     const dvertex_t *dv2,
+                                     const double *farea2,
+                                     const struct triangle_list *tl2,
+                                     double sampling_density1,
+                                     double sampling_density2,
+                                     int min_sample_freq,
+                                     struct dist_surf_surf_stats *stats1,
+                                     struct dist_surf_surf_stats *stats2,
+                                     int calc_normals,
+                                     struct prog_reporter *prog)
+{
+  struct model *m1,*m2;       /* The model meshes */
+  dvertex_t bbox_max;         /* max of bounding box of m1 and m2 */
+  struct triangle_list tl12;  /* size and area of both lists, for the grid */
+  struct dist_grid grid1;     /* grid view with the triangles of m1 */
+  struct dist_grid grid2;     /* grid view with the triangles of m2 */
+  int **storage;              /* cell lists shared by grid1 and grid2 */
+
+  m1 = me1->mesh;
+  m2 = me2->mesh;
+  grid1.bbox_min.x = min(m1->bBox[0].x,m2->bBox[0].x);
+  grid1.bbox_min.y = min(m1->bBox[0].y,m2->bBox[0].y);
+  grid1.bbox_min.z = min(m1->bBox[0].z,m2->bBox[0].z);
+  bbox_max.x = max(m1->bBox[1].x,m2->bBox[1].x);
+  bbox_max.y = max(m1->bBox[1].y,m2->bBox[1].y);
+  bbox_max.z = max(m1->bBox[1].z,m2->bBox[1].z);
+
+  /* One grid, sized for the triangles of both models */
+  tl12.triangles = NULL;
+  tl12.n_triangles = tl1->n_triangles+tl2->n_triangles;
+  tl12.area = tl1->area+tl2->area;
+  grid1.cell_sz = get_cell_size(&tl12,&(grid1.bbox_min),&bbox_max,
+                                &(grid1.grid_sz));
+  grid2 = grid1;
+  triangles_in_cells_split(tl1,tl2,grid1.grid_sz,grid1.cell_sz,
+                           grid1.bbox_min,&(grid1.fic),&(grid2.fic),&storage);
+
+  dist_surf_surf_grid(me1,dv1,farea1,m2,tl2,&grid2,sampling_density1,
+                      min_sample_freq,stats1,calc_normals,prog);
+  dist_surf_surf_grid(me2,dv2,farea2,m1,tl1,&grid1,sampling_density2,
+                      min_sample_freq,stats2,calc_normals,prog);
+
+  free_split_cell_lists(grid1.fic,grid2.fic,storage);
+}
+
+/* --------------------------------------------------------------------------*
+ *                          External functions                               *
+ * --------------------------------------------------------------------------*/
+
+/* See compute_error.h */
+void dist_surf_surf(struct model_error *me1, struct model *m2, 
+        double sampling_density, int min_sample_freq,
+                    struct dist_surf_surf_stats *stats, int calc_normals,
+                    struct prog_reporter *prog)
+{
+  struct model *m1;           /* The m1 model mesh */
+  dvertex_t bbox_min,bbox_max;/* min and max of bounding box of m1 and m2 */
+  struct triangle_list *tl2;  /* triangle list for m2 */
+  struct dist_grid *grid;     /* cell grid for m2 */
+
+  m1 = me1->mesh;
+  bbox_min.x = min(m1->bBox[0].x,m2->bBox[0].x);
+  bbox_min.y = min(m1->bBox[0].y,m2->bBox[0].y);
+  bbox_min.z = min(m1->bBox[0].z,m2->bBox[0].z);
+  bbox_max.x = max(m1->bBox[1].x,m2->bBox[1].x);
+  bbox_max.y = max(m1->bBox[1].y,m2->bBox[1].y);
+  bbox_max.z = max(m1->bBox[1].z,m2->bBox[1].z);
+
+  /* Get the triangle list from model 2 and the grid on the bounding box of
+   * both models */
+  tl2 = model_to_triangle_list(m2,NULL);
+  grid = make_dist_grid(tl2,&bbox_min,&bbox_max);
+
+  dist_surf_surf_grid(me1,NULL,NULL,m2,tl2,grid,sampling_density,
+                      min_sample_freq,stats,calc_normals,prog);
+
+  free_dist_grid(grid);
+  free_triangle_list(tl2);
+}
+
+/* See compute_error.h */
+void dist_surf_surf_prepared(struct model_error *me1,
+                             const struct prepared_mesh *pm1,
+                             struct prepared_mesh *pm2,
+                             double sampling_density, int min_sample_freq,
+                             struct dist_surf_surf_stats *stats,
+                             int calc_normals, struct prog_reporter *prog)
+{
+  prepared_mesh_build_dist_index(pm2);
+  me1->mesh = pm1->mesh;
+  dist_surf_surf_grid(me1,pm1->dvertices,pm1->face_area,pm2->mesh,pm2->tl,
+                      pm2->grid,sampling_density,min_sample_freq,stats,
+                      calc_normals,prog);
+}
+
+/* See compute_error.h */
+void dist_surf_surf_symmetric(struct model_error *me1, struct model_error *me2,
+                              double sampling_density1,
+                              double sampling_density2, int min_sample_freq,
+                              struct dist_surf_surf_stats *stats1,
+                              struct dist_surf_surf_stats *stats2,
+                              int calc_normals, struct prog_reporter *prog)
+{
+  struct triangle_list *tl1,*tl2;
+
+  tl1 = model_to_triangle_list(me1->mesh,NULL);
+  tl2 = model_to_triangle_list(me2->mesh,NULL);
+  dist_surf_surf_sym_lists(me1,NULL,NULL,tl1,me2,NULL,NULL,tl2,
+                           sampling_density1,sampling_density2,
+                           min_sample_freq,stats1,stats2,calc_normals,prog);
+  free_triangle_list(tl1);
+  free_triangle_list(tl2);
+}
+
+/* See compute_error.h */
+void dist_surf_surf_symmetric_prepared(struct model_error *me1,
+                                       struct model_error *me2,
+                                       struct prepared_mesh *pm1,
+                                       struct prepared_mesh *pm2,
+                                       double sampling_density1,
+                                       double sampling_density2,
+                                       int min_sample_freq,
+                                       struct dist_surf_surf_stats *stats1,
+                                       struct dist_surf_surf_stats *stats2,
+                                       int calc_normals,
+                                       struct prog_reporter *prog)
+{
+  if (pm1->tl == NULL) {
+    pm1->tl = model_to_triangle_list(pm1->mesh,pm1->dvertices);
   }
-  free(fic->triag_idx);
-  free(fic->empty_cell);
-  free(fic);
-  for (k=0, kmax=grid_sz.x*grid_sz.y*grid_sz.z; k<kmax; k++) {
-    if (dcl[k].list != NULL) {
-      for (i=0; i<dcl[k].n_dists; i++) {
-        free(dcl[k].list[i].cell);
-      }
-      free(dcl[k].list);
+  if (pm2->tl == NULL) {
+    pm2->tl = model_to_triangle_list(pm2->mesh,pm2->dvertices);
+  }
+  me1->mesh = pm1->mesh;
+  me2->mesh = pm2->mesh;
+  dist_surf_surf_sym_lists(me1,pm1->dvertices,pm1->face_area,pm1->tl,
+                           me2,pm2->dvertices,pm2->face_area,pm2->tl,
+                           sampling_density1,sampling_density2,
+                           min_sample_freq,stats1,stats2,calc_normals,prog);
+}
+
+/* See compute_error.h */
+void dist_surf_field(struct model_error *me1,
+                     const struct prepared_mesh *pm1,
+                     dist_field_t field, void *field_data,
+                     double sampling_density, int min_sample_freq,
+                     struct dist_surf_surf_stats *stats)
+{
+  struct model *m1;           /* The m1 model mesh */
+  struct sample_list ts;      /* list of sample from a triangle */
+  struct triag_sample_error tse; /* the errors at the triangle samples */
+  int n;                      /* sampling frequency for current triangle */
+  int i,k,kmax;               /* counters and loop limits */
+  dvertex_t v1,v2,v3;         /* double version of triangle vertices */
+  struct misc_stats m_stats;  /* temporary structure for temp stats */
+  unsigned int seed;          /* state of the sampling random variable */
+
+  /* Initialize, as in dist_surf_surf_grid() */
+  m1 = pm1->mesh;
+  me1->mesh = m1;
+  memset(&ts,0,sizeof(ts));
+  memset(&tse,0,sizeof(tse));
+  seed = SAMPLING_SEED;
+  me1->fe = (struct face_error *)xa_realloc(me1->fe,m1->num_faces*sizeof(*(me1->fe)));
+  memset(stats,0,sizeof(*stats));
+  stats->min_dist = DBL_MAX;
+  memset(&m_stats,0,sizeof(m_stats));
+  m_stats.dist_smpl_sz = (int)(1.1*pm1->total_area*sampling_density);
+  if (m_stats.dist_smpl_sz < 200) m_stats.dist_smpl_sz = 200;
+  m_stats.dist_smpl =
+    (double *)xa_malloc(sizeof(*(m_stats.dist_smpl))*m_stats.dist_smpl_sz);
+
+  /* For each triangle in model 1, sample and look up the field */
+  for (k=0, kmax=m1->num_faces; k<kmax; k++) {
+    v1 = pm1->dvertices[m1->faces[k].f0];
+    v2 = pm1->dvertices[m1->faces[k].f1];
+    v3 = pm1->dvertices[m1->faces[k].f2];
+    me1->fe[k].face_area = pm1->face_area[k];
+    if (me1->fe[k].face_area < DMARGIN*DBL_MIN) continue; /* degenerate */
+    n = get_sampling_freq(me1->fe[k].face_area,sampling_density,&seed);
+    if (n < min_sample_freq) n = min_sample_freq;
+    realloc_triag_sample_error(&tse,n);
+    sample_triangle(&v1,&v2,&v3,n,&ts);
+    for (i=0; i<tse.n_samples_tot; i++) {
+      tse.err_lin[i] = field(&(ts.sample[i]),field_data);
     }
+    error_stat_triag(&tse,&(me1->fe[k]),stats,&m_stats);
   }
-  free(dcl);
-  free(dcl_buf);
+
+  /* Finalize overall statistics */
+  stats->mean_dist = stats->mean_tot/stats->st_m1_area;
+  stats->rms_dist = sqrt(stats->rms_tot/stats->st_m1_area);
+  stats->abs_mean_dist = stats->abs_mean_tot/stats->st_m1_area;
+  stats->abs_rms_dist = sqrt(stats->abs_rms_tot/stats->st_m1_area);
+  finalize_face_error(me1,&m_stats);
+  me1->min_error = stats->min_dist;
+  me1->max_error = stats->max_dist;
+  me1->abs_min_error = stats->abs_min_dist;
+  me1->abs_max_error = stats->abs_max_dist;
+  me1->mean_error = stats->mean_dist;
+  me1->n_samples = stats->m1_samples;
+
   free_triag_sample_error(&tse);
   free(ts.sample);
 }
 
+/* See compute_error.h */
+void dist_pts_surf_prepared(const dvertex_t *pts, int n_pts,
+                            struct prepared_mesh *pm, double *dist)
+{
+  const struct dist_grid *grid; /* cell grid of pm */
+  struct dist_cell_lists *dcl;/* Cache for the list of non-empty cells at each
+                               * distance, for each cell. */
+  int *dcl_buf;               /* Temporary buffer to construct dcl lists */
+  int dcl_buf_sz;             /* Size of dcl_buf */
+  dvertex_t prev_p;           /* previous point */
+  double prev_d;              /* distance for previous point */
+  int i;
+#ifdef DO_DIST_PT_SURF_STATS
+  struct dist_pt_surf_stats dps_stats; /* Statistics */
+  memset(&dps_stats,0,sizeof(dps_stats));
+#endif
+
+  prepared_mesh_build_dist_index(pm);
+  grid = pm->grid;
+  dcl = (struct dist_cell_lists *)
+    xa_calloc(grid->grid_sz.x*grid->grid_sz.y*grid->grid_sz.z,sizeof(*dcl));
+  dcl_buf = NULL;
+  dcl_buf_sz = 0;
+  prev_p.x = 0;
+  prev_p.y = 0;
+  prev_p.z = 0;
+  prev_d = 0;
+  for (i=0; i<n_pts; i++) {
+    dist[i] = dist_pt_surf(pts[i],pm->tl,grid->fic,
+#ifdef DO_DIST_PT_SURF_STATS
+                           &dps_stats,
+#endif
+                           grid->grid_sz,grid->cell_sz,grid->bbox_min,dcl,
+                           &prev_p,prev_d,&dcl_buf,&dcl_buf_sz);
+    /* the unsigned distance bounds the search for the next point */
+    prev_p = pts[i];
+    prev_d = fabs(dist[i]);
+  }
+  free_dist_cell_lists(dcl,grid->grid_sz);
+  free(dcl_buf);
+}
+
+/* See compute_error.h */
+void prepared_mesh_build_dist_index(struct prepared_mesh *pm)
+{
+  /* The grid is on the bounding box of pm only, so that it can be reused
+   * whatever the other model is. Samples outside of it are clamped to the
+   * closest cell by dist_pt_surf(). */
+  if (pm->tl == NULL) {
+    pm->tl = model_to_triangle_list(pm->mesh,pm->dvertices);
+  }
+  if (pm->grid == NULL) {
+    pm->grid = make_dist_grid(pm->tl,&(pm->bbox_min),&(pm->bbox_max));
+  }
+}
+
+/* See compute_error.h */
+void free_prepared_dist_index(struct prepared_mesh *pm)
+{
+  free_dist_grid(pm->grid);
+  free_triangle_list(pm->tl);
+  pm->grid = NULL;
+  pm->tl = NULL;
+}
+
 /* See compute_error.h */
 void free_face_error(struct face_error *fe)
 {
@@ -58,6 +58,7 @@
  */
 
 #include <model_analysis.h>
+#include <prepared_mesh.h>
 #include <reporting.h>
 
 #ifdef __cplusplus
@@ -132,6 +133,10 @@ struct model_error {
   struct model_info *info;/* The model information. NULL if not present. */
 };
 
+/* A signed distance field sampled by dist_surf_field(): returns the distance
+ * at point p, data being the pointer given to dist_surf_field(). */
+typedef double (*dist_field_t)(const dvertex_t *p, void *data);
+
 /* Statistics from the dist_surf_surf function */
 struct dist_surf_surf_stats {
   double st_m1_area;/* Total area of sampled triangles of model 1 */
@@ -186,6 +191,76 @@ void dist_surf_surf(struct model_error *me1, struct model *m2,
                     struct prog_reporter *prog);
 
 
+/* Same as dist_surf_surf(), but from the prepared mesh pm1 to the prepared
+ * mesh pm2, reusing their derived data. me1->mesh is set to pm1->mesh. The
+ * triangle list and cell grid of pm2 are built on first use and kept in pm2
+ * for further calls; the grid covers the bounding box of pm2 only, so it is
+ * independent of pm1. If calc_normals is non-zero the normals of pm2->mesh
+ * are computed as in dist_surf_surf(). */
+void dist_surf_surf_prepared(struct model_error *me1,
+                             const struct prepared_mesh *pm1,
+                             struct prepared_mesh *pm2,
+                             double sampling_density, int min_sample_freq,
+                             struct dist_surf_surf_stats *stats,
+                             int calc_normals, struct prog_reporter *prog);
+
+/* Calculates the distances from model me1->mesh (m1) to model me2->mesh
+ * (m2) and from m2 to m1, as two calls to dist_surf_surf() would do, but
+ * using a single cell grid over the bounding box of both models, which holds
+ * the triangles of both (tagged by model). m1 is sampled with
+ * sampling_density1 and m2 with sampling_density2. The statistics from m1 to
+ * m2 are returned in stats1 and those from m2 to m1 in stats2. The other
+ * arguments are as for dist_surf_surf(); if calc_normals is non-zero the
+ * normals are calculated for both models. */
+void dist_surf_surf_symmetric(struct model_error *me1, struct model_error *me2,
+                              double sampling_density1,
+                              double sampling_density2, int min_sample_freq,
+                              struct dist_surf_surf_stats *stats1,
+                              struct dist_surf_surf_stats *stats2,
+                              int calc_normals, struct prog_reporter *prog);
+
+/* Same as dist_surf_surf_symmetric(), but for prepared meshes (see
+ * dist_surf_surf_prepared()). Only the triangle lists of pm1 and pm2 are
+ * reused and kept, the shared grid is built for each call. */
+void dist_surf_surf_symmetric_prepared(struct model_error *me1,
+                                       struct model_error *me2,
+                                       struct prepared_mesh *pm1,
+                                       struct prepared_mesh *pm2,
+                                       double sampling_density1,
+                                       double sampling_density2,
+                                       int min_sample_freq,
+                                       struct dist_surf_surf_stats *stats1,
+                                       struct dist_surf_surf_stats *stats2,
+                                       int calc_normals,
+                                       struct prog_reporter *prog);
+
+/* Same as dist_surf_surf_prepared(), but the distance at each sample of
+ * pm1->mesh is the value of the signed distance field, called as
+ * field(p,field_data), instead of the distance to a surface. The triangles
+ * are sampled, and the per face and overall statistics computed, exactly as
+ * in dist_surf_surf(), except that stats->m2_area and the grid statistics
+ * are zero. */
+void dist_surf_field(struct model_error *me1,
+                     const struct prepared_mesh *pm1,
+                     dist_field_t field, void *field_data,
+                     double sampling_density, int min_sample_freq,
+                     struct dist_surf_surf_stats *stats);
+
+/* Computes in dist[i] the signed distance from each of the n_pts points pts
+ * to the surface of pm, as at the samples of dist_surf_surf_prepared()
+ * (positive on the side the face normals point to), using the cell grid of
+ * pm (built on first use). Nearby consecutive points are faster, since each
+ * search starts from the distance found for the previous point. */
+void dist_pts_surf_prepared(const dvertex_t *pts, int n_pts,
+                            struct prepared_mesh *pm, double *dist);
+
+/* Builds the triangle list and cell grid of pm used by
+ * dist_surf_surf_prepared(), if not yet done. */
+void prepared_mesh_build_dist_index(struct prepared_mesh *pm);
+
+/* Frees the triangle list and cell grid of pm, if any. */
+void free_prepared_dist_index(struct prepared_mesh *pm);
+
 /* Frees the memory allocated by dist_surf_surf() for the per face error
  * metrics. */
 void free_face_error(struct face_error *fe);
@@ -24,10 +24,51 @@ typedef struct hit {
 	char boundary;	// 0=none 1=A 2=B
 } HIT;
 
-// STATIC hits
-hit hits[400][400][100];	// [pix][pix][# of hits]
-//2D grid.  each element points to a list of 'hits', distances at which a 
-//triangle was found.  Think of french fries.
+//Read-only view of a triangle mesh, either a MeshValmet model (float vertices,
+//0-based faces) or MATLAB-style buffers (double vertices, 1-based faces).
+//Vertices are fetched through a projection, so that the three orthogonal
+//projections are done without touching (or copying) the caller's arrays.
+typedef struct overlap_mesh {
+	const struct model *m;	// if not NULL, the rest is unused
+	const double *L;	// vertex list (x, y, z, x, ...)
+	const int *T;		// 1-based index list (v0, v1, v2, v0, ...)
+	int numVertices;
+	int numTriangles;
+} OVERLAP_MESH;
+
+//Projection applied to every vertex: p[k] = sign[k]*v[axis[k]]
+typedef struct projection {
+	int axis[3];
+	double sign[3];
+} PROJECTION;
+
+//The three projections of ComputeRobustVolumeOverlap, as obtained originally
+//by swapping the vertex coordinates in place: (x,y,z), then (z,-y,x), then
+//(-z,x,-y).
+static const PROJECTION projections[3] = {
+	{{0, 1, 2}, { 1.0,  1.0,  1.0}},
+	{{2, 1, 0}, { 1.0, -1.0,  1.0}},
+	{{2, 0, 1}, {-1.0,  1.0, -1.0}}
+};
+
+//Hits of one GetVolumeOverlap call, on a 2D grid of rays. Each ray has a list
+//of 'hits', distances at which a triangle was found.  Think of french fries.
+//The hits are appended, tagged with their ray, as the triangles are traced,
+//and then bucketed by ray (keeping their order), so that the memory used is
+//that of the actual hits and every call has its own.
+typedef struct ray_hit {
+	int ray;	// i*pix+j
+	HIT h;
+} RAY_HIT;
+
+typedef struct hit_grid {
+	int pix;	// number of rays along each side
+	RAY_HIT *added;	// the hits in the order they were added
+	int nAdded;
+	int addedSize;	// allocated length of added
+	HIT *hits;	// the hits of ray r are hits[first[r]] to hits[first[r+1]-1]
+	int *first;	// pix*pix+1 offsets
+} HIT_GRID;
 
 /* --------------------------------------------------------------------------*
  *                    Local utility functions                                *
@@ -46,14 +87,6 @@ int compareHitByDistance(const void *arg1, const void *arg2)
 }
 
 
-//Simple swap function.
-void swap(double v[], int ind1, int ind2)
-{
-	double temp = v[ind1];
-	v[ind1] = v[ind2];
-	v[ind2] = temp;
-}
-
 // Sorts an array of three numbers in ascending order in place.
 void sort3( double* a )
 {
@@ -77,24 +110,26 @@ void sort3( double* a )
 // find, in ray (i,j), distances of {A, B, union(A,B), intersection(A,B)};
 // RETURN: hit count
 //Returns volumes along this grid element, returned in d.
-int findDistances(int i, int j, double d[4] )
+int findDistances(HIT_GRID *g, int i, int j, double d[4] )
 {
+	int ray = i*g->pix + j;
+	int nHits = g->first[ray+1] - g->first[ray];
+
 	// no hits on this ray? -> return "no hits"
-	if (! hits[i][j][0].boundary)
+	if (nHits == 0)
 		return 0;
 
 	HIT *h;	// local hit ptr
-	int nHitsA = 0, nHitsB = 0;
+	int nHitsA = 0, nHitsB = 0, n;
 
 	// if A or B have an odd hit count, fail
-	h = hits[i][j];
-	while (h->boundary)
+	h = g->hits + g->first[ray];
+	for (n = 0; n < nHits; n++)
 	{
-		if (h->boundary == 1)
+		if (h[n].boundary == 1)
 			nHitsA++;
 		else
 			nHitsB++;
-		h++;
 	}
 	if (nHitsA&1  ||  nHitsB&1)
 	{
@@ -103,8 +138,6 @@ int findDistances(int i, int j, double d[4] )
 	}
 
 	// sort hits by distance
-	h = hits[i][j];
-	int nHits = nHitsA + nHitsB;
 	qsort( (void *)h, (size_t)nHits, sizeof(HIT), compareHitByDistance);
 
 	// calc d[]
@@ -121,8 +154,7 @@ int findDistances(int i, int j, double d[4] )
 	};
 	d[0] = d[1] = d[2] = d[3] = 0.0;
 
-	h = hits[i][j];
-	while (h->boundary)
+	for (n = 0; n < nHits; n++, h++)
 	{
 		// add the distance from the last intersection into the appropriate d[] counters
 		if (lastDist != -1)	// there's no segment (to add) before the first one
@@ -137,35 +169,99 @@ int findDistances(int i, int j, double d[4] )
 			inA = (h->sign < 0);
 		else
 			inB = (h->sign < 0);
-		h++;
 	}
 	
 	return nHits;
 }
 
 
-// add a hit (d,s,b) to first empty slot in ray (i,j)
-void addHit(int i, int j, double distance, int sign, int boundary)
+// add a hit (d,s,b) to ray (i,j)
+void addHit(HIT_GRID *g, int i, int j, double distance, int sign, int boundary)
 {
 	// boundary==1 -> use Ahits
 	// boundary==2 -> use Bhits
-	HIT *h = hits[i][j];
+	if (g->nAdded == g->addedSize)
+	{
+		g->addedSize = (g->addedSize > 0) ? 2*g->addedSize : 4*g->pix*g->pix;
+		g->added = (RAY_HIT *)realloc(g->added, g->addedSize*sizeof(RAY_HIT));
+		if (g->added == NULL) {printf("ERROR: out of memory for the ray hits - exiting\n"); exit(1);}
+	}
+
+	RAY_HIT *rh = &(g->added[g->nAdded++]);
+	rh->ray        = i*g->pix + j;
+	rh->h.boundary = boundary;
+	rh->h.d        = distance;
+	rh->h.sign     = sign;
+}
 
-	// find first unused entry
-	int nHits = 0;
-	while (h->boundary)
+// bucket the added hits by ray, keeping the order in which they were added
+static void sortHitsByRay(HIT_GRID *g)
+{
+	int nRays = g->pix*g->pix, r, n;
+
+	g->first = (int *)calloc(nRays+1, sizeof(int));
+	g->hits = (HIT *)malloc((g->nAdded > 0 ? g->nAdded : 1)*sizeof(HIT));
+	if (g->first == NULL || g->hits == NULL) {printf("ERROR: out of memory for the ray hits - exiting\n"); exit(1);}
+	for (n = 0; n < g->nAdded; n++)
+		g->first[g->added[n].ray+1]++;
+	for (r = 0; r < nRays; r++)
+		g->first[r+1] += g->first[r];
+	for (n = 0; n < g->nAdded; n++)
 	{
-		if (nHits++ >= 100) {printf("ERROR: exceeded 100 hits per ray - exiting\n"); exit(1);}
-		h++;
+		// first[ray] is used as the insertion point and restored below
+		g->hits[g->first[g->added[n].ray]++] = g->added[n].h;
+	}
+	for (r = nRays; r > 0; r--)
+		g->first[r] = g->first[r-1];
+	g->first[0] = 0;
+	free(g->added);
+	g->added = NULL;
+}
+
+//Number of vertices and triangles of a mesh view.
+static inline int NumVertices(const OVERLAP_MESH *om)
+{
+	return (om->m != NULL) ? om->m->num_vert : om->numVertices;
+}
+
+static inline int NumTriangles(const OVERLAP_MESH *om)
+{
+	return (om->m != NULL) ? om->m->num_faces : om->numTriangles;
+}
+
+//Projected coordinates of vertex v of the mesh view.
+static inline void GetVertex(const OVERLAP_MESH *om, int v, const PROJECTION *pr, double p[3])
+{
+	double q[3];
+
+	if (om->m != NULL) {
+		const vertex_t *mv = &(om->m->vertices[v]);
+		q[0] = mv->x; q[1] = mv->y; q[2] = mv->z;
+	} else {
+		q[0] = om->L[v*3]; q[1] = om->L[v*3+1]; q[2] = om->L[v*3+2];
 	}
+	p[0] = pr->sign[0]*q[pr->axis[0]];
+	p[1] = pr->sign[1]*q[pr->axis[1]];
+	p[2] = pr->sign[2]*q[pr->axis[2]];
+}
 
-	h->boundary = boundary;
-	h->d        = distance;
-	h->sign     = sign;
+//Projected corners of triangle t of the mesh view.
+static inline void GetTriangle(const OVERLAP_MESH *om, int t, const PROJECTION *pr, double p0[3], double p1[3], double p2[3])
+{
+	if (om->m != NULL) {
+		const face_t *f = &(om->m->faces[t]);
+		GetVertex(om, f->f0, pr, p0);
+		GetVertex(om, f->f1, pr, p1);
+		GetVertex(om, f->f2, pr, p2);
+	} else {
+		GetVertex(om, om->T[3*t]-1, pr, p0);
+		GetVertex(om, om->T[3*t+1]-1, pr, p1);
+		GetVertex(om, om->T[3*t+2]-1, pr, p2);
+	}
 }
 
-double Intersect_tri(double e[], double v[], double tuv[], bool Tri1, int trind, double * L1, double * L2, int * T1, int * T2)
-//Returns the extent along v from e to hit the triangle (negative if 
+double Intersect_tri(double e[], double v[], double tuv[], const double p0[], const double p1[], const double p2[])
+//Returns the extent along v from e to hit the triangle (p0,p1,p2) (negative if 
 //non-intersect). In the end, tuv[0] will contain a scaler for v, and 
 //tuv[1] will be a sign, NEGATIVE if the triangle's normal points to e.
 //Optimized by assuming orthographic projection.  I return false before 
@@ -175,16 +271,9 @@ double Intersect_tri(double e[], double v[], double tuv[], bool Tri1, int trind,
         double edge1[3], edge2[3];
 	int i;
 
-	if (Tri1) {
-		for (i = 0; i < 3; i ++) {
-			edge1[i] = L1[(T1[trind+1]-1)*3+i] - L1[(T1[trind]-1)*3+i]; //t->p1[i] - t->p0[i];
-			edge2[i] = L1[(T1[trind+2]-1)*3+i] - L1[(T1[trind]-1)*3+i]; //t->p2[i] - t->p0[i];
-		}
-	}else {
-		for (i = 0; i < 3; i ++) {
-			edge1[i] = L2[(T2[trind+1]-1)*3+i] - L2[(T2[trind]-1)*3+i]; //t->p1[i] - t->p0[i];
-			edge2[i] = L2[(T2[trind+2]-1)*3+i] - L2[(T2[trind]-1)*3+i]; //t->p2[i] - t->p0[i];
-		}
+	for (i = 0; i < 3; i ++) {
+		edge1[i] = p1[i] - p0[i];
+		edge2[i] = p2[i] - p0[i];
 	}
 
 
@@ -205,15 +294,9 @@ double Intersect_tri(double e[], double v[], double tuv[], bool Tri1, int trind,
 	inv_det = 1.0/det;
 
 	//Distance from vert0 to ray origin.
-	if (Tri1) {
-		tvec[0] = e[0]- L1[(T1[trind]-1)*3]; //t->p0[0];
-		tvec[1] = e[1]- L1[(T1[trind]-1)*3+1]; //t->p0[1];
-		tvec[2] = e[2]- L1[(T1[trind]-1)*3+2]; //t->p0[2];
-	}else {
-		tvec[0] = e[0]- L2[(T2[trind]-1)*3]; //t->p0[0];
-		tvec[1] = e[1]- L2[(T2[trind]-1)*3+1]; //t->p0[1];
-		tvec[2] = e[2]- L2[(T2[trind]-1)*3+2]; //t->p0[2];
-	}
+	tvec[0] = e[0]- p0[0];
+	tvec[1] = e[1]- p0[1];
+	tvec[2] = e[2]- p0[2];
 
 	//Calculate u and test bounds
 	tuv[1] = tvec[0]*pvec[0] + tvec[1]*pvec[1] + tvec[2]*pvec[2];
@@ -259,9 +342,8 @@ double Intersect_tri(double e[], double v[], double tuv[], bool Tri1, int trind,
 
 
 //Pengdong Xiao, April 27, 2012: swap T1 and T2
-void GetVolumeOverlap(double vols[],double * L1, double * L2, int numVertices1, int numVertices2, int * T1, int * T2, int numTriangles1, int numTriangles2) 
-//L1, L2 are vertex lists (x coord, y, z, and then the next point, etc).
-//T1 and T2 are index lists for the tileset triangles.  So vert1_index, vert2_index, vert3_index for every triangle 
+void GetVolumeOverlap(double vols[], const OVERLAP_MESH *A, const OVERLAP_MESH *B, const PROJECTION *pr) 
+//A and B are the two meshes, whose vertices are seen through the projection pr.
 
 //In order to approximate the volume overlap of the two polyhedra, 
 //we determine a plane underneath the two objects, the size of the
@@ -275,7 +357,7 @@ void GetVolumeOverlap(double vols[],double * L1, double * L2, int numVertices1,
 //reference to get volume overlap.
 {
 
-	int i, j, t, temp, pix = 400;	// CAREFUL! change size of Ahits if you change this!
+	int i, j, t, pix = VOLUME_OVERLAP_RAYS;
 	double minx = DBL_MAX, miny = DBL_MAX, minz = DBL_MAX;
 	double maxx = -DBL_MAX, maxy = -DBL_MAX;  //for the bounding plane.
 	double xextent, yextent, xinc, yinc, d[4], dA;
@@ -286,29 +368,25 @@ void GetVolumeOverlap(double vols[],double * L1, double * L2, int numVertices1,
 
 	//printf("Computing Volume Overlap Approximation.\n");
 
-	// reset intersection hits
-	memset((void*)hits, 0, sizeof(hits));
-
-	temp = 3*numVertices1;
-	for (i = 0; i < temp; i = i + 3) {
-		if (L1[i] < minx) minx = L1[i];
-		if (L1[i] > maxx) maxx = L1[i];
-		sumx += L1[i];
-		if (L1[i+1] < miny) miny = L1[i+1];
-		if (L1[i+1] > maxy) maxy = L1[i+1];
-		sumy += L1[i+1];
-		if (L1[i+2] < minz) minz = L1[i+2];
-	}
-	
-	temp = 3*numVertices2;
-	for (i = 0; i < temp; i = i + 3) {
-		if (L2[i] < minx) minx = L2[i];
-		if (L2[i] > maxx) maxx = L2[i];
-		sumx += L2[i];
-		if (L2[i+1] < miny) miny = L2[i+1];
-		if (L2[i+1] > maxy) maxy = L2[i+1];
-		sumy += L2[i+1];
-		if (L2[i+2] < minz) minz = L2[i+2];
+	// intersection hits of this call
+	HIT_GRID grid = {pix, NULL, 0, 0, NULL, NULL};
+
+	double p[3], p0[3], p1[3], p2[3];
+	const OVERLAP_MESH *meshes[2] = {A, B};
+	int k, numVertices, numTriangles;
+
+	for (k = 0; k < 2; k++) {
+		numVertices = NumVertices(meshes[k]);
+		for (i = 0; i < numVertices; i++) {
+			GetVertex(meshes[k], i, pr, p);
+			if (p[0] < minx) minx = p[0];
+			if (p[0] > maxx) maxx = p[0];
+			sumx += p[0];
+			if (p[1] < miny) miny = p[1];
+			if (p[1] > maxy) maxy = p[1];
+			sumy += p[1];
+			if (p[2] < minz) minz = p[2];
+		}
 	}
 
 	//printf("\tBounding box (x y z): %f %f, %f %f, %f\n", minx,maxx,miny,maxy,minz);
@@ -321,101 +399,49 @@ void GetVolumeOverlap(double vols[],double * L1, double * L2, int numVertices1,
 
 	//printf("pix = %d, thus column base area = %lf ( %f * %f )\n", pix, dA, xinc, yinc);
 
-	int vert;
 	// for each tile, intersect rays that cover it's bounding box with the tile
-	for (t = 0; t < numTriangles1; t++)
+	for (k = 0; k < 2; k++)
 	{
-		// find tile's bb
-		vert = T1[3*t + 0]-1;
-		double tileMinx =        L1[vert*3 + 0];
-		double tileMaxx =        L1[vert*3 + 0];
-		double tileMiny =        L1[vert*3 + 1];
-		double tileMaxy =        L1[vert*3 + 1];
-		
-		vert = T1[3*t + 1]-1;
-		tileMinx = MIN(tileMinx, L1[vert*3 + 0]);
-		tileMaxx = MAX(tileMaxx, L1[vert*3 + 0]);		
-		tileMiny = MIN(tileMiny, L1[vert*3 + 1]);
-		tileMaxy = MAX(tileMaxy, L1[vert*3 + 1]);
-		
-		vert = T1[3*t + 2]-1;
-		tileMinx = MIN(tileMinx, L1[vert*3 + 0]);
-		tileMaxx = MAX(tileMaxx, L1[vert*3 + 0]);		
-		tileMiny = MIN(tileMiny, L1[vert*3 + 1]);
-		tileMaxy = MAX(tileMaxy, L1[vert*3 + 1]);
-		
-		// now intersect all rays in bb with the tile and record in Ahits
-		double tuv[3], dst;
-		int startx = int((tileMinx - minx) / xinc);
-		int   endx = int((tileMaxx - minx) / xinc);
-		int starty = int((tileMiny - miny) / yinc);
-		int   endy = int((tileMaxy - miny) / yinc);
-		for (i = startx; i <= endx; i++)
+		numTriangles = NumTriangles(meshes[k]);
+		for (t = 0; t < numTriangles; t++)
 		{
-			for (j = starty; j <= endy; j++)
+			// find tile's bb
+			GetTriangle(meshes[k], t, pr, p0, p1, p2);
+			double tileMinx = MIN(MIN(p0[0], p1[0]), p2[0]);
+			double tileMaxx = MAX(MAX(p0[0], p1[0]), p2[0]);
+			double tileMiny = MIN(MIN(p0[1], p1[1]), p2[1]);
+			double tileMaxy = MAX(MAX(p0[1], p1[1]), p2[1]);
+
+			// now intersect all rays in bb with the tile and record in hits
+			double tuv[3], dst;
+			int startx = int((tileMinx - minx) / xinc);
+			int   endx = int((tileMaxx - minx) / xinc);
+			int starty = int((tileMiny - miny) / yinc);
+			int   endy = int((tileMaxy - miny) / yinc);
+			for (i = startx; i <= endx; i++)
 			{
-				e[0] = minx + xinc/2.0 + i*xinc;
-				e[1] = miny + yinc/2.0 + j*yinc;
-				e[2] = minz - 5.0;
-				dst = Intersect_tri(e,n,tuv,true, 3*t, L1, L2, T1, T2);
-				if (dst > -1.0e3) {	//A real hit, so append to the hitlist.
-					int sgn = (int) (tuv[1]/fabs(tuv[1]));
-					addHit(i, j, fabs(dst), sgn, 1);
-					//numhits1++;
+				for (j = starty; j <= endy; j++)
+				{
+					e[0] = minx + xinc/2.0 + i*xinc;
+					e[1] = miny + yinc/2.0 + j*yinc;
+					e[2] = minz - 5.0;
+					dst = Intersect_tri(e,n,tuv,p0,p1,p2);
+					if (dst > -1.0e3) {	//A real hit, so append to the hitlist.
+						int sgn = (int) (tuv[1]/fabs(tuv[1]));
+						addHit(&grid, i, j, fabs(dst), sgn, k+1);
+					}
 				}
-			}							
-		}
-	}
-		
-	for (t = 0; t < numTriangles2; t++)
-	{
-		// find tile's bb
-		vert = T2[3*t + 0]-1;
-		double tileMinx =        L2[vert*3 + 0];
-		double tileMaxx =        L2[vert*3 + 0];
-		double tileMiny =        L2[vert*3 + 1];
-		double tileMaxy =        L2[vert*3 + 1];
-		
-		vert = T2[3*t + 1]-1;
-		tileMinx = MIN(tileMinx, L2[vert*3 + 0]);
-		tileMaxx = MAX(tileMaxx, L2[vert*3 + 0]);		
-		tileMiny = MIN(tileMiny, L2[vert*3 + 1]);
-		tileMaxy = MAX(tileMaxy, L2[vert*3 + 1]);
-		
-		vert = T2[3*t + 2]-1;
-		tileMinx = MIN(tileMinx, L2[vert*3 + 0]);
-		tileMaxx = MAX(tileMaxx, L2[vert*3 + 0]);		
-		tileMiny = MIN(tileMiny, L2[vert*3 + 1]);
-		tileMaxy = MAX(tileMaxy, L2[vert*3 + 1]);
-		
-		// now intersect all rays in bb with the tile and record in Ahits
-		double tuv[3], dst;
-		int startx = int((tileMinx - minx) / xinc);
-		int endx = int((tileMaxx - minx) / xinc);
-		int starty = int((tileMiny - miny) / yinc);
-		int endy = int((tileMaxy - miny) / yinc);
-		for (i = startx; i <= endx; i++)
-		{
-			for (j = starty; j <= endy; j++)
-			{
-				e[0] = minx + xinc/2.0 + i*xinc;
-				e[1] = miny + yinc/2.0 + j*yinc;
-				e[2] = minz - 5.0;
-				dst = Intersect_tri(e,n,tuv,false, 3*t, L1, L2, T1, T2);
-				if (dst > -1.0e3) {	//A real hit, so append to the hitlist.
-					int sgn = (int) (tuv[1]/fabs(tuv[1]));
-					addHit(i, j, fabs(dst), sgn, 2);
-					//numhits1++;
-				}
-			}							
+			}
 		}
 	}
 
+	sortHitsByRay(&grid);
+
 	for (i = 0; i < pix; i ++) {
 		//if (i%10 == 0) {printf(" %d ", i); spittime("");}
 		
 		for (j = 0; j < pix; j ++) {
-			if (findDistances(i,j,d))
+			if (findDistances(&grid,i,j,d))
 			{
 				A_vol            += d[0];
 				B_vol            += d[1];
@@ -444,69 +470,54 @@ void GetVolumeOverlap(double vols[],double * L1, double * L2, int numVertices1,
 	
 	//return ret;
 
-	vols[0] = A_vol; 
-	vols[1] = B_vol;
-	vols[2] = union_vol;
-	vols[3] = intersection_vol;
-}
-
-
-//coord1 and coord2 are 0, 1, or 2.  This function swaps values in both vertex 
-//arrays so that volume overlap projection can be with respect to orthogonal planes.
-//In order to preserve the right-hand rule, you should negate one of the dimensions, 
-//and I don't think it makes a difference, so I negate the dimension not swapped.
-void SwapCoordinates(int coord, double * L1, double * L2, int numVertices1, int numVertices2)
-{
-	int i; 
-
-	int coord1 = (coord + 1) % 3;
-	int coord2 = (coord + 2) % 3;
-
-	double temp = 3*numVertices1;
-	for (i = 0; i < temp; i = i + 3)
-	{
-		swap(L1, (i + coord1), (i + coord2));
-		L1[i + coord] = -1.0*L1[i + coord];
-	}
-	
-	temp = 3*numVertices2;
-	for (i = 0; i < temp; i = i + 3) 
-	{
-		swap(L2, (i + coord1), (i + coord2));
-		L2[i + coord] = -1.0*L2[i + coord];
-	}
+	free(grid.hits);
+	free(grid.first);
 
+	//Scale the summed ray lengths by the pixel area, so that the volumes are
+	//in model units and comparable with ComputeMeshVolume().
+	vols[0] = A_vol * dA; 
+	vols[1] = B_vol * dA;
+	vols[2] = union_vol * dA;
+	vols[3] = intersection_vol * dA;
 }
 
+
 /* --------------------------------------------------------------------------*
  *                    External functions                                     *
  * --------------------------------------------------------------------------*/
 
-//This is an overarching function that will call GetVolumeOverlap 3 times, one for
-//each projection (x,y,z).  That way it's a bit more robust to degenerate or axis-
-//aligned byus.
-void ComputeRobustVolumeOverlap(double * L1, double * L2, int numVertices1, int numVertices2, int * T1, int * T2, int numTriangles1, int numTriangles2, double dice[], double int_union_ratio[] )
+//Fills in the Dice (intersection over average volume) and intersection over
+//union ratios for one projection. The mesh volumes are taken from exact_vols
+//if not NULL, otherwise the ray-integrated ones in vols are used.
+static void OverlapRatios(const double vols[], const double exact_vols[], double *int_avg, double *int_union)
+{
+	double volA, volB;
+
+	if (exact_vols != NULL) {
+		volA = exact_vols[0];
+		volB = exact_vols[1];
+		*int_avg   = vols[3]/((volA + volB)/2.0);
+		*int_union = vols[3]/(volA + volB - vols[3]);
+	} else {
+		*int_avg   = vols[3]/((vols[0] + vols[1])/2.0);
+		*int_union = vols[3]/vols[2];
+	}
+}
+
+//Runs GetVolumeOverlap once per projection (x,y,z) and combines the results.
+static void RobustVolumeOverlap(const OVERLAP_MESH *A, const OVERLAP_MESH *B, const double exact_vols[], double dice[], double int_union_ratio[], double ray_vols[])
 {
 	double vols[4];
 	double int_avgs[3], int_unions[3];
+	double volsA[3], volsB[3];
 	double int_avg = 0.0, int_union = 0.0; 
+	int k;
 
-	GetVolumeOverlap(vols, L1, L2, numVertices1, numVertices2, T1, T2, numTriangles1, numTriangles2);
-	int_avgs[0]   = vols[3]/((vols[0] + vols[1])/2.0);
-	int_unions[0] = vols[3]/vols[2]; 
-
-	SwapCoordinates(1, L1, L2, numVertices1, numVertices2); //becomes (z,y,x)
-
-	GetVolumeOverlap(vols, L1, L2, numVertices1, numVertices2, T1, T2, numTriangles1, numTriangles2);
-	int_avgs[1]   = vols[3]/((vols[0] + vols[1])/2.0);
-	int_unions[1] = vols[3]/vols[2];
-
-	SwapCoordinates(0, L1, L2, numVertices1, numVertices2); //becomes (z,x,y)
-
-	GetVolumeOverlap(vols, L1, L2, numVertices1, numVertices2, T1, T2, numTriangles1, numTriangles2);
-	int_avgs[2]   = vols[3]/((vols[0] + vols[1])/2.0);
-	int_unions[2] = vols[3]/vols[2];
-
+	for (k = 0; k < 3; k++) {
+		GetVolumeOverlap(vols, A, B, &projections[k]);
+		OverlapRatios(vols, exact_vols, &int_avgs[k], &int_unions[k]);
+		volsA[k] = vols[0]; volsB[k] = vols[1];
+	}
 
 	sort3(int_avgs);
 	sort3(int_unions);
@@ -519,7 +530,84 @@ void ComputeRobustVolumeOverlap(double * L1, double * L2, int numVertices1, int
 
 	dice[0] = int_avg;
 	int_union_ratio[0] = int_union;
+
+	if (ray_vols != NULL) {
+		sort3(volsA);
+		sort3(volsB);
+		ray_vols[0] = volsA[1];
+		ray_vols[1] = volsB[1];
+	}
+}
+
+//This is an overarching function that will call GetVolumeOverlap 3 times, one for
+//each projection (x,y,z).  That way it's a bit more robust to degenerate or axis-
+//aligned byus.
+void ComputeRobustVolumeOverlap(double * L1, double * L2, int numVertices1, int numVertices2, int * T1, int * T2, int numTriangles1, int numTriangles2, double dice[], double int_union_ratio[] )
+{
+	ComputeRobustVolumeOverlapExt(L1, L2, numVertices1, numVertices2, T1, T2, numTriangles1, numTriangles2, NULL, dice, int_union_ratio, NULL);
 }
 
+void ComputeRobustVolumeOverlapExt(double * L1, double * L2, int numVertices1, int numVertices2, int * T1, int * T2, int numTriangles1, int numTriangles2, const double exact_vols[], double dice[], double int_union_ratio[], double ray_vols[] )
+{
+	OVERLAP_MESH A = {NULL, L1, T1, numVertices1, numTriangles1};
+	OVERLAP_MESH B = {NULL, L2, T2, numVertices2, numTriangles2};
+
+	RobustVolumeOverlap(&A, &B, exact_vols, dice, int_union_ratio, ray_vols);
+}
+
+void ComputeRobustVolumeOverlapModels(const struct model *m1, const struct model *m2, const double exact_vols[], double dice[], double int_union_ratio[], double ray_vols[] )
+{
+	OVERLAP_MESH A = {m1, NULL, NULL, 0, 0};
+	OVERLAP_MESH B = {m2, NULL, NULL, 0, 0};
+
+	RobustVolumeOverlap(&A, &B, exact_vols, dice, int_union_ratio, ray_vols);
+}
+
+double ComputeMeshVolume(const struct model *m, double *open_ratio)
+{
+	double cx, cy, cz;
+	double vol = 0.0, ax = 0.0, ay = 0.0, az = 0.0, area = 0.0;
+	int t;
+
+	//Use the bounding box center as apex of the tetrahedra, to keep the
+	//magnitudes (and rounding errors) of the summed terms small.
+	cx = 0.5*((double)m->bBox[0].x + (double)m->bBox[1].x);
+	cy = 0.5*((double)m->bBox[0].y + (double)m->bBox[1].y);
+	cz = 0.5*((double)m->bBox[0].z + (double)m->bBox[1].z);
+
+#pragma omp parallel for reduction(+:vol,ax,ay,az,area)
+	for (t = 0; t < m->num_faces; t++)
+	{
+		const vertex_t *p0 = &(m->vertices[m->faces[t].f0]);
+		const vertex_t *p1 = &(m->vertices[m->faces[t].f1]);
+		const vertex_t *p2 = &(m->vertices[m->faces[t].f2]);
+		double a[3], b[3], c[3], n[3];
+
+		a[0] = p0->x - cx; a[1] = p0->y - cy; a[2] = p0->z - cz;
+		b[0] = p1->x - cx; b[1] = p1->y - cy; b[2] = p1->z - cz;
+		c[0] = p2->x - cx; c[1] = p2->y - cy; c[2] = p2->z - cz;
+
+		//Signed tetrahedron volume (times 6): a . (b x c)
+		vol += a[0]*(b[1]*c[2] - b[2]*c[1])
+		     + a[1]*(b[2]*c[0] - b[0]*c[2])
+		     + a[2]*(b[0]*c[1] - b[1]*c[0]);
+
+		//Face area vector (times 2): (b-a) x (c-a)
+		b[0] -= a[0]; b[1] -= a[1]; b[2] -= a[2];
+		c[0] -= a[0]; c[1] -= a[1]; c[2] -= a[2];
+		n[0] = b[1]*c[2] - b[2]*c[1];
+		n[1] = b[2]*c[0] - b[0]*c[2];
+		n[2] = b[0]*c[1] - b[1]*c[0];
+		ax += n[0];
+		ay += n[1];
+		az += n[2];
+		area += sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+	}
+
+	if (open_ratio != NULL)
+		open_ratio[0] = (area > 0.0) ? sqrt(ax*ax + ay*ay + az*az)/area : 0.0;
+
+	return vol/6.0;
+}
 
 #endif
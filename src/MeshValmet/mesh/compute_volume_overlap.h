@@ -3,6 +3,7 @@
 #ifndef _COMPUTE_VOLUME_OVERLAP_PROTO
 #define _COMPUTE_VOLUME_OVERLAP_PROTO
 
+#include <3dmodel.h>
 
 
 #ifdef __cplusplus
@@ -16,11 +17,35 @@
 BEGIN_DECL
 #undef BEGIN_DECL
 
+//Number of rays along each side of the bounding box of the two meshes, in
+//each projection, for the ray-integrated volumes
+#define VOLUME_OVERLAP_RAYS 400
+
 //This is an overarching function that will call GetVolumeOverlap 3 times, one for
 //each projection (x,y,z).  That way it's a bit more robust to degenerate or axis-
 //aligned byus.
 void ComputeRobustVolumeOverlap(double * L1, double * L2, int numVertices1, int numVertices2, int * T1, int * T2, int numTriangles1, int numTriangles2, double dice[], double int_union_ratio[] );
 
+//Same as ComputeRobustVolumeOverlap, but if exact_vols is not NULL the two mesh
+//volumes it holds are used in the Dice and intersection/union denominators
+//instead of the ray-integrated ones. If ray_vols is not NULL it receives the
+//ray-integrated volumes of both meshes (median over the three projections).
+void ComputeRobustVolumeOverlapExt(double * L1, double * L2, int numVertices1, int numVertices2, int * T1, int * T2, int numTriangles1, int numTriangles2, const double exact_vols[], double dice[], double int_union_ratio[], double ray_vols[] );
+
+//Same as ComputeRobustVolumeOverlapExt, but reads the vertices and faces of
+//the two meshes directly; nothing is copied and the meshes are not modified.
+void ComputeRobustVolumeOverlapModels(const struct model *m1, const struct model *m2, const double exact_vols[], double dice[], double int_union_ratio[], double ray_vols[] );
+
+//Returns the volume enclosed by the mesh m, summing the signed volumes of the
+//tetrahedra spanned by each face and the bounding box center (divergence
+//theorem). It is exact for a closed mesh and positive if the faces are
+//oriented outwards. If open_ratio is not NULL it receives the norm of the sum
+//of the face area vectors over the total area. It vanishes (up to rounding)
+//for a closed mesh, so a large value reveals holes; the converse does not
+//hold, as the boundaries of some open meshes cancel out (e.g. an uncapped
+//tube).
+double ComputeMeshVolume(const struct model *m, double *open_ratio);
+
 END_DECL
 #undef END_DECL
 
@@ -59,6 +59,40 @@
 
 #include <mesh_run.h>
 
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+
+/* Returns a wall clock time, in seconds */
+static double wall_time(void)
+{
+#ifdef _OPENMP
+  return omp_get_wtime();
+#else
+  return (double)clock()/CLOCKS_PER_SEC;
+#endif
+}
+
+/* Reads the model of file 'fname' into me->mesh, prepares it into '*pm' and
+ * analyzes it (see prepared_mesh_info()) into '*info', which is then set as
+ * me->info. The reading time and the analysis messages are printed through
+ * the output buffer out. */
+static void read_and_analyze(const char *fname, int do_orient, int verbose,
+                             const char *name, struct model_error *me,
+                             struct prepared_mesh **pm,
+                             struct model_info *info, struct outbuf *out)
+{
+  double start_time;
+
+  outbuf_printf(out,"Reading %s ... ",fname);
+  start_time = wall_time();
+  me->mesh = read_model_file(fname);
+  outbuf_printf(out,"Done (%.2f secs)\n",wall_time()-start_time);
+  *pm = prepare_mesh(me->mesh);
+  *info = *prepared_mesh_info(*pm,do_orient,verbose,out,name);
+  me->info = info;
+}
+
 /* Runs the mesh program, given the parsed arguments in *args. The models and
  * their respective errors are returned in *model1 and *model2. If
  * args->no_gui is zero a QT window is opened to display the visual
@@ -76,8 +110,13 @@ void mesh_run(const struct args *args, struct model_error *model1,
   //struct dist_surf_surf_stats stats_rev;
   double bbox1_diag,bbox2_diag;
   struct model_info *m1info,*m2info;
+  struct prepared_mesh *pm1,*pm2;
   //double abs_sampling_step,abs_sampling_dens;
   int nv_empty,nf_empty;
+  struct outbuf *ob1,*ob2;
+#ifdef _OPENMP
+  int levels;
+#endif
 
   /* Read models from input files */
   memset(model1,0,sizeof(*model1));
@@ -88,31 +127,44 @@ void mesh_run(const struct args *args, struct model_error *model1,
   /*END added by Christine Xu*/
   m1info = (struct model_info*) xa_malloc(sizeof(*m1info));
   m2info = (struct model_info*) xa_malloc(sizeof(*m2info));
-  outbuf_printf(out,"Reading %s ... ",args->m1_fname);
-  outbuf_flush(out);
-  start_time = clock();
-  model1->mesh = read_model_file(args->m1_fname);
-  outbuf_printf(out,"Done (%.2f secs)\n",
-                (double)(clock()-start_time)/CLOCKS_PER_SEC);
-  outbuf_printf(out,"Reading %s ... ",args->m2_fname);
-  outbuf_flush(out);
+
+  /* Read, prepare and analyze the models, as two concurrent pipelines (we
+   * don't need normals for model 1, so we don't request for it to be
+   * oriented). Each one prints to its own buffer, output in order once both
+   * are done. The parallel loops of the readers stay parallel. The reading
+   * overlaps the analysis, so the time reported for the analysis and
+   * measuring includes it. */
   start_time = clock();
-  model2->mesh = read_model_file(args->m2_fname);
-  outbuf_printf(out,"Done (%.2f secs)\n",
-                (double)(clock()-start_time)/CLOCKS_PER_SEC);
+  ob1 = outbuf_new(NULL,NULL);
+  ob2 = outbuf_new(NULL,NULL);
+#ifdef _OPENMP
+  levels = omp_get_max_active_levels();
+  if (levels < 2) omp_set_max_active_levels(2);
+#pragma omp parallel sections num_threads(2)
+#endif
+  {
+#ifdef _OPENMP
+#pragma omp section
+#endif
+    read_and_analyze(args->m1_fname,0,args->verb_analysis,"model 1",
+                     model1,&pm1,m1info,ob1);
+#ifdef _OPENMP
+#pragma omp section
+#endif
+    read_and_analyze(args->m2_fname,1,args->verb_analysis,"model 2",
+                     model2,&pm2,m2info,ob2);
+  }
+#ifdef _OPENMP
+  omp_set_max_active_levels(levels);
+#endif
+  outbuf_puts(out,ob1->strbuf);
+  outbuf_puts(out,ob2->strbuf);
   outbuf_flush(out);
+  outbuf_delete(ob1);
+  outbuf_delete(ob2);
+  bbox1_diag = pm1->bbox_diag;
+  bbox2_diag = pm2->bbox_diag;
 
-  /* Analyze models (we don't need normals for model 1, so we don't request
-   * for it to be oriented). */
-  start_time = clock();
-  bbox1_diag = dist_v(&model1->mesh->bBox[0], &model1->mesh->bBox[1]);
-  bbox2_diag = dist_v(&model2->mesh->bBox[0], &model2->mesh->bBox[1]);
-  printf("before analyze_model\n");
-  analyze_model(model1->mesh,m1info,0,args->verb_analysis,out,"model 1");
-  model1->info = m1info;
-  analyze_model(model2->mesh,m2info,1,args->verb_analysis,out,"model 2");
-  model2->info = m2info;
-  printf("after analyze_model\n");
   /* Adjust sampling step size */
   
   *abs_sampling_step = args->sampling_step*bbox2_diag;
@@ -149,8 +201,9 @@ void mesh_run(const struct args *args, struct model_error *model1,
   if(args->do_symmetric == 1 || args->do_symmetric == 3)
   {
     /* Compute the distance from one model to the other */
-    dist_surf_surf(model1,model2->mesh,*abs_sampling_dens,args->min_sample_freq,
-                   stats,1,(args->quiet ? NULL : progress));
+    dist_surf_surf_prepared(model1,pm1,pm2,*abs_sampling_dens,
+                            args->min_sample_freq,stats,1,
+                            (args->quiet ? NULL : progress));
   
     /* Print results */
     outbuf_printf(out,"Surface area:            \t%11g\t%11g\n",
@@ -173,8 +226,9 @@ void mesh_run(const struct args *args, struct model_error *model1,
   { 
       /* Invert models and recompute distance */
         outbuf_printf(out,"       Distance from model 2 to model 1\n\n");
-        dist_surf_surf(model2,model1->mesh,*abs_sampling_dens,args->min_sample_freq,
-                   stats_rev,0,(args->quiet ? NULL : progress));
+        dist_surf_surf_prepared(model2,pm2,pm1,*abs_sampling_dens,
+                                args->min_sample_freq,stats_rev,0,
+                                (args->quiet ? NULL : progress));
         outbuf_printf(out,"        \t   Absolute\t%% BBox diag\n");
         outbuf_printf(out,"        \t           \t  (Model 2)\n");
         outbuf_printf(out,"Min:    \t%11g\t%11g\n",
@@ -292,6 +346,8 @@ void mesh_run(const struct args *args, struct model_error *model1,
   outbuf_printf(out,"Analysis and measuring time (secs.):\t%.2f\n",
                 (double)(clock()-start_time)/CLOCKS_PER_SEC);
   outbuf_flush(out);
+  free_prepared_mesh(pm1);
+  free_prepared_mesh(pm2);
   
   /* Get the per vertex error metric */
   nv_empty = nf_empty = 0; /* keep compiler happy */
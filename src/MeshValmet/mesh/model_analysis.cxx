@@ -958,13 +958,26 @@ void analyze_model(struct model *m, struct model_info *info, int do_orient,
                    int verbose, struct outbuf *out, const char *name)
 {
   struct face_list *flist;       /* list of faces incident on each vertex */
+  int n_degenerate;              /* number of degenerate faces */
+
+  flist = faces_of_vertex(m,&n_degenerate);
+  analyze_model_flist(m,flist,n_degenerate,info,do_orient,verbose,out,name);
+  free_face_lists(flist,m->num_vert);
+}
+
+/* See model_analysis.h */
+void analyze_model_flist(struct model *m, struct face_list *flist,
+                         int n_degenerate, struct model_info *info,
+                         int do_orient, int verbose, struct outbuf *out,
+                         const char *name)
+{
   bmap_t *face_revo;             /* flag for each face: if its orientation
                                   * should be reversed. */
   bmap_t *manifold_vtcs;         /* array flagging manifold vertices */
 
   /* Initialize */
   memset(info,0,sizeof(*info));
-  flist = faces_of_vertex(m,&(info->n_degenerate));
+  info->n_degenerate = n_degenerate;
 
   /* Make topology and orientation analysis */
   manifold_vtcs = model_topology(m->num_vert,m->faces,flist,info);
@@ -986,7 +999,6 @@ void analyze_model(struct model *m, struct model_info *info, int do_orient,
   /* Free memory */
   free(face_revo);
   free(manifold_vtcs);
-  free_face_lists(flist,m->num_vert);
 }
 
 /* See model_analysis.h */
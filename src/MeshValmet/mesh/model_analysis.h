@@ -111,6 +111,14 @@ struct model_info {
 void analyze_model(struct model *m, struct model_info *info, int do_orient,
                    int verbose, struct outbuf *out, const char *name);
 
+/* Same as analyze_model(), but using the face lists flist of m (as returned
+ * by faces_of_vertex(), with n_degenerate degenerate faces) instead of
+ * computing them. The order of the faces in each list may be changed. */
+void analyze_model_flist(struct model *m, struct face_list *flist,
+                         int n_degenerate, struct model_info *info,
+                         int do_orient, int verbose, struct outbuf *out,
+                         const char *name);
+
 /* Returns an array of length m->num_vert with the list of faces incident on
  * each vertex. The number of degenerate faces is returned in
  * *n_degenerate. Degenerate faces are ignored (i.e. not included as incident
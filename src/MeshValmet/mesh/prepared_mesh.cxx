@@ -0,0 +1,105 @@
+/*
+ * Prepared meshes, see prepared_mesh.h
+ */
+
+#include <prepared_mesh.h>
+
+#include <compute_error.h>
+#include <compute_volume_overlap.h>
+#include <geomutils.h>
+#include <xalloc.h>
+
+/* --------------------------------------------------------------------------*
+ *                          External functions                               *
+ * --------------------------------------------------------------------------*/
+
+/* See prepared_mesh.h */
+struct prepared_mesh *prepare_mesh(struct model *m)
+{
+  struct prepared_mesh *pm;
+  int i,n;
+
+  pm = (struct prepared_mesh *)xa_calloc(1,sizeof(*pm));
+  pm->mesh = m;
+
+  pm->dvertices = (dvertex_t *)xa_malloc(m->num_vert*sizeof(*(pm->dvertices)));
+  for (i=0, n=m->num_vert; i<n; i++) {
+    vertex_f2d_dv(&(m->vertices[i]),&(pm->dvertices[i]));
+  }
+
+  pm->face_area = (double *)xa_malloc(m->num_faces*sizeof(*(pm->face_area)));
+  pm->total_area = 0;
+  for (i=0, n=m->num_faces; i<n; i++) {
+    pm->face_area[i] = tri_area_dv(&(pm->dvertices[m->faces[i].f0]),
+                                   &(pm->dvertices[m->faces[i].f1]),
+                                   &(pm->dvertices[m->faces[i].f2]));
+    pm->total_area += pm->face_area[i];
+  }
+
+  vertex_f2d_dv(&(m->bBox[0]),&(pm->bbox_min));
+  vertex_f2d_dv(&(m->bBox[1]),&(pm->bbox_max));
+  pm->bbox_diag = dist_dv(&(pm->bbox_min),&(pm->bbox_max));
+
+  return pm;
+}
+
+/* See prepared_mesh.h */
+void free_prepared_mesh(struct prepared_mesh *pm)
+{
+  if (pm == NULL) return;
+  free_prepared_dist_index(pm);
+  if (pm->flist != NULL) free_face_lists(pm->flist,pm->mesh->num_vert);
+  free(pm->info);
+  free(pm->face_area);
+  free(pm->dvertices);
+  free(pm);
+}
+
+/* See prepared_mesh.h */
+void prepared_mesh_build_all(struct prepared_mesh *pm)
+{
+  prepared_mesh_face_lists(pm);
+  prepared_mesh_volume(pm,NULL);
+  prepared_mesh_build_dist_index(pm);
+}
+
+/* See prepared_mesh.h */
+const struct face_list *prepared_mesh_face_lists(struct prepared_mesh *pm)
+{
+  if (pm->flist == NULL) {
+    pm->flist = faces_of_vertex(pm->mesh,&(pm->n_degenerate));
+  }
+  return pm->flist;
+}
+
+/* See prepared_mesh.h */
+const struct model_info *prepared_mesh_info(struct prepared_mesh *pm,
+                                            int do_orient, int verbose,
+                                            struct outbuf *out,
+                                            const char *name)
+{
+  if (pm->info == NULL) {
+    prepared_mesh_face_lists(pm);
+    pm->info = (struct model_info *)xa_malloc(sizeof(*(pm->info)));
+    analyze_model_flist(pm->mesh,pm->flist,pm->n_degenerate,pm->info,
+                        do_orient,verbose,out,name);
+    if (((do_orient && pm->info->orientable) || do_orient > 1) &&
+        !pm->info->orig_oriented) {
+      /* Faces were flipped: triangle normals and volume sign are stale */
+      free_prepared_dist_index(pm);
+      pm->has_volume = 0;
+    }
+  }
+  return pm->info;
+}
+
+/* See prepared_mesh.h */
+double prepared_mesh_volume(struct prepared_mesh *pm, double *open_ratio)
+{
+  if (!pm->has_volume) {
+    pm->volume = ComputeMeshVolume(pm->mesh,&(pm->open_ratio));
+    pm->has_volume = 1;
+  }
+  if (open_ratio != NULL) *open_ratio = pm->open_ratio;
+  return pm->volume;
+}
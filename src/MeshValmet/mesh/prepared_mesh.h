@@ -0,0 +1,108 @@
+/*
+ * Prepared meshes: a model together with all the derived data that the
+ * distance, volume overlap and analysis code needs, computed once and shared
+ * by all the metrics of a comparison (and by several comparisons, when the
+ * same mesh is compared against many others).
+ */
+
+#ifndef _PREPARED_MESH_PROTO
+#define _PREPARED_MESH_PROTO
+
+/*
+ * --------------------------------------------------------------------------*
+ *                         External includes                                 *
+ * --------------------------------------------------------------------------*
+ */
+
+#include <3dmodel.h>
+#include <model_analysis.h>
+
+#ifdef __cplusplus
+#define BEGIN_DECL extern "C" {
+#define END_DECL }
+#else
+#define BEGIN_DECL
+#define END_DECL
+#endif
+
+BEGIN_DECL
+#undef BEGIN_DECL
+
+/* --------------------------------------------------------------------------*
+ *                       Exported data types                                 *
+ * --------------------------------------------------------------------------*/
+
+/* Opaque types, private to compute_error.cxx */
+struct triangle_list;
+struct dist_grid;
+
+/* A model and its derived data. The fields in the first group are computed
+ * by prepare_mesh(), the others are computed on first use (by the accessor
+ * functions below, or by dist_surf_surf_prepared()) and kept until
+ * free_prepared_mesh() is called. Lazy initialization is not thread safe: if
+ * a prepared mesh is to be used concurrently, call prepared_mesh_build_all()
+ * first. */
+struct prepared_mesh {
+  struct model *mesh;       /* The model. Not owned, it must outlive the
+                             * prepared mesh and must not be modified
+                             * (except by prepared_mesh_info()). */
+  dvertex_t *dvertices;     /* The vertices, in double precision */
+  double *face_area;        /* The area of each face */
+  double total_area;        /* The total surface area */
+  dvertex_t bbox_min;       /* The minimum corner of the bounding box */
+  dvertex_t bbox_max;       /* The maximum corner of the bounding box */
+  double bbox_diag;         /* The length of the bounding box diagonal */
+
+  struct face_list *flist;  /* The faces incident on each vertex. NULL if not
+                             * yet computed. */
+  int n_degenerate;         /* The number of degenerate faces (valid only if
+                             * flist is not NULL) */
+  struct model_info *info;  /* The topology analysis. NULL if not yet
+                             * computed. */
+  int has_volume;           /* Non-zero if volume and open_ratio are valid */
+  double volume;            /* The signed enclosed volume */
+  double open_ratio;        /* See ComputeMeshVolume() */
+  struct triangle_list *tl; /* The triangle precomputation for point to
+                             * surface distances. NULL if not yet computed. */
+  struct dist_grid *grid;   /* The cell grid over the bounding box, with the
+                             * triangles intersecting each cell. NULL if not
+                             * yet computed. */
+};
+
+/* --------------------------------------------------------------------------*
+ *                       Exported functions                                  *
+ * --------------------------------------------------------------------------*/
+
+/* Returns a new prepared mesh for model m, with the double precision
+ * vertices, face areas and bounding box already computed. The allocation
+ * never fails (see xalloc.h). */
+struct prepared_mesh *prepare_mesh(struct model *m);
+
+/* Frees pm and all its derived data, but not pm->mesh. */
+void free_prepared_mesh(struct prepared_mesh *pm);
+
+/* Computes all the lazily initialized data of pm, so that it can then be
+ * shared read-only between threads. */
+void prepared_mesh_build_all(struct prepared_mesh *pm);
+
+/* Returns the list of faces incident on each vertex of pm->mesh (see
+ * faces_of_vertex()). */
+const struct face_list *prepared_mesh_face_lists(struct prepared_mesh *pm);
+
+/* Analyzes pm->mesh as analyze_model() does, reusing the face lists of
+ * pm. The result is cached; do_orient is only honored on the first call. If
+ * the model gets oriented, the data depending on the face orientation is
+ * discarded. */
+const struct model_info *prepared_mesh_info(struct prepared_mesh *pm,
+                                            int do_orient, int verbose,
+                                            struct outbuf *out,
+                                            const char *name);
+
+/* Returns the signed volume enclosed by pm->mesh (see ComputeMeshVolume()),
+ * and in *open_ratio (if not NULL) the closedness residual. */
+double prepared_mesh_volume(struct prepared_mesh *pm, double *open_ratio);
+
+END_DECL
+#undef END_DECL
+
+#endif /* _PREPARED_MESH_PROTO */
@@ -132,6 +132,19 @@ void outbuf_printf(struct outbuf *ob, const char *format, ...)
   ob->pos += len;
 }
 
+/* see reporting.h */
+void outbuf_puts(struct outbuf *ob, const char *str)
+{
+  int len;
+
+  /* In pieces that outbuf_printf() can take */
+  while (*str != '\0') {
+    for (len=0; len<OUTBUF_MAX_SZ-1 && str[len]!='\0'; len++) ;
+    outbuf_printf(ob,"%.*s",len,str);
+    str += len;
+  }
+}
+
 /* see reporting.h */
 void prog_report(struct prog_reporter *pr, int p)
 {
@@ -128,6 +128,9 @@ void outbuf_flush(struct outbuf *ob);
 void outbuf_printf(struct outbuf *ob, const char *format, ...)
   REPORTING_PRINTF_ATTR(2,3); /* allow GCC to check format string */
 
+/* Appends the string str, of any length, to the ob output buffer. */
+void outbuf_puts(struct outbuf *ob, const char *str);
+
 /* Reports the progress p to pr. */
 void prog_report(struct prog_reporter *pr, int p);
 
@@ -1,30 +1,200 @@
 /* Author: Eugene Vorontsov
  *
- * Load any two files of type image mask (target value 1, else 0) or vtk/vtp mesh and compare the two surfaces using MeshValmet.
+ * Load any two files of type image mask (target value 1, else 0) or vtk/vtp/stl/obj mesh and compare the two surfaces using MeshValmet.
  * Code for converting itk to vtk meshes taken from Arnaud Gelas <arnaud_gelas@hms.harvard.edu> from github (https://github.com/arnaudgelas/itkQuadEdgeMeshProcessing) */
 
 #include <unistd.h>
 #include <iostream>
+#include <fstream>
+#include <vector>
+#include <map>
+#include <deque>
+#include <algorithm>
+#include <exception>
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <ctype.h>
+#include <errno.h>
+#include <sys/stat.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include <vtkGenericDataObjectReader.h>
 #include <vtkXMLPolyDataReader.h>
+#include <vtkSTLReader.h>
+#include <vtkOBJReader.h>
 #include <vtkPolyData.h>
 #include <vtkPolyDataWriter.h>
 
 #include <itkImageFileReader.h>
 #include <itkCastImageFilter.h>
+#include <itkRegionOfInterestImageFilter.h>
 #include <itkBinaryMask3DMeshSource.h>
 #include <itkSimplexMeshToTriangleMeshFilter.h>
 
 #include "itkMeshTovtkPolyData.h"
 #include "VTK_to_MeshValmet.h"
+#include "ITK_to_MeshValmet.h"
+#include "MaskToModel.h"
 #include "CompareMeshes.h"
+#include "CompareMasks.h"
+#include "CompareMeshMask.h"
+#include "MeshCache.h"
+#include "model_mvm.h"
 
-enum file_type {IMAGE, VTK, VTP, UNKNOWN};
+enum file_type {IMAGE, VTK, VTP, STL, OBJ, MVM, UNKNOWN};
 
-/* Identify file type: ITK image, vtk/vtp mesh, unkown. */
+/* Surface extraction for masks: marching cubes (MaskToModel.h) or the former
+   itk::BinaryMask3DMeshSource. */
+enum mask_mesher {MARCHING_CUBES, ITK_MESH_SOURCE};
+
+/* Return true if the n bytes at p start with the string prefix. */
+bool starts_with(const char* p, size_t n, const char* prefix)
+{
+  size_t len = strlen(prefix);
+  return n>=len && memcmp(p, prefix, len)==0;
+}
+
+/* Return the (lowercase) extension of a file name, without the dot, or an
+   empty string. */
+std::string file_extension(std::string filename)
+{
+  std::string::size_type dot = filename.rfind('.');
+  if( dot==std::string::npos || filename.find('/', dot)!=std::string::npos )
+  {
+    return std::string();
+  }
+  std::string extension = filename.substr(dot+1);
+  for(size_t c=0; c<extension.size(); c++)
+  {
+    extension[c] = tolower((unsigned char)extension[c]);
+  }
+  return extension;
+}
+
+/* Classify a file from its first bytes and its extension, without probing the
+   ITK image readers (each of which opens and parses the file): legacy vtk
+   polydata, XML PolyData, STL (ASCII or binary, by its size), OBJ and mvm
+   meshes, and NIfTI, Analyze, NRRD, MetaImage, DICOM, TIFF, HDF5 and gzipped
+   NIfTI images. Returns false if the file cannot be read or its type is not
+   clear from these, e.g. a legacy vtk image, leaving the decision to ITK. */
+bool sniff_file_type(std::string filename, file_type& type)
+{
+  FILE* f = fopen(filename.c_str(), "rb");
+  if( f==NULL )
+  {
+    return false;
+  }
+  char head[1024];
+  size_t n = fread(head, 1, sizeof(head), f);
+  long long size = fseek(f, 0, SEEK_END)==0 ? (long long)ftell(f) : -1;
+  fclose(f);
+  std::string extension = file_extension(filename);
+  type = UNKNOWN;
+  
+  // Signatures of meshes
+  if( starts_with(head, n, "MVM\r\n\032\n") )
+  {
+    type = MVM;
+  }
+  else if( starts_with(head, n, "# vtk DataFile") )
+  {
+    // Other datasets (e.g. STRUCTURED_POINTS, which ITK reads) are left to ITK
+    std::string header(head, n);
+    std::string::size_type dataset = header.find("DATASET ");
+    if( dataset!=std::string::npos && header.compare(dataset+8, 8, "POLYDATA")==0 )
+    {
+      type = VTK;
+    }
+  }
+  else if( (starts_with(head, n, "<?xml") || starts_with(head, n, "<VTKFile")) &&
+           std::string(head, n).find("type=\"PolyData\"")!=std::string::npos )
+  {
+    type = VTP;
+  }
+  
+  // Signatures of images
+  else if( n>=348 && (memcmp(head+344, "n+1\0", 4)==0 || memcmp(head+344, "ni1\0", 4)==0) )
+  {
+    type = IMAGE;  // NIfTI-1
+  }
+  else if( n>=12 && (memcmp(head+4, "n+2\0", 4)==0 || memcmp(head+4, "ni2\0", 4)==0) )
+  {
+    type = IMAGE;  // NIfTI-2
+  }
+  else if( n>=4 && extension=="hdr" && (memcmp(head, "\x5c\x01\0\0", 4)==0 || memcmp(head, "\0\0\x01\x5c", 4)==0) )
+  {
+    type = IMAGE;  // Analyze 7.5 (a header size of 348, in either byte order)
+  }
+  else if( starts_with(head, n, "NRRD000") )
+  {
+    type = IMAGE;
+  }
+  else if( (extension=="mha" || extension=="mhd") && std::string(head, n).find("NDims")!=std::string::npos )
+  {
+    type = IMAGE;  // MetaImage
+  }
+  else if( n>=132 && memcmp(head+128, "DICM", 4)==0 )
+  {
+    type = IMAGE;
+  }
+  else if( n>=4 && (memcmp(head, "II*\0", 4)==0 || memcmp(head, "MM\0*", 4)==0) )
+  {
+    type = IMAGE;  // TIFF
+  }
+  else if( starts_with(head, n, "\x89HDF\r\n\032\n") )
+  {
+    type = IMAGE;  // HDF5 (e.g. MINC 2)
+  }
+  else if( starts_with(head, n, "\x1f\x8b") && extension=="gz" &&
+           file_extension(filename.substr(0, filename.size()-3))=="nii" )
+  {
+    type = IMAGE;  // gzipped NIfTI
+  }
+  
+  // STL files: binary ones have an 80 byte header, a little endian triangle
+  // count and 50 bytes per triangle (and some start with "solid", like ASCII
+  // files)
+  else if( n>=84 && size==84+50*(long long)(((unsigned char)head[80]) | ((unsigned char)head[81]<<8) |
+                                            ((unsigned char)head[82]<<16) | ((unsigned long)(unsigned char)head[83]<<24)) )
+  {
+    type = STL;
+  }
+  else if( starts_with(head, n, "solid") && extension=="stl" )
+  {
+    type = STL;
+  }
+  
+  // OBJ files have no signature; ITK reads no images with this extension
+  else if( extension=="obj" )
+  {
+    type = OBJ;
+  }
+  return type!=UNKNOWN;
+}
+
+
+/* Identify file type: ITK image, vtk/vtp/stl/obj mesh, mvm cache, unkown. The
+   file is classified by its first bytes when they are clear, and by the ITK
+   image readers and its extension otherwise. */
 file_type identify_file_type(std::string filename)
 {
+  file_type type;
+  if( sniff_file_type(filename, type) )
+  {
+    return type;
+  }
+  
+  // Check for a converted mesh first, without probing the ITK image readers
+  std::string::size_type dot = filename.rfind('.');
+  if(dot != std::string::npos && filename.compare(dot, std::string::npos, ".mvm")==0)
+  {
+    return MVM;
+  }
+  
   // Check for image (by header)
   itk::ImageIOBase::Pointer imageIO = itk::ImageIOFactory::CreateImageIO( filename.c_str(), itk::ImageIOFactory::ReadMode );
   if( imageIO.IsNotNull() )
@@ -45,6 +215,14 @@ file_type identify_file_type(std::string filename)
     {
       return VTP;
     }
+    if(extension.compare("stl")==0 || extension.compare("STL")==0)
+    {
+      return STL;
+    }
+    if(extension.compare("obj")==0 || extension.compare("OBJ")==0)
+    {
+      return OBJ;
+    }
   }
   
   // Unknown file type
@@ -54,84 +232,492 @@ file_type identify_file_type(std::string filename)
 
 
 
-/* Load an image and return the image with float type pixels.
+/* Read the header of an image, check that it is a 3D scalar image and return
+   the type of its pixel values.
    Supporting DICOM, MetaImage (see http://www.itk.org/Wiki/ITK/File_Formats) */
-template < typename TPixel, typename TCastPixel >
-typename itk::Image<TCastPixel, 3>::Pointer load_and_cast_image3D_subroutine(std::string filename);
-template < typename TCastPixel >
-typename itk::Image<TCastPixel, 3>::Pointer load_and_cast_image3D(std::string filename)
+itk::ImageIOBase::IOComponentType read_image3D_component_type(std::string filename)
 {
-  // Identify image type
   itk::ImageIOBase::Pointer imageIO = itk::ImageIOFactory::CreateImageIO( filename.c_str(), itk::ImageIOFactory::ReadMode );
   imageIO->SetFileName(filename);
   imageIO->ReadImageInformation();
   itk::ImageIOBase::IOPixelType PixelType = imageIO->GetPixelType();
-  itk::ImageIOBase::IOComponentType PixelValueType = imageIO->GetComponentType();
   if( imageIO->GetNumberOfDimensions() != 3 )
   {
     std::cerr << "ERROR: There are fewer or more than 3 dimensions in the image file: " << filename << std::endl;
     throw 2;
   }
-  
-  // Load and cast the image
-  if( PixelType == itk::ImageIOBase::SCALAR )
-  {
-    switch( PixelValueType )
-    {
-      case itk::ImageIOBase::FLOAT  :
-        return load_and_cast_image3D_subroutine<float, TCastPixel>(filename);
-      case itk::ImageIOBase::DOUBLE  :
-        return load_and_cast_image3D_subroutine<double, TCastPixel>(filename);
-      case itk::ImageIOBase::CHAR  :
-        return load_and_cast_image3D_subroutine<char, TCastPixel>(filename);
-      case itk::ImageIOBase::UCHAR  :
-        return load_and_cast_image3D_subroutine<unsigned char, TCastPixel>(filename);
-      case itk::ImageIOBase::SHORT  :
-        return load_and_cast_image3D_subroutine<short, TCastPixel>(filename);
-      case itk::ImageIOBase::USHORT  :
-        return load_and_cast_image3D_subroutine<unsigned short, TCastPixel>(filename);
-      case itk::ImageIOBase::LONG  :
-        return load_and_cast_image3D_subroutine<long, TCastPixel>(filename);
-      case itk::ImageIOBase::ULONG  :
-        return load_and_cast_image3D_subroutine<unsigned long, TCastPixel>(filename);
-      case itk::ImageIOBase::INT  :
-        return load_and_cast_image3D_subroutine<int, TCastPixel>(filename);
-      case itk::ImageIOBase::UINT  :
-        return load_and_cast_image3D_subroutine<unsigned int, TCastPixel>(filename);
-      default:
-        std::cerr << "Unsupported pixel value type: " << imageIO->GetComponentTypeAsString( PixelValueType )
-        << std::endl;
-        throw 2;
-    }
-  }
-  else
+  if( PixelType != itk::ImageIOBase::SCALAR )
   {
     std::cerr << "File format not supported. Only DICOM and MetaImage files are supported.\n";
     std::cerr << "Unsupported pixel type: " << imageIO->GetPixelTypeAsString( PixelType ) << std::endl;
     throw 2;
   }
+  return imageIO->GetComponentType();
+}
+
+
+/* Print the error for an image of unsupported pixel value type and throw. */
+void unsupported_component_type(itk::ImageIOBase::IOComponentType PixelValueType)
+{
+  std::cerr << "Unsupported pixel value type: " << itk::ImageIOBase::GetComponentTypeAsString( PixelValueType )
+  << std::endl;
+  throw 2;
+}
+
+
+/* Margin, in voxels, kept around the voxels of value 1 when a mask is cropped */
+const int MASK_ROI_MARGIN = 2;
+
+/* Default size bound of the mesh cache, in MB */
+const unsigned long long DEFAULT_MESH_CACHE_MB = 4096;
+
+/* Find the bounding box of the voxels of value 1 of an image (compared as
+   floats, the type masks used to be cast to), on the image's own pixel type
+   and in parallel over its z planes, and return it grown by margin voxels
+   within the buffered region. Returns false, leaving region unset, if there
+   are no voxels of value 1. */
+template < typename TImage >
+bool find_mask_region(const TImage* image, int margin, typename TImage::RegionType& region)
+{
+  typename TImage::RegionType buffered = image->GetBufferedRegion();
+  const int nx = (int)buffered.GetSize()[0], ny = (int)buffered.GetSize()[1], nz = (int)buffered.GetSize()[2];
+  const typename TImage::PixelType* pixels = image->GetBufferPointer();
+  std::vector<int> plane_box(4*nz);  // per plane: lowest i and j, highest i and j
+  #pragma omp parallel for schedule(dynamic)
+  for(int k=0; k<nz; k++)
+  {
+    int* pb = &plane_box[4*k];
+    pb[0] = nx; pb[1] = ny; pb[2] = pb[3] = -1;
+    for(int j=0; j<ny; j++)
+    {
+      const typename TImage::PixelType* row = pixels + (size_t)nx*(j+(size_t)ny*k);
+      for(int i=0; i<nx; i++)
+      {
+        if( (float)row[i]!=1.0f ) continue;
+        if( i<pb[0] ) pb[0] = i;
+        if( j<pb[1] ) pb[1] = j;
+        if( i>pb[2] ) pb[2] = i;
+        pb[3] = j;
+      }
+    }
+  }
+  int lo[3] = { nx, ny, nz }, hi[3] = { -1, -1, -1 };
+  for(int k=0; k<nz; k++)
+  {
+    const int* pb = &plane_box[4*k];
+    if( pb[2]<0 ) continue;
+    lo[0] = min(lo[0], pb[0]);
+    lo[1] = min(lo[1], pb[1]);
+    hi[0] = max(hi[0], pb[2]);
+    hi[1] = max(hi[1], pb[3]);
+    lo[2] = min(lo[2], k);
+    hi[2] = k;
+  }
+  if( hi[2]<0 )
+  {
+    return false;
+  }
+  const int dims[3] = { nx, ny, nz };
+  typename TImage::IndexType index;
+  typename TImage::SizeType size;
+  for(int a=0; a<3; a++)
+  {
+    lo[a] = max(lo[a]-margin, 0);
+    hi[a] = min(hi[a]+margin, dims[a]-1);
+    index[a] = buffered.GetIndex()[a]+lo[a];
+    size[a] = hi[a]-lo[a]+1;
+  }
+  region.SetIndex(index);
+  region.SetSize(size);
+  return true;
+}
+
+
+/* Geometry of the buffered region of an image. */
+template < typename TImage >
+void image_geometry(const TImage* image, struct mask_geometry& geom)
+{
+  // The first voxel of the buffer need not be the image origin
+  typename TImage::RegionType region = image->GetBufferedRegion();
+  typename TImage::PointType first;
+  image->TransformIndexToPhysicalPoint(region.GetIndex(), first);
+  for(int a=0; a<3; a++)
+  {
+    geom.dims[a] = (int)region.GetSize()[a];
+    geom.origin[a] = first[a];
+    geom.spacing[a] = image->GetSpacing()[a];
+    for(int b=0; b<3; b++)
+    {
+      geom.direction[3*a+b] = image->GetDirection()[a][b];
+    }
+  }
+}
+
+
+/* Geometry of the box of dims voxels of the grid geom starting at voxel lo. */
+void crop_geometry(const struct mask_geometry& geom, const int* lo, const int* dims, struct mask_geometry& roi)
+{
+  roi = geom;
+  for(int a=0; a<3; a++)
+  {
+    roi.dims[a] = dims[a];
+    for(int b=0; b<3; b++)
+    {
+      roi.origin[a] += geom.direction[3*a+b]*geom.spacing[b]*lo[b];
+    }
+  }
+}
+
+
+/* Load a mask image on its pixel type and threshold the voxels of its region
+   of interest (see load_mask()). */
+template < typename TPixel >
+void load_mask_subroutine(std::string filename, struct mask_geometry& geom, std::vector<unsigned char>& mask,
+                          struct mask_geometry* full_geom, int* roi_lo)
+{
+  typedef itk::Image< TPixel, 3 > LoadImageType;
+  typedef itk::ImageFileReader<LoadImageType> ReaderType;
+  typename ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName( filename );
+  reader->Update();
+  const LoadImageType* image = reader->GetOutput();
+  
+  struct mask_geometry full;
+  image_geometry(image, full);
+  if( full_geom!=NULL )
+  {
+    *full_geom = full;
+  }
+  int lo[3] = { 0, 0, 0 }, dims[3] = { 0, 0, 0 };
+  typename LoadImageType::RegionType region;
+  if( find_mask_region(image, MASK_ROI_MARGIN, region) )
+  {
+    for(int a=0; a<3; a++)
+    {
+      lo[a] = (int)(region.GetIndex()[a]-image->GetBufferedRegion().GetIndex()[a]);
+      dims[a] = (int)region.GetSize()[a];
+    }
+  }
+  crop_geometry(full, lo, dims, geom);
+  if( roi_lo!=NULL )
+  {
+    for(int a=0; a<3; a++) roi_lo[a] = lo[a];
+  }
+  
+  const TPixel* pixels = image->GetBufferPointer();
+  mask.resize((size_t)dims[0]*dims[1]*dims[2]);
+  #pragma omp parallel for
+  for(int k=0; k<dims[2]; k++)
+  {
+    for(int j=0; j<dims[1]; j++)
+    {
+      const TPixel* row = pixels + lo[0] + (size_t)full.dims[0]*((lo[1]+j) + (size_t)full.dims[1]*(lo[2]+k));
+      unsigned char* out = &mask[(size_t)dims[0]*(j+(size_t)dims[1]*k)];
+      for(int i=0; i<dims[0]; i++)
+      {
+        out[i] = (float)row[i]==1.0f;
+      }
+    }
+  }
+}
+
+
+/* Load a mask image as a binary mask: the voxels of value 1 are inside, the
+   others are background. The image is read on its own pixel type and only its
+   region of interest, the bounding box of the voxels of value 1 plus a margin,
+   is kept: geom is the grid of that region (empty if there are no voxels of
+   value 1) and mask holds its voxels. If not NULL, full_geom is set to the grid
+   of the whole image and roi_lo to the index of the first voxel of the region
+   in it. */
+void load_mask(std::string filename, struct mask_geometry& geom, std::vector<unsigned char>& mask,
+               struct mask_geometry* full_geom=NULL, int* roi_lo=NULL)
+{
+  itk::ImageIOBase::IOComponentType PixelValueType = read_image3D_component_type(filename);
+  switch( PixelValueType )
+  {
+    case itk::ImageIOBase::FLOAT  :
+      return load_mask_subroutine<float>(filename, geom, mask, full_geom, roi_lo);
+    case itk::ImageIOBase::DOUBLE  :
+      return load_mask_subroutine<double>(filename, geom, mask, full_geom, roi_lo);
+    case itk::ImageIOBase::CHAR  :
+      return load_mask_subroutine<char>(filename, geom, mask, full_geom, roi_lo);
+    case itk::ImageIOBase::UCHAR  :
+      return load_mask_subroutine<unsigned char>(filename, geom, mask, full_geom, roi_lo);
+    case itk::ImageIOBase::SHORT  :
+      return load_mask_subroutine<short>(filename, geom, mask, full_geom, roi_lo);
+    case itk::ImageIOBase::USHORT  :
+      return load_mask_subroutine<unsigned short>(filename, geom, mask, full_geom, roi_lo);
+    case itk::ImageIOBase::LONG  :
+      return load_mask_subroutine<long>(filename, geom, mask, full_geom, roi_lo);
+    case itk::ImageIOBase::ULONG  :
+      return load_mask_subroutine<unsigned long>(filename, geom, mask, full_geom, roi_lo);
+    case itk::ImageIOBase::INT  :
+      return load_mask_subroutine<int>(filename, geom, mask, full_geom, roi_lo);
+    case itk::ImageIOBase::UINT  :
+      return load_mask_subroutine<unsigned int>(filename, geom, mask, full_geom, roi_lo);
+    default:
+      unsupported_component_type(PixelValueType);
+  }
 }
 
-template < typename TPixel, typename TCastPixel >
-typename itk::Image<TCastPixel, 3>::Pointer load_and_cast_image3D_subroutine(std::string filename)
+
+/* Load a mask image on its pixel type, crop it to its region of interest
+   (see load_mask()) with the ITK region pipeline, and only then cast it to
+   float. Images without voxels of value 1 are kept whole. */
+template < typename TPixel >
+itk::Image<float, 3>::Pointer load_mask_image_subroutine(std::string filename)
 {
-  // Load the image
   typedef itk::Image< TPixel, 3 > LoadImageType;
   typedef itk::ImageFileReader<LoadImageType> ReaderType;
   typename ReaderType::Pointer reader = ReaderType::New();
   reader->SetFileName( filename );
   reader->Update();
   
-  // Cast the image to an internal type
-  typedef itk::Image< TCastPixel, 3 > CastImageType;
+  typedef itk::Image< float, 3 > CastImageType;
   typedef itk::CastImageFilter< LoadImageType, CastImageType > CastFilterType;
   typename CastFilterType::Pointer cast_filter = CastFilterType::New();
-  cast_filter->SetInput( reader->GetOutput() );
+  typename LoadImageType::RegionType region;
+  typedef itk::RegionOfInterestImageFilter< LoadImageType, LoadImageType > ROIFilterType;
+  typename ROIFilterType::Pointer roi_filter = ROIFilterType::New();
+  if( find_mask_region(reader->GetOutput(), MASK_ROI_MARGIN, region) )
+  {
+    roi_filter->SetInput( reader->GetOutput() );
+    roi_filter->SetRegionOfInterest( region );
+    cast_filter->SetInput( roi_filter->GetOutput() );
+  }
+  else
+  {
+    cast_filter->SetInput( reader->GetOutput() );
+  }
   cast_filter->Update();
   
   return cast_filter->GetOutput();
 }
 
+itk::Image<float, 3>::Pointer load_mask_image(std::string filename)
+{
+  itk::ImageIOBase::IOComponentType PixelValueType = read_image3D_component_type(filename);
+  switch( PixelValueType )
+  {
+    case itk::ImageIOBase::FLOAT  :
+      return load_mask_image_subroutine<float>(filename);
+    case itk::ImageIOBase::DOUBLE  :
+      return load_mask_image_subroutine<double>(filename);
+    case itk::ImageIOBase::CHAR  :
+      return load_mask_image_subroutine<char>(filename);
+    case itk::ImageIOBase::UCHAR  :
+      return load_mask_image_subroutine<unsigned char>(filename);
+    case itk::ImageIOBase::SHORT  :
+      return load_mask_image_subroutine<short>(filename);
+    case itk::ImageIOBase::USHORT  :
+      return load_mask_image_subroutine<unsigned short>(filename);
+    case itk::ImageIOBase::LONG  :
+      return load_mask_image_subroutine<long>(filename);
+    case itk::ImageIOBase::ULONG  :
+      return load_mask_image_subroutine<unsigned long>(filename);
+    case itk::ImageIOBase::INT  :
+      return load_mask_image_subroutine<int>(filename);
+    case itk::ImageIOBase::UINT  :
+      return load_mask_image_subroutine<unsigned int>(filename);
+    default:
+      unsupported_component_type(PixelValueType);
+  }
+  return NULL;
+}
+
+
+typedef itk::DefaultDynamicMeshTraits<double, 3, 3,double,double> TriangleMeshTraits;
+typedef itk::Mesh<double,3, TriangleMeshTraits> TriangleMeshType;
+
+/* Load a mask image and convert it to an ITK triangle mesh. */
+TriangleMeshType::Pointer load_mask_as_itk_mesh(std::string filename)
+{
+  // Load the region of interest of the image, cast to an internal type
+  typedef itk::Image< float, 3 > InternalImageType;
+  InternalImageType::Pointer image = load_mask_image(filename);
+  
+  // Convert the image into a mesh
+  typedef itk::BinaryMask3DMeshSource< InternalImageType, TriangleMeshType > MaskToMeshType;
+  typename MaskToMeshType::Pointer mask2mesh = MaskToMeshType::New();
+  mask2mesh->SetInput( image );
+  mask2mesh->Update();
+  if( mask2mesh->GetOutput()->GetNumberOfPoints()==0 )
+  {
+    std::cerr << "Error: No points in the mesh." << std::endl;
+    throw 2;
+  }
+  return mask2mesh->GetOutput();
+}
+
+
+/* Load a mask image and extract the surface of its voxels of value 1 by
+   marching cubes, in parallel slabs, straight into a MeshValmet mesh. */
+boost::shared_ptr<model> load_mask_as_model(std::string filename)
+{
+  struct mask_geometry geom;
+  std::vector<unsigned char> mask;
+  load_mask(filename, geom, mask);
+  
+  struct model* mesh = mask_to_model(mask.empty() ? NULL : &mask[0], &geom);
+  if( mesh==NULL )
+  {
+    std::cerr << "Error: Too many faces in the mesh of: " << filename << std::endl;
+    throw 2;
+  }
+  if( mesh->num_vert==0 )
+  {
+    __free_raw_model(mesh);
+    std::cerr << "Error: No points in the mesh." << std::endl;
+    throw 2;
+  }
+  return boost::shared_ptr<model>(mesh, free_model_delete());
+}
+
+
+/* Return true if the two grids match, up to rounding. */
+bool same_mask_grid(const struct mask_geometry& geom1, const struct mask_geometry& geom2)
+{
+  for(int a=0; a<3; a++)
+  {
+    double tolerance = 1e-6*fabs(geom1.spacing[a]);
+    if( geom1.dims[a]!=geom2.dims[a] ||
+        fabs(geom1.spacing[a]-geom2.spacing[a])>tolerance ||
+        fabs(geom1.origin[a]-geom2.origin[a])>1e3*tolerance )
+    {
+      return false;
+    }
+  }
+  for(int i=0; i<9; i++)
+  {
+    if( fabs(geom1.direction[i]-geom2.direction[i])>1e-6 )
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+/* Copy the voxels of roi, a box of roi_dims voxels starting at voxel roi_lo of
+   a grid, into mask, the box of dims voxels starting at voxel lo which holds
+   it. */
+void paste_mask(const std::vector<unsigned char>& roi, const int* roi_lo, const int* roi_dims,
+                const int* lo, const int* dims, std::vector<unsigned char>& mask)
+{
+  mask.assign((size_t)dims[0]*dims[1]*dims[2], 0);
+  #pragma omp parallel for
+  for(int k=0; k<roi_dims[2]; k++)
+  {
+    for(int j=0; j<roi_dims[1]; j++)
+    {
+      const unsigned char* in = &roi[(size_t)roi_dims[0]*(j+(size_t)roi_dims[1]*k)];
+      unsigned char* out = &mask[(roi_lo[0]-lo[0]) +
+                                 (size_t)dims[0]*((roi_lo[1]-lo[1]+j) + (size_t)dims[1]*(roi_lo[2]-lo[2]+k))];
+      memcpy(out, in, roi_dims[0]);
+    }
+  }
+}
+
+
+/* Run a task (a functor) and return 0, or report its exception and return 1. */
+template < typename TTask >
+int run_task(TTask& task)
+{
+  try
+  {
+    task();
+  }
+  catch( int )
+  {
+    return 1;  // already reported
+  }
+  catch( std::exception& e )
+  {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+
+/* Run two independent tasks (functors), e.g. the loading of the two inputs,
+   concurrently and return once both are done. The parallel loops of the tasks
+   stay parallel. If a task fails, 2 is thrown once both are done. */
+template < typename TTask1, typename TTask2 >
+void run_concurrently(TTask1& task1, TTask2& task2)
+{
+  int failed[2] = { 0, 0 };
+#ifdef _OPENMP
+  int levels = omp_get_max_active_levels();
+  if( levels<2 ) omp_set_max_active_levels(2);
+#endif
+  #pragma omp parallel sections num_threads(2)
+  {
+    #pragma omp section
+    failed[0] = run_task(task1);
+    #pragma omp section
+    failed[1] = run_task(task2);
+  }
+#ifdef _OPENMP
+  omp_set_max_active_levels(levels);
+#endif
+  if( failed[0] || failed[1] )
+  {
+    throw 2;
+  }
+}
+
+
+/* Loading of a mask (see load_mask()), as a task for run_concurrently(). */
+struct load_mask_task
+{
+  load_mask_task(std::string filename) : filename(filename) {}
+  void operator()() { load_mask(filename, geom, mask, &full_geom, roi_lo); }
+  
+  std::string filename;
+  struct mask_geometry geom, full_geom;
+  std::vector<unsigned char> mask;
+  int roi_lo[3];
+};
+
+
+/* Compare two mask images in the voxel domain, without meshing them (see
+   CompareMasks.h), over the union of their regions of interest. Returns false,
+   leaving diff unset, if the masks are not on the same voxel grid. */
+bool compare_masks(std::string filename1, std::string filename2, CompareMeshes::mesh_differences& diff)
+{
+  load_mask_task load1(filename1), load2(filename2);
+  run_concurrently(load1, load2);
+  if( !same_mask_grid(load1.full_geom, load2.full_geom) )
+  {
+    return false;
+  }
+  if( std::find(load1.mask.begin(), load1.mask.end(), 1)==load1.mask.end() ||
+      std::find(load2.mask.begin(), load2.mask.end(), 1)==load2.mask.end() )
+  {
+    std::cerr << "Error: No voxels of value 1 in the mask." << std::endl;
+    throw 2;
+  }
+  
+  int lo[3], dims[3];
+  for(int a=0; a<3; a++)
+  {
+    lo[a] = min(load1.roi_lo[a], load2.roi_lo[a]);
+    dims[a] = max(load1.roi_lo[a]+load1.geom.dims[a], load2.roi_lo[a]+load2.geom.dims[a]) - lo[a];
+  }
+  struct mask_geometry geom;
+  crop_geometry(load1.full_geom, lo, dims, geom);
+  std::vector<unsigned char> mask1, mask2;
+  paste_mask(load1.mask, load1.roi_lo, load1.geom.dims, lo, dims, mask1);
+  std::vector<unsigned char>().swap(load1.mask);
+  paste_mask(load2.mask, load2.roi_lo, load2.geom.dims, lo, dims, mask2);
+  std::vector<unsigned char>().swap(load2.mask);
+  
+  CompareMasks cm;
+  diff = cm.GetMaskDifferences(&mask1[0], &mask2[0], &geom);
+  return true;
+}
+
 
 /* Load a file and return the contents as a mesh. If it's an mask, convert it to a mesh. */
 vtkSmartPointer<vtkPolyData> load_file_as_mesh(std::string filename, file_type type)
@@ -140,24 +726,8 @@ vtkSmartPointer<vtkPolyData> load_file_as_mesh(std::string filename, file_type t
   {
     case IMAGE :
     {
-      // Load and cast the image to an internal type
-      typedef itk::Image< float, 3 > InternalImageType;
-      InternalImageType::Pointer image = load_and_cast_image3D<float>(filename);
-      
-      // Convert the image into a mesh
-      typedef itk::DefaultDynamicMeshTraits<double, 3, 3,double,double> TriangleMeshTraits;
-      typedef itk::Mesh<double,3, TriangleMeshTraits> TriangleMeshType;
-      typedef itk::BinaryMask3DMeshSource< InternalImageType, TriangleMeshType > MaskToMeshType;
-      typename MaskToMeshType::Pointer mask2mesh = MaskToMeshType::New();
-      mask2mesh->SetInput( image );
-      mask2mesh->Update();
-      if( mask2mesh->GetOutput()->GetNumberOfPoints()==0 )
-      {
-        std::cerr << "Error: No points in the mesh." << std::endl;
-        throw 2;
-      }
       itkMeshTovtkPolyData itk2vtk;
-      itk2vtk.SetInput( mask2mesh->GetOutput() );
+      itk2vtk.SetInput( load_mask_as_itk_mesh(filename) );
       return itk2vtk.GetOutput();
     } 
     case VTK :
@@ -174,6 +744,25 @@ vtkSmartPointer<vtkPolyData> load_file_as_mesh(std::string filename, file_type t
       reader->Update();
       return reader->GetOutput();
     }
+    case STL :
+    {
+      vtkSmartPointer<vtkSTLReader> reader = vtkSmartPointer<vtkSTLReader>::New();
+      reader->SetFileName( filename.c_str() );
+      reader->Update();
+      return reader->GetOutput();
+    }
+    case OBJ :
+    {
+      vtkSmartPointer<vtkOBJReader> reader = vtkSmartPointer<vtkOBJReader>::New();
+      reader->SetFileName( filename.c_str() );
+      reader->Update();
+      return reader->GetOutput();
+    }
+    case MVM :
+    {
+      std::cerr << "ERROR: Cannot load file as a VTK mesh: " << filename << std::endl;
+      throw 2;
+    }
     case UNKNOWN :
     {
       std::cerr << "ERROR: Cannot load file; unknown file type for file: " << filename << std::endl;
@@ -183,36 +772,915 @@ vtkSmartPointer<vtkPolyData> load_file_as_mesh(std::string filename, file_type t
 }
 
 
-int main(int argc, char** argv)
+/* Read a vtk/vtp/stl/obj mesh file with the MeshValmet readers, which fill the
+   mesh directly. Returns an empty pointer if they cannot read the file (e.g. a
+   compressed vtp file without zlib support), so that VTK can be used instead. */
+boost::shared_ptr<model> read_mesh_file(std::string filename, file_type type)
 {
-  if( argc!=3 and argc!=4 )
+  struct model* mesh = NULL;
+  int fformat;
+  switch( type )
   {
-    std::cerr << "Usage: " << std::endl;
-    std::cerr << argv[0] << " <mesh/image filename> <ground truth mesh/image filename> [<results file>]" << std::endl;
-    return 1;
+    case VTK : fformat = MESH_FF_VTK; break;
+    case VTP : fformat = MESH_FF_VTP; break;
+    case STL : fformat = MESH_FF_STL; break;
+    case OBJ : fformat = MESH_FF_OBJ; break;
+    default : return boost::shared_ptr<model>();
   }
-  
-  // Identify file types and load as meshes accordingly
-  file_type type1 = identify_file_type(argv[1]);
-  if( type1==UNKNOWN )
+  if( read_fmodel(&mesh, filename.c_str(), fformat, 1)<=0 )
   {
-    std::cerr << "Unknown file type for file: " << argv[1] << std::endl;
-    return 1;
+    return boost::shared_ptr<model>();
   }
-  file_type type2 = identify_file_type(argv[2]);
-  if( type2==UNKNOWN )
-  {
-    std::cerr << "Unknown file type for file: " << argv[2] << std::endl;
-    return 1;
+  return boost::shared_ptr<model>(mesh, free_model_delete());
+}
+
+
+// Frees a model loaded by read_mvm_model()
+struct mvm_model_delete
+{
+  void operator()(struct model* x) { free_mvm_model(x); }
+};
+
+
+/* Version of the mask meshing, part of the mesh cache keys: increment it when
+   a change of the meshing (or of the cropping) changes the meshes. */
+const int MASK_MESH_VERSION = 1;
+
+/* The parameters of the conversion of a mask into a mesh, as a mesh cache key
+   part. */
+std::string mask_mesh_params(mask_mesher mesher)
+{
+  char params[128];
+  snprintf(params, sizeof(params), "mask;mesher=%s;version=%d;margin=%d",
+           mesher==MARCHING_CUBES ? "mc" : "itk", MASK_MESH_VERSION, MASK_ROI_MARGIN);
+  return params;
+}
+
+
+/* Load a file and return the contents as a MeshValmet mesh. Meshes are read
+   natively when possible, otherwise through VTK. Masks are meshed with the
+   given mesher, without VTK, or loaded from the mesh cache if one is given and
+   holds the mesh of the same mask and mesher (a mesh made here is then stored
+   in it). Converted (mvm) meshes are used in place, from the mapped file. */
+boost::shared_ptr<model> load_file_as_model(std::string filename, file_type type,
+                                            mask_mesher mesher=MARCHING_CUBES, MeshCache* cache=NULL)
+{
+  if( type==IMAGE && cache!=NULL )
+  {
+    std::string key = MeshCache::Key(filename, mask_mesh_params(mesher));
+    struct model* mesh = NULL;
+    if( !key.empty() && cache->Load(key, &mesh) )
+    {
+      return boost::shared_ptr<model>(mesh, mvm_model_delete());
+    }
+    boost::shared_ptr<model> converted = load_file_as_model(filename, type, mesher);
+    if( !key.empty() )
+    {
+      cache->Store(key, converted.get());
+    }
+    return converted;
+  }
+  if( type==MVM )
+  {
+    struct model* mesh = NULL;
+    if( read_mvm_model(&mesh, filename.c_str(), NULL, NULL)<0 )
+    {
+      std::cerr << "ERROR: Cannot read converted mesh file (convert it again with --convert): " << filename << std::endl;
+      throw 2;
+    }
+    return boost::shared_ptr<model>(mesh, mvm_model_delete());
+  }
+  if( type==IMAGE && mesher==MARCHING_CUBES )
+  {
+    return load_mask_as_model(filename);
+  }
+  if( type==IMAGE )
+  {
+    TriangleMeshType::Pointer itk_mesh = load_mask_as_itk_mesh(filename);
+    return ITK_to_MeshValmet(itk_mesh.GetPointer());
+  }
+  else
+  {
+    boost::shared_ptr<model> mesh = read_mesh_file(filename, type);
+    if( mesh )
+    {
+      return mesh;
+    }
+  }
+  return VTK_to_MeshValmet_view(load_file_as_mesh(filename, type));
+}
+
+
+/* Loading of a file as a MeshValmet mesh (see load_file_as_model()) and its
+   preparation for the comparison, with its volume, as a task for
+   run_concurrently(). The prepared mesh is freed along with the task. */
+struct load_model_task
+{
+  load_model_task(std::string filename, file_type type, mask_mesher mesher, MeshCache* cache) :
+    filename(filename), type(type), mesher(mesher), cache(cache), prepared(NULL) {}
+  ~load_model_task() { if( prepared!=NULL ) free_prepared_mesh(prepared); }
+  void operator()()
+  {
+    mesh = load_file_as_model(filename, type, mesher, cache);
+    prepared = prepare_mesh(mesh.get());
+    prepared_mesh_volume(prepared, NULL);
   }
-  vtkSmartPointer<vtkPolyData> mesh1 = load_file_as_mesh(argv[1], type1);
-  vtkSmartPointer<vtkPolyData> mesh2 = load_file_as_mesh(argv[2], type2);
   
-  // Compare meshes using MeshValmet
-  CompareMeshes* cm = new CompareMeshes();
-  CompareMeshes::mesh_differences diff = cm->GetMeshDifferences( VTK_to_MeshValmet(mesh1), VTK_to_MeshValmet(mesh2) );
+  std::string filename;
+  file_type type;
+  mask_mesher mesher;
+  MeshCache* cache;
+  boost::shared_ptr<model> mesh;
+  struct prepared_mesh* prepared;
+};
+
+
+/* Compare a mesh file with a mask image through the distance map of the mask
+   (see CompareMeshMask.h). The mesh is mesh 1 of diff if mesh_first is true,
+   mesh 2 otherwise. */
+void compare_mesh_mask(std::string mesh_filename, file_type mesh_type, std::string mask_filename,
+                       bool mesh_first, CompareMeshes::mesh_differences& diff)
+{
+  load_model_task mesh_task(mesh_filename, mesh_type, MARCHING_CUBES, NULL);
+  load_mask_task mask_task(mask_filename);
+  run_concurrently(mesh_task, mask_task);
+  if( std::find(mask_task.mask.begin(), mask_task.mask.end(), 1)==mask_task.mask.end() )
+  {
+    std::cerr << "Error: No voxels of value 1 in the mask." << std::endl;
+    throw 2;
+  }
   
-  // Output results to stdout
+  CompareMeshMask cmm;
+  diff = cmm.GetMeshMaskDifferences(mesh_task.prepared, &mask_task.mask[0], &mask_task.geom);
+  if( !mesh_first )
+  {
+    std::swap(diff.volume1, diff.volume2);
+    std::swap(diff.mesh1_closed, diff.mesh2_closed);
+  }
+}
+
+
+/* The voxels of one label of a label image, cropped to the label's region of
+   interest: lo is the index of its first voxel in the image and geom its grid. */
+struct label_mask
+{
+  int label;
+  int lo[3];
+  struct mask_geometry geom;
+  std::vector<unsigned char> mask;
+};
+
+/* The bounding box, in one z plane, of the voxels of one label. */
+struct plane_label_box
+{
+  int label;
+  int lo[2], hi[2];
+};
+
+/* The lowest and highest voxel indices of a box, inclusive. */
+struct voxel_box_bounds
+{
+  int lo[3], hi[3];
+};
+
+/* Return the label of a voxel value, false if it is not a nonzero integer. */
+inline bool voxel_label(double value, int& label)
+{
+  if( value==0 || !(fabs(value)<2147483648.0) ) return false;
+  label = (int)value;
+  return label==value;
+}
+
+/* Load a label image on its pixel type and split it into the masks of its
+   labels (see load_label_masks()). */
+template < typename TPixel >
+void load_label_masks_subroutine(std::string filename, const std::vector<int>& labels,
+                                 struct mask_geometry& full_geom, std::vector<label_mask>& masks)
+{
+  typedef itk::Image< TPixel, 3 > LoadImageType;
+  typedef itk::ImageFileReader<LoadImageType> ReaderType;
+  typename ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName( filename );
+  reader->Update();
+  const LoadImageType* image = reader->GetOutput();
+  image_geometry(image, full_geom);
+  const int nx = full_geom.dims[0], ny = full_geom.dims[1], nz = full_geom.dims[2];
+  const TPixel* pixels = image->GetBufferPointer();
+  
+  // Bucket the voxels by label in one scan, in parallel over the z planes.
+  // Labels come in runs, so the last value seen is looked up first.
+  std::vector< std::vector<plane_label_box> > planes(nz);
+  #pragma omp parallel for schedule(dynamic)
+  for(int k=0; k<nz; k++)
+  {
+    std::vector<plane_label_box>& boxes = planes[k];
+    TPixel last_value = 0;
+    int last = -1;  // box of last_value, -1 if it is not a requested label
+    for(int j=0; j<ny; j++)
+    {
+      const TPixel* row = pixels + (size_t)nx*(j+(size_t)ny*k);
+      for(int i=0; i<nx; i++)
+      {
+        if( row[i]!=last_value )
+        {
+          last_value = row[i];
+          last = -1;
+          int label;
+          if( voxel_label((double)row[i], label) &&
+              (labels.empty() || std::binary_search(labels.begin(), labels.end(), label)) )
+          {
+            for(last=0; last<(int)boxes.size() && boxes[last].label!=label; last++) ;
+            if( last==(int)boxes.size() )
+            {
+              plane_label_box box = { label, { nx, ny }, { -1, -1 } };
+              boxes.push_back(box);
+            }
+          }
+        }
+        if( last<0 ) continue;
+        plane_label_box& box = boxes[last];
+        if( i<box.lo[0] ) box.lo[0] = i;
+        if( j<box.lo[1] ) box.lo[1] = j;
+        if( i>box.hi[0] ) box.hi[0] = i;
+        box.hi[1] = j;
+      }
+    }
+  }
+  
+  // Merge the plane boxes into the bounding box of each label, grown by the
+  // margin as in find_mask_region()
+  std::map<int, voxel_box_bounds> found;
+  for(int k=0; k<nz; k++)
+  {
+    for(size_t b=0; b<planes[k].size(); b++)
+    {
+      const plane_label_box& box = planes[k][b];
+      std::map<int, voxel_box_bounds>::iterator it = found.find(box.label);
+      if( it==found.end() )
+      {
+        voxel_box_bounds bounds = { { box.lo[0], box.lo[1], k }, { box.hi[0], box.hi[1], k } };
+        found[box.label] = bounds;
+        continue;
+      }
+      voxel_box_bounds& bounds = it->second;
+      bounds.lo[0] = min(bounds.lo[0], box.lo[0]);
+      bounds.lo[1] = min(bounds.lo[1], box.lo[1]);
+      bounds.hi[0] = max(bounds.hi[0], box.hi[0]);
+      bounds.hi[1] = max(bounds.hi[1], box.hi[1]);
+      bounds.hi[2] = k;
+    }
+    std::vector<plane_label_box>().swap(planes[k]);
+  }
+  masks.resize(found.size());
+  std::map<int, voxel_box_bounds>::const_iterator it = found.begin();
+  for(size_t m=0; m<masks.size(); m++, ++it)
+  {
+    label_mask& lm = masks[m];
+    lm.label = it->first;
+    int dims[3];
+    for(int a=0; a<3; a++)
+    {
+      lm.lo[a] = max(it->second.lo[a]-MASK_ROI_MARGIN, 0);
+      dims[a] = min(it->second.hi[a]+MASK_ROI_MARGIN, full_geom.dims[a]-1) - lm.lo[a] + 1;
+    }
+    crop_geometry(full_geom, lm.lo, dims, lm.geom);
+  }
+  
+  // Threshold the region of interest of each label, the labels in parallel
+  #pragma omp parallel for schedule(dynamic)
+  for(int m=0; m<(int)masks.size(); m++)
+  {
+    label_mask& lm = masks[m];
+    const int* dims = lm.geom.dims;
+    const double label = lm.label;
+    lm.mask.resize((size_t)dims[0]*dims[1]*dims[2]);
+    for(int k=0; k<dims[2]; k++)
+    {
+      for(int j=0; j<dims[1]; j++)
+      {
+        const TPixel* row = pixels + lm.lo[0] + (size_t)nx*((lm.lo[1]+j) + (size_t)ny*(lm.lo[2]+k));
+        unsigned char* out = &lm.mask[(size_t)dims[0]*(j+(size_t)dims[1]*k)];
+        for(int i=0; i<dims[0]; i++)
+        {
+          out[i] = (double)row[i]==label;
+        }
+      }
+    }
+  }
+}
+
+
+/* Load a label image, read once on its own pixel type, and return the masks of
+   its labels (the nonzero integer voxel values), sorted by label: all of them
+   if labels is empty, otherwise those of labels (sorted) found in the image.
+   The voxels are bucketed by label in a single scan and each mask is cropped
+   to the label's region of interest, as in load_mask(). full_geom is set to
+   the grid of the whole image. */
+void load_label_masks(std::string filename, const std::vector<int>& labels,
+                      struct mask_geometry& full_geom, std::vector<label_mask>& masks)
+{
+  itk::ImageIOBase::IOComponentType PixelValueType = read_image3D_component_type(filename);
+  switch( PixelValueType )
+  {
+    case itk::ImageIOBase::FLOAT  :
+      return load_label_masks_subroutine<float>(filename, labels, full_geom, masks);
+    case itk::ImageIOBase::DOUBLE  :
+      return load_label_masks_subroutine<double>(filename, labels, full_geom, masks);
+    case itk::ImageIOBase::CHAR  :
+      return load_label_masks_subroutine<char>(filename, labels, full_geom, masks);
+    case itk::ImageIOBase::UCHAR  :
+      return load_label_masks_subroutine<unsigned char>(filename, labels, full_geom, masks);
+    case itk::ImageIOBase::SHORT  :
+      return load_label_masks_subroutine<short>(filename, labels, full_geom, masks);
+    case itk::ImageIOBase::USHORT  :
+      return load_label_masks_subroutine<unsigned short>(filename, labels, full_geom, masks);
+    case itk::ImageIOBase::LONG  :
+      return load_label_masks_subroutine<long>(filename, labels, full_geom, masks);
+    case itk::ImageIOBase::ULONG  :
+      return load_label_masks_subroutine<unsigned long>(filename, labels, full_geom, masks);
+    case itk::ImageIOBase::INT  :
+      return load_label_masks_subroutine<int>(filename, labels, full_geom, masks);
+    case itk::ImageIOBase::UINT  :
+      return load_label_masks_subroutine<unsigned int>(filename, labels, full_geom, masks);
+    default:
+      unsupported_component_type(PixelValueType);
+  }
+}
+
+
+/* Loading of the masks of the labels of a label image (see
+   load_label_masks()), as a task for run_concurrently(). */
+struct load_label_masks_task
+{
+  load_label_masks_task(std::string filename, const std::vector<int>& labels) :
+    filename(filename), labels(labels) {}
+  void operator()() { load_label_masks(filename, labels, full_geom, masks); }
+  
+  std::string filename;
+  const std::vector<int>& labels;
+  struct mask_geometry full_geom;
+  std::vector<label_mask> masks;
+};
+
+
+/* The differences of the surfaces of one label in two label images. */
+struct label_differences
+{
+  int label;
+  CompareMeshes::mesh_differences diff;
+};
+
+/* Compare the labels of two label images, each image loaded once: every label
+   found in both images (all of them if labels is empty, otherwise those of
+   labels) is compared as a pair of masks, and the results are returned in
+   label order. The surfaces of all the labels are extracted in parallel by
+   marching cubes, then the pairs are compared concurrently, one per thread,
+   from the largest. With voxel_metrics, masks on the same voxel grid are
+   compared in the voxel domain instead (see compare_masks()). Labels found in
+   only one image are reported and skipped. */
+void compare_labels(std::string filename1, std::string filename2, std::vector<int> labels,
+                    bool voxel_metrics, std::vector<label_differences>& results)
+{
+  std::sort(labels.begin(), labels.end());
+  labels.erase(std::unique(labels.begin(), labels.end()), labels.end());
+  load_label_masks_task load1(filename1, labels), load2(filename2, labels);
+  run_concurrently(load1, load2);
+  const struct mask_geometry &full1 = load1.full_geom, &full2 = load2.full_geom;
+  std::vector<label_mask> &masks1 = load1.masks, &masks2 = load2.masks;
+  
+  // Pair the labels found in both images
+  std::vector<label_mask*> pairs1, pairs2;
+  std::vector<int> all_labels = labels;
+  for(size_t m=0; m<masks1.size(); m++) all_labels.push_back(masks1[m].label);
+  for(size_t m=0; m<masks2.size(); m++) all_labels.push_back(masks2[m].label);
+  std::sort(all_labels.begin(), all_labels.end());
+  all_labels.erase(std::unique(all_labels.begin(), all_labels.end()), all_labels.end());
+  size_t m1 = 0, m2 = 0;
+  for(size_t l=0; l<all_labels.size(); l++)
+  {
+    int label = all_labels[l];
+    bool in1 = m1<masks1.size() && masks1[m1].label==label;
+    bool in2 = m2<masks2.size() && masks2[m2].label==label;
+    if( in1 && in2 )
+    {
+      pairs1.push_back(&masks1[m1]);
+      pairs2.push_back(&masks2[m2]);
+    }
+    else
+    {
+      std::cerr << "WARNING: label " << label << " is not in " <<
+        (in1 ? filename2 : (in2 ? filename1 : std::string("either image"))) << "; skipping it" << std::endl;
+    }
+    m1 += in1;
+    m2 += in2;
+  }
+  int num_pairs = (int)pairs1.size();
+  results.resize(num_pairs);
+  
+  // Largest pairs first, so that the last ones to finish are short
+  std::vector< std::pair<size_t, int> > order(num_pairs);
+  for(int p=0; p<num_pairs; p++)
+  {
+    order[p] = std::make_pair(pairs1[p]->mask.size()+pairs2[p]->mask.size(), p);
+  }
+  std::sort(order.rbegin(), order.rend());
+  
+  if( voxel_metrics && same_mask_grid(full1, full2) )
+  {
+    #pragma omp parallel for schedule(dynamic)
+    for(int o=0; o<num_pairs; o++)
+    {
+      int p = order[o].second;
+      const label_mask& lm1 = *pairs1[p];
+      const label_mask& lm2 = *pairs2[p];
+      int lo[3], dims[3];
+      for(int a=0; a<3; a++)
+      {
+        lo[a] = min(lm1.lo[a], lm2.lo[a]);
+        dims[a] = max(lm1.lo[a]+lm1.geom.dims[a], lm2.lo[a]+lm2.geom.dims[a]) - lo[a];
+      }
+      struct mask_geometry geom;
+      crop_geometry(full1, lo, dims, geom);
+      std::vector<unsigned char> mask1, mask2;
+      paste_mask(lm1.mask, lm1.lo, lm1.geom.dims, lo, dims, mask1);
+      paste_mask(lm2.mask, lm2.lo, lm2.geom.dims, lo, dims, mask2);
+      CompareMasks cm;
+      results[p].label = lm1.label;
+      results[p].diff = cm.GetMaskDifferences(&mask1[0], &mask2[0], &geom);
+    }
+    return;
+  }
+  if( voxel_metrics )
+  {
+    std::cerr << "WARNING: the masks are not on the same voxel grid; comparing their meshes" << std::endl;
+  }
+  
+  // Extract the surfaces of both images in one parallel loop
+  std::vector<label_mask*> all_masks(pairs1);
+  all_masks.insert(all_masks.end(), pairs2.begin(), pairs2.end());
+  std::vector<struct model*> meshes(all_masks.size());
+  #pragma omp parallel for schedule(dynamic)
+  for(int m=0; m<(int)all_masks.size(); m++)
+  {
+    meshes[m] = mask_to_model(&all_masks[m]->mask[0], &all_masks[m]->geom);
+    std::vector<unsigned char>().swap(all_masks[m]->mask);
+  }
+  bool failed = false;
+  for(size_t m=0; m<meshes.size(); m++)
+  {
+    if( meshes[m]==NULL )
+    {
+      std::cerr << "Error: Too many faces in the mesh of label " << all_masks[m]->label << " of: " <<
+        (m<(size_t)num_pairs ? filename1 : filename2) << std::endl;
+      failed = true;
+    }
+  }
+  if( failed )
+  {
+    for(size_t m=0; m<meshes.size(); m++)
+    {
+      if( meshes[m]!=NULL ) __free_raw_model(meshes[m]);
+    }
+    throw 2;
+  }
+  
+  // Compare the pairs concurrently
+  #pragma omp parallel for schedule(dynamic)
+  for(int o=0; o<num_pairs; o++)
+  {
+    int p = order[o].second;
+    CompareMeshes cm;
+    results[p].label = pairs1[p]->label;
+    results[p].diff = cm.GetMeshDifferences(meshes[p], meshes[num_pairs+p]);
+  }
+  for(size_t m=0; m<meshes.size(); m++)
+  {
+    __free_raw_model(meshes[m]);
+  }
+}
+
+
+/* Convert a mesh or mask file into an mvm file, which later runs load without
+   parsing or meshing. Only the mesh is stored: the comparisons do not use
+   the topology analysis that the format can hold. */
+int convert_to_mvm(std::string in_filename, std::string out_filename, mask_mesher mesher, MeshCache* cache)
+{
+  file_type type = identify_file_type(in_filename);
+  if( type==UNKNOWN )
+  {
+    std::cerr << "Unknown file type for file: " << in_filename << std::endl;
+    return 1;
+  }
+  boost::shared_ptr<model> mesh = load_file_as_model(in_filename, type, mesher, cache);
+  
+  if( write_mvm_model(out_filename.c_str(), mesh.get(), NULL, 0)<0 )
+  {
+    std::cerr << "ERROR: Cannot write converted mesh file: " << out_filename << std::endl;
+    return 2;
+  }
+  return 0;
+}
+
+
+/* A pair of a batch manifest: a prediction, compared with a reference (the
+   ground truth) as mesh 1 with mesh 2, and the id of the pair in the results
+   table. */
+struct batch_pair
+{
+  std::string prediction;
+  std::string reference;
+  std::string id;
+};
+
+/* Remove the leading and trailing white space of str. */
+std::string trim(std::string str)
+{
+  size_t first = str.find_first_not_of(" \t\r\n");
+  if( first==std::string::npos )
+  {
+    return std::string();
+  }
+  return str.substr(first, str.find_last_not_of(" \t\r\n")-first+1);
+}
+
+/* Read a batch manifest: one pair per line, "<prediction>,<reference>[,<id>]"
+   (or the same separated by tabs), without quoting. Empty lines and lines
+   starting with '#' are skipped, as is a first line starting with the
+   "prediction" column name. The id defaults to the prediction filename; its
+   spaces are replaced by underscores, the results table being separated by
+   spaces.
+   Returns false (the error being reported) if the manifest cannot be read. */
+bool read_manifest(std::string filename, std::vector<batch_pair>& pairs)
+{
+  std::ifstream manifest(filename.c_str());
+  if( !manifest )
+  {
+    std::cerr << "Cannot read the manifest: " << filename << std::endl;
+    return false;
+  }
+  pairs.clear();
+  std::string line;
+  int line_number = 0;
+  bool first = true;
+  while( std::getline(manifest, line) )
+  {
+    line_number++;
+    if( trim(line).empty() || trim(line)[0]=='#' )
+    {
+      continue;
+    }
+    char separator = line.find('\t')!=std::string::npos ? '\t' : ',';
+    std::vector<std::string> fields;
+    size_t start = 0;
+    while( start<=line.size() )
+    {
+      size_t end = line.find(separator, start);
+      if( end==std::string::npos ) end = line.size();
+      fields.push_back(trim(line.substr(start, end-start)));
+      start = end+1;
+    }
+    std::string column = fields[0];
+    for(size_t c=0; c<column.size(); c++)
+    {
+      column[c] = tolower((unsigned char)column[c]);
+    }
+    if( first && column=="prediction" )
+    {
+      first = false;
+      continue;
+    }
+    first = false;
+    if( fields.size()<2 || fields.size()>3 || fields[0].empty() || fields[1].empty() )
+    {
+      std::cerr << "Line " << line_number << " of the manifest " << filename <<
+        " is not <prediction>,<reference>[,<id>]" << std::endl;
+      return false;
+    }
+    batch_pair pair;
+    pair.prediction = fields[0];
+    pair.reference = fields[1];
+    pair.id = fields.size()==3 && !fields[2].empty() ? fields[2] : fields[0];
+    std::replace(pair.id.begin(), pair.id.end(), ' ', '_');
+    pairs.push_back(pair);
+  }
+  return true;
+}
+
+/* Return the size of a file in bytes, or 0 if it cannot be read. */
+long long file_size(std::string filename)
+{
+  struct stat st;
+  return stat(filename.c_str(), &st)==0 ? (long long)st.st_size : 0;
+}
+
+/* Identify the type of a file and load it as a prepared mesh (see
+   load_model_task). Returns NULL, the error being reported, if that fails. */
+load_model_task* load_batch_mesh(std::string filename, mask_mesher mesher, MeshCache* cache)
+{
+  file_type type = identify_file_type(filename);
+  if( type==UNKNOWN )
+  {
+    std::cerr << "Unknown file type for file: " << filename << std::endl;
+    return NULL;
+  }
+  load_model_task* load = new load_model_task(filename, type, mesher, cache);
+  if( run_task(*load) )
+  {
+    delete load;
+    return NULL;
+  }
+  return load;
+}
+
+/* A reference of a batch, loaded by one thread before any of its pairs is
+   handed out, shared read-only by them, then freed by the last. All of its
+   derived data is built while it loads, so that GetMeshDifferences() only
+   reads it. Its lock is held while it loads. */
+struct batch_reference
+{
+  std::string filename;
+  std::vector<int> pairs; // in the order they are handed out
+  size_t next_pair;       // next pair to hand out
+  int remaining;          // pairs not yet compared
+  bool loading;
+  bool failed;
+  load_model_task* load;  // NULL until loaded, and once freed
+#ifdef _OPENMP
+  omp_lock_t lock;
+#endif
+};
+
+/* The work a thread of a batch takes next (see next_batch_work). */
+enum batch_work
+{
+  BATCH_PAIR,  // compare a pair of a loaded reference
+  BATCH_LOAD,  // load a reference
+  BATCH_WAIT,  // wait for a reference being loaded by another thread
+  BATCH_DONE   // no pair is left to hand out
+};
+
+/* The references of a batch in the order they are loaded, and those that are
+   loaded with pairs left to hand out, oldest first. Shared by the threads
+   under the batch_schedule critical section. */
+struct batch_schedule
+{
+  std::vector<int> references;
+  size_t next_reference;  // next reference to load
+  std::deque<int> ready;
+};
+
+/* Take the next work of a thread of a batch: a pair of the oldest loaded
+   reference (p, of reference r), or else the next reference to load (r, whose
+   lock is then held), or else a reference being loaded (r), whose lock is to
+   be waited for before asking again. The threads thus load the next reference
+   instead of waiting for one, and a reference is only loaded when no pair of
+   a loaded one is left. */
+batch_work next_batch_work(batch_schedule& schedule, std::vector<batch_reference>& references, int& r, int& p)
+{
+  batch_work work = BATCH_DONE;
+  #pragma omp critical(batch_schedule)
+  {
+    if( !schedule.ready.empty() )
+    {
+      r = schedule.ready.front();
+      batch_reference& ref = references[r];
+      p = ref.pairs[ref.next_pair++];
+      if( ref.next_pair==ref.pairs.size() )
+      {
+        schedule.ready.pop_front();
+      }
+      work = BATCH_PAIR;
+    }
+    else if( schedule.next_reference<schedule.references.size() )
+    {
+      r = schedule.references[schedule.next_reference++];
+      references[r].loading = true;
+#ifdef _OPENMP
+      omp_set_lock(&references[r].lock);
+#endif
+      work = BATCH_LOAD;
+    }
+    else
+    {
+      for(size_t i=0; i<schedule.next_reference && work==BATCH_DONE; i++)
+      {
+        if( references[schedule.references[i]].loading )
+        {
+          r = schedule.references[i];
+          work = BATCH_WAIT;
+        }
+      }
+    }
+  }
+  return work;
+}
+
+/* The results of the pairs of a batch, written to the results table in the
+   order of the manifest as soon as all the pairs before them are done. */
+struct batch_results
+{
+  FILE* table;
+  std::vector<CompareMeshes::mesh_differences> diffs;
+  std::vector<bool> done;
+  size_t written;
+};
+
+/* Record the differences of pair p (NaN if failed) and write out the rows
+   that are now in order. */
+void write_batch_results(batch_results& results, const std::vector<batch_pair>& pairs, int p,
+                         const CompareMeshes::mesh_differences& diff)
+{
+  #pragma omp critical(batch_results)
+  {
+    results.diffs[p] = diff;
+    results.done[p] = true;
+    for(; results.written<pairs.size() && results.done[results.written]; results.written++)
+    {
+      const CompareMeshes::mesh_differences& d = results.diffs[results.written];
+      fprintf(results.table, "%s %f %f %f %f %f %f %f %f %f\n", pairs[results.written].id.c_str(),
+              d.min_dist, d.max_dist, d.abs_min_dist, d.abs_max_dist, d.mean_dist, d.abs_mean_dist,
+              d.rms_dist, d.volume_overlap, d.int_union_ratio);
+    }
+    fflush(results.table);
+  }
+}
+
+/* Compare the pairs of a batch manifest as meshes, concurrently, one pair per
+   thread, and write the results table to table in the order of the manifest.
+   Each reference is loaded once, by one thread, before its pairs are handed
+   out to the threads (see next_batch_work); the references with the largest
+   total file size are loaded first, and their pairs go from the largest
+   prediction. A reference is freed once its pairs are done, so that only the
+   references of the pairs in progress are in memory. A pair that fails is
+   reported and has NaN results. Returns the number of failed pairs. */
+int compare_batch(const std::vector<batch_pair>& pairs, mask_mesher mesher, MeshCache* cache, FILE* table)
+{
+  // Index the references, and total the file sizes of their pairs
+  std::map<std::string, int> reference_index;
+  std::vector<batch_reference> references;
+  std::vector<long long> reference_total;
+  std::vector<int> pair_reference(pairs.size());
+  std::vector<long long> prediction_size(pairs.size());
+  for(size_t p=0; p<pairs.size(); p++)
+  {
+    std::map<std::string, int>::iterator it = reference_index.find(pairs[p].reference);
+    if( it==reference_index.end() )
+    {
+      batch_reference ref;
+      ref.filename = pairs[p].reference;
+      ref.next_pair = 0;
+      ref.remaining = 0;
+      ref.loading = false;
+      ref.failed = false;
+      ref.load = NULL;
+      it = reference_index.insert(std::make_pair(ref.filename, (int)references.size())).first;
+      references.push_back(ref);
+      reference_total.push_back(file_size(ref.filename));
+    }
+    pair_reference[p] = it->second;
+    references[it->second].remaining++;
+    prediction_size[p] = file_size(pairs[p].prediction);
+    reference_total[it->second] += prediction_size[p];
+  }
+#ifdef _OPENMP
+  for(size_t r=0; r<references.size(); r++)
+  {
+    omp_init_lock(&references[r].lock);
+  }
+#endif
+  
+  // Order the references, then their pairs by prediction, largest first
+  typedef std::pair< std::pair<long long, int>, std::pair<long long, int> > batch_key;
+  std::vector<batch_key> order(pairs.size());
+  for(size_t p=0; p<pairs.size(); p++)
+  {
+    int r = pair_reference[p];
+    order[p] = std::make_pair(std::make_pair(reference_total[r], r), std::make_pair(prediction_size[p], (int)p));
+  }
+  std::sort(order.rbegin(), order.rend());
+  batch_schedule schedule;
+  schedule.next_reference = 0;
+  for(size_t o=0; o<order.size(); o++)
+  {
+    batch_reference& ref = references[order[o].first.second];
+    if( ref.pairs.empty() )
+    {
+      schedule.references.push_back(order[o].first.second);
+    }
+    ref.pairs.push_back(order[o].second.second);
+  }
+  
+  batch_results results;
+  results.table = table;
+  results.diffs.resize(pairs.size());
+  results.done.assign(pairs.size(), false);
+  results.written = 0;
+  int failed = 0;
+  #pragma omp parallel reduction(+:failed)
+  {
+    int r, p;
+    batch_work work;
+    while( (work = next_batch_work(schedule, references, r, p))!=BATCH_DONE )
+    {
+      batch_reference& ref = references[r];
+      if( work==BATCH_WAIT )
+      {
+#ifdef _OPENMP
+        omp_set_lock(&ref.lock);
+        omp_unset_lock(&ref.lock);
+#endif
+        continue;
+      }
+      if( work==BATCH_LOAD )
+      {
+        ref.load = load_batch_mesh(ref.filename, mesher, cache);
+        if( ref.load!=NULL )
+        {
+          prepared_mesh_build_all(ref.load->prepared);
+        }
+        ref.failed = ref.load==NULL;
+        #pragma omp critical(batch_schedule)
+        {
+          ref.loading = false;
+          schedule.ready.push_back(r);
+        }
+#ifdef _OPENMP
+        omp_unset_lock(&ref.lock);
+#endif
+        continue;
+      }
+      
+      CompareMeshes::mesh_differences diff;
+      memset(&diff, 0, sizeof(diff));
+      diff.min_dist = diff.max_dist = diff.abs_min_dist = diff.abs_max_dist = NAN;
+      diff.mean_dist = diff.abs_mean_dist = diff.rms_dist = NAN;
+      diff.volume_overlap = diff.int_union_ratio = NAN;
+      load_model_task* prediction = ref.failed ? NULL : load_batch_mesh(pairs[p].prediction, mesher, cache);
+      if( prediction!=NULL )
+      {
+        CompareMeshes cm;
+        diff = cm.GetMeshDifferences(prediction->prepared, ref.load->prepared);
+        delete prediction;
+      }
+      else
+      {
+        std::cerr << "ERROR: pair " << pairs[p].id << " was not compared" << std::endl;
+        failed++;
+      }
+      
+      bool last;
+      #pragma omp critical(batch_schedule)
+      last = --ref.remaining==0;
+      if( last )
+      {
+        delete ref.load;
+        ref.load = NULL;
+      }
+      write_batch_results(results, pairs, p, diff);
+    }
+  }
+  
+#ifdef _OPENMP
+  for(size_t r=0; r<references.size(); r++)
+  {
+    omp_destroy_lock(&references[r].lock);
+  }
+#endif
+  return failed;
+}
+
+
+/* Parse a --labels argument: "all", or label values separated by commas. An
+   empty list means all the labels. Returns false if it cannot be parsed. */
+bool parse_labels(std::string arg, std::vector<int>& labels)
+{
+  labels.clear();
+  if( arg=="all" )
+  {
+    return true;
+  }
+  size_t start = 0;
+  while( start<=arg.size() )
+  {
+    size_t end = arg.find(',', start);
+    if( end==std::string::npos ) end = arg.size();
+    std::string item = arg.substr(start, end-start);
+    char* item_end;
+    long label = strtol(item.c_str(), &item_end, 10);
+    if( item.empty() || *item_end!='\0' || label==0 || label<INT_MIN || label>INT_MAX )
+    {
+      return false;
+    }
+    labels.push_back((int)label);
+    start = end+1;
+  }
+  return true;
+}
+
+
+/* Print the differences to stdout. */
+void print_differences(const CompareMeshes::mesh_differences& diff)
+{
   std::cout << "MIN DIST: " << diff.min_dist << std::endl;
   std::cout << "MAX DIST: " << diff.max_dist << std::endl;
   std::cout << "MIN ABS DIST: " << diff.abs_min_dist << std::endl;
@@ -222,6 +1690,236 @@ int main(int argc, char** argv)
   std::cout << "RMS DIST: " << diff.rms_dist << std::endl;
   std::cout << "VOLUME OVERLAP: " << diff.volume_overlap << std::endl;
   std::cout << "INTERSECTION/UNION: " << diff.int_union_ratio << std::endl;
+  std::cout << "VOLUME 1: " << diff.volume1 << (diff.mesh1_closed ? "" : " (open mesh)") << std::endl;
+  std::cout << "VOLUME 2: " << diff.volume2 << (diff.mesh2_closed ? "" : " (open mesh)") << std::endl;
+}
+
+
+int main(int argc, char** argv)
+{
+  // Options, dropped from the arguments
+  mask_mesher mesher = MARCHING_CUBES;
+  bool voxel_metrics = false;
+  bool mask_distance_map = false;
+  bool multi_label = false;
+  std::vector<int> labels;
+  std::string cache_dir;
+  std::string manifest;
+  unsigned long long cache_size = DEFAULT_MESH_CACHE_MB<<20;
+  while( argc>1 && (std::string(argv[1])=="--itk-mask-mesh" || std::string(argv[1])=="--voxel-metrics" ||
+                    std::string(argv[1])=="--mask-distance-map" || std::string(argv[1])=="--labels" ||
+                    std::string(argv[1])=="--cache" || std::string(argv[1])=="--cache-size" ||
+                    std::string(argv[1])=="--batch") )
+  {
+    if( std::string(argv[1])=="--cache" || std::string(argv[1])=="--cache-size" || std::string(argv[1])=="--batch" )
+    {
+      if( argc<3 )
+      {
+        std::cerr << argv[1] << " takes " << (std::string(argv[1])=="--cache" ? "a directory" :
+                                               std::string(argv[1])=="--batch" ? "a manifest filename" : "a size in MB") << std::endl;
+        return 1;
+      }
+      if( std::string(argv[1])=="--cache" )
+      {
+        cache_dir = argv[2];
+      }
+      else if( std::string(argv[1])=="--batch" )
+      {
+        manifest = argv[2];
+      }
+      else
+      {
+        char* end;
+        cache_size = strtoull(argv[2], &end, 10)<<20;
+        if( *end!='\0' || end==argv[2] )
+        {
+          std::cerr << "--cache-size takes a size in MB" << std::endl;
+          return 1;
+        }
+      }
+      argv[1] = argv[0];
+      argv++;
+      argc--;
+    }
+    else if( std::string(argv[1])=="--labels" )
+    {
+      if( argc<3 || !parse_labels(argv[2], labels) )
+      {
+        std::cerr << "--labels takes \"all\" or nonzero integer labels separated by commas" << std::endl;
+        return 1;
+      }
+      multi_label = true;
+      argv[1] = argv[0];
+      argv++;
+      argc--;
+    }
+    else if( std::string(argv[1])=="--itk-mask-mesh" )
+    {
+      mesher = ITK_MESH_SOURCE;
+    }
+    else if( std::string(argv[1])=="--voxel-metrics" )
+    {
+      voxel_metrics = true;
+    }
+    else
+    {
+      mask_distance_map = true;
+    }
+    argv[1] = argv[0];
+    argv++;
+    argc--;
+  }
+  
+  // Cache of the meshes of masks
+  boost::shared_ptr<MeshCache> cache;
+  if( !cache_dir.empty() )
+  {
+    struct stat st;
+    if( stat(cache_dir.c_str(), &st)!=0 && mkdir(cache_dir.c_str(), 0755)!=0 && errno!=EEXIST )
+    {
+      std::cerr << "Cannot create the mesh cache directory: " << cache_dir << std::endl;
+      return 1;
+    }
+    cache.reset(new MeshCache(cache_dir, cache_size));
+  }
+  
+  // Compare the pairs of a manifest, into one results table
+  if( !manifest.empty() )
+  {
+    if( argc>2 || multi_label || voxel_metrics || mask_distance_map )
+    {
+      std::cerr << "Usage: " << std::endl;
+      std::cerr << argv[0] << " [--itk-mask-mesh] [--cache <dir> [--cache-size <MB>]] --batch <manifest> [<results file>]" << std::endl;
+      return 1;
+    }
+    std::vector<batch_pair> pairs;
+    if( !read_manifest(manifest, pairs) )
+    {
+      return 1;
+    }
+    FILE* table = argc==2 ? fopen(argv[1], "w") : stdout;
+    if( table==NULL )
+    {
+      std::cerr << "ERROR opening file to write results. Filename requested: " << argv[1] << std::endl;
+      return 2;
+    }
+    fprintf(table, "%s %s %s %s %s %s %s %s %s %s\n", "id", "min_dist", "max_dist", "min_abs_dist",
+            "max_abs_dist", "mean_dist", "mean_abs_dist", "rms_dist", "volume_overlap", "int_over_union");
+    int failed = compare_batch(pairs, mesher, cache.get(), table);
+    if( table!=stdout )
+    {
+      fclose(table);
+    }
+    if( failed>0 )
+    {
+      std::cerr << failed << " of " << pairs.size() << " pairs were not compared" << std::endl;
+      return 2;
+    }
+    return 0;
+  }
+  
+  if( argc==4 && std::string(argv[1])=="--convert" )
+  {
+    return convert_to_mvm(argv[2], argv[3], mesher, cache.get());
+  }
+  if( argc!=3 and argc!=4 )
+  {
+    std::cerr << "Usage: " << std::endl;
+    std::cerr << argv[0] << " [--itk-mask-mesh] [--voxel-metrics] [--mask-distance-map] [--cache <dir> [--cache-size <MB>]] <mesh/image filename> <ground truth mesh/image filename> [<results file>]" << std::endl;
+    std::cerr << argv[0] << " --labels <all|label,label,...> [--voxel-metrics] <label image filename> <ground truth label image filename> [<results file>]" << std::endl;
+    std::cerr << argv[0] << " [--itk-mask-mesh] [--cache <dir> [--cache-size <MB>]] --batch <manifest> [<results file>]" << std::endl;
+    std::cerr << argv[0] << " [--itk-mask-mesh] [--cache <dir> [--cache-size <MB>]] --convert <mesh/image filename> <output .mvm filename>" << std::endl;
+    return 1;
+  }
+  
+  // Identify file types and load as meshes accordingly
+  file_type type1 = identify_file_type(argv[1]);
+  if( type1==UNKNOWN )
+  {
+    std::cerr << "Unknown file type for file: " << argv[1] << std::endl;
+    return 1;
+  }
+  file_type type2 = identify_file_type(argv[2]);
+  if( type2==UNKNOWN )
+  {
+    std::cerr << "Unknown file type for file: " << argv[2] << std::endl;
+    return 1;
+  }
+  
+  // Compare label images label by label, one table per label
+  if( multi_label )
+  {
+    if( type1!=IMAGE || type2!=IMAGE )
+    {
+      std::cerr << "--labels compares two label images" << std::endl;
+      return 1;
+    }
+    std::vector<label_differences> results;
+    compare_labels(argv[1], argv[2], labels, voxel_metrics, results);
+    for(size_t l=0; l<results.size(); l++)
+    {
+      std::cout << "LABEL: " << results[l].label << std::endl;
+      print_differences(results[l].diff);
+    }
+    if( argc==4 )
+    {
+      FILE* results_file = fopen(argv[3], "aw");
+      if( results_file==NULL )
+      {
+        std::cerr << "ERROR opening file to write results. Filename requested: " << argv[3] << std::endl;
+        return 2;
+      }
+      fprintf(results_file, "%s %s %s %s %s %s %s %s %s %s\n", "label", "min_dist", "max_dist", "min_abs_dist",
+              "max_abs_dist", "mean_dist", "mean_abs_dist", "rms_dist", "volume_overlap", "int_over_union");
+      for(size_t l=0; l<results.size(); l++)
+      {
+        const CompareMeshes::mesh_differences& diff = results[l].diff;
+        fprintf(results_file, "%d %f %f %f %f %f %f %f %f %f\n", results[l].label, diff.min_dist, diff.max_dist,
+                diff.abs_min_dist, diff.abs_max_dist, diff.mean_dist, diff.abs_mean_dist,
+                diff.rms_dist, diff.volume_overlap, diff.int_union_ratio);
+      }
+      fclose(results_file);
+    }
+    return 0;
+  }
+  
+  // Compare two masks on the same grid voxel by voxel if asked to
+  CompareMeshes::mesh_differences diff;
+  bool compared = false;
+  if( voxel_metrics && type1==IMAGE && type2==IMAGE )
+  {
+    compared = compare_masks(argv[1], argv[2], diff);
+    if( !compared )
+    {
+      std::cerr << "WARNING: the masks are not on the same voxel grid; comparing their meshes" << std::endl;
+    }
+  }
+  
+  // Compare a mesh with a mask through the distance map of the mask if asked to
+  if( mask_distance_map && (type1==IMAGE)!=(type2==IMAGE) )
+  {
+    if( type2==IMAGE )
+    {
+      compare_mesh_mask(argv[1], type1, argv[2], true, diff);
+    }
+    else
+    {
+      compare_mesh_mask(argv[2], type2, argv[1], false, diff);
+    }
+    compared = true;
+  }
+  
+  // Compare meshes using MeshValmet
+  if( !compared )
+  {
+    load_model_task load1(argv[1], type1, mesher, cache.get()), load2(argv[2], type2, mesher, cache.get());
+    run_concurrently(load1, load2);
+    CompareMeshes* cm = new CompareMeshes();
+    diff = cm->GetMeshDifferences( load1.prepared, load2.prepared );
+  }
+  
+  // Output results to stdout
+  print_differences(diff);
   
   // Output results to a file (compact)
   if( argc==4 )
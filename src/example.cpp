@@ -46,6 +46,8 @@ int main()
   std::cout << "RMS DIST: " << diff.rms_dist << std::endl;
   std::cout << "VOLUME OVERLAP: " << diff.volume_overlap << std::endl;
   std::cout << "INTERSECTION/UNION: " << diff.int_union_ratio << std::endl;
+  std::cout << "VOLUME 1: " << diff.volume1 << (diff.mesh1_closed ? "" : " (open mesh)") << std::endl;
+  std::cout << "VOLUME 2: " << diff.volume2 << (diff.mesh2_closed ? "" : " (open mesh)") << std::endl;
   
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,243 @@
+#include "CompareMasks.h"
+#include "DistanceTransform.h"
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+// MeshValmet
+#include "geomutils.h"
+
+// Returns the number of set bits of w
+static inline int popcount64(uint64_t w)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_popcountll(w);
+#else
+  w = w - ((w>>1) & 0x5555555555555555ULL);
+  w = (w & 0x3333333333333333ULL) + ((w>>2) & 0x3333333333333333ULL);
+  w = (w + (w>>4)) & 0x0f0f0f0f0f0f0f0fULL;
+  return (int)((w*0x0101010101010101ULL)>>56);
+#endif
+}
+
+// Packs mask into bits, 64 voxels per word
+static void pack_mask(const unsigned char* mask, size_t num_voxels, std::vector<uint64_t>& bits)
+{
+  long num_words = (long)((num_voxels+63)/64);
+  bits.resize(num_words);
+  #pragma omp parallel for
+  for(long w=0; w<num_words; w++)
+  {
+    size_t first = (size_t)w*64;
+    int n = num_voxels-first<64 ? (int)(num_voxels-first) : 64;
+    uint64_t word = 0;
+    for(int b=0; b<n; b++)
+    {
+      word |= (uint64_t)(mask[first+b]!=0)<<b;
+    }
+    bits[w] = word;
+  }
+}
+
+// Volume of a voxel of the grid
+static double voxel_volume(const struct mask_geometry* geom)
+{
+  const double* d = geom->direction;
+  double det = d[0]*(d[4]*d[8]-d[5]*d[7]) - d[1]*(d[3]*d[8]-d[5]*d[6]) + d[2]*(d[3]*d[7]-d[4]*d[6]);
+  return fabs(det)*geom->spacing[0]*geom->spacing[1]*geom->spacing[2];
+}
+
+void CompareMasks::compute_overlap(const unsigned char* mask1, const unsigned char* mask2,
+                                   const struct mask_geometry* geom, mesh_differences& diff)
+{
+  size_t num_voxels = (size_t)geom->dims[0]*geom->dims[1]*geom->dims[2];
+  std::vector<uint64_t> bits1, bits2;
+  pack_mask(mask1, num_voxels, bits1);
+  pack_mask(mask2, num_voxels, bits2);
+
+  long long n1 = 0, n2 = 0, n12 = 0;
+  long num_words = (long)bits1.size();
+  #pragma omp parallel for reduction(+:n1,n2,n12)
+  for(long w=0; w<num_words; w++)
+  {
+    n1 += popcount64(bits1[w]);
+    n2 += popcount64(bits2[w]);
+    n12 += popcount64(bits1[w] & bits2[w]);
+  }
+
+  double vv = voxel_volume(geom);
+  diff.volume1 = n1*vv;
+  diff.volume2 = n2*vv;
+  diff.volume_overlap = n1+n2>0 ? 2.0*n12/(double)(n1+n2) : NAN;
+  diff.int_union_ratio = n1+n2-n12>0 ? n12/(double)(n1+n2-n12) : NAN;
+  diff.mesh1_closed = 1;
+  diff.mesh2_closed = 1;
+}
+
+// Sets border to 1 for the inside voxels of mask with a 6-neighbor outside
+// (or off the grid), and to 0 elsewhere; box is set to the bounding box of
+// the mask, with empty dims if there are no inside voxels
+static void find_border(const unsigned char* mask, const int* dims, std::vector<unsigned char>& border,
+                        struct voxel_box& box)
+{
+  const int nx = dims[0], ny = dims[1], nz = dims[2];
+  const size_t sy = nx, sz = (size_t)nx*ny;
+  border.assign(sz*nz, 0);
+  std::vector<int> plane_box(4*nz);  // per plane: lowest i and j, highest i and j
+  #pragma omp parallel for schedule(dynamic)
+  for(int k=0; k<nz; k++)
+  {
+    int* pb = &plane_box[4*k];
+    pb[0] = nx; pb[1] = ny; pb[2] = pb[3] = -1;
+    for(int j=0; j<ny; j++)
+    {
+      size_t row = j*sy + k*sz;
+      for(int i=0; i<nx; i++)
+      {
+        size_t v = row+i;
+        if( !mask[v] ) continue;
+        if( i<pb[0] ) pb[0] = i;
+        if( j<pb[1] ) pb[1] = j;
+        if( i>pb[2] ) pb[2] = i;
+        pb[3] = j;
+        border[v] = i==0 || i==nx-1 || j==0 || j==ny-1 || k==0 || k==nz-1 ||
+                    !mask[v-1] || !mask[v+1] || !mask[v-sy] || !mask[v+sy] ||
+                    !mask[v-sz] || !mask[v+sz];
+      }
+    }
+  }
+  int lo[3] = { nx, ny, nz }, hi[3] = { -1, -1, -1 };
+  for(int k=0; k<nz; k++)
+  {
+    const int* pb = &plane_box[4*k];
+    if( pb[2]<0 ) continue;
+    lo[0] = min(lo[0], pb[0]);
+    lo[1] = min(lo[1], pb[1]);
+    hi[0] = max(hi[0], pb[2]);
+    hi[1] = max(hi[1], pb[3]);
+    lo[2] = min(lo[2], k);
+    hi[2] = k;
+  }
+  for(int a=0; a<3; a++)
+  {
+    box.lo[a] = lo[a];
+    box.dims[a] = hi[a]>=lo[a] ? hi[a]-lo[a]+1 : 0;
+  }
+}
+
+// Distance statistics of one direction, from the border voxels of a mask
+struct border_dist_stats
+{
+  long long samples;
+  double min_dist, max_dist, abs_min_dist, abs_max_dist;
+  double sum, abs_sum, sqr_sum;
+};
+
+static void init_border_dist_stats(border_dist_stats& st)
+{
+  st.samples = 0;
+  st.sum = st.abs_sum = st.sqr_sum = 0;
+  st.min_dist = st.abs_min_dist = HUGE_VAL;
+  st.max_dist = st.abs_max_dist = -HUGE_VAL;
+}
+
+// Distances from the border voxels of mask1 (border1, within box1) to the
+// nearest border voxel of mask2 (border2, within box2), signed by mask2
+static border_dist_stats border_distances(const std::vector<unsigned char>& border1, const struct voxel_box& box1,
+                                          const std::vector<unsigned char>& border2, const struct voxel_box& box2,
+                                          const unsigned char* mask2, const struct mask_geometry* geom)
+{
+  // The distances to the border of mask2 are only needed over the bounding
+  // box of both masks, which holds the border voxels of mask2 too
+  struct voxel_box box;
+  for(int a=0; a<3; a++)
+  {
+    int lo = min(box1.lo[a], box2.lo[a]);
+    int hi = max(box1.lo[a]+box1.dims[a], box2.lo[a]+box2.dims[a]);
+    box.lo[a] = lo;
+    box.dims[a] = hi-lo;
+  }
+  std::vector<float> dist2;
+  distance_transform(&border2[0], geom->dims, geom->spacing, box, dist2);
+
+  // Per plane statistics, summed in order
+  const int* dims = geom->dims;
+  std::vector<border_dist_stats> planes(box1.dims[2]);
+  #pragma omp parallel for schedule(dynamic)
+  for(int k=0; k<box1.dims[2]; k++)
+  {
+    border_dist_stats& st = planes[k];
+    init_border_dist_stats(st);
+    for(int j=0; j<box1.dims[1]; j++)
+    {
+      int gj = box1.lo[1]+j, gk = box1.lo[2]+k;
+      size_t row = (size_t)dims[0]*(gj+(size_t)dims[1]*gk);
+      size_t box_row = (size_t)box.dims[0]*((gj-box.lo[1])+(size_t)box.dims[1]*(gk-box.lo[2]));
+      for(int gi=box1.lo[0]; gi<box1.lo[0]+box1.dims[0]; gi++)
+      {
+        if( !border1[row+gi] ) continue;
+        double d = sqrt((double)dist2[box_row+gi-box.lo[0]]);
+        if( mask2[row+gi] ) d = -d;
+        st.samples++;
+        st.sum += d;
+        st.abs_sum += fabs(d);
+        st.sqr_sum += d*d;
+        if( d<st.min_dist ) st.min_dist = d;
+        if( d>st.max_dist ) st.max_dist = d;
+        if( fabs(d)<st.abs_min_dist ) st.abs_min_dist = fabs(d);
+        if( fabs(d)>st.abs_max_dist ) st.abs_max_dist = fabs(d);
+      }
+    }
+  }
+  border_dist_stats total;
+  init_border_dist_stats(total);
+  for(size_t k=0; k<planes.size(); k++)
+  {
+    const border_dist_stats& st = planes[k];
+    total.samples += st.samples;
+    total.sum += st.sum;
+    total.abs_sum += st.abs_sum;
+    total.sqr_sum += st.sqr_sum;
+    total.min_dist = min(total.min_dist, st.min_dist);
+    total.max_dist = max(total.max_dist, st.max_dist);
+    total.abs_min_dist = min(total.abs_min_dist, st.abs_min_dist);
+    total.abs_max_dist = max(total.abs_max_dist, st.abs_max_dist);
+  }
+  return total;
+}
+
+void CompareMasks::compute_distances(const unsigned char* mask1, const unsigned char* mask2,
+                                     const struct mask_geometry* geom, mesh_differences& diff)
+{
+  std::vector<unsigned char> border1, border2;
+  struct voxel_box box1, box2;
+  find_border(mask1, geom->dims, border1, box1);
+  find_border(mask2, geom->dims, border2, box2);
+
+  border_dist_stats stats = border_distances(border1, box1, border2, box2, mask2, geom);
+  border_dist_stats stats_rev = border_distances(border2, box2, border1, box1, mask1, geom);
+
+  // Summarize stats symmetrically, as for meshes (the samples are the border
+  // voxels)
+  double n1 = (double)stats.samples, n2 = (double)stats_rev.samples;
+  diff.min_dist = min(stats.min_dist, stats_rev.min_dist);
+  diff.max_dist = max(stats.max_dist, stats_rev.max_dist);
+  diff.abs_min_dist = min(stats.abs_min_dist, stats_rev.abs_min_dist);
+  diff.abs_max_dist = max(stats.abs_max_dist, stats_rev.abs_max_dist);
+  diff.mean_dist = (stats.sum/n1 + stats_rev.sum/n2)/2.0;
+  diff.abs_mean_dist = (stats.abs_sum + stats_rev.abs_sum)/(n1+n2);
+  diff.rms_dist = sqrt((stats.sqr_sum + stats_rev.sqr_sum)/(n1+n2));
+}
+
+CompareMasks::mesh_differences CompareMasks::GetMaskDifferences(const unsigned char* mask1, const unsigned char* mask2,
+                                                                const struct mask_geometry* geom)
+{
+  mesh_differences results;
+  memset(&results,0,sizeof(results));
+
+  compute_distances( mask1, mask2, geom, results );
+  compute_overlap( mask1, mask2, geom, results );
+
+  return results;
+}
@@ -0,0 +1,30 @@
+#ifndef CompareMasks_h
+#define CompareMasks_h
+
+#include "CompareMeshes.h"
+#include "MaskToModel.h"
+
+// Compares two binary masks on the same voxel grid without meshing them. The
+// volumes and the overlap are counted on the voxels, and the distances are
+// measured between the border voxels of the two masks (inside voxels with a
+// 6-neighbor outside), as in the mesh comparison: from each border voxel of
+// one mask to the nearest border voxel of the other, positive outside the
+// other mask and negative inside, in physical units.
+class CompareMasks
+{
+public:
+  typedef CompareMeshes::mesh_differences mesh_differences;
+
+  // mask1 and mask2 have nonzero voxels inside, laid out as for
+  // mask_to_model(), on the grid geom. Neither should be empty.
+  mesh_differences GetMaskDifferences(const unsigned char* mask1, const unsigned char* mask2,
+                                      const struct mask_geometry* geom);
+
+protected:
+  void compute_overlap(const unsigned char* mask1, const unsigned char* mask2,
+                       const struct mask_geometry* geom, mesh_differences& diff);
+  void compute_distances(const unsigned char* mask1, const unsigned char* mask2,
+                         const struct mask_geometry* geom, mesh_differences& diff);
+};
+
+#endif // CompareMasks_h
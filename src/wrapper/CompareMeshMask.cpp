@@ -0,0 +1,417 @@
+#include "CompareMeshMask.h"
+#include "DistanceTransform.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+// MeshValmet
+#include "compute_error.h"
+#include "geomutils.h"
+
+// Signed distance to the surface of a mask, at the voxels of a box of its grid
+// (the box may extend past the image)
+struct signed_distance_map
+{
+  struct voxel_box box;
+  std::vector<float> dist;  // laid out as the voxels of the grid
+  double origin[3];         // physical position of voxel (0,0,0) of the grid
+  double spacing[3];
+  double to_index[9];       // physical offset to grid index offset, row-major
+};
+
+// Physical position of the grid point of continuous index c
+static void index_to_point(const struct mask_geometry* geom, const double* c, dvertex_t& p)
+{
+  double q[3];
+  for(int a=0; a<3; a++)
+  {
+    q[a] = 0;
+    for(int b=0; b<3; b++)
+    {
+      q[a] += geom->direction[3*a+b]*geom->spacing[b]*c[b];
+    }
+  }
+  p.x = geom->origin[0]+q[0];
+  p.y = geom->origin[1]+q[1];
+  p.z = geom->origin[2]+q[2];
+}
+
+// Sets sdm->to_index to the inverse of direction*diag(spacing)
+static void init_to_index(const struct mask_geometry* geom, struct signed_distance_map* sdm)
+{
+  double m[9];
+  for(int a=0; a<3; a++)
+  {
+    for(int b=0; b<3; b++)
+    {
+      m[3*a+b] = geom->direction[3*a+b]*geom->spacing[b];
+    }
+  }
+  double det = m[0]*(m[4]*m[8]-m[5]*m[7]) - m[1]*(m[3]*m[8]-m[5]*m[6]) + m[2]*(m[3]*m[7]-m[4]*m[6]);
+  double* r = sdm->to_index;
+  r[0] = (m[4]*m[8]-m[5]*m[7])/det;
+  r[1] = (m[2]*m[7]-m[1]*m[8])/det;
+  r[2] = (m[1]*m[5]-m[2]*m[4])/det;
+  r[3] = (m[5]*m[6]-m[3]*m[8])/det;
+  r[4] = (m[0]*m[8]-m[2]*m[6])/det;
+  r[5] = (m[2]*m[3]-m[0]*m[5])/det;
+  r[6] = (m[3]*m[7]-m[4]*m[6])/det;
+  r[7] = (m[1]*m[6]-m[0]*m[7])/det;
+  r[8] = (m[0]*m[4]-m[1]*m[3])/det;
+}
+
+// Signed distance at point p, interpolated trilinearly in the map (data). A
+// point off the map gets the distance at the nearest point of the map, plus
+// the distance to it.
+static double lookup_distance(const dvertex_t* p, void* data)
+{
+  const struct signed_distance_map* sdm = (const struct signed_distance_map*)data;
+  const int* dims = sdm->box.dims;
+  double q[3] = { p->x-sdm->origin[0], p->y-sdm->origin[1], p->z-sdm->origin[2] };
+  int i0[3], i1[3];
+  double t[3], off_sqr = 0;
+  for(int a=0; a<3; a++)
+  {
+    double c = sdm->to_index[3*a]*q[0] + sdm->to_index[3*a+1]*q[1] + sdm->to_index[3*a+2]*q[2] - sdm->box.lo[a];
+    double cc = c<0 ? 0 : (c>dims[a]-1 ? dims[a]-1 : c);
+    off_sqr += (c-cc)*(c-cc)*sdm->spacing[a]*sdm->spacing[a];
+    i0[a] = (int)cc;
+    if( i0[a]>=dims[a]-1 ) i0[a] = dims[a]>1 ? dims[a]-2 : 0;
+    i1[a] = dims[a]>1 ? i0[a]+1 : i0[a];
+    t[a] = cc-i0[a];
+  }
+  const float* d = &sdm->dist[0];
+  size_t sy = dims[0], sz = (size_t)dims[0]*dims[1];
+  size_t y0 = i0[1]*sy, y1 = i1[1]*sy, z0 = i0[2]*sz, z1 = i1[2]*sz;
+  double d00 = d[i0[0]+y0+z0] + t[0]*(d[i1[0]+y0+z0]-d[i0[0]+y0+z0]);
+  double d10 = d[i0[0]+y1+z0] + t[0]*(d[i1[0]+y1+z0]-d[i0[0]+y1+z0]);
+  double d01 = d[i0[0]+y0+z1] + t[0]*(d[i1[0]+y0+z1]-d[i0[0]+y0+z1]);
+  double d11 = d[i0[0]+y1+z1] + t[0]*(d[i1[0]+y1+z1]-d[i0[0]+y1+z1]);
+  double d0 = d00 + t[1]*(d10-d00);
+  double d1 = d01 + t[1]*(d11-d01);
+  return d0 + t[2]*(d1-d0) + sqrt(off_sqr);
+}
+
+// Bounding box of the nonzero voxels of mask, with empty dims if there are none
+static void mask_bounding_box(const unsigned char* mask, const int* dims, struct voxel_box& box)
+{
+  const int nx = dims[0], ny = dims[1], nz = dims[2];
+  std::vector<int> plane_box(4*nz);  // per plane: lowest i and j, highest i and j
+  #pragma omp parallel for schedule(dynamic)
+  for(int k=0; k<nz; k++)
+  {
+    int* pb = &plane_box[4*k];
+    pb[0] = nx; pb[1] = ny; pb[2] = pb[3] = -1;
+    for(int j=0; j<ny; j++)
+    {
+      const unsigned char* row = mask + (size_t)nx*(j+(size_t)ny*k);
+      for(int i=0; i<nx; i++)
+      {
+        if( !row[i] ) continue;
+        if( i<pb[0] ) pb[0] = i;
+        if( j<pb[1] ) pb[1] = j;
+        if( i>pb[2] ) pb[2] = i;
+        pb[3] = j;
+      }
+    }
+  }
+  int lo[3] = { nx, ny, nz }, hi[3] = { -1, -1, -1 };
+  for(int k=0; k<nz; k++)
+  {
+    const int* pb = &plane_box[4*k];
+    if( pb[2]<0 ) continue;
+    lo[0] = min(lo[0], pb[0]);
+    lo[1] = min(lo[1], pb[1]);
+    hi[0] = max(hi[0], pb[2]);
+    hi[1] = max(hi[1], pb[3]);
+    lo[2] = min(lo[2], k);
+    hi[2] = k;
+  }
+  for(int a=0; a<3; a++)
+  {
+    box.lo[a] = lo[a];
+    box.dims[a] = hi[a]>=lo[a] ? hi[a]-lo[a]+1 : 0;
+  }
+}
+
+// Copies the mask into inside, over box (zero off the image), and marks in
+// inner the inside voxels with a 6-neighbor outside and in outer the outside
+// voxels with a 6-neighbor inside. The box should leave a margin of one voxel
+// around the mask.
+static void mask_borders(const unsigned char* mask, const int* dims, const struct voxel_box& box,
+                         std::vector<unsigned char>& inside, std::vector<unsigned char>& inner,
+                         std::vector<unsigned char>& outer)
+{
+  const int bx = box.dims[0], by = box.dims[1], bz = box.dims[2];
+  const size_t sy = bx, sz = (size_t)bx*by;
+  inside.assign(sz*bz, 0);
+  inner.assign(sz*bz, 0);
+  outer.assign(sz*bz, 0);
+  #pragma omp parallel for schedule(dynamic)
+  for(int k=0; k<bz; k++)
+  {
+    int gk = box.lo[2]+k;
+    if( gk<0 || gk>=dims[2] ) continue;
+    for(int j=0; j<by; j++)
+    {
+      int gj = box.lo[1]+j;
+      if( gj<0 || gj>=dims[1] ) continue;
+      const unsigned char* row = mask + (size_t)dims[0]*(gj+(size_t)dims[1]*gk);
+      for(int i=0; i<bx; i++)
+      {
+        int gi = box.lo[0]+i;
+        if( gi>=0 && gi<dims[0] && row[gi] ) inside[i+j*sy+k*sz] = 1;
+      }
+    }
+  }
+  #pragma omp parallel for schedule(dynamic)
+  for(int k=0; k<bz; k++)
+  {
+    for(int j=0; j<by; j++)
+    {
+      for(int i=0; i<bx; i++)
+      {
+        size_t v = i+j*sy+k*sz;
+        unsigned char in = inside[v];
+        bool differs = (i>0 && inside[v-1]!=in) || (i<bx-1 && inside[v+1]!=in) ||
+                       (j>0 && inside[v-sy]!=in) || (j<by-1 && inside[v+sy]!=in) ||
+                       (k>0 && inside[v-sz]!=in) || (k<bz-1 && inside[v+sz]!=in);
+        if( differs )
+        {
+          if( in ) inner[v] = 1;
+          else outer[v] = 1;
+        }
+      }
+    }
+  }
+}
+
+// Computes the signed distance map of the mask over box, the voxels of which
+// are in inside, inner and outer (see mask_borders()). The surface of the mask
+// lies between its inner and outer border voxels, so the distance to it is
+// taken as the mean of the distances to the two borders: it is exact at the
+// border voxels (half a voxel) and far from the surface.
+static void signed_distance(const std::vector<unsigned char>& inside, const std::vector<unsigned char>& inner,
+                            const std::vector<unsigned char>& outer, const struct mask_geometry* geom,
+                            struct signed_distance_map* sdm)
+{
+  struct voxel_box whole;
+  for(int a=0; a<3; a++)
+  {
+    whole.lo[a] = 0;
+    whole.dims[a] = sdm->box.dims[a];
+  }
+  std::vector<float> dist_outer;
+  distance_transform(&inner[0], whole.dims, geom->spacing, whole, sdm->dist);
+  distance_transform(&outer[0], whole.dims, geom->spacing, whole, dist_outer);
+  long num_voxels = (long)sdm->dist.size();
+  #pragma omp parallel for
+  for(long v=0; v<num_voxels; v++)
+  {
+    float d = 0.5f*(sqrtf(sdm->dist[v])+sqrtf(dist_outer[v]));
+    sdm->dist[v] = inside[v] ? -d : d;
+  }
+}
+
+// Appends to points the centers of the faces between the inside voxels of
+// plane k of box and their outside 6-neighbors, in physical coordinates
+static void surface_points(const std::vector<unsigned char>& inside, const struct voxel_box& box, int k,
+                           const struct mask_geometry* geom, std::vector<dvertex_t>& points)
+{
+  const int bx = box.dims[0], by = box.dims[1];
+  const size_t sy = bx, sz = (size_t)bx*by;
+  const size_t steps[3] = { 1, sy, sz };
+  for(int j=0; j<by; j++)
+  {
+    for(int i=0; i<bx; i++)
+    {
+      size_t v = i+j*sy+k*sz;
+      if( !inside[v] ) continue;
+      for(int a=0; a<3; a++)
+      {
+        for(int side=-1; side<=1; side+=2)
+        {
+          if( inside[side<0 ? v-steps[a] : v+steps[a]] ) continue;
+          double c[3] = { (double)(box.lo[0]+i), (double)(box.lo[1]+j), (double)(box.lo[2]+k) };
+          c[a] += 0.5*side;
+          dvertex_t p;
+          index_to_point(geom, c, p);
+          points.push_back(p);
+        }
+      }
+    }
+  }
+}
+
+// Expected number of samples of dist_surf_surf() on mesh at the given density
+// and minimum frequency
+static double expected_samples(const struct prepared_mesh* mesh, double sampling_density, int min_sample_freq)
+{
+  double min_samples = 0.5*min_sample_freq*(min_sample_freq+1);
+  double n = 0;
+  for(int k=0; k<mesh->mesh->num_faces; k++)
+  {
+    n += max(min_samples, mesh->face_area[k]*sampling_density);
+  }
+  return n;
+}
+
+void CompareMeshMask::compute_mask_distances(struct prepared_mesh* mesh, const unsigned char* mask,
+                                             const struct mask_geometry* geom, struct prepared_mesh* mask_mesh,
+                                             mesh_differences& diff)
+{
+  // The map covers the mask and the mesh, with a margin of one voxel (so that
+  // the outer border of the mask is in it), but not more than the size of the
+  // image past the image on each side: the mesh is looked up beyond that
+  struct signed_distance_map sdm;
+  for(int a=0; a<3; a++)
+  {
+    sdm.origin[a] = geom->origin[a];
+    sdm.spacing[a] = geom->spacing[a];
+  }
+  init_to_index(geom, &sdm);
+  struct voxel_box mask_box;
+  mask_bounding_box(mask, geom->dims, mask_box);
+  double mesh_lo[3] = { HUGE_VAL, HUGE_VAL, HUGE_VAL }, mesh_hi[3] = { -HUGE_VAL, -HUGE_VAL, -HUGE_VAL };
+  for(int corner=0; corner<8; corner++)
+  {
+    double q[3] = { (corner&1 ? mesh->bbox_max.x : mesh->bbox_min.x) - geom->origin[0],
+                    (corner&2 ? mesh->bbox_max.y : mesh->bbox_min.y) - geom->origin[1],
+                    (corner&4 ? mesh->bbox_max.z : mesh->bbox_min.z) - geom->origin[2] };
+    for(int a=0; a<3; a++)
+    {
+      double c = sdm.to_index[3*a]*q[0] + sdm.to_index[3*a+1]*q[1] + sdm.to_index[3*a+2]*q[2];
+      mesh_lo[a] = min(mesh_lo[a], c);
+      mesh_hi[a] = max(mesh_hi[a], c);
+    }
+  }
+  double mask_diag_sqr = 0;
+  for(int a=0; a<3; a++)
+  {
+    double lo = min((double)mask_box.lo[a], floor(mesh_lo[a])) - 1;
+    double hi = max((double)(mask_box.lo[a]+mask_box.dims[a]-1), ceil(mesh_hi[a])) + 1;
+    lo = max(lo, -(double)geom->dims[a]);
+    hi = min(hi, 2.0*geom->dims[a]-1);
+    sdm.box.lo[a] = (int)lo;
+    sdm.box.dims[a] = (int)(hi-lo)+1;
+    mask_diag_sqr += (mask_box.dims[a]*geom->spacing[a])*(mask_box.dims[a]*geom->spacing[a]);
+  }
+  std::vector<unsigned char> inside, inner, outer;
+  mask_borders(mask, geom->dims, sdm.box, inside, inner, outer);
+  signed_distance(inside, inner, outer, geom, &sdm);
+  std::vector<unsigned char>().swap(inner);
+  std::vector<unsigned char>().swap(outer);
+
+  // From the mesh to the mask, sampled relative to the size of the mask as in
+  // CompareMeshes::compute_distances()
+  sampling_step = 0.005*(mask_mesh!=NULL ? mask_mesh->bbox_diag : sqrt(mask_diag_sqr));
+  sampling_dens = 1.0/(sampling_step*sampling_step);
+  min_sample_freq = 2;
+  struct model_error mesh_err;
+  memset(&mesh_err,0,sizeof(mesh_err));
+  struct dist_surf_surf_stats stats;
+  dist_surf_field(&mesh_err, mesh, lookup_distance, &sdm, sampling_dens, (int)min_sample_freq, &stats);
+  free_face_error(mesh_err.fe);
+
+  // From the surface points of the mask to the mesh, in chunks sharing the
+  // spatial index of the mesh
+  std::vector< std::vector<dvertex_t> > planes(sdm.box.dims[2]);
+  #pragma omp parallel for schedule(dynamic)
+  for(int k=1; k<sdm.box.dims[2]-1; k++)
+  {
+    surface_points(inside, sdm.box, k, geom, planes[k]);
+  }
+  std::vector<dvertex_t> points;
+  for(size_t k=0; k<planes.size(); k++)
+  {
+    points.insert(points.end(), planes[k].begin(), planes[k].end());
+    std::vector<dvertex_t>().swap(planes[k]);
+  }
+  int num_points = (int)points.size();
+  std::vector<double> dist(num_points);
+  prepared_mesh_build_dist_index(mesh);
+  const int num_chunks = 16;
+  #pragma omp parallel for schedule(dynamic)
+  for(int c=0; c<num_chunks; c++)
+  {
+    int first = (int)((long long)num_points*c/num_chunks);
+    int last = (int)((long long)num_points*(c+1)/num_chunks);
+    if( last>first )
+    {
+      dist_pts_surf_prepared(&points[first], last-first, mesh, &dist[first]);
+    }
+  }
+  double rev_min = HUGE_VAL, rev_max = -HUGE_VAL, rev_abs_min = HUGE_VAL, rev_abs_max = 0;
+  double rev_sum = 0, rev_abs_sum = 0, rev_sqr_sum = 0;
+  for(int i=0; i<num_points; i++)
+  {
+    double d = dist[i];
+    rev_sum += d;
+    rev_abs_sum += fabs(d);
+    rev_sqr_sum += d*d;
+    if( d<rev_min ) rev_min = d;
+    if( d>rev_max ) rev_max = d;
+    if( fabs(d)<rev_abs_min ) rev_abs_min = fabs(d);
+    if( fabs(d)>rev_abs_max ) rev_abs_max = fabs(d);
+  }
+
+  // Summarize stats symmetrically, as for meshes. The surface points of the
+  // mask count as the samples that the mesh comparison would take on its
+  // marching cubes mesh, so that both directions weigh as they would there.
+  double n1 = (double)stats.m1_samples, n2 = (double)num_points;
+  if( mask_mesh!=NULL )
+  {
+    sampling_step = 0.005*mesh->bbox_diag;
+    n2 = expected_samples(mask_mesh, 1.0/(sampling_step*sampling_step), (int)min_sample_freq);
+    rev_abs_sum *= n2/num_points;
+    rev_sqr_sum *= n2/num_points;
+  }
+  diff.min_dist = min(stats.min_dist, rev_min);
+  diff.max_dist = max(stats.max_dist, rev_max);
+  diff.abs_min_dist = min(stats.abs_min_dist, rev_abs_min);
+  diff.abs_max_dist = max(stats.abs_max_dist, rev_abs_max);
+  diff.mean_dist = (stats.mean_dist + rev_sum/num_points)/2.0;
+  diff.abs_mean_dist = (stats.abs_mean_dist*n1 + rev_abs_sum)/(n1+n2);
+  diff.rms_dist = sqrt( (n1*stats.rms_dist*stats.rms_dist + rev_sqr_sum)/(n1+n2) );
+}
+
+void CompareMeshMask::compute_mask_overlap(struct prepared_mesh* mesh, struct prepared_mesh* mask_mesh,
+                                           mesh_differences& diff)
+{
+  if( mask_mesh==NULL )
+  {
+    fprintf(stderr, "WARNING: mask too large to mesh; no volume overlap\n");
+    diff.volume_overlap = NAN;
+    diff.int_union_ratio = NAN;
+    diff.volume1 = fabs(prepared_mesh_volume(mesh, NULL));
+    diff.volume2 = NAN;
+    diff.mesh1_closed = 1;
+    diff.mesh2_closed = 1;
+    return;
+  }
+  compute_overlap(mesh, mask_mesh, diff);
+}
+
+CompareMeshMask::mesh_differences CompareMeshMask::GetMeshMaskDifferences(struct prepared_mesh* mesh,
+                                                                          const unsigned char* mask,
+                                                                          const struct mask_geometry* geom)
+{
+  mesh_differences results;
+  memset(&results,0,sizeof(results));
+
+  // The marching cubes mesh of the mask, for the overlap and the sample
+  // weights (NULL if too large)
+  struct model* mask_model = mask_to_model(mask, geom);
+  struct prepared_mesh* mask_mesh = mask_model!=NULL ? prepare_mesh(mask_model) : NULL;
+
+  compute_mask_distances( mesh, mask, geom, mask_mesh, results );
+  compute_mask_overlap( mesh, mask_mesh, results );
+
+  if( mask_mesh!=NULL )
+  {
+    free_prepared_mesh(mask_mesh);
+    __free_raw_model(mask_model);
+  }
+  return results;
+}
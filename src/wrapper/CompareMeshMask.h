@@ -0,0 +1,35 @@
+#ifndef CompareMeshMask_h
+#define CompareMeshMask_h
+
+#include "CompareMeshes.h"
+#include "MaskToModel.h"
+
+// Compares a mesh with a binary mask without measuring distances on a mesh of
+// the mask. A signed Euclidean distance map of the mask (negative inside) is
+// computed once, on the voxel grid over both, and the mesh is sampled as in
+// the mesh comparison, the distance at each sample being interpolated
+// trilinearly in the map. In the other direction, the surface points of the
+// mask (the centers of the faces between inside and outside voxels, which are
+// the vertices of its marching cubes mesh) are looked up in the spatial index
+// of the mesh. The volumes and the overlap are computed as for two meshes,
+// with the marching cubes mesh of the mask.
+class CompareMeshMask : public CompareMeshes
+{
+public:
+  // Compares mesh (mesh 1 of the results) with mask (mesh 2), which has
+  // nonzero voxels inside, laid out as for mask_to_model(), on the grid geom.
+  // The mask should not be empty, and the grid directions should be
+  // orthonormal.
+  mesh_differences GetMeshMaskDifferences(struct prepared_mesh* mesh, const unsigned char* mask,
+                                          const struct mask_geometry* geom);
+
+protected:
+  // mask_mesh is the marching cubes mesh of the mask, NULL if too large
+  void compute_mask_distances(struct prepared_mesh* mesh, const unsigned char* mask,
+                              const struct mask_geometry* geom, struct prepared_mesh* mask_mesh,
+                              mesh_differences& diff);
+  void compute_mask_overlap(struct prepared_mesh* mesh, struct prepared_mesh* mask_mesh,
+                            mesh_differences& diff);
+};
+
+#endif // CompareMeshMask_h
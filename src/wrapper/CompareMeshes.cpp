@@ -1,4 +1,5 @@
 #include "CompareMeshes.h"
+#include <math.h>
 
 // MeshValmet
 #include "3dmodel.h"
@@ -7,6 +8,17 @@
 #include "geomutils.h"
 
 CompareMeshes::mesh_differences CompareMeshes::GetMeshDifferences(struct model* mesh1, struct model* mesh2)
+{
+  struct prepared_mesh* pmesh1 = prepare_mesh(mesh1);
+  struct prepared_mesh* pmesh2 = prepare_mesh(mesh2);
+  mesh_differences results = GetMeshDifferences(pmesh1, pmesh2);
+  free_prepared_mesh(pmesh1);
+  free_prepared_mesh(pmesh2);
+  return results;
+}
+
+
+CompareMeshes::mesh_differences CompareMeshes::GetMeshDifferences(struct prepared_mesh* mesh1, struct prepared_mesh* mesh2)
 {
   CompareMeshes::mesh_differences results;
   memset(&results,0,sizeof(results));
@@ -27,37 +39,34 @@ CompareMeshes::mesh_differences CompareMeshes::GetMeshDifferences(boost::shared_
 }
 
 
-void CompareMeshes::compute_distances(struct model* mesh1, struct model* mesh2, struct mesh_differences& diff)
+void CompareMeshes::compute_distances(struct prepared_mesh* mesh1, struct prepared_mesh* mesh2, struct mesh_differences& diff)
 {
-  // Compute distances in from mesh1 to mesh2
-  double bbox2_diag = dist_v(&mesh2->bBox[0], &mesh2->bBox[1]);
+  // Sampling densities: mesh1 is sampled relative to the size of mesh2, and
+  // vice versa
+  double bbox2_diag = mesh2->bbox_diag;
   sampling_step = 0.005*bbox2_diag;
-  sampling_dens = 1.0/(sampling_step*sampling_step);
+  double sampling_dens1 = 1.0/(sampling_step*sampling_step);
+  double bbox1_diag = mesh1->bbox_diag;
+  sampling_step = 0.005*bbox1_diag;
+  double sampling_dens2 = 1.0/(sampling_step*sampling_step);
+  sampling_dens = sampling_dens2;
   min_sample_freq = 2;
   
   struct model_error* mesh1_err = (struct model_error*)malloc(sizeof(struct model_error));
   memset(mesh1_err,0,sizeof(*mesh1_err));
-  mesh1_err->mesh = mesh1;
-  
-  struct dist_surf_surf_stats* stats = (struct dist_surf_surf_stats*)malloc(sizeof(struct dist_surf_surf_stats));
-  memset(stats,0,sizeof(*stats));
-  
-  dist_surf_surf(mesh1_err, mesh2, sampling_dens, min_sample_freq, stats, 1, 0);
-  
-  
-  // Compute distances in from mesh2 to mesh1
-  double bbox1_diag = dist_v(&mesh1->bBox[0], &mesh1->bBox[1]);
-  sampling_step = 0.005*bbox1_diag;
-  sampling_dens = 1.0/(sampling_step*sampling_step);
-  
   struct model_error* mesh2_err = (struct model_error*)malloc(sizeof(struct model_error));
   memset(mesh2_err,0,sizeof(*mesh2_err));
-  mesh2_err->mesh = mesh2;
   
+  struct dist_surf_surf_stats* stats = (struct dist_surf_surf_stats*)malloc(sizeof(struct dist_surf_surf_stats));
+  memset(stats,0,sizeof(*stats));
   struct dist_surf_surf_stats* stats_rev = (struct dist_surf_surf_stats*)malloc(sizeof(struct dist_surf_surf_stats));
   memset(stats_rev,0,sizeof(*stats_rev));
   
-  dist_surf_surf(mesh2_err, mesh1, sampling_dens, min_sample_freq, stats_rev, 1, 0);
+  // Compute distances from mesh1 to mesh2 and from mesh2 to mesh1, on one grid.
+  // The vertex normals are never used here, so they are not computed: that
+  // would write to the meshes, which a batch shares between threads.
+  dist_surf_surf_symmetric_prepared(mesh1_err, mesh2_err, mesh1, mesh2, sampling_dens1, sampling_dens2,
+                                    min_sample_freq, stats, stats_rev, 0, 0);
   
   
   // Summarize stats symmetrically
@@ -73,6 +82,8 @@ void CompareMeshes::compute_distances(struct model* mesh1, struct model* mesh2,
                       );
   
   // Free
+  free_face_error(mesh1_err->fe);
+  free_face_error(mesh2_err->fe);
   free(mesh1_err);
   free(mesh2_err);
   free(stats);
@@ -81,48 +92,52 @@ void CompareMeshes::compute_distances(struct model* mesh1, struct model* mesh2,
 
 
 // Taken from MeshValmetControls.cxx
-void CompareMeshes::compute_overlap(struct model* mesh1, struct model* mesh2, struct mesh_differences& diff)
+void CompareMeshes::compute_overlap(struct prepared_mesh* mesh1, struct prepared_mesh* mesh2, struct mesh_differences& diff)
 {
-  int num_vert1 = mesh1->num_vert;
-  int num_vert2 = mesh2->num_vert;
-  int num_faces1 = mesh1->num_faces;
-  int num_faces2 = mesh2->num_faces;
-  
-  double * L1 = new double[3*num_vert1];
-  double * L2 = new double[3*num_vert2];
-  int * T1 = new int[3*num_faces1];
-  int * T2 = new int[3*num_faces2];
-  
-  vertex_t * vert_list = mesh1->vertices;
-  for(int i=0; i<num_vert1; i++) {
-    L1[3*i+0] = vert_list[i].x;
-    L1[3*i+1] = vert_list[i].y;
-    L1[3*i+2] = vert_list[i].z;
-  }
-  vert_list = mesh2->vertices;
-  for(int i=0; i<num_vert2; i++) {
-    L2[3*i+0] = vert_list[i].x;
-    L2[3*i+1] = vert_list[i].y;
-    L2[3*i+2] = vert_list[i].z;
+  // Exact volumes, plus a cheap closedness test done in the same pass, before
+  // paying for the ray-cast overlap
+  double open_ratio1, open_ratio2;
+  double exact_vols[2], ray_vols[2];
+  exact_vols[0] = fabs(prepared_mesh_volume(mesh1, &open_ratio1));
+  exact_vols[1] = fabs(prepared_mesh_volume(mesh2, &open_ratio2));
+  diff.volume1 = exact_vols[0];
+  diff.volume2 = exact_vols[1];
+  diff.mesh1_closed = (open_ratio1 <= open_tolerance);
+  diff.mesh2_closed = (open_ratio2 <= open_tolerance);
+  if( !diff.mesh1_closed || !diff.mesh2_closed )
+  {
+    fprintf(stderr, "WARNING: mesh %s is not closed; volume overlap is unreliable\n",
+            (!diff.mesh1_closed && !diff.mesh2_closed) ? "1 and 2" : (!diff.mesh1_closed ? "1" : "2"));
+    if( skip_open_overlap )
+    {
+      diff.volume_overlap = NAN;
+      diff.int_union_ratio = NAN;
+      return;
+    }
   }
   
-  face_t * face_list = mesh1->faces;
-  for(int i=0; i<num_faces1; i++) {
-    T1[3*i+0] = face_list[i].f0+1;
-    T1[3*i+1] = face_list[i].f1+1;
-    T1[3*i+2] = face_list[i].f2+1;
+  ComputeRobustVolumeOverlapModels(mesh1->mesh,mesh2->mesh,(use_exact_volumes ? exact_vols : NULL),
+                                   &(diff.volume_overlap),&(diff.int_union_ratio),ray_vols);
+  
+  // A closed mesh that does not match its ray-integrated volume has holes
+  // too small for the area test, or self-intersections. The ray-integrated
+  // volume itself is off by up to about the surface area times the ray
+  // spacing, which is a large part of the volume of thin or small meshes,
+  // so that much is allowed on top of the relative tolerance.
+  dvertex_t lo, hi;
+  lo.x = min(mesh1->bbox_min.x, mesh2->bbox_min.x);
+  lo.y = min(mesh1->bbox_min.y, mesh2->bbox_min.y);
+  lo.z = min(mesh1->bbox_min.z, mesh2->bbox_min.z);
+  hi.x = max(mesh1->bbox_max.x, mesh2->bbox_max.x);
+  hi.y = max(mesh1->bbox_max.y, mesh2->bbox_max.y);
+  hi.z = max(mesh1->bbox_max.z, mesh2->bbox_max.z);
+  double ray_spacing = max(hi.x-lo.x, max(hi.y-lo.y, hi.z-lo.z))/VOLUME_OVERLAP_RAYS;
+  if( fabs(ray_vols[0]-exact_vols[0]) > ray_volume_tolerance*exact_vols[0] + ray_spacing*mesh1->total_area )
+  {
+    diff.mesh1_closed = 0;
+  }
+  if( fabs(ray_vols[1]-exact_vols[1]) > ray_volume_tolerance*exact_vols[1] + ray_spacing*mesh2->total_area )
+  {
+    diff.mesh2_closed = 0;
   }
-  face_list = mesh2->faces;
-  for(int i=0; i<num_faces2; i++) {
-    T2[3*i+0] = face_list[i].f0+1;
-    T2[3*i+1] = face_list[i].f1+1;
-    T2[3*i+2] = face_list[i].f2+1;
-  } 
-  
-  ComputeRobustVolumeOverlap(L1,L2,num_vert1,num_vert2,T1,T2,num_faces1,num_faces2,&(diff.volume_overlap),&(diff.int_union_ratio));
-  
-  delete [] L1;
-  delete [] L2;
-  delete [] T1;
-  delete [] T2;
 }
\ No newline at end of file
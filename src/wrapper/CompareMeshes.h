@@ -3,6 +3,7 @@
 
 // MeshValmet
 #include "3dmodel.h"
+#include "prepared_mesh.h"
 
 // Boost
 #include <boost/shared_ptr.hpp>
@@ -10,7 +11,9 @@
 class CompareMeshes
 {
 public:
-  CompareMeshes() : sampling_step(1), sampling_dens(1), min_sample_freq(1) {};
+  CompareMeshes() : sampling_step(1), sampling_dens(1), min_sample_freq(1),
+                    use_exact_volumes(false), skip_open_overlap(false),
+                    open_tolerance(1e-4), ray_volume_tolerance(0.05) {};
   
   struct mesh_differences
   {
@@ -23,18 +26,44 @@ public:
     double rms_dist;
     double volume_overlap;
     double int_union_ratio;
+    double volume1;       // exact (divergence theorem) volume of mesh1
+    double volume2;       // exact (divergence theorem) volume of mesh2
+    int mesh1_closed;     // 0 if mesh1 looks open (volumes and overlap unreliable)
+    int mesh2_closed;     // 0 if mesh2 looks open (volumes and overlap unreliable)
   };
   
   mesh_differences GetMeshDifferences(struct model* mesh1, struct model* mesh2);
   mesh_differences GetMeshDifferences(boost::shared_ptr<model> mesh1, boost::shared_ptr<model> mesh2);
+  // Same, for meshes prepared with prepare_mesh(). Their derived data (triangle
+  // precomputation, spatial index, volume) is built once and kept, so a mesh
+  // compared several times should be passed in this form.
+  mesh_differences GetMeshDifferences(struct prepared_mesh* mesh1, struct prepared_mesh* mesh2);
+  
+  // Use the exact mesh volumes instead of the ray-integrated ones in the Dice
+  // and intersection/union denominators (default: off).
+  void SetUseExactVolumes(bool use) {use_exact_volumes = use;};
+  // Skip the (expensive) volume overlap when a mesh is detected as open; the
+  // overlap fields are then set to NaN (default: off).
+  void SetSkipOverlapForOpenMeshes(bool skip) {skip_open_overlap = skip;};
   
 protected:
-  void compute_distances(struct model* mesh1, struct model* mesh2, struct mesh_differences& diff);
-  void compute_overlap(struct model* mesh1, struct model* mesh2, struct mesh_differences& diff);
+  void compute_distances(struct prepared_mesh* mesh1, struct prepared_mesh* mesh2, struct mesh_differences& diff);
+  void compute_overlap(struct prepared_mesh* mesh1, struct prepared_mesh* mesh2, struct mesh_differences& diff);
   
   double sampling_step;
   double sampling_dens;
   double min_sample_freq;
+  
+  bool use_exact_volumes;
+  bool skip_open_overlap;
+  // The closedness flags are heuristics. A mesh is flagged as open if the sum
+  // of its face area vectors is not about zero (holes with boundaries that
+  // cancel out, as in an uncapped tube, pass this test), or if its exact and
+  // ray-integrated volumes differ by more than ray_volume_tolerance times the
+  // volume plus the surface area times the ray spacing (the error of the ray
+  // integration, see compute_overlap()).
+  double open_tolerance;        // max. |sum of face area vectors| / area
+  double ray_volume_tolerance;  // max. relative difference between exact and ray volumes
 };
 
 #endif // CompareMeshes_h
\ No newline at end of file
@@ -0,0 +1,78 @@
+#include "DistanceTransform.h"
+#include <stddef.h>
+#include <limits>
+
+// Lower envelope step of the Maurer distance transform: returns true if the
+// parabola of (u,du) is hidden by those of (v,dv) and (w,dw) along the line
+static inline bool maurer_remove(double du, double dv, double dw, double u, double v, double w)
+{
+  double a = v-u, b = w-v, c = w-u;
+  return c*dv - b*du - a*dw > a*b*c;
+}
+
+// One Maurer pass over a line of n squared distances f (infinite where
+// unknown) with the given stride and spacing: replaces each by the minimum
+// over the line of f plus the squared distance along it. g and h are scratch
+// arrays of n values.
+static void maurer_line(float* f, size_t stride, int n, double spacing, double* g, double* h)
+{
+  int l = -1;
+  for(int i=0; i<n; i++)
+  {
+    double fi = f[i*stride];
+    if( fi==std::numeric_limits<float>::infinity() ) continue;
+    double xi = i*spacing;
+    while( l>=1 && maurer_remove(g[l-1], g[l], fi, h[l-1], h[l], xi) ) l--;
+    l++;
+    g[l] = fi;
+    h[l] = xi;
+  }
+  if( l<0 ) return;
+  int ns = l;
+  l = 0;
+  for(int i=0; i<n; i++)
+  {
+    double xi = i*spacing;
+    while( l<ns && g[l]+(h[l]-xi)*(h[l]-xi) > g[l+1]+(h[l+1]-xi)*(h[l+1]-xi) ) l++;
+    f[i*stride] = (float)(g[l]+(h[l]-xi)*(h[l]-xi));
+  }
+}
+
+void distance_transform(const unsigned char* features, const int* dims, const double* spacing,
+                        const struct voxel_box& box, std::vector<float>& dist)
+{
+  const int bx = box.dims[0], by = box.dims[1], bz = box.dims[2];
+  dist.resize((size_t)bx*by*bz);
+  #pragma omp parallel for schedule(dynamic)
+  for(int k=0; k<bz; k++)
+  {
+    for(int j=0; j<by; j++)
+    {
+      const unsigned char* row = features + box.lo[0] +
+        (size_t)dims[0]*((box.lo[1]+j) + (size_t)dims[1]*(box.lo[2]+k));
+      float* out = &dist[(size_t)bx*(j+(size_t)by*k)];
+      for(int i=0; i<bx; i++)
+      {
+        out[i] = row[i] ? 0.0f : std::numeric_limits<float>::infinity();
+      }
+    }
+  }
+
+  const size_t strides[3] = { 1, (size_t)bx, (size_t)bx*by };
+  for(int a=0; a<3; a++)
+  {
+    // Lines along a, numbered by their position along the other two axes
+    int u = a==0 ? 1 : 0, v = a==2 ? 1 : 2;
+    long num_lines = (long)box.dims[u]*box.dims[v];
+    #pragma omp parallel
+    {
+      std::vector<double> g(box.dims[a]), h(box.dims[a]);
+      #pragma omp for schedule(dynamic, 64)
+      for(long line=0; line<num_lines; line++)
+      {
+        size_t start = (line%box.dims[u])*strides[u] + (line/box.dims[u])*strides[v];
+        maurer_line(&dist[start], strides[a], box.dims[a], spacing[a], &g[0], &h[0]);
+      }
+    }
+  }
+}
@@ -0,0 +1,22 @@
+#ifndef DistanceTransform_h
+#define DistanceTransform_h
+
+#include <vector>
+
+// Sub-box of a voxel grid: voxels lo[a] to lo[a]+dims[a]-1 along each axis
+struct voxel_box
+{
+  int lo[3];
+  int dims[3];
+};
+
+// Computes in dist the squared Euclidean distance, in physical units, from
+// each voxel of box to the nearest feature voxel (nonzero in features, laid
+// out on a grid of dims voxels with the given spacing). Only the feature
+// voxels in box are considered; dist is infinite if there are none. The
+// voxels of box are laid out in dist as those of the grid. Uses the separable algorithm
+// of Maurer et al. (2003), parallel over the lines of each axis.
+void distance_transform(const unsigned char* features, const int* dims, const double* spacing,
+                        const struct voxel_box& box, std::vector<float>& dist);
+
+#endif // DistanceTransform_h
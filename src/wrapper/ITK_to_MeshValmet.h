@@ -0,0 +1,134 @@
+#ifndef ITK_to_MeshValmet_h
+#define ITK_to_MeshValmet_h
+
+// STL
+#include <map>
+#include <vector>
+
+// Boost (for shared pointer without c++11)
+#include <boost/shared_ptr.hpp>
+
+// ITK
+#include "itkMesh.h"
+#include "itkCellInterface.h"
+
+// MeshValmet
+#include "MeshValmet_model.h"
+
+// Converts the triangle and polygon cells of an ITK mesh to a new MeshValmet
+// mesh, reading the point and cell containers of itk_mesh directly: the
+// vertices and faces are allocated once, from the container sizes, and filled
+// in a single pass over each container. Polygons are triangulated as fans;
+// vertex and line cells are ignored. Point identifiers are used as vertex
+// indices when they are 0..n-1 (as for the meshes of BinaryMask3DMeshSource),
+// otherwise they are renumbered. Cells referencing a point that is not in the
+// points container are skipped. The bounding box is computed but not the face
+// areas. The result is never NULL, and should be freed with __free_raw_model().
+template < typename TMesh >
+struct model* itkMesh_to_model( const TMesh* itk_mesh )
+{
+  typedef typename TMesh::PointsContainer PointsContainer;
+  typedef typename TMesh::CellsContainer CellsContainer;
+  typedef typename TMesh::CellType CellType;
+  typedef typename TMesh::PointIdentifier PointIdentifier;
+
+  struct model* mesh = (struct model*)calloc(1, sizeof(struct model));
+  const PointsContainer* points = itk_mesh->GetPoints();
+  if( points==NULL || points->Size()==0 )
+  {
+    return mesh;
+  }
+
+  // Points, noting whether their identifiers are the vertex indices
+  int num_vert = (int)points->Size();
+  mesh->vertices = (vertex_t*)malloc(num_vert*sizeof(vertex_t));
+  mesh->num_vert = num_vert;
+  bool contiguous_ids = true;
+  int idx = 0;
+  for( typename PointsContainer::ConstIterator it = points->Begin(); it!=points->End(); ++it, idx++ )
+  {
+    const typename TMesh::PointType& p = it.Value();
+    mesh->vertices[idx].x = (float)p[0];
+    mesh->vertices[idx].y = (float)p[1];
+    mesh->vertices[idx].z = (float)p[2];
+    if( it.Index()!=(PointIdentifier)idx ) contiguous_ids = false;
+  }
+  set_model_bbox(mesh);
+
+  std::map<PointIdentifier, int> vertex_index;
+  if( !contiguous_ids )
+  {
+    idx = 0;
+    for( typename PointsContainer::ConstIterator it = points->Begin(); it!=points->End(); ++it, idx++ )
+    {
+      vertex_index[it.Index()] = idx;
+    }
+  }
+
+  // Cells, with room for one face per cell (the faces are grown only for
+  // polygons with more than 3 points)
+  const CellsContainer* cells = itk_mesh->GetCells();
+  if( cells==NULL || cells->Size()==0 )
+  {
+    return mesh;
+  }
+  int faces_len = (int)cells->Size();
+  mesh->faces = (face_t*)malloc(faces_len*sizeof(face_t));
+  std::vector<int> cell_vertices;
+  for( typename CellsContainer::ConstIterator it = cells->Begin(); it!=cells->End(); ++it )
+  {
+    const CellType* cell = it.Value();
+    if( cell->GetType()!=CellType::TRIANGLE_CELL && cell->GetType()!=CellType::POLYGON_CELL )
+    {
+      continue;
+    }
+    int npts = (int)cell->GetNumberOfPoints();
+    if( npts<3 )
+    {
+      continue;
+    }
+    // Vertex indices of the cell, which is skipped if one of its points is
+    // unknown
+    cell_vertices.resize(npts);
+    typename CellType::PointIdConstIterator pt = cell->PointIdsBegin();
+    int j;
+    for(j=0; j<npts; j++, ++pt)
+    {
+      if( contiguous_ids )
+      {
+        if( *pt>=(PointIdentifier)num_vert ) break;
+        cell_vertices[j] = (int)*pt;
+      }
+      else
+      {
+        typename std::map<PointIdentifier, int>::const_iterator found = vertex_index.find(*pt);
+        if( found==vertex_index.end() ) break;
+        cell_vertices[j] = found->second;
+      }
+    }
+    if( j<npts )
+    {
+      continue;
+    }
+    if( mesh->num_faces+npts-2>faces_len )
+    {
+      faces_len = 2*faces_len+npts;
+      mesh->faces = (face_t*)realloc(mesh->faces, faces_len*sizeof(face_t));
+    }
+    for(j=2; j<npts; j++)
+    {
+      add_triangle_to_model(mesh, cell_vertices[0], cell_vertices[j-1], cell_vertices[j]);
+    }
+  }
+
+  return mesh;
+}
+
+template < typename TMesh >
+boost::shared_ptr<model> ITK_to_MeshValmet( const TMesh* itk_mesh )
+{
+  boost::shared_ptr<model> mesh(itkMesh_to_model(itk_mesh), free_model_delete());
+  return mesh;
+}
+
+#endif
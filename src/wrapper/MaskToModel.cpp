@@ -0,0 +1,363 @@
+#include "MaskToModel.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+// The lattice is the image padded with one layer of outside voxels on each
+// side: lattice point (I,J,K) is voxel (I-1,J-1,K-1). A cube has its lower
+// corner at a lattice point, and its corner n is at offset
+// (n&1, (n>>1)&1, (n>>2)&1). Its 12 edges are numbered by axis: x edges 0-3
+// (at dy+2*dz), y edges 4-7 (at 4+dx+2*dz) and z edges 8-11 (at 8+dx+2*dy).
+// Each lattice edge belongs to the row of lattice points (J,K) of its lower
+// end, and the vertex on it is numbered from the crossing edges before it:
+// all the x edges first, row by row, then the y edges and the z edges.
+
+#define MC_MAX_TRIS 10  // a cube has at most 12 crossing edges, in loops of 3 or more
+
+// Marching cubes triangulation of the 256 cube configurations (bit n set if
+// corner n is inside): the edges of each triangle, by 3
+struct mc_table
+{
+  signed char num_tris[256];
+  signed char edges[256][3*MC_MAX_TRIS];
+};
+
+// Returns the edge between cube corners p and q, which differ by one axis
+static int mc_edge(int p, int q)
+{
+  int diff = p^q;
+  int lo = p&q;
+  int dx = lo&1, dy = (lo>>1)&1, dz = (lo>>2)&1;
+  if( diff==1 ) return dy+2*dz;
+  if( diff==2 ) return 4+dx+2*dz;
+  return 8+dx+2*dy;
+}
+
+// Returns the corners at the ends of edge e
+static void mc_edge_corners(int e, int* p, int* q)
+{
+  int a = e/4, d0 = e&1, d1 = (e>>1)&1;
+  int u = a==0 ? 1 : 0, v = a==2 ? 1 : 2;
+  *p = (d0<<u) | (d1<<v);
+  *q = *p | (1<<a);
+}
+
+// Returns 1 if edges e and f lie on a common face of the cube
+static int mc_edges_share_face(int e, int f)
+{
+  int c[4];
+  mc_edge_corners(e, &c[0], &c[1]);
+  mc_edge_corners(f, &c[2], &c[3]);
+  int all = c[0]&c[1]&c[2]&c[3], any = c[0]|c[1]|c[2]|c[3];
+  return (all | (~any&7)) != 0;
+}
+
+// Returns 1 if the fan of loop around loop[apex] has no diagonal between two
+// edges of the same face, which would lie in the face and could overlap the
+// triangles of the neighboring cube
+static int valid_fan_apex(const int* loop, int len, int apex)
+{
+  for(int j=2; j<len-1; j++)
+  {
+    if( mc_edges_share_face(loop[apex], loop[(apex+j)%len]) ) return 0;
+  }
+  return 1;
+}
+
+// Builds the triangulation table. On each cube face, every run of inside
+// corners is cut off by a segment between the two crossing edges around it;
+// on faces with two diagonal inside corners, these are thus kept apart. The
+// decision depends only on the face, so the two cubes sharing it agree and
+// the surface is closed. Walking each face counterclockwise as seen from
+// outside the cube, a segment goes from the edge entering the run to the edge
+// leaving it: every crossing edge then starts one segment and ends another,
+// and the segments form loops, which are triangulated as fans (from a loop
+// vertex chosen so that no diagonal lies in a face, see valid_fan_apex()).
+// Their orientation makes the faces point from the inside
+// corners to the outside.
+static void build_mc_table(struct mc_table* table)
+{
+  // Corners of the 6 faces, counterclockwise from outside
+  int faces[6][4];
+  for(int a=0; a<3; a++)
+  {
+    int u = (a+1)%3, v = (a+2)%3;
+    static const int uv[4][2] = { {0,0}, {1,0}, {1,1}, {0,1} };
+    for(int s=0; s<2; s++)
+    {
+      for(int k=0; k<4; k++)
+      {
+        int c = (s<<a) | (uv[k][0]<<u) | (uv[k][1]<<v);
+        faces[2*a+s][s ? k : 3-k] = c;
+      }
+    }
+  }
+
+  for(int config=0; config<256; config++)
+  {
+    int next[12];
+    for(int e=0; e<12; e++) next[e] = -1;
+    for(int f=0; f<6; f++)
+    {
+      for(int k=0; k<4; k++)
+      {
+        int c0 = faces[f][k], c1 = faces[f][(k+1)%4];
+        if( (config>>c0)&1 || !((config>>c1)&1) ) continue;
+        int m = k+1;
+        while( (config>>faces[f][(m+1)%4])&1 ) m++;
+        next[mc_edge(c0, c1)] = mc_edge(faces[f][m%4], faces[f][(m+1)%4]);
+      }
+    }
+
+    int n = 0;
+    bool visited[12] = {false};
+    for(int e=0; e<12; e++)
+    {
+      if( next[e]<0 || visited[e] ) continue;
+      int loop[12], len = 0;
+      for(int cur=e; !visited[cur]; cur=next[cur])
+      {
+        visited[cur] = true;
+        loop[len++] = cur;
+      }
+      int apex = 0;
+      while( apex<len-1 && !valid_fan_apex(loop, len, apex) ) apex++;
+      for(int j=2; j<len; j++, n++)
+      {
+        table->edges[config][3*n] = (signed char)loop[apex];
+        table->edges[config][3*n+1] = (signed char)loop[(apex+j-1)%len];
+        table->edges[config][3*n+2] = (signed char)loop[(apex+j)%len];
+      }
+    }
+    table->num_tris[config] = (signed char)n;
+  }
+}
+
+// Returns 1 if lattice point I of a row is inside; row is NULL for the rows
+// of the padding
+static inline int lattice_value(const unsigned char* row, int I, int nx)
+{
+  return row!=NULL && I>=1 && I<=nx && row[I-1]!=0;
+}
+
+// Returns the voxels of the lattice row (J,K), or NULL in the padding
+static inline const unsigned char* lattice_row(const unsigned char* mask, const int* dims, int J, int K)
+{
+  if( J<1 || J>dims[1] || K<1 || K>dims[2] ) return NULL;
+  return mask + (size_t)dims[0]*((J-1)+(size_t)dims[1]*(K-1));
+}
+
+// Returns the cube configuration at lattice point I, from the rows of its 4
+// x edges (at dy+2*dz)
+static inline int cube_config(const unsigned char* const* rows, int I, int nx)
+{
+  int config = 0;
+  for(int n=0; n<8; n++)
+  {
+    config |= lattice_value(rows[(n>>1)&3], I+(n&1), nx)<<n;
+  }
+  return config;
+}
+
+struct model* mask_to_model(const unsigned char* mask, const struct mask_geometry* geom)
+{
+  const int* dims = geom->dims;
+  const int nx = dims[0];
+  const int PX = dims[0]+2, PY = dims[1]+2, PZ = dims[2]+2;
+  const size_t num_rows = (size_t)PY*PZ;
+
+  struct mc_table table;
+  build_mc_table(&table);
+
+  // First pass: count the crossing edges of each row, and the faces of each
+  // row of cubes
+  std::vector<long long> x_base(num_rows), y_base(num_rows), z_base(num_rows), face_base(num_rows);
+  #pragma omp parallel for schedule(dynamic)
+  for(int K=0; K<PZ; K++)
+  {
+    for(int J=0; J<PY; J++)
+    {
+      size_t r = (size_t)J + (size_t)PY*K;
+      const unsigned char* row = lattice_row(mask, dims, J, K);
+      const unsigned char* row_y = J<PY-1 ? lattice_row(mask, dims, J+1, K) : NULL;
+      const unsigned char* row_z = K<PZ-1 ? lattice_row(mask, dims, J, K+1) : NULL;
+      long long nvx = 0, nvy = 0, nvz = 0, nf = 0;
+      if( row!=NULL || row_y!=NULL || row_z!=NULL )
+      {
+        for(int I=0; I<PX; I++)
+        {
+          int v = lattice_value(row, I, nx);
+          if( I<PX-1 ) nvx += v!=lattice_value(row, I+1, nx);
+          nvy += v!=lattice_value(row_y, I, nx);
+          nvz += v!=lattice_value(row_z, I, nx);
+        }
+      }
+      if( J<PY-1 && K<PZ-1 )
+      {
+        const unsigned char* rows[4] = { row, row_y, row_z, lattice_row(mask, dims, J+1, K+1) };
+        if( rows[0]!=NULL || rows[1]!=NULL || rows[2]!=NULL || rows[3]!=NULL )
+        {
+          for(int I=0; I<PX-1; I++)
+          {
+            nf += table.num_tris[cube_config(rows, I, nx)];
+          }
+        }
+      }
+      x_base[r] = nvx;
+      y_base[r] = nvy;
+      z_base[r] = nvz;
+      face_base[r] = nf;
+    }
+  }
+
+  // Turn the counts into the numbers of the first vertex and face of each row
+  long long num_vert = 0, num_faces = 0;
+  std::vector<long long>* bases[3] = { &x_base, &y_base, &z_base };
+  for(int a=0; a<3; a++)
+  {
+    std::vector<long long>& base = *bases[a];
+    for(size_t r=0; r<num_rows; r++)
+    {
+      long long n = base[r];
+      base[r] = num_vert;
+      num_vert += n;
+    }
+  }
+  for(size_t r=0; r<num_rows; r++)
+  {
+    long long n = face_base[r];
+    face_base[r] = num_faces;
+    num_faces += n;
+  }
+  if( num_vert>INT_MAX || num_faces>INT_MAX )
+  {
+    return NULL;
+  }
+
+  struct model* mesh = (struct model*)calloc(1, sizeof(struct model));
+  if( num_vert==0 )
+  {
+    return mesh;
+  }
+  mesh->num_vert = (int)num_vert;
+  mesh->num_faces = (int)num_faces;
+  mesh->vertices = (vertex_t*)malloc(num_vert*sizeof(vertex_t));
+  mesh->faces = (face_t*)malloc(num_faces*sizeof(face_t));
+
+  // Index to physical transform, with the spacing folded into the direction
+  double m[9];
+  for(int i=0; i<9; i++) m[i] = geom->direction[i]*geom->spacing[i%3];
+  // A mirroring transform would turn the faces inwards
+  double det = m[0]*(m[4]*m[8]-m[5]*m[7]) - m[1]*(m[3]*m[8]-m[5]*m[6]) + m[2]*(m[3]*m[7]-m[4]*m[6]);
+  const int flip = det<0 ? 1 : 0;
+
+  // Second pass: place the vertices and connect them
+  #pragma omp parallel for schedule(dynamic)
+  for(int K=0; K<PZ; K++)
+  {
+    for(int J=0; J<PY; J++)
+    {
+      size_t r = (size_t)J + (size_t)PY*K;
+      const unsigned char* row = lattice_row(mask, dims, J, K);
+      const unsigned char* row_y = J<PY-1 ? lattice_row(mask, dims, J+1, K) : NULL;
+      const unsigned char* row_z = K<PZ-1 ? lattice_row(mask, dims, J, K+1) : NULL;
+
+      // Vertices at the midpoints of the crossing edges of the row
+      if( row!=NULL || row_y!=NULL || row_z!=NULL )
+      {
+        int ids[3] = { (int)x_base[r], (int)y_base[r], (int)z_base[r] };
+        for(int I=0; I<PX; I++)
+        {
+          int v = lattice_value(row, I, nx);
+          int crossing[3] = { I<PX-1 && v!=lattice_value(row, I+1, nx),
+                              v!=lattice_value(row_y, I, nx),
+                              v!=lattice_value(row_z, I, nx) };
+          for(int a=0; a<3; a++)
+          {
+            if( !crossing[a] ) continue;
+            double idx[3] = { I-1.0, J-1.0, K-1.0 };
+            idx[a] += 0.5;
+            vertex_t* p = &mesh->vertices[ids[a]++];
+            p->x = (float)(geom->origin[0] + m[0]*idx[0] + m[1]*idx[1] + m[2]*idx[2]);
+            p->y = (float)(geom->origin[1] + m[3]*idx[0] + m[4]*idx[1] + m[5]*idx[2]);
+            p->z = (float)(geom->origin[2] + m[6]*idx[0] + m[7]*idx[1] + m[8]*idx[2]);
+          }
+        }
+      }
+
+      // Faces of the row of cubes, following the vertex numbers of its 12
+      // edges along the row
+      if( J==PY-1 || K==PZ-1 ) continue;
+      const unsigned char* rows[4] = { row, row_y, row_z, lattice_row(mask, dims, J+1, K+1) };
+      if( rows[0]==NULL && rows[1]==NULL && rows[2]==NULL && rows[3]==NULL ) continue;
+      size_t r_y = r+1, r_z = r+PY, r_yz = r+PY+1;
+      long long x_ids[4] = { x_base[r], x_base[r_y], x_base[r_z], x_base[r_yz] };
+      long long y_ids[2] = { y_base[r], y_base[r_z] };
+      long long z_ids[2] = { z_base[r], z_base[r_y] };
+      face_t* face = &mesh->faces[face_base[r]];
+      for(int I=0; I<PX-1; I++)
+      {
+        int config = cube_config(rows, I, nx);
+        if( config==0 || config==255 ) continue;
+        int crossing[12];
+        for(int e=0; e<4; e++)
+        {
+          int c0 = (e&1)<<1 | (e&2)<<1;   // x edge at (dy,dz)
+          crossing[e] = ((config>>c0)^(config>>(c0|1)))&1;
+          int c1 = (e&1) | (e&2)<<1;      // y edge at (dx,dz)
+          crossing[4+e] = ((config>>c1)^(config>>(c1|2)))&1;
+          int c2 = (e&1) | (e&2);         // z edge at (dx,dy)
+          crossing[8+e] = ((config>>c2)^(config>>(c2|4)))&1;
+        }
+        int vid[12];
+        for(int e=0; e<4; e++)
+        {
+          vid[e] = (int)x_ids[e];
+        }
+        for(int dz=0; dz<2; dz++)
+        {
+          vid[4+2*dz] = (int)y_ids[dz];
+          vid[5+2*dz] = (int)y_ids[dz] + crossing[4+2*dz];
+        }
+        for(int dy=0; dy<2; dy++)
+        {
+          vid[8+2*dy] = (int)z_ids[dy];
+          vid[9+2*dy] = (int)z_ids[dy] + crossing[8+2*dy];
+        }
+        const signed char* edges = table.edges[config];
+        for(int t=0; t<table.num_tris[config]; t++, face++)
+        {
+          face->f0 = vid[edges[3*t]];
+          face->f1 = vid[edges[3*t+1+flip]];
+          face->f2 = vid[edges[3*t+2-flip]];
+        }
+        for(int e=0; e<4; e++)
+        {
+          x_ids[e] += crossing[e];
+        }
+        for(int d=0; d<2; d++)
+        {
+          y_ids[d] += crossing[4+2*d];
+          z_ids[d] += crossing[8+2*d];
+        }
+      }
+    }
+  }
+
+  // Bounding box
+  mesh->bBox[0] = mesh->vertices[0];
+  mesh->bBox[1] = mesh->vertices[0];
+  for(int i=1; i<mesh->num_vert; i++)
+  {
+    const vertex_t* v = &mesh->vertices[i];
+    if( v->x < mesh->bBox[0].x ) mesh->bBox[0].x = v->x;
+    if( v->y < mesh->bBox[0].y ) mesh->bBox[0].y = v->y;
+    if( v->z < mesh->bBox[0].z ) mesh->bBox[0].z = v->z;
+    if( v->x > mesh->bBox[1].x ) mesh->bBox[1].x = v->x;
+    if( v->y > mesh->bBox[1].y ) mesh->bBox[1].y = v->y;
+    if( v->z > mesh->bBox[1].z ) mesh->bBox[1].z = v->z;
+  }
+
+  return mesh;
+}
@@ -0,0 +1,29 @@
+#ifndef MaskToModel_h
+#define MaskToModel_h
+
+// MeshValmet
+#include "3dmodel.h"
+
+// Geometry of a 3D image: the physical position of voxel (i,j,k) is
+// origin + direction*(spacing.*(i,j,k)), direction being row-major
+struct mask_geometry
+{
+  int dims[3];
+  double origin[3];
+  double spacing[3];
+  double direction[9];
+};
+
+// Extracts the surface of a binary mask (nonzero voxels inside, voxel (i,j,k)
+// at mask[i+dims[0]*(j+dims[1]*k)]) by marching cubes, with the vertices at
+// the midpoints of the lattice edges. Voxels outside the image count as
+// outside, so the surface is closed, and its faces are oriented outwards.
+// The volume is processed in slabs of z planes, in parallel when OpenMP is
+// used; the vertices are numbered from the lattice edges they lie on, so the
+// slabs share the vertices on their boundaries and the mesh is welded. The
+// bounding box is computed but not the face areas. Returns NULL if the mesh
+// would have more than INT_MAX vertices or faces. The result should be freed
+// with __free_raw_model().
+struct model* mask_to_model(const unsigned char* mask, const struct mask_geometry* geom);
+
+#endif // MaskToModel_h
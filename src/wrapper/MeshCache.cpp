@@ -0,0 +1,266 @@
+#include "MeshCache.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include <dirent.h>
+#include <time.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+
+// MeshValmet
+#include "model_mvm.h"
+
+// Temporary files older than this (in seconds) were left by a writer that
+// died, and are deleted when the cache is trimmed
+static const time_t STALE_TMP_AGE = 3600;
+
+// Length of the hexadecimal keys
+static const size_t KEY_LENGTH = 32;
+
+// A 128-bit hash of a byte stream, fed in pieces of any size: four 64-bit
+// lanes, each taking one word of every 32 bytes (multiply, rotate, multiply),
+// combined with the length at the end. It reads the data at memory speed, and
+// is not meant to resist crafted collisions.
+struct content_hash
+{
+  uint64_t lane[4];
+  unsigned char tail[32];
+  size_t tail_len;
+  uint64_t len;
+};
+
+static const uint64_t HASH_P1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t HASH_P2 = 0xC2B2AE3D27D4EB4FULL;
+
+static inline uint64_t hash_round(uint64_t acc, uint64_t word)
+{
+  acc += word*HASH_P2;
+  acc = (acc<<31) | (acc>>33);
+  return acc*HASH_P1;
+}
+
+// The final mixing of MurmurHash3, so that every bit of h affects every bit
+// of the result
+static inline uint64_t hash_avalanche(uint64_t h)
+{
+  h ^= h>>33;
+  h *= 0xFF51AFD7ED558CCDULL;
+  h ^= h>>33;
+  h *= 0xC4CEB9FE1A85EC53ULL;
+  h ^= h>>33;
+  return h;
+}
+
+static void hash_init(content_hash& h)
+{
+  h.lane[0] = HASH_P1+HASH_P2;
+  h.lane[1] = HASH_P2;
+  h.lane[2] = 0;
+  h.lane[3] = 0-HASH_P1;
+  h.tail_len = 0;
+  h.len = 0;
+}
+
+static void hash_block(content_hash& h, const unsigned char* block)
+{
+  for(int l=0; l<4; l++)
+  {
+    uint64_t word;
+    memcpy(&word, block+8*l, 8);
+    h.lane[l] = hash_round(h.lane[l], word);
+  }
+}
+
+static void hash_update(content_hash& h, const unsigned char* data, size_t n)
+{
+  h.len += n;
+  if( h.tail_len>0 )
+  {
+    size_t take = std::min(n, sizeof(h.tail)-h.tail_len);
+    memcpy(h.tail+h.tail_len, data, take);
+    h.tail_len += take;
+    data += take;
+    n -= take;
+    if( h.tail_len<sizeof(h.tail) ) return;
+    hash_block(h, h.tail);
+    h.tail_len = 0;
+  }
+  for(; n>=32; data+=32, n-=32)
+  {
+    hash_block(h, data);
+  }
+  memcpy(h.tail, data, n);
+  h.tail_len = n;
+}
+
+// Writes the 128-bit hash as KEY_LENGTH hexadecimal digits
+static std::string hash_final(content_hash& h)
+{
+  // The tail is zero padded; the length tells it apart from actual zeros
+  memset(h.tail+h.tail_len, 0, sizeof(h.tail)-h.tail_len);
+  hash_block(h, h.tail);
+  // Both halves depend on all the lanes
+  uint64_t h1 = h.len, h2 = ~h.len;
+  for(int l=0; l<4; l++)
+  {
+    h1 += (h.lane[l]<<(6*l+1)) | (h.lane[l]>>(63-6*l));
+    h2 = hash_round(h2, h.lane[l]);
+  }
+  h1 = hash_avalanche(h1);
+  h2 = hash_avalanche(h2);
+  char hex[KEY_LENGTH+1];
+  snprintf(hex, sizeof(hex), "%016llx%016llx", (unsigned long long)h1, (unsigned long long)h2);
+  return std::string(hex);
+}
+
+std::string MeshCache::Key(std::string filename, std::string params)
+{
+  FILE* f = fopen(filename.c_str(), "rb");
+  if( f==NULL )
+  {
+    return std::string();
+  }
+  content_hash h;
+  hash_init(h);
+
+  // The parameters and the layout of the entries come first, after their
+  // length, so that they cannot run into the contents
+  char prefix[64];
+  snprintf(prefix, sizeof(prefix), "mvm=%d;%lu:", MVM_VERSION, (unsigned long)params.size());
+  hash_update(h, (const unsigned char*)prefix, strlen(prefix));
+  hash_update(h, (const unsigned char*)params.data(), params.size());
+
+  std::vector<unsigned char> buf(1<<20);
+  size_t n;
+  while( (n = fread(&buf[0], 1, buf.size(), f))>0 )
+  {
+    hash_update(h, &buf[0], n);
+  }
+  bool failed = ferror(f)!=0;
+  fclose(f);
+  if( failed )
+  {
+    return std::string();
+  }
+  return hash_final(h);
+}
+
+std::string MeshCache::EntryPath(std::string key)
+{
+  return dir + "/" + key + ".mvm";
+}
+
+bool MeshCache::Load(std::string key, struct model** mesh)
+{
+  std::string path = EntryPath(key);
+  *mesh = NULL;
+  if( read_mvm_model(mesh, path.c_str(), NULL, NULL)<0 )
+  {
+    *mesh = NULL;
+    return false;
+  }
+  // Mark the entry as recently used
+  utime(path.c_str(), NULL);
+  return true;
+}
+
+void MeshCache::Store(std::string key, const struct model* mesh)
+{
+  std::string path = EntryPath(key);
+  std::vector<char> tmp_path(path.begin(), path.end());
+  const char suffix[] = ".tmp.XXXXXX";
+  tmp_path.insert(tmp_path.end(), suffix, suffix+sizeof(suffix));
+  int fd = mkstemp(&tmp_path[0]);
+  if( fd<0 )
+  {
+    std::cerr << "WARNING: cannot write to the mesh cache: " << dir << std::endl;
+    return;
+  }
+  // mkstemp() makes the file private; entries are shared like other files
+  fchmod(fd, 0644);
+  close(fd);
+
+  if( write_mvm_model(&tmp_path[0], mesh, NULL, 0)<0 )
+  {
+    std::cerr << "WARNING: cannot write to the mesh cache: " << dir << std::endl;
+    remove(&tmp_path[0]);
+    return;
+  }
+  // Readers see either the whole entry or none. If another process stored
+  // the same entry meanwhile, it is replaced by an identical one.
+  if( rename(&tmp_path[0], path.c_str())!=0 )
+  {
+    remove(&tmp_path[0]);
+    return;
+  }
+  Trim();
+}
+
+// An entry, or a temporary file, of the cache directory
+struct cache_file
+{
+  time_t mtime;
+  unsigned long long size;
+  std::string path;
+
+  bool operator<(const cache_file& other) const { return mtime<other.mtime; }
+};
+
+// Returns true if name is an entry name: KEY_LENGTH hexadecimal digits and
+// the .mvm extension. With tmp, checks for a temporary file name instead.
+static bool is_cache_file_name(const char* name, bool tmp)
+{
+  if( strlen(name)<KEY_LENGTH+4 ) return false;
+  for(size_t c=0; c<KEY_LENGTH; c++)
+  {
+    if( !((name[c]>='0' && name[c]<='9') || (name[c]>='a' && name[c]<='f')) ) return false;
+  }
+  const char* ext = name+KEY_LENGTH;
+  return tmp ? strncmp(ext, ".mvm.tmp.", 9)==0 : strcmp(ext, ".mvm")==0;
+}
+
+void MeshCache::Trim()
+{
+  DIR* d = opendir(dir.c_str());
+  if( d==NULL )
+  {
+    return;
+  }
+  std::vector<cache_file> entries;
+  unsigned long long total = 0;
+  time_t now = time(NULL);
+  struct dirent* de;
+  while( (de = readdir(d))!=NULL )
+  {
+    bool entry = is_cache_file_name(de->d_name, false);
+    if( !entry && !is_cache_file_name(de->d_name, true) ) continue;
+    cache_file file;
+    file.path = dir + "/" + de->d_name;
+    struct stat st;
+    if( stat(file.path.c_str(), &st)!=0 ) continue;  // deleted meanwhile
+    if( !entry )
+    {
+      if( now-st.st_mtime>STALE_TMP_AGE ) remove(file.path.c_str());
+      continue;
+    }
+    file.mtime = st.st_mtime;
+    file.size = (unsigned long long)st.st_size;
+    total += file.size;
+    entries.push_back(file);
+  }
+  closedir(d);
+
+  // Delete the least recently used entries. Concurrent trims may delete the
+  // same entries; the failures are harmless.
+  std::sort(entries.begin(), entries.end());
+  for(size_t e=0; e<entries.size() && total>max_bytes; e++)
+  {
+    remove(entries[e].path.c_str());
+    total -= entries[e].size;
+  }
+}
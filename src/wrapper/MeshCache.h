@@ -0,0 +1,48 @@
+#ifndef MeshCache_h
+#define MeshCache_h
+
+#include <string>
+
+// MeshValmet
+#include "3dmodel.h"
+
+// On-disk cache of converted meshes, e.g. the meshes of masks, so that a file
+// converted once (typically a ground truth compared with many predictions) is
+// not converted again on later runs. The entries are mvm files (see
+// model_mvm.h) named after a hash of the contents of the input file and of the
+// conversion parameters, so an edited input or a change of parameters misses.
+//
+// Several processes can share a cache directory: an entry is written to a
+// temporary file and renamed into place, so it is either complete or absent,
+// and an entry deleted while another process has it mapped stays valid for
+// that process. A hit refreshes the modification time of the entry, and after
+// each store the least recently used entries are deleted until the cache fits
+// its size bound.
+class MeshCache
+{
+public:
+  // dir must exist. max_bytes bounds the total size of the entries.
+  MeshCache(std::string dir, unsigned long long max_bytes) : dir(dir), max_bytes(max_bytes) {};
+
+  // Returns the key of the contents of filename converted with params, or an
+  // empty string if the file cannot be read.
+  static std::string Key(std::string filename, std::string params);
+
+  // Loads the entry of key into *mesh and returns true, or returns false if
+  // there is none (or it cannot be read). The mesh is an mvm model, to be
+  // freed with free_mvm_model().
+  bool Load(std::string key, struct model** mesh);
+
+  // Stores mesh as the entry of key, then trims the cache. Failures are
+  // reported and otherwise ignored, the cache being only an optimization.
+  void Store(std::string key, const struct model* mesh);
+
+protected:
+  std::string EntryPath(std::string key);
+  void Trim();
+
+  std::string dir;
+  unsigned long long max_bytes;
+};
+
+#endif // MeshCache_h
@@ -0,0 +1,58 @@
+#ifndef MeshValmet_model_h
+#define MeshValmet_model_h
+
+// Helpers to build and free MeshValmet meshes, shared by the VTK and ITK
+// conversions (they do not depend on VTK or ITK)
+
+// C
+#include <stdlib.h>
+
+// MeshValmet
+#include "3dmodel.h"
+#include "geomutils.h"
+
+struct free_delete
+{
+    void operator()(void* x) { free(x); }
+};
+
+// Frees a model and its arrays
+struct free_model_delete
+{
+    void operator()(struct model* x) { if( x!=NULL ) __free_raw_model(x); }
+};
+
+// Sets the bounding box of mesh from its vertices (num_vert must be positive)
+inline void set_model_bbox( struct model* mesh )
+{
+  mesh->bBox[0] = mesh->vertices[0];
+  mesh->bBox[1] = mesh->vertices[0];
+  for(int i=1; i<mesh->num_vert; i++)
+  {
+    const vertex_t* v = &mesh->vertices[i];
+    if( v->x < mesh->bBox[0].x ) mesh->bBox[0].x = v->x;
+    if( v->y < mesh->bBox[0].y ) mesh->bBox[0].y = v->y;
+    if( v->z < mesh->bBox[0].z ) mesh->bBox[0].z = v->z;
+    if( v->x > mesh->bBox[1].x ) mesh->bBox[1].x = v->x;
+    if( v->y > mesh->bBox[1].y ) mesh->bBox[1].y = v->y;
+    if( v->z > mesh->bBox[1].z ) mesh->bBox[1].z = v->z;
+  }
+}
+
+// Appends face (f0,f1,f2) to mesh and, if mesh->area is not NULL,
+// accumulates its area
+inline void add_triangle_to_model( struct model* mesh, int f0, int f1, int f2 )
+{
+  face_t* face = &mesh->faces[mesh->num_faces];
+  face->f0 = f0;
+  face->f1 = f1;
+  face->f2 = f2;
+  if( mesh->area!=NULL )
+  {
+    mesh->area[mesh->num_faces] = (float)tri_area_v(&mesh->vertices[f0], &mesh->vertices[f1], &mesh->vertices[f2]);
+    mesh->total_area += mesh->area[mesh->num_faces];
+  }
+  mesh->num_faces++;
+}
+
+#endif // MeshValmet_model_h
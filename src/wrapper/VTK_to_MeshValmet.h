@@ -4,66 +4,179 @@
 // Boost (for shared pointer without c++11)
 #include <boost/shared_ptr.hpp>
 
-// Modified VTK
-#include "vtkPLYStreamWriter.h"
-
 // MeshValmet
 #include "types.h"
 #include "3dmodel.h"
 #include "model_in.h"
-#include "model_in_ply.h"
 #include "geomutils.h"
 #include "compute_error.h" 
+#include "MeshValmet_model.h"
 #include "vtkSmartPointer.h"
-#include "vtkPLYStreamWriter.h"
 #include "vtkPolyData.h"
+#include "vtkCellArray.h"
+#include "vtkPoints.h"
+#include "vtkFloatArray.h"
+#include "vtkVersion.h"
 
-#define GZ_BUF_SZ   16384
+#if VTK_MAJOR_VERSION >= 9
+typedef const vtkIdType* vtk_cell_ids_t;
+#else
+typedef vtkIdType* vtk_cell_ids_t;
+#endif
 
-struct free_delete
+// Returns the coordinates of points if they are stored as packed (x,y,z)
+// floats, which is the layout of vertex_t, or NULL otherwise
+inline float* packed_float_points( vtkPoints* points )
 {
-    void operator()(void* x) { free(x); }
-};
+  vtkFloatArray* coords = vtkFloatArray::SafeDownCast(points->GetData());
+  if( coords==NULL || coords->GetNumberOfComponents()!=3 )
+  {
+    return NULL;
+  }
+  return coords->GetPointer(0);
+}
 
-boost::shared_ptr<model> VTK_to_MeshValmet( vtkPolyData* vtk_mesh )
+// Triangulates the polygon and triangle strip cells of vtk_mesh into the
+// faces of mesh (polygons as fans, strips split into triangles), computing the
+// face areas if with_area is true. Vertex and line cells are ignored. The
+// vertices of mesh must already be set.
+inline void add_model_faces( struct model* mesh, vtkPolyData* vtk_mesh, bool with_area )
 {
-  // Get the readable end of a pipe from the modified VTK PLY writer class and open it as a file
-  vtkSmartPointer<vtkPLYStreamWriter> stream = vtkSmartPointer<vtkPLYStreamWriter>::New();
-  stream->SetInputData(vtk_mesh);
-  stream->SetFileTypeToASCII();
-  stream->Write();
-  char* data_block = stream->getWrittenDataBlock();
-  size_t data_block_size = stream->getWrittenDataBlockSize();
-  FILE* stream_file = fmemopen(data_block, data_block_size, "rb");  
-  
-  // Prepare the MeshValmet data struct which contains the open file pointer
-  struct file_data* data;
-  data = (struct file_data*)malloc(sizeof(struct file_data));
-  data->f = stream_file;
-  data->block = (unsigned char*)malloc(GZ_BUF_SZ*sizeof(unsigned char));
-  data->size = GZ_BUF_SZ;
-  data->eof_reached = 0;
-  data->nbytes = 0;
-  data->pos = 1;
-  data->is_binary = 0;
+  // Count the triangles: a cell with n points gives n-2 of them
+  vtkCellArray* polys = vtk_mesh->GetPolys();
+  vtkCellArray* strips = vtk_mesh->GetStrips();
+  vtkIdType npts;
+  vtk_cell_ids_t pts;
+  int num_faces = 0;
+  for( polys->InitTraversal(); polys->GetNextCell(npts, pts); )
+  {
+    if( npts>=3 ) num_faces += (int)npts-2;
+  }
+  for( strips->InitTraversal(); strips->GetNextCell(npts, pts); )
+  {
+    if( npts>=3 ) num_faces += (int)npts-2;
+  }
+  mesh->faces = (face_t*)malloc(num_faces*sizeof(face_t));
+  mesh->area = with_area ? (float*)malloc(num_faces*sizeof(float)) : NULL;
   
-  // Read the mesh data using MeshValmet
-  struct model* mesh_rawptr;
-  int load_success = read_ply_tmesh(&mesh_rawptr, data);   // returns a different pointer!
-  free(data);
+  // Polygons, as fans around their first point
+  for( polys->InitTraversal(); polys->GetNextCell(npts, pts); )
+  {
+    for(vtkIdType j=2; j<npts; j++)
+    {
+      add_triangle_to_model(mesh, (int)pts[0], (int)pts[j-1], (int)pts[j]);
+    }
+  }
   
-  // Close the file and the pipe end
-  fclose(stream_file);
+  // Strips, flipping every other triangle to keep the orientation, and
+  // skipping the degenerate triangles used to join strips
+  for( strips->InitTraversal(); strips->GetNextCell(npts, pts); )
+  {
+    for(vtkIdType j=2; j<npts; j++)
+    {
+      if( pts[j-2]==pts[j-1] || pts[j-1]==pts[j] || pts[j-2]==pts[j] ) continue;
+      if( j%2==0 )
+        add_triangle_to_model(mesh, (int)pts[j-2], (int)pts[j-1], (int)pts[j]);
+      else
+        add_triangle_to_model(mesh, (int)pts[j-1], (int)pts[j-2], (int)pts[j]);
+    }
+  }
+}
+
+// Converts a vtkPolyData to a new MeshValmet mesh, copying the points and the
+// polygon and triangle strip connectivity directly (see add_model_faces()).
+// The bounding box and face areas are computed along the way. The result is
+// never NULL, and should be freed with __free_raw_model().
+inline struct model* vtkPolyData_to_model( vtkPolyData* vtk_mesh )
+{
+  struct model* mesh = (struct model*)calloc(1, sizeof(struct model));
+  vtkPoints* points = vtk_mesh->GetPoints();
+  if( points==NULL || points->GetNumberOfPoints()==0 )
+  {
+    return mesh;
+  }
   
-  // If the load failed, make an empty mesh
-  if( !load_success )
+  // Points, with a single copy when they are already packed floats
+  int num_vert = (int)points->GetNumberOfPoints();
+  mesh->vertices = (vertex_t*)malloc(num_vert*sizeof(vertex_t));
+  mesh->num_vert = num_vert;
+  float* packed = packed_float_points(points);
+  if( packed!=NULL )
+  {
+    memcpy(mesh->vertices, packed, num_vert*sizeof(vertex_t));
+  }
+  else
   {
-    memset(mesh_rawptr,0,sizeof(*mesh_rawptr));
+    double p[3];
+    for(int i=0; i<num_vert; i++)
+    {
+      points->GetPoint(i, p);
+      mesh->vertices[i].x = (float)p[0];
+      mesh->vertices[i].y = (float)p[1];
+      mesh->vertices[i].z = (float)p[2];
+    }
   }
+  set_model_bbox(mesh);
   
-  // Return the MeshValmet mesh object
-  boost::shared_ptr<model> mesh(mesh_rawptr, free_delete());
+  add_model_faces(mesh, vtk_mesh, true);
+  
+  return mesh;
+}
+
+inline boost::shared_ptr<model> VTK_to_MeshValmet( vtkPolyData* vtk_mesh )
+{
+  boost::shared_ptr<model> mesh(vtkPolyData_to_model(vtk_mesh), free_model_delete());
   return mesh;
 }
 
+// Frees a model view and releases the vtkPolyData it borrows from
+struct view_model_delete
+{
+  vtkSmartPointer<vtkPolyData> owner;
+  view_model_delete( vtkPolyData* vtk_mesh ) : owner(vtk_mesh) {}
+  void operator()(struct model* x) { if( x!=NULL ) __free_raw_model(x); owner = NULL; }
+};
+
+// Returns a MeshValmet mesh that points into the arrays of vtk_mesh instead of
+// copying them, where their layout allows it: the points when they are packed
+// floats, and (with VTK 9 and 32-bit cell storage) the faces when the mesh
+// holds only triangles. Whatever cannot be borrowed is converted as
+// VTK_to_MeshValmet() does. The returned pointer keeps a reference on vtk_mesh;
+// the points and cells of vtk_mesh must not be modified while the view is in
+// use, and the view must not be oriented, since that would flip the faces of
+// vtk_mesh. The face areas are not computed (area is NULL and total_area 0).
+inline boost::shared_ptr<model> VTK_to_MeshValmet_view( vtkPolyData* vtk_mesh )
+{
+  vtkPoints* points = vtk_mesh->GetPoints();
+  float* packed = points!=NULL && points->GetNumberOfPoints()>0 ? packed_float_points(points) : NULL;
+  if( packed==NULL )
+  {
+    return VTK_to_MeshValmet(vtk_mesh);
+  }
+  
+  struct model* mesh = (struct model*)calloc(1, sizeof(struct model));
+  mesh->vertices = (vertex_t*)packed;
+  mesh->num_vert = (int)points->GetNumberOfPoints();
+  mesh->borrowed = MODEL_BORROWS_VERTICES;
+  set_model_bbox(mesh);
+  
+#if VTK_MAJOR_VERSION >= 9
+  vtkCellArray* polys = vtk_mesh->GetPolys();
+  if( vtk_mesh->GetNumberOfStrips()==0 && !polys->IsStorage64Bit() &&
+      polys->GetNumberOfConnectivityIds()==3*polys->GetNumberOfCells() )
+  {
+    mesh->faces = (face_t*)polys->GetConnectivityArray32()->GetPointer(0);
+    mesh->num_faces = (int)polys->GetNumberOfCells();
+    mesh->borrowed |= MODEL_BORROWS_FACES;
+  }
+#endif
+  if( !(mesh->borrowed & MODEL_BORROWS_FACES) )
+  {
+    add_model_faces(mesh, vtk_mesh, false);
+  }
+  
+  boost::shared_ptr<model> view(mesh, view_model_delete(vtk_mesh));
+  return view;
+}
+
 #endif // VTK_to_MeshValmet_h
\ No newline at end of file